@@ -0,0 +1,55 @@
+#ifndef __COSIM_BRIDGE_H
+#define __COSIM_BRIDGE_H
+
+/*
+ * MMIO/DMA bridge between the userspace driver build and a Verilator model
+ * of AudioPCIeTop. Register accesses become memory request TLPs to BAR0 and
+ * reads wait for their completion; the DMA engine's AXI master is served
+ * from the simulated host memory.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct cosim_options {
+    const char *wave_path;           /* FST trace, NULL for none */
+    unsigned int pcie_period_ps;     /* User clock, 8000 = 125 MHz */
+    unsigned int read_latency_ns;    /* MMIO read round trip, per request */
+    unsigned int completion_ns;      /* DMA read request to first beat */
+};
+
+struct cosim_bridge_stats {
+    uint64_t reg_reads;              /* Read requests, a block read is one */
+    uint64_t reg_writes;
+    uint64_t dma_read_bursts;
+    uint64_t dma_write_bursts;
+    uint64_t dma_faults;             /* Bursts outside host memory */
+};
+
+int cosim_bridge_open(const struct cosim_options *opts);
+void cosim_bridge_close(void);
+
+uint32_t cosim_bridge_read(uint32_t offset);
+/* count consecutive registers in one read request */
+void cosim_bridge_read_block(uint32_t offset, uint32_t *buf, unsigned int count);
+void cosim_bridge_write(uint32_t offset, uint32_t val);
+
+void cosim_bridge_advance_ns(uint64_t ns);
+uint64_t cosim_bridge_time_ns(void);
+bool cosim_bridge_irq(void);
+
+void cosim_bridge_get_stats(struct cosim_bridge_stats *stats);
+
+/* Host memory, provided by cosim-kernel.c */
+void *cosim_host_ptr(uint64_t bus_addr, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __COSIM_BRIDGE_H */
@@ -0,0 +1,340 @@
+#include <stdlib.h>
+#include <time.h>
+#include "cosim-kernel.h"
+#include "cosim-bridge.h"
+
+/* Simulated host memory, handed out to dma_alloc_coherent() and the PCM
+ * buffers and served to the DMA engine by the bridge */
+#define HOST_MEM_BASE   0x10000000ULL
+#define HOST_MEM_SIZE   (64 * 1024 * 1024)
+#define HOST_MEM_ALIGN  4096
+
+/* Interrupt line polling interval inside cosim_run_ns() */
+#define IRQ_POLL_NS     1000
+
+static u8 *host_mem;
+static size_t host_mem_used;
+
+/* Freed coherent blocks, reused first-fit so repeated hw_params calls in a
+ * benchmark do not exhaust host memory */
+#define MAX_FREE_BLOCKS 64
+
+static struct {
+    size_t offset;
+    size_t size;
+} free_blocks[MAX_FREE_BLOCKS];
+static unsigned int num_free_blocks;
+
+static u8 bar0_cookie[COSIM_BAR0_SIZE];
+static struct cosim_reg_access reg_accesses[COSIM_BAR0_SIZE / 4];
+
+static irq_handler_t irq_handler;
+static void *irq_dev_id;
+static struct cosim_irq_stats irq_stats;
+
+void *cosim_host_ptr(u64 bus_addr, size_t len)
+{
+    if (!host_mem || bus_addr < HOST_MEM_BASE ||
+        bus_addr + len > HOST_MEM_BASE + host_mem_used)
+        return NULL;
+    return host_mem + (bus_addr - HOST_MEM_BASE);
+}
+
+void cosim_host_reset(void)
+{
+    if (!host_mem)
+        host_mem = calloc(1, HOST_MEM_SIZE);
+    else
+        memset(host_mem, 0, host_mem_used);
+    host_mem_used = 0;
+    num_free_blocks = 0;
+}
+
+static void *host_alloc(size_t size, dma_addr_t *bus_addr)
+{
+    size_t offset = (host_mem_used + HOST_MEM_ALIGN - 1) & ~(size_t)(HOST_MEM_ALIGN - 1);
+    unsigned int i;
+
+    if (!host_mem)
+        cosim_host_reset();
+
+    for (i = 0; i < num_free_blocks; i++) {
+        if (free_blocks[i].size >= size) {
+            offset = free_blocks[i].offset;
+            free_blocks[i] = free_blocks[--num_free_blocks];
+            goto found;
+        }
+    }
+
+    if (offset + size > HOST_MEM_SIZE)
+        return NULL;
+    host_mem_used = offset + size;
+
+found:
+    *bus_addr = HOST_MEM_BASE + offset;
+    memset(host_mem + offset, 0, size);
+    return host_mem + offset;
+}
+
+static void host_free(dma_addr_t bus_addr, size_t size)
+{
+    if (num_free_blocks < MAX_FREE_BLOCKS) {
+        free_blocks[num_free_blocks].offset = bus_addr - HOST_MEM_BASE;
+        free_blocks[num_free_blocks].size = size;
+        num_free_blocks++;
+    }
+}
+
+/* MMIO */
+void __iomem *cosim_bar0(void)
+{
+    return bar0_cookie;
+}
+
+const struct cosim_reg_access *cosim_reg_accesses(void)
+{
+    return reg_accesses;
+}
+
+void cosim_reset_reg_accesses(void)
+{
+    memset(reg_accesses, 0, sizeof(reg_accesses));
+}
+
+static u32 bar0_offset(const volatile void __iomem *addr)
+{
+    ptrdiff_t offset = (const volatile u8 *)addr - bar0_cookie;
+
+    if (offset < 0 || offset >= COSIM_BAR0_SIZE || (offset & 3)) {
+        fprintf(stderr, "cosim: MMIO access outside BAR0 (offset %td)\n", offset);
+        abort();
+    }
+    return offset;
+}
+
+u32 readl(const volatile void __iomem *addr)
+{
+    u32 offset = bar0_offset(addr);
+
+    reg_accesses[offset / 4].reads++;
+    return cosim_bridge_read(offset);
+}
+
+void writel(u32 val, volatile void __iomem *addr)
+{
+    u32 offset = bar0_offset(addr);
+
+    reg_accesses[offset / 4].writes++;
+    cosim_bridge_write(offset, val);
+}
+
+void memcpy_fromio(void *dst, const volatile void __iomem *src, size_t count)
+{
+    u32 offset = bar0_offset(src);
+    unsigned int i;
+
+    if ((count & 3) || offset + count > COSIM_BAR0_SIZE) {
+        fprintf(stderr, "cosim: MMIO block read of %zu bytes at 0x%03x\n", count, offset);
+        abort();
+    }
+    for (i = 0; i < count / 4; i++)
+        reg_accesses[offset / 4 + i].reads++;
+    cosim_bridge_read_block(offset, dst, count / 4);
+}
+
+/* Time */
+u64 cosim_wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void dispatch_irq(void)
+{
+    u64 wall = cosim_wall_ns();
+    u64 sim = cosim_bridge_time_ns();
+    irqreturn_t ret = irq_handler(0, irq_dev_id);
+
+    wall = cosim_wall_ns() - wall;
+    irq_stats.count++;
+    irq_stats.spurious += ret == IRQ_NONE;
+    irq_stats.wall_ns += wall;
+    irq_stats.sim_ns += cosim_bridge_time_ns() - sim;
+    if (wall > irq_stats.max_wall_ns)
+        irq_stats.max_wall_ns = wall;
+}
+
+void cosim_run_ns(u64 ns)
+{
+    u64 end = cosim_bridge_time_ns() + ns;
+
+    while (cosim_bridge_time_ns() < end) {
+        u64 left = end - cosim_bridge_time_ns();
+
+        cosim_bridge_advance_ns(left < IRQ_POLL_NS ? left : IRQ_POLL_NS);
+        if (irq_handler && cosim_bridge_irq())
+            dispatch_irq();
+    }
+}
+
+/* Calls the registered handler once, whatever the interrupt line says */
+irqreturn_t cosim_raise_irq(void)
+{
+    return irq_handler ? irq_handler(0, irq_dev_id) : IRQ_NONE;
+}
+
+void cosim_get_irq_stats(struct cosim_irq_stats *stats)
+{
+    *stats = irq_stats;
+}
+
+void cosim_reset_irq_stats(void)
+{
+    memset(&irq_stats, 0, sizeof(irq_stats));
+}
+
+unsigned long cosim_jiffies(void)
+{
+    return cosim_bridge_time_ns() / (1000000000ULL / HZ);
+}
+
+void msleep(unsigned int msecs)
+{
+    cosim_run_ns((u64)msecs * 1000000);
+}
+
+void udelay(unsigned long usecs)
+{
+    cosim_run_ns((u64)usecs * 1000);
+}
+
+ktime_t ktime_get(void)
+{
+    return cosim_bridge_time_ns();
+}
+
+u64 ktime_get_ns(void)
+{
+    return cosim_bridge_time_ns();
+}
+
+/* PCI */
+int pci_alloc_irq_vectors(struct pci_dev *dev, unsigned int min_vecs,
+                          unsigned int max_vecs, unsigned int flags)
+{
+    return min_vecs;
+}
+
+void pci_free_irq_vectors(struct pci_dev *dev)
+{
+}
+
+int pci_irq_vector(struct pci_dev *dev, unsigned int nr)
+{
+    return nr;
+}
+
+int pcie_set_readrq(struct pci_dev *dev, int rq)
+{
+    return 0;
+}
+
+void pci_set_master(struct pci_dev *dev)
+{
+}
+
+int pcie_capability_clear_and_set_word(struct pci_dev *dev, int pos,
+                                       u16 clear, u16 set)
+{
+    return 0;
+}
+
+/* Interrupts */
+int request_irq(unsigned int irq, irq_handler_t handler, unsigned long flags,
+                const char *name, void *dev_id)
+{
+    if (irq_handler)
+        return -EBUSY;
+    irq_handler = handler;
+    irq_dev_id = dev_id;
+    return 0;
+}
+
+void free_irq(unsigned int irq, void *dev_id)
+{
+    irq_handler = NULL;
+    irq_dev_id = NULL;
+}
+
+/* DMA */
+void *dma_alloc_coherent(struct device *dev, size_t size,
+                         dma_addr_t *dma_handle, gfp_t gfp)
+{
+    return host_alloc(size, dma_handle);
+}
+
+void dma_free_coherent(struct device *dev, size_t size,
+                       void *cpu_addr, dma_addr_t dma_handle)
+{
+    host_free(dma_handle, size);
+}
+
+/* ALSA */
+int snd_pcm_lib_ioctl(struct snd_pcm_substream *substream, unsigned int cmd, void *arg)
+{
+    return 0;
+}
+
+int snd_pcm_lib_malloc_pages(struct snd_pcm_substream *substream, size_t size)
+{
+    struct snd_pcm_runtime *runtime = substream->runtime;
+
+    if (runtime->dma_area && runtime->dma_bytes >= size) {
+        runtime->dma_bytes = size;
+        return 0;
+    }
+
+    runtime->dma_area = host_alloc(size, &runtime->dma_addr);
+    if (!runtime->dma_area)
+        return -ENOMEM;
+    runtime->dma_bytes = size;
+    return 1;
+}
+
+int snd_pcm_lib_free_pages(struct snd_pcm_substream *substream)
+{
+    return 0;
+}
+
+void snd_pcm_period_elapsed(struct snd_pcm_substream *substream)
+{
+    substream->runtime->periods_elapsed++;
+}
+
+int snd_pcm_stop_xrun(struct snd_pcm_substream *substream)
+{
+    substream->runtime->xruns++;
+    return 0;
+}
+
+int cosim_pcm_hw_params(const struct snd_pcm_ops *ops,
+                        struct snd_pcm_substream *substream,
+                        struct snd_pcm_hw_params *params)
+{
+    struct snd_pcm_runtime *runtime = substream->runtime;
+    int err = ops->hw_params(substream, params);
+
+    if (err < 0)
+        return err;
+
+    runtime->format = params_format(params);
+    runtime->rate = params_rate(params);
+    runtime->channels = params_channels(params);
+    runtime->frame_bits = params_physical_width(params) * params_channels(params);
+    runtime->period_size = params_period_size(params);
+    runtime->periods = params_periods(params);
+    runtime->buffer_size = runtime->period_size * runtime->periods;
+    return 0;
+}
@@ -0,0 +1,354 @@
+#ifndef __COSIM_KERNEL_H
+#define __COSIM_KERNEL_H
+
+/*
+ * Userspace stand-ins for the kernel and ALSA interfaces used by the
+ * driver's hw, irq and pcm code. MMIO goes to the co-simulation bridge,
+ * coherent DMA memory comes from the simulated host memory and time is
+ * simulation time, so msleep() and jiffies advance the RTL.
+ *
+ * The co-simulation is single threaded: interrupts are only delivered
+ * between driver calls (from cosim_run_ns()), so locks are no-ops.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+typedef u16 __le16;
+typedef u32 __le32;
+typedef u64 __le64;
+typedef u64 dma_addr_t;
+typedef s64 ktime_t;
+typedef unsigned int gfp_t;
+
+#define __iomem
+#define __packed        __attribute__((packed))
+#define GFP_KERNEL      0
+#define HZ              1000
+
+#define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
+#define likely(x)       __builtin_expect(!!(x), 1)
+#define unlikely(x)     __builtin_expect(!!(x), 0)
+#define BUILD_BUG_ON(c) _Static_assert(!(c), #c)
+#define rmb()           __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+#define BIT(n)              (1U << (n))
+#define GENMASK(h, l)       ((~0U >> (31 - (h))) & (~0U << (l)))
+#define FIELD_GET(mask, reg)  (((reg) & (mask)) >> __builtin_ctz(mask))
+#define FIELD_PREP(mask, val) (((val) << __builtin_ctz(mask)) & (mask))
+#define FIELD_MAX(mask)       ((mask) >> __builtin_ctz(mask))
+#define hweight32(w)        ((unsigned int)__builtin_popcount(w))
+#define min(a, b)           ((a) < (b) ? (a) : (b))
+#define is_power_of_2(n)    ((n) != 0 && ((n) & ((n) - 1)) == 0)
+#define ilog2(n)            (31 - __builtin_clz(n))
+#define lower_32_bits(n)    ((u32)((n) & 0xffffffff))
+#define upper_32_bits(n)    ((u32)((u64)(n) >> 32))
+
+/* The simulated host is little endian, like the card */
+#define cpu_to_le32(x)  ((__le32)(x))
+#define cpu_to_le64(x)  ((__le64)(x))
+#define le32_to_cpu(x)  ((u32)(x))
+#define le64_to_cpu(x)  ((u64)(x))
+
+static inline u64 div64_u64_rem(u64 dividend, u64 divisor, u64 *remainder)
+{
+    *remainder = dividend % divisor;
+    return dividend / divisor;
+}
+
+/* Pseudo-random numbers, the kernel's Tausworthe generator */
+struct rnd_state {
+    u32 s1, s2, s3, s4;
+};
+
+static inline u32 prandom_u32_state(struct rnd_state *state)
+{
+#define TAUSWORTHE(s, a, b, c, d) ((((s) & (c)) << (d)) ^ ((((s) << (a)) ^ (s)) >> (b)))
+    state->s1 = TAUSWORTHE(state->s1,  6U, 13U, 4294967294U, 18U);
+    state->s2 = TAUSWORTHE(state->s2,  2U, 27U, 4294967288U,  2U);
+    state->s3 = TAUSWORTHE(state->s3, 13U, 21U, 4294967280U,  7U);
+    state->s4 = TAUSWORTHE(state->s4,  3U, 12U, 4294967168U, 13U);
+#undef TAUSWORTHE
+    return state->s1 ^ state->s2 ^ state->s3 ^ state->s4;
+}
+
+static inline void prandom_seed_state(struct rnd_state *state, u64 seed)
+{
+    u32 i = ((seed >> 32) ^ (seed << 10) ^ seed) & 0xffffffffUL;
+
+    state->s1 = i < 2 ? i + 2 : i;
+    state->s2 = i < 8 ? i + 8 : i;
+    state->s3 = i < 16 ? i + 16 : i;
+    state->s4 = i < 128 ? i + 128 : i;
+}
+
+/* Modules */
+#define MODULE_LICENSE(license)
+#define MODULE_IMPORT_NS(ns)
+#define EXPORT_SYMBOL_IF_KUNIT(sym)
+#define module_param(name, type, perm)
+#define MODULE_PARM_DESC(name, desc)
+
+/* Locking */
+typedef struct { int unused; } spinlock_t;
+
+#define spin_lock_init(lock)                 ((void)(lock))
+#define spin_lock_irqsave(lock, flags)       do { (void)(lock); (flags) = 0; } while (0)
+#define spin_unlock_irqrestore(lock, flags)  do { (void)(lock); (void)(flags); } while (0)
+
+struct mutex { int unused; };
+
+#define mutex_init(lock)                     ((void)(lock))
+#define mutex_lock(lock)                     ((void)(lock))
+#define mutex_unlock(lock)                   ((void)(lock))
+
+/* Devices */
+struct device {
+    const char *name;
+};
+
+struct pci_dev {
+    struct device dev;
+    unsigned int irq;
+    int current_state;
+};
+
+#define dev_err(dev, fmt, ...)   fprintf(stderr, "%s: " fmt, (dev)->name, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...)  fprintf(stderr, "%s: " fmt, (dev)->name, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...)  fprintf(stdout, "%s: " fmt, (dev)->name, ##__VA_ARGS__)
+
+/* Time, in simulation nanoseconds */
+unsigned long cosim_jiffies(void);
+void msleep(unsigned int msecs);
+void udelay(unsigned long usecs);
+ktime_t ktime_get(void);
+u64 ktime_get_ns(void);
+
+#define jiffies                 cosim_jiffies()
+#define msecs_to_jiffies(m)     ((unsigned long)(m))
+#define time_before(a, b)       ((long)((a) - (b)) < 0)
+#define ktime_sub(a, b)         ((a) - (b))
+#define ktime_to_us(t)          ((s64)(t) / 1000)
+#define ktime_to_ns(t)          ((s64)(t))
+
+/* MMIO: offsets from the BAR0 cookie handed out by cosim_bar0() */
+u32 readl(const volatile void __iomem *addr);
+void writel(u32 val, volatile void __iomem *addr);
+/* One read request for the whole range, whole registers only */
+void memcpy_fromio(void *dst, const volatile void __iomem *src, size_t count);
+
+/* PCI */
+#define PCI_IRQ_LEGACY          (1 << 0)
+#define PCI_IRQ_MSI             (1 << 1)
+#define PCI_IRQ_MSIX            (1 << 2)
+#define PCI_IRQ_AFFINITY        (1 << 3)
+#define PCI_EXP_DEVCTL          8
+#define PCI_EXP_DEVCTL_PAYLOAD  0x00e0
+#define PCI_EXP_DEVCTL_READRQ   0x7000
+
+int pci_alloc_irq_vectors(struct pci_dev *dev, unsigned int min_vecs,
+                          unsigned int max_vecs, unsigned int flags);
+void pci_free_irq_vectors(struct pci_dev *dev);
+int pci_irq_vector(struct pci_dev *dev, unsigned int nr);
+int pcie_set_readrq(struct pci_dev *dev, int rq);
+void pci_set_master(struct pci_dev *dev);
+int pcie_capability_clear_and_set_word(struct pci_dev *dev, int pos,
+                                       u16 clear, u16 set);
+
+/* Interrupts */
+typedef enum irqreturn {
+    IRQ_NONE = 0,
+    IRQ_HANDLED = 1,
+} irqreturn_t;
+
+typedef irqreturn_t (*irq_handler_t)(int irq, void *dev_id);
+
+#define IRQF_SHARED             0x00000080
+
+int request_irq(unsigned int irq, irq_handler_t handler, unsigned long flags,
+                const char *name, void *dev_id);
+void free_irq(unsigned int irq, void *dev_id);
+
+/* Coherent DMA memory */
+void *dma_alloc_coherent(struct device *dev, size_t size,
+                         dma_addr_t *dma_handle, gfp_t gfp);
+void dma_free_coherent(struct device *dev, size_t size,
+                       void *cpu_addr, dma_addr_t dma_handle);
+
+/* ALSA PCM */
+typedef int snd_pcm_format_t;
+typedef unsigned long snd_pcm_uframes_t;
+typedef long snd_pcm_sframes_t;
+
+#define SNDRV_PCM_STREAM_PLAYBACK   0
+#define SNDRV_PCM_STREAM_CAPTURE    1
+
+#define SNDRV_PCM_FORMAT_S16_LE     2
+#define SNDRV_PCM_FORMAT_S24_LE     6
+#define SNDRV_PCM_FORMAT_S32_LE     10
+#define SNDRV_PCM_FMTBIT_S16_LE     (1ULL << SNDRV_PCM_FORMAT_S16_LE)
+#define SNDRV_PCM_FMTBIT_S24_LE     (1ULL << SNDRV_PCM_FORMAT_S24_LE)
+#define SNDRV_PCM_FMTBIT_S32_LE     (1ULL << SNDRV_PCM_FORMAT_S32_LE)
+
+#define SNDRV_PCM_RATE_44100        (1 << 6)
+#define SNDRV_PCM_RATE_48000        (1 << 7)
+#define SNDRV_PCM_RATE_88200        (1 << 8)
+#define SNDRV_PCM_RATE_96000        (1 << 9)
+#define SNDRV_PCM_RATE_176400       (1 << 10)
+#define SNDRV_PCM_RATE_192000       (1 << 11)
+
+#define SNDRV_PCM_INFO_MMAP             0x00000001
+#define SNDRV_PCM_INFO_MMAP_VALID       0x00000002
+#define SNDRV_PCM_INFO_INTERLEAVED      0x00000100
+#define SNDRV_PCM_INFO_BLOCK_TRANSFER   0x00010000
+
+#define SNDRV_PCM_TRIGGER_STOP          0
+#define SNDRV_PCM_TRIGGER_START         1
+#define SNDRV_PCM_TRIGGER_PAUSE_PUSH    3
+#define SNDRV_PCM_TRIGGER_PAUSE_RELEASE 4
+#define SNDRV_PCM_TRIGGER_SUSPEND       5
+#define SNDRV_PCM_TRIGGER_RESUME        6
+
+struct snd_pcm_hardware {
+    unsigned int info;
+    u64 formats;
+    unsigned int rates;
+    unsigned int rate_min;
+    unsigned int rate_max;
+    unsigned int channels_min;
+    unsigned int channels_max;
+    size_t buffer_bytes_max;
+    size_t period_bytes_min;
+    size_t period_bytes_max;
+    unsigned int periods_min;
+    unsigned int periods_max;
+};
+
+struct snd_pcm_runtime {
+    struct snd_pcm_hardware hw;
+    snd_pcm_format_t format;
+    unsigned int rate;
+    unsigned int channels;
+    unsigned int frame_bits;
+    snd_pcm_uframes_t period_size;
+    unsigned int periods;
+    snd_pcm_uframes_t buffer_size;
+    snd_pcm_sframes_t delay;
+
+    unsigned char *dma_area;
+    dma_addr_t dma_addr;
+    size_t dma_bytes;
+
+    /* Co-simulation bookkeeping, updated by the shim */
+    unsigned long periods_elapsed;
+    unsigned long xruns;
+};
+
+struct snd_pcm_substream {
+    int number;
+    int stream;
+    struct snd_pcm_runtime *runtime;
+    void *private_data;
+};
+
+#define snd_pcm_substream_chip(substream)   ((substream)->private_data)
+
+static inline size_t frames_to_bytes(struct snd_pcm_runtime *runtime,
+                                     snd_pcm_sframes_t size)
+{
+    return size * runtime->frame_bits / 8;
+}
+
+static inline snd_pcm_sframes_t bytes_to_frames(struct snd_pcm_runtime *runtime,
+                                                size_t size)
+{
+    return size * 8 / runtime->frame_bits;
+}
+
+struct snd_pcm_hw_params {
+    snd_pcm_format_t format;
+    unsigned int physical_width;
+    unsigned int channels;
+    unsigned int rate;
+    snd_pcm_uframes_t period_size;
+    unsigned int periods;
+};
+
+#define params_format(p)            ((p)->format)
+#define params_physical_width(p)    ((p)->physical_width)
+#define params_channels(p)          ((p)->channels)
+#define params_rate(p)              ((p)->rate)
+#define params_period_size(p)       ((p)->period_size)
+#define params_periods(p)           ((p)->periods)
+#define params_period_bytes(p) \
+    ((p)->period_size * (p)->channels * (p)->physical_width / 8)
+#define params_buffer_bytes(p)      (params_period_bytes(p) * (p)->periods)
+
+struct snd_pcm_ops {
+    int (*open)(struct snd_pcm_substream *substream);
+    int (*close)(struct snd_pcm_substream *substream);
+    int (*ioctl)(struct snd_pcm_substream *substream, unsigned int cmd, void *arg);
+    int (*hw_params)(struct snd_pcm_substream *substream,
+                     struct snd_pcm_hw_params *params);
+    int (*hw_free)(struct snd_pcm_substream *substream);
+    int (*prepare)(struct snd_pcm_substream *substream);
+    int (*trigger)(struct snd_pcm_substream *substream, int cmd);
+    snd_pcm_uframes_t (*pointer)(struct snd_pcm_substream *substream);
+};
+
+int snd_pcm_lib_ioctl(struct snd_pcm_substream *substream, unsigned int cmd, void *arg);
+int snd_pcm_lib_malloc_pages(struct snd_pcm_substream *substream, size_t size);
+int snd_pcm_lib_free_pages(struct snd_pcm_substream *substream);
+void snd_pcm_period_elapsed(struct snd_pcm_substream *substream);
+int snd_pcm_stop_xrun(struct snd_pcm_substream *substream);
+
+/* Co-simulation entry points */
+struct cosim_reg_access {
+    unsigned long reads;
+    unsigned long writes;
+};
+
+#define COSIM_BAR0_SIZE     4096
+
+void __iomem *cosim_bar0(void);
+const struct cosim_reg_access *cosim_reg_accesses(void);
+void cosim_reset_reg_accesses(void);
+
+void *cosim_host_ptr(u64 bus_addr, size_t len);
+void cosim_host_reset(void);
+
+/* Runs the simulation, delivering the interrupt between polling slices */
+void cosim_run_ns(u64 ns);
+irqreturn_t cosim_raise_irq(void);
+
+/* Handler invocations made by cosim_run_ns(), with the time spent in them */
+struct cosim_irq_stats {
+    unsigned long count;
+    unsigned long spurious;
+    u64 wall_ns;
+    u64 max_wall_ns;
+    u64 sim_ns;
+};
+
+void cosim_get_irq_stats(struct cosim_irq_stats *stats);
+void cosim_reset_irq_stats(void);
+u64 cosim_wall_ns(void);
+
+/* What the ALSA core does around .hw_params: call it, then commit the
+ * negotiated parameters to the runtime */
+int cosim_pcm_hw_params(const struct snd_pcm_ops *ops,
+                        struct snd_pcm_substream *substream,
+                        struct snd_pcm_hw_params *params);
+
+#endif /* __COSIM_KERNEL_H */
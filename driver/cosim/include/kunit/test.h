@@ -0,0 +1,68 @@
+#ifndef __COSIM_KUNIT_TEST_H
+#define __COSIM_KUNIT_TEST_H
+
+/*
+ * Just enough of KUnit to run the driver's pure-logic suites in userspace
+ * (see kunit-runner.c). Failed assertions abort the case like the kernel's
+ * do; failed expectations mark it failed and carry on.
+ */
+
+#include <setjmp.h>
+#include "cosim-kernel.h"
+
+struct kunit {
+    const char *name;
+    bool failed;
+    jmp_buf abort;
+};
+
+struct kunit_case {
+    void (*run_case)(struct kunit *test);
+    const char *name;
+};
+
+struct kunit_suite {
+    const char *name;
+    struct kunit_case *test_cases;
+};
+
+#define KUNIT_CASE(fn)  { .run_case = fn, .name = #fn }
+
+void kunit_register_suite(struct kunit_suite *suite);
+
+#define kunit_test_suite(suite)                                             \
+    static void __attribute__((constructor)) register_##suite(void)         \
+    {                                                                       \
+        kunit_register_suite(&suite);                                       \
+    }
+
+#define kunit_info(test, fmt, ...) \
+    printf("    # %s: " fmt, (test)->name, ##__VA_ARGS__)
+
+void kunit_fail(struct kunit *test, const char *file, int line,
+                const char *cond, long long left, long long right);
+
+#define KUNIT_BINARY_EXPECT(test, left, op, right, abort_case)              \
+    do {                                                                    \
+        long long __l = (long long)(left), __r = (long long)(right);        \
+        if (!(__l op __r)) {                                                \
+            kunit_fail(test, __FILE__, __LINE__,                            \
+                       #left " " #op " " #right, __l, __r);                 \
+            if (abort_case)                                                 \
+                longjmp((test)->abort, 1);                                  \
+        }                                                                   \
+    } while (0)
+
+#define KUNIT_EXPECT_EQ(test, l, r)     KUNIT_BINARY_EXPECT(test, l, ==, r, false)
+#define KUNIT_EXPECT_NE(test, l, r)     KUNIT_BINARY_EXPECT(test, l, !=, r, false)
+#define KUNIT_EXPECT_LT(test, l, r)     KUNIT_BINARY_EXPECT(test, l, <, r, false)
+#define KUNIT_EXPECT_LE(test, l, r)     KUNIT_BINARY_EXPECT(test, l, <=, r, false)
+#define KUNIT_EXPECT_GT(test, l, r)     KUNIT_BINARY_EXPECT(test, l, >, r, false)
+#define KUNIT_EXPECT_GE(test, l, r)     KUNIT_BINARY_EXPECT(test, l, >=, r, false)
+#define KUNIT_EXPECT_TRUE(test, c)      KUNIT_BINARY_EXPECT(test, !!(c), ==, 1, false)
+#define KUNIT_EXPECT_FALSE(test, c)     KUNIT_BINARY_EXPECT(test, !!(c), ==, 0, false)
+#define KUNIT_ASSERT_EQ(test, l, r)     KUNIT_BINARY_EXPECT(test, l, ==, r, true)
+#define KUNIT_ASSERT_GT(test, l, r)     KUNIT_BINARY_EXPECT(test, l, >, r, true)
+#define KUNIT_ASSERT_LT(test, l, r)     KUNIT_BINARY_EXPECT(test, l, <, r, true)
+
+#endif /* __COSIM_KUNIT_TEST_H */
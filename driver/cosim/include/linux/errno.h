@@ -0,0 +1,2 @@
+/* Co-simulation stand-in: glibc's <errno.h> includes this header itself */
+#include_next <linux/errno.h>
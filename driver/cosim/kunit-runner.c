@@ -0,0 +1,71 @@
+/*
+ * Runs the KUnit suites linked into the binary and prints KTAP-style
+ * results; exits non-zero if any case failed. Unlike the co-simulation,
+ * time here is wall-clock time, so the benchmark cases measure the host.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <kunit/test.h>
+
+#define MAX_SUITES  16
+
+static struct kunit_suite *suites[MAX_SUITES];
+static unsigned int num_suites;
+
+void kunit_register_suite(struct kunit_suite *suite)
+{
+    if (num_suites < MAX_SUITES)
+        suites[num_suites++] = suite;
+}
+
+void kunit_fail(struct kunit *test, const char *file, int line,
+                const char *cond, long long left, long long right)
+{
+    printf("    # %s: EXPECTATION FAILED at %s:%d\n"
+           "    Expected %s, but left == %lld, right == %lld\n",
+           test->name, file, line, cond, left, right);
+    test->failed = true;
+}
+
+u64 ktime_get_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool run_suite(struct kunit_suite *suite, unsigned int index)
+{
+    struct kunit_case *c;
+    unsigned int n = 0, i = 0;
+    bool ok = true;
+
+    for (c = suite->test_cases; c->run_case; c++)
+        n++;
+
+    printf("    # Subtest: %s\n    1..%u\n", suite->name, n);
+    for (c = suite->test_cases; c->run_case; c++) {
+        struct kunit test = { .name = c->name };
+
+        if (!setjmp(test.abort))
+            c->run_case(&test);
+        printf("    %s %u %s\n", test.failed ? "not ok" : "ok", ++i, c->name);
+        ok &= !test.failed;
+    }
+    printf("%s %u %s\n", ok ? "ok" : "not ok", index, suite->name);
+    return ok;
+}
+
+int main(void)
+{
+    bool ok = true;
+    unsigned int i;
+
+    printf("KTAP version 1\n1..%u\n", num_suites);
+    for (i = 0; i < num_suites; i++)
+        ok &= run_suite(suites[i], i + 1);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
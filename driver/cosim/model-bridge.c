@@ -0,0 +1,536 @@
+/*
+ * Software model of the card behind the co-simulation bridge interface.
+ *
+ * Implements the register map of pcie-audio-regs.h, not the RTL itself: the
+ * DMA engines walk the descriptor ring in host memory and consume (playback)
+ * or produce (capture) one descriptor's bytes at the programmed frame rate,
+ * raising the period interrupt for descriptors flagged DESC_FLAG_INT. Like
+ * the RTL they report progress per descriptor only: CURRENT holds the
+ * descriptor index and DESC_ACTIVE the descriptors with a burst under way,
+ * both truncated to their fields. Each capture context writes the channels
+ * of its route at their container size.
+ * There are no FIFOs in between, so their levels read 0 and the watermark events
+ * never fire. The output EQ takes its coefficients without filtering and
+ * switches banks as soon as EQ_CTRL is written. The output FIR, 8 lanes of
+ * 1024 words at a 49.152 MHz MCLK, reads its coefficients from host memory
+ * the moment FIR_LOAD is written, and does not filter. The spectrum analyzer
+ * writes a fixed spectrum, a full-scale tone on bin size / 16 over a floor,
+ * every size x average frames at the programmed rate. Time only moves when the
+ * harness advances it, so the simulated cost of every driver call is
+ * deterministic.
+ */
+
+#include "pcie-audio.h"
+#include "cosim-bridge.h"
+
+#define NUM_REGS            (COSIM_BAR0_SIZE / 4)
+#define BURST_BYTES         512
+#define WRITE_LATENCY_NS    8       /* One user clock cycle */
+#define MODEL_MCLK_HZ       49152000
+#define MODEL_FIR_CAPS      (FIELD_PREP(FIR_CAPS_LANES, 8) | FIELD_PREP(FIR_CAPS_DEPTH, 1024))
+#define MODEL_SPEC_CAPS     12
+
+struct model_stream {
+    bool capture;
+    bool running;
+    unsigned int context;       /* Capture DMA context */
+    u32 reg_desc_base;
+    u32 reg_desc_count;
+    u32 reg_current;
+    u32 reg_desc_active;
+    u32 index_mask;             /* DESC_COUNT and CURRENT field */
+    u32 active_mask;            /* DESC_ACTIVE field */
+    u32 reg_irq_en;             /* REG_DMA_CAPn_CTRL for contexts n >= 1 */
+    u32 reg_route;
+    u32 reg_status;
+    u32 period;                 /* Bit of reg_status */
+    u32 reg_error;
+    u32 error;                  /* Bit of reg_error */
+    u32 reg_bytes_proc;
+
+    unsigned int index;         /* Current descriptor */
+    struct pcie_audio_dma_desc desc;
+    u32 offset;                 /* Bytes done in the current descriptor */
+    u64 start_ns;
+    u64 frames_done;
+    u64 burst_bytes;            /* Towards the next counted burst */
+};
+
+static struct {
+    u32 regs[NUM_REGS];
+    u64 now_ns;
+    u64 read_latency_ns;
+    struct model_stream pb;
+    struct model_stream cap[CAP_CONTEXTS];
+    struct {
+        u64 start_ns;
+        u64 written;            /* Spectra since enable */
+    } spectrum;
+    struct cosim_bridge_stats stats;
+} model;
+
+static u32 *reg(u32 offset)
+{
+    return &model.regs[offset / 4];
+}
+
+static void playback_init(struct model_stream *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->reg_desc_base = REG_DMA_PB_DESC_BASE;
+    s->reg_desc_count = REG_DMA_PB_DESC_COUNT;
+    s->reg_current = REG_DMA_PB_CURRENT;
+    s->reg_desc_active = REG_STATUS_PB_DESC_ACTIVE;
+    s->index_mask = DMA_PB_CURRENT_MASK;
+    s->active_mask = STATUS_PB_DESC_ACTIVE_MASK;
+    s->reg_irq_en = REG_DMA_PB_IRQ_EN;
+    s->reg_status = REG_STATUS_PB_UNDERRUN;
+    s->period = STATUS_PERIOD;
+    s->reg_error = REG_STATUS_DMA_ERROR;
+    s->error = STATUS_DMA_ERROR_PB;
+    s->reg_bytes_proc = REG_STATUS_PB_BYTES_PROC;
+}
+
+/* Context 0 reports through the capture registers, the others through
+ * REG_STATUS_CAP_CONTEXTS; only context 0 counts its bytes */
+static void capture_init(struct model_stream *s, unsigned int context)
+{
+    struct pcie_audio_cap_regs regs;
+
+    memset(s, 0, sizeof(*s));
+    pcie_audio_cap_regs(context, &regs);
+    s->capture = true;
+    s->context = context;
+    s->reg_desc_base = regs.desc_base;
+    s->reg_desc_count = regs.desc_count;
+    s->reg_current = regs.current_desc;
+    s->reg_desc_active = regs.desc_active;
+    s->index_mask = DMA_CAP_CURRENT_MASK;
+    s->active_mask = STATUS_CAP_DESC_ACTIVE_MASK;
+    s->reg_route = regs.route;
+    if (context) {
+        s->reg_irq_en = regs.ctrl;
+        s->reg_status = REG_STATUS_CAP_CONTEXTS;
+        s->period = CAP_CONTEXT_PERIOD(context);
+        s->reg_error = REG_STATUS_CAP_CONTEXTS;
+        s->error = CAP_CONTEXT_ERROR(context);
+    } else {
+        s->reg_irq_en = REG_DMA_CAP_IRQ_EN;
+        s->reg_status = REG_STATUS_CAP_OVERRUN;
+        s->period = STATUS_PERIOD;
+        s->reg_error = REG_STATUS_DMA_ERROR;
+        s->error = STATUS_DMA_ERROR_CAP;
+        s->reg_bytes_proc = REG_STATUS_CAP_BYTES_PROC;
+    }
+}
+
+static void model_reset(void)
+{
+    unsigned int i;
+
+    memset(model.regs, 0, sizeof(model.regs));
+    playback_init(&model.pb);
+    for (i = 0; i < CAP_CONTEXTS; i++)
+        capture_init(&model.cap[i], i);
+}
+
+/*
+ * Playback frames as the serializer registers, capture ones as the
+ * context's route. DSD is not modelled.
+ */
+static unsigned int frame_bytes(const struct model_stream *s)
+{
+    unsigned int width = FIELD_GET(CTRL_I2S_BITDEPTH_MASK, *reg(REG_CTRL_I2S_BITDEPTH));
+    unsigned int channels = FIELD_GET(CTRL_I2S_TDM_SLOTS_MASK, *reg(REG_CTRL_I2S_TDM_SLOTS)) + 1;
+    u32 format = FIELD_GET(CTRL_FORMAT_MASK, *reg(REG_CTRL_FORMAT));
+    u32 route;
+
+    if (!s->capture)
+        return width / 8 * (format == CTRL_FORMAT_TDM ? channels : min(channels, 2U));
+
+    route = *reg(s->reg_route);
+    if (FIELD_GET(DMA_CAP_ROUTE_MASK, route))
+        channels = hweight32(FIELD_GET(DMA_CAP_ROUTE_MASK, route));
+    return (FIELD_GET(DMA_CAP_ROUTE_FORMAT, route) == CAP_ROUTE_S16 ? 2 : 4) * channels;
+}
+
+/* Descriptors the RTL has a burst in flight for: one while the model is
+ * part way through a burst, none between bursts or once stopped */
+static void set_active(struct model_stream *s)
+{
+    *reg(s->reg_desc_active) = (s->running && s->burst_bytes) & s->active_mask;
+}
+
+static void stream_stop(struct model_stream *s)
+{
+    s->running = false;
+    s->burst_bytes = 0;
+    set_active(s);
+}
+
+static void dma_error(struct model_stream *s)
+{
+    *reg(s->reg_error) |= s->error;
+    stream_stop(s);
+}
+
+static u32 desc_count(struct model_stream *s)
+{
+    return *reg(s->reg_desc_count) & s->index_mask;
+}
+
+static bool load_desc(struct model_stream *s)
+{
+    u64 base = ((u64)*reg(s->reg_desc_base + 4) << 32) | *reg(s->reg_desc_base);
+    u64 addr = base + (u64)s->index * sizeof(struct pcie_audio_dma_desc);
+    const void *src = cosim_host_ptr(addr, sizeof(s->desc));
+
+    if (!src || s->index >= desc_count(s)) {
+        model.stats.dma_faults++;
+        dma_error(s);
+        return false;
+    }
+
+    memcpy(&s->desc, src, sizeof(s->desc));
+    s->offset = 0;
+    *reg(s->reg_current) = s->index & s->index_mask;
+    return true;
+}
+
+static void next_desc(struct model_stream *s)
+{
+    if (s->desc.flags & DESC_FLAG_INT)
+        *reg(s->reg_status) |= s->period;
+
+    if ((s->desc.flags & (DESC_FLAG_WRAP | DESC_FLAG_LAST)) ||
+        s->index + 1 >= desc_count(s))
+        s->index = 0;
+    else
+        s->index++;
+    load_desc(s);
+}
+
+static void stream_start(struct model_stream *s)
+{
+    s->running = true;
+    s->index = 0;
+    s->start_ns = model.now_ns;
+    s->frames_done = 0;
+    s->burst_bytes = 0;
+    load_desc(s);
+}
+
+/* The serializer's rate, as CTRL_SAMPLE_FAMILY and CTRL_SAMPLE_MULTI set it */
+static u32 model_rate(void)
+{
+    u32 family = FIELD_GET(CTRL_SAMPLE_FAMILY_MASK, *reg(REG_CTRL_SAMPLE_FAMILY));
+    u32 multi = FIELD_GET(CTRL_SAMPLE_MULTI_MASK, *reg(REG_CTRL_SAMPLE_MULTI));
+
+    return (family == CTRL_SAMPLE_FAMILY_SF_48K ? 48000 : 44100) * (multi + 1);
+}
+
+/* Moves the stream's DMA position up to the current time */
+static void stream_advance(struct model_stream *s)
+{
+    u32 rate = model_rate();
+    unsigned int fbytes = frame_bytes(s);
+    u64 frames_due, bytes;
+
+    if (!s->running || !rate)
+        return;
+
+    frames_due = (model.now_ns - s->start_ns) * rate / 1000000000ULL;
+    bytes = (frames_due - s->frames_done) * fbytes;
+    s->frames_done = frames_due;
+
+    while (bytes && s->running) {
+        u32 chunk = s->desc.length - s->offset;
+        void *buf;
+
+        if (!s->desc.length) {
+            model.stats.dma_faults++;
+            dma_error(s);
+            break;
+        }
+        if (chunk > bytes)
+            chunk = bytes;
+
+        buf = cosim_host_ptr(s->desc.address + s->offset, chunk);
+        if (!buf) {
+            model.stats.dma_faults++;
+            dma_error(s);
+            break;
+        }
+        if (s->capture)
+            memset(buf, 0x5A, chunk);
+
+        s->burst_bytes += chunk;
+        while (s->burst_bytes >= BURST_BYTES) {
+            s->burst_bytes -= BURST_BYTES;
+            if (s->capture)
+                model.stats.dma_write_bursts++;
+            else
+                model.stats.dma_read_bursts++;
+        }
+
+        s->offset += chunk;
+        bytes -= chunk;
+        if (s->reg_bytes_proc)
+            *reg(s->reg_bytes_proc) += chunk;
+
+        if (s->offset == s->desc.length)
+            next_desc(s);
+    }
+    set_active(s);
+}
+
+/* Writes the spectra due by now to their slots, in BURST_BYTES writes */
+static void spectrum_advance(void)
+{
+    u32 ctrl = *reg(REG_SPEC_CTRL);
+    u32 rate = model_rate();
+    u64 base = *reg(REG_SPEC_BASE) | (u64)*reg(REG_SPEC_BASE_HI) << 32;
+    unsigned int size = 1U << FIELD_GET(SPEC_CTRL_SIZE, ctrl);
+    unsigned int average = 1U << FIELD_GET(SPEC_CTRL_AVERAGE, ctrl);
+    unsigned int bins = size / 2, k;
+    u64 due;
+
+    if (!(ctrl & SPEC_CTRL_ENABLE) || (*reg(REG_SPEC_STATUS) & SPEC_STATUS_ERROR) || !rate)
+        return;
+
+    due = (model.now_ns - model.spectrum.start_ns) * rate / 1000000000ULL / size / average;
+    for (; model.spectrum.written < due; model.spectrum.written++) {
+        u64 slot = base + (model.spectrum.written & 1) * (2U << MODEL_SPEC_CAPS);
+        u32 *buf = cosim_host_ptr(slot, bins * sizeof(u32));
+
+        if (!buf) {
+            *reg(REG_SPEC_STATUS) |= SPEC_STATUS_ERROR;
+            model.stats.dma_faults++;
+            return;
+        }
+        for (k = 0; k < bins; k++) {
+            float power = k == size / 16 ? 0.25f : 1e-9f;
+
+            memcpy(&buf[k], &power, sizeof(power));
+        }
+        model.stats.dma_write_bursts += bins * sizeof(u32) / BURST_BYTES;
+        *reg(REG_SPEC_STATUS) = SPEC_STATUS_VALID |
+                                FIELD_PREP(SPEC_STATUS_COUNT, model.spectrum.written + 1);
+    }
+}
+
+static void advance_all(void)
+{
+    unsigned int i;
+
+    stream_advance(&model.pb);
+    for (i = 0; i < CAP_CONTEXTS; i++)
+        stream_advance(&model.cap[i]);
+    spectrum_advance();
+}
+
+/* The capture context, if any, whose DMA a write to offset starts or stops */
+static struct model_stream *context_ctrl(u32 offset)
+{
+    unsigned int i;
+
+    for (i = 1; i < CAP_CONTEXTS; i++)
+        if (offset == model.cap[i].reg_irq_en)
+            return &model.cap[i];
+    return NULL;
+}
+
+static bool is_w1c(u32 offset)
+{
+    return offset == REG_STATUS_PB_UNDERRUN ||
+           offset == REG_STATUS_CAP_OVERRUN ||
+           offset == REG_STATUS_DMA_ERROR ||
+           offset == REG_STATUS_CAP_CONTEXTS;
+}
+
+static bool is_read_only(u32 offset)
+{
+    unsigned int i;
+
+    for (i = 1; i < CAP_CONTEXTS; i++)
+        if (offset == model.cap[i].reg_current || offset == model.cap[i].reg_desc_active)
+            return true;
+    return offset == REG_DMA_PB_CURRENT || offset == REG_DMA_CAP_CURRENT ||
+           (offset >= REG_STATUS_LOCKED && offset < REG_EQ_CTRL && !is_w1c(offset)) ||
+           offset == REG_EQ_STATUS || offset == REG_FIR_STATUS || offset == REG_FIR_CAPS ||
+           offset == REG_SPEC_STATUS || offset == REG_SPEC_CAPS;
+}
+
+/* The coefficient load of FIR_LOAD, in BURST_BYTES reads */
+static void fir_load(void)
+{
+    u64 base = *reg(REG_FIR_COEF_BASE) | (u64)*reg(REG_FIR_COEF_BASE_HI) << 32;
+    size_t bytes = FIELD_GET(FIR_CTRL_CHANNELS, *reg(REG_FIR_CTRL)) *
+                   FIELD_GET(FIR_TAPS_MASK, *reg(REG_FIR_TAPS)) * sizeof(u32);
+
+    if (!cosim_host_ptr(base, bytes)) {
+        *reg(REG_FIR_STATUS) = FIR_STATUS_ERROR;
+        model.stats.dma_faults++;
+        return;
+    }
+    *reg(REG_FIR_STATUS) = 0;
+    model.stats.dma_read_bursts += (bytes + BURST_BYTES - 1) / BURST_BYTES;
+}
+
+int cosim_bridge_open(const struct cosim_options *opts)
+{
+    memset(&model, 0, sizeof(model));
+    model.read_latency_ns = opts->read_latency_ns;
+    model_reset();
+    return 0;
+}
+
+void cosim_bridge_close(void)
+{
+}
+
+static u32 model_read(u32 offset)
+{
+    switch (offset) {
+    case REG_STATUS_LOCKED:
+        return !*reg(REG_CTRL_RESET);
+    case REG_STATUS_ACTUAL_RATE:
+        return model_rate();
+    case REG_EQ_COEF_DATA:
+        return 0;
+    case REG_EQ_STATUS:
+        /* The bank switch lands within the write's latency */
+        return FIELD_GET(EQ_CTRL_BANK, *reg(REG_EQ_CTRL));
+    case REG_STATUS_MCLK_FREQ:
+        return MODEL_MCLK_HZ;
+    case REG_FIR_LOAD:
+        return 0;
+    case REG_FIR_CAPS:
+        return MODEL_FIR_CAPS;
+    case REG_SPEC_CAPS:
+        return MODEL_SPEC_CAPS;
+    default:
+        return offset < COSIM_BAR0_SIZE ? *reg(offset) : 0;
+    }
+}
+
+uint32_t cosim_bridge_read(uint32_t offset)
+{
+    u32 val;
+
+    cosim_bridge_read_block(offset, &val, 1);
+    return val;
+}
+
+/* The whole block comes back in one completion, one round trip */
+void cosim_bridge_read_block(uint32_t offset, uint32_t *buf, unsigned int count)
+{
+    unsigned int i;
+
+    model.stats.reg_reads++;
+    model.now_ns += model.read_latency_ns;
+    advance_all();
+
+    for (i = 0; i < count; i++)
+        buf[i] = model_read(offset + 4 * i);
+}
+
+void cosim_bridge_write(uint32_t offset, uint32_t val)
+{
+    model.stats.reg_writes++;
+    model.now_ns += WRITE_LATENCY_NS;
+    advance_all();
+
+    if (offset >= COSIM_BAR0_SIZE || is_read_only(offset))
+        return;
+
+    if (is_w1c(offset)) {
+        *reg(offset) &= ~val;
+        return;
+    }
+
+    switch (offset) {
+    case REG_CTRL_RESET:
+        if (val)
+            model_reset();
+        *reg(offset) = val;
+        break;
+    case REG_CTRL_PB_ENABLE:
+    case REG_CTRL_CAP_ENABLE: {
+        struct model_stream *s = offset == REG_CTRL_PB_ENABLE ? &model.pb : &model.cap[0];
+
+        if (val && !s->running)
+            stream_start(s);
+        else if (!val)
+            stream_stop(s);
+        *reg(offset) = val;
+        break;
+    }
+    case REG_FIR_LOAD:
+        if (val & FIR_LOAD_MASK)
+            fir_load();
+        break;
+    case REG_SPEC_CTRL:
+        /* Disabling restarts the slots and the count */
+        if (!(val & SPEC_CTRL_ENABLE)) {
+            *reg(REG_SPEC_STATUS) = 0;
+        } else if (!(*reg(offset) & SPEC_CTRL_ENABLE)) {
+            model.spectrum.start_ns = model.now_ns;
+            model.spectrum.written = 0;
+        }
+        *reg(offset) = val;
+        break;
+    default: {
+        struct model_stream *s = context_ctrl(offset);
+
+        if (s && (val & DMA_CAP1_CTRL_ENABLE) && !s->running)
+            stream_start(s);
+        else if (s && !(val & DMA_CAP1_CTRL_ENABLE))
+            stream_stop(s);
+        *reg(offset) = val;
+        break;
+    }
+    }
+}
+
+void cosim_bridge_advance_ns(uint64_t ns)
+{
+    model.now_ns += ns;
+    advance_all();
+}
+
+uint64_t cosim_bridge_time_ns(void)
+{
+    return model.now_ns;
+}
+
+/*
+ * Both directions lay out IRQ_EN and their status register the same. A
+ * capture context n >= 1 interrupts on its periods with DMA_CAP1_CTRL_IRQ
+ * set, and on its errors
+ */
+static bool stream_irq(const struct model_stream *s)
+{
+    u32 enable = *reg(s->reg_irq_en);
+    u32 status = *reg(s->reg_status);
+
+    if (s->context)
+        return ((enable & DMA_CAP1_CTRL_IRQ) && (status & s->period)) || (status & s->error);
+    return ((enable & DMA_PB_IRQ_EN_EVENTS) && (status & (STATUS_XRUN | STATUS_PERIOD))) ||
+           ((enable & DMA_PB_IRQ_EN_WATERMARK) && (status & (STATUS_LOW | STATUS_HIGH)));
+}
+
+bool cosim_bridge_irq(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < CAP_CONTEXTS; i++)
+        if (stream_irq(&model.cap[i]))
+            return true;
+    return stream_irq(&model.pb) || *reg(REG_STATUS_DMA_ERROR);
+}
+
+void cosim_bridge_get_stats(struct cosim_bridge_stats *stats)
+{
+    *stats = model.stats;
+}
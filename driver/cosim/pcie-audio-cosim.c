@@ -0,0 +1,651 @@
+/*
+ * Driver harness: runs the driver's hw, irq and pcm code against the device
+ * behind cosim-bridge.h, either the Verilator model of AudioPCIeTop
+ * (pcie-audio-cosim) or the software model (pcie-audio-model).
+ *
+ *   regmap             driver REG_* defines vs. the RTL map
+ *   stream [options]   init, hw_params, prepare, trigger and run periods
+ *                      with interrupt delivery
+ *   bench [options]    per-call cost of the hot paths
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include "pcie-audio.h"
+#include "cosim-bridge.h"
+
+struct driver_reg {
+    const char *name;
+    u32 offset;
+};
+
+/* Generated from the driver headers by the Makefile */
+static const struct driver_reg driver_regs[] = {
+#include "driver-regs.h"
+};
+
+#define NUM_DRIVER_REGS (sizeof(driver_regs) / sizeof(driver_regs[0]))
+
+/* Register map exported by audio.AudioPCIeCosim next to the Verilog */
+struct rtl_reg {
+    bool present;
+    bool readable;
+    bool writable;
+    char name[64];
+};
+
+static struct rtl_reg rtl_map[COSIM_BAR0_SIZE / 4];
+static bool rtl_map_loaded;
+
+struct cosim_card {
+    struct pci_dev pci;
+    struct pcie_audio chip;
+    struct snd_pcm_runtime runtime[2];
+    struct snd_pcm_substream substream[2];
+};
+
+struct cosim_config {
+    const char *regmap_path;
+    const char *wave_path;
+    unsigned int rate;
+    unsigned int channels;
+    unsigned int period_frames;
+    unsigned int periods;
+    unsigned int run_periods;
+    unsigned int iterations;
+    bool capture;
+    unsigned int context;       /* Capture substream, its DMA context */
+    u32 channel_mask;
+    unsigned int eq_sections;   /* Output EQ biquads per channel */
+    unsigned int fir_taps;      /* Output FIR taps per channel */
+    unsigned int spectrum_size; /* Spectrum analyzer points, on output channel 0 */
+};
+
+static int load_rtl_map(const char *path)
+{
+    char line[256];
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        fprintf(stderr, "cannot open register map %s\n", path);
+        return -ENOENT;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned int offset;
+        char access[4] = "";
+        char name[64] = "";
+
+        if (sscanf(line, "%x %3s %63s", &offset, access, name) < 2 ||
+            offset >= COSIM_BAR0_SIZE)
+            continue;
+        rtl_map[offset / 4].present = true;
+        /* RO, RW, W1C or WO */
+        rtl_map[offset / 4].readable = strchr(access, 'R') || !strcmp(access, "W1C");
+        rtl_map[offset / 4].writable = strchr(access, 'W') != NULL;
+        strcpy(rtl_map[offset / 4].name, name);
+    }
+
+    fclose(f);
+    rtl_map_loaded = true;
+    return 0;
+}
+
+static const char *driver_reg_name(u32 offset)
+{
+    unsigned int i;
+
+    for (i = 0; i < NUM_DRIVER_REGS; i++) {
+        if (driver_regs[i].offset == offset)
+            return driver_regs[i].name;
+    }
+    return "?";
+}
+
+/* Every REG_* define must name a register the RTL decodes */
+static int check_static_map(void)
+{
+    unsigned int i, missing = 0;
+
+    for (i = 0; i < NUM_DRIVER_REGS; i++) {
+        const struct driver_reg *reg = &driver_regs[i];
+
+        if (!rtl_map[reg->offset / 4].present) {
+            printf("  %-28s 0x%03x  not decoded by the RTL\n", reg->name, reg->offset);
+            missing++;
+        }
+    }
+
+    printf("register map: %u of %zu driver registers missing in hardware\n",
+           missing, NUM_DRIVER_REGS);
+    return missing ? -EINVAL : 0;
+}
+
+/* Every access the driver actually made must hit a register that supports it */
+static int check_accesses(void)
+{
+    const struct cosim_reg_access *access = cosim_reg_accesses();
+    unsigned int i, bad = 0;
+
+    for (i = 0; i < COSIM_BAR0_SIZE / 4; i++) {
+        const struct rtl_reg *reg = &rtl_map[i];
+
+        if (!access[i].reads && !access[i].writes)
+            continue;
+        if (!reg->present) {
+            printf("  %-28s 0x%03x  %lu reads, %lu writes to an undecoded address\n",
+                   driver_reg_name(i * 4), i * 4, access[i].reads, access[i].writes);
+            bad++;
+        } else if (access[i].writes && !reg->writable) {
+            printf("  %-28s 0x%03x  %lu writes to read-only %s\n",
+                   driver_reg_name(i * 4), i * 4, access[i].writes, reg->name);
+            bad++;
+        } else if (access[i].reads && !reg->readable) {
+            printf("  %-28s 0x%03x  %lu reads of write-only %s\n",
+                   driver_reg_name(i * 4), i * 4, access[i].reads, reg->name);
+            bad++;
+        }
+    }
+
+    printf("register accesses: %u addresses disagree with the RTL\n", bad);
+    return bad ? -EINVAL : 0;
+}
+
+static int open_bridge(const struct cosim_config *cfg)
+{
+    struct cosim_options opts = {
+        .wave_path = cfg->wave_path,
+        .pcie_period_ps = 8000,
+        .read_latency_ns = 800,
+        .completion_ns = 800,
+    };
+
+    cosim_host_reset();
+    cosim_reset_reg_accesses();
+    cosim_reset_irq_stats();
+    return cosim_bridge_open(&opts);
+}
+
+static void card_init(struct cosim_card *card)
+{
+    int dir;
+
+    memset(card, 0, sizeof(*card));
+    card->pci.dev.name = DRIVER_NAME;
+    card->chip.pci = &card->pci;
+    card->chip.reg_base = cosim_bar0();
+    spin_lock_init(&card->chip.reg_lock);
+    spin_lock_init(&card->chip.pb_lock);
+    spin_lock_init(&card->chip.cap_lock);
+
+    for (dir = 0; dir < 2; dir++) {
+        card->substream[dir].stream = dir;
+        card->substream[dir].runtime = &card->runtime[dir];
+        card->substream[dir].private_data = &card->chip;
+    }
+}
+
+static void fill_params(const struct cosim_config *cfg, struct snd_pcm_hw_params *params)
+{
+    params->format = SNDRV_PCM_FORMAT_S32_LE;
+    params->physical_width = 32;
+    params->channels = cfg->channels;
+    params->rate = cfg->rate;
+    params->period_size = cfg->period_frames;
+    params->periods = cfg->periods;
+}
+
+static u64 frames_to_ns(const struct cosim_config *cfg, u64 frames)
+{
+    return frames * 1000000000ULL / cfg->rate;
+}
+
+/*
+ * The cascade loaded twice, so both coefficient banks are written and
+ * switched to, the second time one section longer on channel 0
+ */
+static int load_eq(struct pcie_audio *chip, unsigned int sections)
+{
+    unsigned int ch, s;
+    int err;
+
+    for (ch = 0; ch < EQ_CHANNELS; ch++) {
+        chip->eq[ch].sections = cpu_to_le32(sections);
+        for (s = 0; s < sections; s++) {
+            /* Lowpass, poles at 0.5 +- 0.25j, unity gain at DC */
+            chip->eq[ch].coef[s][0] = cpu_to_le32(EQ_UNITY / 64 * 5);
+            chip->eq[ch].coef[s][1] = cpu_to_le32(EQ_UNITY / 32 * 5);
+            chip->eq[ch].coef[s][2] = cpu_to_le32(EQ_UNITY / 64 * 5);
+            chip->eq[ch].coef[s][3] = cpu_to_le32(-EQ_UNITY);
+            chip->eq[ch].coef[s][4] = cpu_to_le32(EQ_UNITY / 16 * 5);
+        }
+    }
+
+    err = pcie_audio_load_eq(chip);
+    if (err || sections == EQ_MAX_SECTIONS)
+        return err;
+    chip->eq[0].coef[sections][0] = cpu_to_le32(EQ_UNITY / 2);
+    chip->eq[0].sections = cpu_to_le32(sections + 1);
+    return pcie_audio_load_eq(chip);
+}
+
+/*
+ * A decaying impulse response on every channel, FIR_COEF_FRAC fractional
+ * bits, through the driver's path: reordered for the lanes and DMA'd
+ */
+static int load_fir(struct pcie_audio *chip, const struct cosim_config *cfg)
+{
+    unsigned int channels = cfg->channels, taps = cfg->fir_taps;
+    __le32 *coefs = calloc((size_t)channels * taps, sizeof(*coefs));
+    unsigned int ch, tap;
+    int err;
+
+    if (!coefs)
+        return -ENOMEM;
+    for (ch = 0; ch < channels; ch++)
+        for (tap = 0; tap < taps; tap++)
+            coefs[ch * taps + tap] = cpu_to_le32((1 << 22) >> (tap / 16 + ch % 4));
+
+    err = pcie_audio_set_fir(chip, channels, taps, coefs, cfg->rate);
+    free(coefs);
+    return err;
+}
+
+/* A Hann-windowed analyzer on the first output channel, one block a spectrum */
+static int set_spectrum(struct pcie_audio *chip, const struct cosim_config *cfg)
+{
+    struct pcie_audio_spectrum_config spectrum = {
+        .source = cpu_to_le32(SPEC_SOURCE_OUTPUT),
+        .size = cpu_to_le32(cfg->spectrum_size),
+        .window = cpu_to_le32(SPEC_WINDOW_HANN),
+        .average = cpu_to_le32(1),
+    };
+
+    return pcie_audio_set_spectrum(chip, &spectrum);
+}
+
+/* The newest spectrum, through the driver's read of the slots */
+static int check_spectrum(struct pcie_audio *chip, const struct cosim_config *cfg)
+{
+    unsigned int bins = cfg->spectrum_size / 2;
+    __le32 *buf = calloc(bins, sizeof(*buf));
+    u32 sequence;
+    int err;
+
+    if (!buf)
+        return -ENOMEM;
+    err = pcie_audio_read_spectrum(chip, buf, &sequence);
+    if (!err)
+        printf("  spectrum %u of %u bins read\n", sequence, bins);
+    else
+        printf("  no spectrum read: %d\n", err);
+    free(buf);
+    return err;
+}
+
+static int run_stream(const struct cosim_config *cfg)
+{
+    const struct snd_pcm_ops *ops = &pcie_audio_pcm_ops;
+    struct cosim_card card;
+    struct cosim_bridge_stats stats;
+    struct cosim_irq_stats irq;
+    struct snd_pcm_hw_params params;
+    struct snd_pcm_substream *substream;
+    struct snd_pcm_runtime *runtime;
+    snd_pcm_uframes_t pos, last_pos = 0;
+    u64 advanced = 0, slice_ns;
+    unsigned int i, step, steps;
+    int err, failures = 0;
+
+    if (open_bridge(cfg))
+        return -EIO;
+    card_init(&card);
+
+    substream = &card.substream[cfg->capture ? SNDRV_PCM_STREAM_CAPTURE
+                                             : SNDRV_PCM_STREAM_PLAYBACK];
+    runtime = substream->runtime;
+    fill_params(cfg, &params);
+    if (cfg->capture) {
+        substream->number = cfg->context;
+        card.chip.capture[cfg->context].channel_mask = cfg->channel_mask;
+    }
+
+    err = pcie_audio_init_hw(&card.chip);
+    if (!err)
+        err = pcie_audio_setup_irq(&card.chip);
+    if (!err)
+        err = ops->open(substream);
+    if (!err)
+        err = cosim_pcm_hw_params(ops, substream, &params);
+    if (!err)
+        err = ops->prepare(substream);
+    if (!err && cfg->eq_sections)
+        err = load_eq(&card.chip, cfg->eq_sections);
+    if (!err && cfg->fir_taps)
+        err = load_fir(&card.chip, cfg);
+    if (!err && cfg->spectrum_size)
+        err = set_spectrum(&card.chip, cfg);
+    if (err) {
+        printf("stream setup failed: %d\n", err);
+        cosim_bridge_close();
+        return err;
+    }
+
+    /* Ramp on every channel so landed data can be recognised */
+    if (!cfg->capture) {
+        u32 *samples = (u32 *)runtime->dma_area;
+        for (i = 0; i < runtime->dma_bytes / 4; i++)
+            samples[i] = i << 8;
+    }
+
+    ops->trigger(substream, SNDRV_PCM_TRIGGER_START);
+
+    /* Sample the pointer eight times per period */
+    steps = cfg->run_periods * 8;
+    slice_ns = frames_to_ns(cfg, cfg->period_frames) / 8;
+    for (step = 0; step < steps; step++) {
+        cosim_run_ns(slice_ns);
+        pos = ops->pointer(substream);
+        if (pos >= runtime->buffer_size) {
+            printf("  pointer %lu outside the %lu frame buffer\n", pos, runtime->buffer_size);
+            failures++;
+            break;
+        }
+        /* The DMA engines report whole descriptors only */
+        if (pos % cfg->period_frames) {
+            printf("  pointer %lu inside a %u frame period\n", pos, cfg->period_frames);
+            failures++;
+            break;
+        }
+        advanced += (pos + runtime->buffer_size - last_pos) % runtime->buffer_size;
+        last_pos = pos;
+    }
+
+    ops->trigger(substream, SNDRV_PCM_TRIGGER_STOP);
+    ops->close(substream);
+    pcie_audio_free_irq(&card.chip);
+
+    cosim_bridge_get_stats(&stats);
+    cosim_get_irq_stats(&irq);
+    printf("%s %u Hz, %u x %u frames, %u periods run:\n",
+           cfg->capture ? "capture" : "playback", cfg->rate,
+           cfg->periods, cfg->period_frames, cfg->run_periods);
+    printf("  pointer advanced %llu frames, %lu periods elapsed, %lu xruns\n",
+           (unsigned long long)advanced, runtime->periods_elapsed, runtime->xruns);
+    printf("  %lu interrupts (%lu spurious), %llu DMA read / %llu write bursts, %llu faults\n",
+           irq.count, irq.spurious,
+           (unsigned long long)stats.dma_read_bursts,
+           (unsigned long long)stats.dma_write_bursts,
+           (unsigned long long)stats.dma_faults);
+    printf("  %llu register reads, %llu writes\n",
+           (unsigned long long)stats.reg_reads, (unsigned long long)stats.reg_writes);
+
+    if (runtime->periods_elapsed + 1 < cfg->run_periods) {
+        printf("  expected %u period interrupts\n", cfg->run_periods);
+        failures++;
+    }
+    if (advanced + cfg->period_frames < (u64)cfg->run_periods * cfg->period_frames) {
+        printf("  pointer fell behind the stream\n");
+        failures++;
+    }
+    if (runtime->xruns || stats.dma_faults) {
+        printf("  xruns or DMA faults during a clean run\n");
+        failures++;
+    }
+    if (cfg->spectrum_size && check_spectrum(&card.chip, cfg))
+        failures++;
+    if (rtl_map_loaded && check_accesses())
+        failures++;
+
+    cosim_bridge_close();
+    return failures ? -EINVAL : 0;
+}
+
+struct bench_result {
+    const char *name;
+    unsigned int calls;
+    u64 *wall_ns;               /* Per call */
+    u64 sim_ns;
+    u64 reads;
+    u64 writes;
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+    u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Wall time is reported as median and p99 so a noisy CI host does not skew
+ * it; simulated time is deterministic and reported as a mean */
+static void bench_report(struct bench_result *r)
+{
+    if (!r->calls)
+        return;
+    qsort(r->wall_ns, r->calls, sizeof(u64), cmp_u64);
+    printf("  %-24s %8u %10llu %10llu %10.0f %7.1f %7.1f\n", r->name, r->calls,
+           (unsigned long long)r->wall_ns[r->calls / 2],
+           (unsigned long long)r->wall_ns[(r->calls - 1) * 99 / 100],
+           (double)r->sim_ns / r->calls,
+           (double)r->reads / r->calls, (double)r->writes / r->calls);
+}
+
+#define BENCH(result, iterations, body)                                     \
+    do {                                                                    \
+        struct cosim_bridge_stats before, after;                            \
+        u64 sim = cosim_bridge_time_ns();                                   \
+        unsigned int n;                                                     \
+        cosim_bridge_get_stats(&before);                                    \
+        for (n = 0; n < (iterations); n++) {                                \
+            u64 wall = cosim_wall_ns();                                     \
+            body;                                                           \
+            (result)->wall_ns[n] = cosim_wall_ns() - wall;                  \
+        }                                                                   \
+        cosim_bridge_get_stats(&after);                                     \
+        (result)->calls = (iterations);                                     \
+        (result)->sim_ns = cosim_bridge_time_ns() - sim;                    \
+        (result)->reads = after.reg_reads - before.reg_reads;               \
+        (result)->writes = after.reg_writes - before.reg_writes;            \
+    } while (0)
+
+enum {
+    BENCH_HW_PARAMS,
+    BENCH_TRIGGER,
+    BENCH_POINTER,
+    BENCH_IRQ_IDLE,
+    BENCH_IRQ_PERIOD,
+    NUM_BENCH
+};
+
+static int run_bench(const struct cosim_config *cfg)
+{
+    const struct snd_pcm_ops *ops = &pcie_audio_pcm_ops;
+    struct cosim_card card;
+    struct cosim_irq_stats irq;
+    struct snd_pcm_hw_params params;
+    struct snd_pcm_substream *substream;
+    struct bench_result results[NUM_BENCH] = {
+        [BENCH_HW_PARAMS]  = { .name = "hw_params + prepare" },
+        [BENCH_TRIGGER]    = { .name = "trigger start/stop" },
+        [BENCH_POINTER]    = { .name = "pointer" },
+        [BENCH_IRQ_IDLE]   = { .name = "irq, nothing pending" },
+        [BENCH_IRQ_PERIOD] = { .name = "irq, period elapsed" },
+    };
+    unsigned int i;
+    int err = 0;
+
+    for (i = 0; i < NUM_BENCH; i++) {
+        results[i].wall_ns = calloc(cfg->iterations, sizeof(u64));
+        if (!results[i].wall_ns)
+            err = -ENOMEM;
+    }
+    if (err || open_bridge(cfg)) {
+        err = err ? err : -EIO;
+        goto out;
+    }
+
+    card_init(&card);
+    substream = &card.substream[SNDRV_PCM_STREAM_PLAYBACK];
+    fill_params(cfg, &params);
+
+    if (pcie_audio_init_hw(&card.chip) || pcie_audio_setup_irq(&card.chip) ||
+        ops->open(substream)) {
+        err = -EIO;
+        goto close;
+    }
+
+    /* Warm up caches and the allocator before measuring */
+    for (i = 0; i < cfg->iterations / 10; i++) {
+        cosim_pcm_hw_params(ops, substream, &params);
+        ops->prepare(substream);
+    }
+
+    BENCH(&results[BENCH_HW_PARAMS], cfg->iterations, {
+        cosim_pcm_hw_params(ops, substream, &params);
+        ops->prepare(substream);
+    });
+    BENCH(&results[BENCH_TRIGGER], cfg->iterations, {
+        ops->trigger(substream, SNDRV_PCM_TRIGGER_START);
+        ops->trigger(substream, SNDRV_PCM_TRIGGER_STOP);
+    });
+
+    /* Handler cost with real completions, as delivered while streaming */
+    ops->prepare(substream);
+    ops->trigger(substream, SNDRV_PCM_TRIGGER_START);
+    cosim_reset_irq_stats();
+    cosim_run_ns(frames_to_ns(cfg, (u64)cfg->run_periods * cfg->period_frames));
+    cosim_get_irq_stats(&irq);
+
+    BENCH(&results[BENCH_POINTER], cfg->iterations, ops->pointer(substream));
+    ops->trigger(substream, SNDRV_PCM_TRIGGER_STOP);
+
+    /* The first call clears whatever is still pending */
+    cosim_raise_irq();
+    BENCH(&results[BENCH_IRQ_IDLE], cfg->iterations, cosim_raise_irq());
+
+    ops->close(substream);
+    pcie_audio_free_irq(&card.chip);
+
+    printf("%u iterations, per call:\n", cfg->iterations);
+    printf("  %-24s %8s %10s %10s %10s %7s %7s\n", "operation", "calls",
+           "wall p50", "wall p99", "sim ns", "reads", "writes");
+    for (i = 0; i < BENCH_IRQ_PERIOD; i++)
+        bench_report(&results[i]);
+    if (irq.count)
+        printf("  %-24s %8lu %10llu %10llu %10.0f\n", results[BENCH_IRQ_PERIOD].name,
+               irq.count, (unsigned long long)(irq.wall_ns / irq.count),
+               (unsigned long long)irq.max_wall_ns, (double)irq.sim_ns / irq.count);
+    else
+        printf("  %-24s no interrupts in %u periods\n",
+               results[BENCH_IRQ_PERIOD].name, cfg->run_periods);
+
+close:
+    cosim_bridge_close();
+out:
+    for (i = 0; i < NUM_BENCH; i++)
+        free(results[i].wall_ns);
+    return err;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s regmap|stream|bench [options]\n"
+            "  --regmap FILE     register map written by audio.AudioPCIeCosim\n"
+            "  --waves FILE      dump an FST trace (needs a WAVES=1 build)\n"
+            "  --rate HZ         sample rate (48000)\n"
+            "  --channels N      channels (8)\n"
+            "  --period FRAMES   period size (1024)\n"
+            "  --periods N       periods per buffer (4)\n"
+            "  --run N           periods to stream (16)\n"
+            "  --iterations N    bench iterations (1000)\n"
+            "  --capture         stream capture instead of playback\n"
+            "  --context N       capture substream, its DMA context (0)\n"
+            "  --mask M          channels the capture context records (0: the first)\n"
+            "  --eq N            load an output EQ of N biquads per channel first\n"
+            "  --fir N           load an output FIR of N taps per channel first\n"
+            "  --spectrum N      analyze output channel 0 in N-point spectra\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "regmap",     required_argument, NULL, 'm' },
+        { "waves",      required_argument, NULL, 'w' },
+        { "rate",       required_argument, NULL, 'r' },
+        { "channels",   required_argument, NULL, 'c' },
+        { "period",     required_argument, NULL, 'p' },
+        { "periods",    required_argument, NULL, 'n' },
+        { "run",        required_argument, NULL, 'u' },
+        { "iterations", required_argument, NULL, 'i' },
+        { "capture",    no_argument,       NULL, 'C' },
+        { "context",    required_argument, NULL, 'x' },
+        { "mask",       required_argument, NULL, 'k' },
+        { "eq",         required_argument, NULL, 'e' },
+        { "fir",        required_argument, NULL, 'f' },
+        { "spectrum",   required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 }
+    };
+    struct cosim_config cfg = {
+        .rate = 48000,
+        .channels = 8,
+        .period_frames = 1024,
+        .periods = 4,
+        .run_periods = 16,
+        .iterations = 1000,
+    };
+    const char *cmd;
+    int opt, err;
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    cmd = argv[1];
+    optind = 2;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'm': cfg.regmap_path = optarg; break;
+        case 'w': cfg.wave_path = optarg; break;
+        case 'r': cfg.rate = strtoul(optarg, NULL, 0); break;
+        case 'c': cfg.channels = strtoul(optarg, NULL, 0); break;
+        case 'p': cfg.period_frames = strtoul(optarg, NULL, 0); break;
+        case 'n': cfg.periods = strtoul(optarg, NULL, 0); break;
+        case 'u': cfg.run_periods = strtoul(optarg, NULL, 0); break;
+        case 'i': cfg.iterations = strtoul(optarg, NULL, 0); break;
+        case 'C': cfg.capture = true; break;
+        case 'x': cfg.context = strtoul(optarg, NULL, 0); break;
+        case 'k': cfg.channel_mask = strtoul(optarg, NULL, 0); break;
+        case 'e': cfg.eq_sections = strtoul(optarg, NULL, 0); break;
+        case 'f': cfg.fir_taps = strtoul(optarg, NULL, 0); break;
+        case 's': cfg.spectrum_size = strtoul(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (cfg.context >= CAP_CONTEXTS || cfg.eq_sections > EQ_MAX_SECTIONS) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (cfg.regmap_path && load_rtl_map(cfg.regmap_path))
+        return 1;
+
+    if (!strcmp(cmd, "regmap"))
+        err = rtl_map_loaded ? check_static_map() : -EINVAL;
+    else if (!strcmp(cmd, "stream"))
+        err = run_stream(&cfg);
+    else if (!strcmp(cmd, "bench"))
+        err = run_bench(&cfg);
+    else {
+        usage(argv[0]);
+        return 2;
+    }
+
+    return err ? 1 : 0;
+}
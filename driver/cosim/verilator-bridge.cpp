@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "verilated.h"
+#if VM_TRACE
+#include "verilated_fst_c.h"
+#endif
+#include "VAudioPCIeTop.h"
+#include "VAudioPCIeTop___024root.h"
+
+#include "cosim-bridge.h"
+
+namespace {
+
+/*
+ * The DMA engine's AXI master is not brought out to top-level pins (there is
+ * no AXI-to-PCIe bridge in the RTL yet), so the model is verilated with
+ * --public-flat-rw and the bridge drives the engine's port directly.
+ */
+#define AXI(sig) (top->rootp->AudioPCIeTop__DOT__dmaEngine_io_axi_##sig)
+
+/* Both oscillators of a board: 256 fs for the 44.1 kHz and 48 kHz families */
+constexpr double MCLK_44K1_HZ = 11289600.0;
+constexpr double MCLK_48K_HZ = 12288000.0;
+
+constexpr unsigned BEAT_BYTES = 16;
+constexpr unsigned RESET_CYCLES = 16;
+
+/* TLP header fields of the BAR0 requests, see BarDecoder.scala */
+constexpr uint32_t TLP_MRD_3DW = 0x0u << 29;
+constexpr uint32_t TLP_MWR_3DW = 0x2u << 29;
+constexpr unsigned CPL_HEADER_DWORDS = 3;
+
+struct Burst {
+    uint64_t addr;
+    unsigned beats;
+    unsigned beat;
+    uint64_t readyPs;
+    bool fault;
+};
+
+class Bridge {
+public:
+    explicit Bridge(const cosim_options &opts)
+        : top(new VAudioPCIeTop(&ctx)),
+          periodPs(opts.pcie_period_ps ? opts.pcie_period_ps : 8000),
+          readLatencyPs(uint64_t(opts.read_latency_ns) * 1000),
+          completionPs(uint64_t(opts.completion_ns) * 1000)
+    {
+        mclk44k1.halfPs = 1e12 / MCLK_44K1_HZ / 2;
+        mclk48k.halfPs = 1e12 / MCLK_48K_HZ / 2;
+        mclk44k1.next = mclk44k1.halfPs;
+        mclk48k.next = mclk48k.halfPs;
+
+#if VM_TRACE
+        if (opts.wave_path) {
+            ctx.traceEverOn(true);
+            trace.reset(new VerilatedFstC);
+            top->trace(trace.get(), 99);
+            trace->open(opts.wave_path);
+        }
+#endif
+
+        top->clk = 0;
+        top->reset = 1;
+        top->io_pcie_cfg_read = 0;
+        top->io_pcie_cfg_write = 0;
+        top->io_pcie_rx_valid = 0;
+        top->io_pcie_tx_ready = 0;
+        top->io_pcie_completerId = 0;
+        top->io_audio_mclk44k1 = 0;
+        top->io_audio_mclk48k = 0;
+        top->eval();
+        for (unsigned i = 0; i < RESET_CYCLES; i++)
+            tick();
+        top->reset = 0;
+        tick();
+    }
+
+    ~Bridge()
+    {
+        top->final();
+#if VM_TRACE
+        if (trace)
+            trace->close();
+#endif
+    }
+
+    void readBlock(uint32_t offset, uint32_t *buf, unsigned count)
+    {
+        stats.reg_reads++;
+        std::vector<uint32_t> request = header(TLP_MRD_3DW, offset, count);
+        send(request);
+
+        // Non-posted: the CPU stalls for the completion round trip, of which
+        // the card's part is simulated and the link's is read_latency_ns
+        std::vector<uint32_t> completion = receive();
+        for (unsigned i = 0; i < count; i++)
+            buf[i] = CPL_HEADER_DWORDS + i < completion.size() ?
+                     completion[CPL_HEADER_DWORDS + i] : ~0u;
+        advancePs(readLatencyPs);
+    }
+
+    void write(uint32_t offset, uint32_t val)
+    {
+        stats.reg_writes++;
+        std::vector<uint32_t> request = header(TLP_MWR_3DW, offset, 1);
+        request.push_back(val);
+        send(request);
+    }
+
+    void advancePs(uint64_t ps)
+    {
+        uint64_t end = now + ps;
+
+        while (now < end)
+            tick();
+    }
+
+    uint64_t timePs() const { return now; }
+    bool irq() const { return top->io_interrupt; }
+
+    cosim_bridge_stats stats{};
+
+private:
+    std::vector<uint32_t> header(uint32_t fmt, uint32_t offset, unsigned count)
+    {
+        tag = (tag + 1) & 0xff;
+        return {
+            fmt | count,
+            tag << 8 | (count > 1 ? 0xf0u : 0) | 0xf,
+            offset & ~3u,
+        };
+    }
+
+    // DWORDs four to a 128-bit beat on rx, DW0 in the low bits
+    void send(const std::vector<uint32_t> &dwords)
+    {
+        for (size_t at = 0; at < dwords.size(); at += 4) {
+            size_t n = std::min<size_t>(4, dwords.size() - at);
+
+            for (unsigned i = 0; i < 4; i++)
+                top->io_pcie_rx_data[i] = i < n ? dwords[at + i] : 0;
+            top->io_pcie_rx_keepBits = (1u << (4 * n)) - 1;
+            top->io_pcie_rx_last = at + 4 >= dwords.size();
+            top->io_pcie_rx_valid = 1;
+            top->eval();
+            while (!top->io_pcie_rx_ready)
+                tick();
+            tick();
+        }
+        top->io_pcie_rx_valid = 0;
+    }
+
+    std::vector<uint32_t> receive()
+    {
+        std::vector<uint32_t> dwords;
+        bool last = false;
+
+        top->io_pcie_tx_ready = 1;
+        while (!last) {
+            top->eval();
+            if (top->io_pcie_tx_valid) {
+                for (unsigned i = 0; i < 4; i++) {
+                    if (top->io_pcie_tx_keepBits & (0xfu << (4 * i)))
+                        dwords.push_back(top->io_pcie_tx_data[i]);
+                }
+                last = top->io_pcie_tx_last;
+            }
+            tick();
+        }
+        top->io_pcie_tx_ready = 0;
+        return dwords;
+    }
+
+    struct AudioClock {
+        double halfPs;
+        double next;
+    };
+
+    void dump()
+    {
+#if VM_TRACE
+        if (trace)
+            trace->dump(ctx.time());
+#endif
+    }
+
+    void audioEdgesUntil(uint64_t ps)
+    {
+        for (;;) {
+            AudioClock &clk = mclk44k1.next <= mclk48k.next ? mclk44k1 : mclk48k;
+
+            if (clk.next > ps)
+                break;
+            ctx.time(uint64_t(clk.next));
+            if (&clk == &mclk44k1)
+                top->io_audio_mclk44k1 = !top->io_audio_mclk44k1;
+            else
+                top->io_audio_mclk48k = !top->io_audio_mclk48k;
+            top->eval();
+            dump();
+            clk.next += clk.halfPs;
+        }
+    }
+
+    // One user clock cycle: falling edge, then rising edge at the cycle end
+    void tick()
+    {
+        audioEdgesUntil(now + periodPs / 2);
+        ctx.time(now + periodPs / 2);
+        top->clk = 0;
+        top->eval();
+        dump();
+
+        now += periodPs;
+        audioEdgesUntil(now);
+        ctx.time(now);
+        sampleAxi();
+        top->clk = 1;
+        top->eval();
+        driveAxi();
+        top->eval();
+        dump();
+    }
+
+    // Handshakes completed by the rising edge, from pre-edge values
+    void sampleAxi()
+    {
+        if (AXI(ar_valid) && AXI(ar_ready)) {
+            Burst burst{AXI(ar_addr), unsigned(AXI(ar_len)) + 1, 0, now + completionPs, false};
+            burst.fault = !cosim_host_ptr(burst.addr, burst.beats * BEAT_BYTES);
+            stats.dma_read_bursts++;
+            stats.dma_faults += burst.fault;
+            reads.push_back(burst);
+        }
+        if (AXI(r_valid) && AXI(r_ready) && !reads.empty()) {
+            if (++reads.front().beat == reads.front().beats)
+                reads.pop_front();
+        }
+
+        if (AXI(aw_valid) && AXI(aw_ready)) {
+            Burst burst{AXI(aw_addr), unsigned(AXI(aw_len)) + 1, 0, 0, false};
+            burst.fault = !cosim_host_ptr(burst.addr, burst.beats * BEAT_BYTES);
+            stats.dma_write_bursts++;
+            stats.dma_faults += burst.fault;
+            writes.push_back(burst);
+        }
+        if (AXI(w_valid) && AXI(w_ready) && !writes.empty()) {
+            Burst &burst = writes.front();
+            if (!burst.fault) {
+                uint8_t *dst = static_cast<uint8_t *>(
+                    cosim_host_ptr(burst.addr + burst.beat * BEAT_BYTES, BEAT_BYTES));
+                for (unsigned i = 0; i < BEAT_BYTES; i++) {
+                    if (AXI(w_strb) & (1u << i))
+                        dst[i] = AXI(w_data)[i / 4] >> (8 * (i % 4));
+                }
+            }
+            if (++burst.beat == burst.beats || AXI(w_last)) {
+                pendingResponses.push_back(burst.fault);
+                writes.pop_front();
+            }
+        }
+        if (AXI(b_valid) && AXI(b_ready) && !pendingResponses.empty())
+            pendingResponses.pop_front();
+    }
+
+    void driveAxi()
+    {
+        AXI(ar_ready) = 1;
+        AXI(aw_ready) = 1;
+        AXI(w_ready) = 1;
+
+        bool rValid = !reads.empty() && reads.front().readyPs <= now;
+        AXI(r_valid) = rValid;
+        if (rValid) {
+            const Burst &burst = reads.front();
+            const uint8_t *src = burst.fault ? nullptr : static_cast<const uint8_t *>(
+                cosim_host_ptr(burst.addr + burst.beat * BEAT_BYTES, BEAT_BYTES));
+            for (unsigned word = 0; word < BEAT_BYTES / 4; word++) {
+                uint32_t val = 0;
+                if (src)
+                    std::memcpy(&val, src + word * 4, 4);
+                AXI(r_data)[word] = val;
+            }
+            AXI(r_last) = burst.beat == burst.beats - 1;
+            AXI(r_resp) = burst.fault ? 2 : 0; // SLVERR
+        }
+
+        AXI(b_valid) = !pendingResponses.empty();
+        AXI(b_resp) = !pendingResponses.empty() && pendingResponses.front() ? 2 : 0;
+    }
+
+    VerilatedContext ctx;
+    std::unique_ptr<VAudioPCIeTop> top;
+#if VM_TRACE
+    std::unique_ptr<VerilatedFstC> trace;
+#endif
+
+    uint64_t periodPs;
+    uint64_t readLatencyPs;
+    uint64_t completionPs;
+    uint64_t now = 0;
+    uint32_t tag = 0;
+    AudioClock mclk44k1{};
+    AudioClock mclk48k{};
+
+    std::deque<Burst> reads;
+    std::deque<Burst> writes;
+    std::deque<bool> pendingResponses;
+};
+
+std::unique_ptr<Bridge> bridge;
+
+} // namespace
+
+extern "C" {
+
+int cosim_bridge_open(const struct cosim_options *opts)
+{
+    if (bridge)
+        return -1;
+    bridge.reset(new Bridge(*opts));
+    return 0;
+}
+
+void cosim_bridge_close(void)
+{
+    bridge.reset();
+}
+
+uint32_t cosim_bridge_read(uint32_t offset)
+{
+    uint32_t val;
+
+    bridge->readBlock(offset, &val, 1);
+    return val;
+}
+
+void cosim_bridge_read_block(uint32_t offset, uint32_t *buf, unsigned int count)
+{
+    bridge->readBlock(offset, buf, count);
+}
+
+void cosim_bridge_write(uint32_t offset, uint32_t val)
+{
+    bridge->write(offset, val);
+}
+
+void cosim_bridge_advance_ns(uint64_t ns)
+{
+    bridge->advancePs(ns * 1000);
+}
+
+uint64_t cosim_bridge_time_ns(void)
+{
+    return bridge->timePs() / 1000;
+}
+
+bool cosim_bridge_irq(void)
+{
+    return bridge->irq();
+}
+
+void cosim_bridge_get_stats(struct cosim_bridge_stats *stats)
+{
+    *stats = bridge->stats;
+}
+
+} // extern "C"
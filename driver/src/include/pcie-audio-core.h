@@ -0,0 +1,192 @@
+#ifndef __PCIE_AUDIO_CORE_H
+#define __PCIE_AUDIO_CORE_H
+
+/*
+ * Pure driver logic: no register access, locking or ALSA state, so it can
+ * be unit tested (see pcie-audio-core-test.c) and benchmarked on its own.
+ */
+
+#include <linux/types.h>
+#include "pcie-audio-regs.h"
+
+/* DMA descriptor structure */
+struct pcie_audio_dma_desc {
+    __le64 address;    /* Buffer physical address */
+    __le32 length;     /* Buffer length in bytes */
+    __le32 flags;      /* Control flags */
+    __le64 next;       /* Next descriptor physical address */
+} __packed;
+
+/* DMA descriptor flags */
+#define DESC_FLAG_INT      (1 << 0)    /* Generate interrupt */
+#define DESC_FLAG_LAST     (1 << 1)    /* Last descriptor in chain */
+#define DESC_FLAG_WRAP     (1 << 2)    /* Wrap to start of ring */
+#define DESC_FLAG_OWNED    (1 << 31)   /* Owned by hardware */
+
+/* Bits of REG_STATUS_PB_UNDERRUN / REG_STATUS_CAP_OVERRUN, same layout */
+#define STATUS_XRUN        STATUS_PB_UNDERRUN_XRUN
+#define STATUS_PERIOD      STATUS_PB_UNDERRUN_PERIOD
+#define STATUS_LOW         STATUS_PB_UNDERRUN_LOW
+#define STATUS_HIGH        STATUS_PB_UNDERRUN_HIGH
+
+/* Bits of REG_STATUS_DMA_ERROR */
+#define DMA_ERROR_PB       STATUS_DMA_ERROR_PB
+#define DMA_ERROR_CAP      STATUS_DMA_ERROR_CAP
+
+/* Events decoded from the interrupt status registers */
+#define PCIE_AUDIO_EV_PB_PERIOD     (1 << 0)
+#define PCIE_AUDIO_EV_PB_XRUN       (1 << 1)
+#define PCIE_AUDIO_EV_CAP_PERIOD    (1 << 2)
+#define PCIE_AUDIO_EV_CAP_XRUN      (1 << 3)
+#define PCIE_AUDIO_EV_PB_DMA_ERROR  (1 << 4)
+#define PCIE_AUDIO_EV_CAP_DMA_ERROR (1 << 5)
+#define PCIE_AUDIO_EV_PB_NEAR_XRUN  (1 << 6)    /* Low watermark */
+#define PCIE_AUDIO_EV_CAP_NEAR_XRUN (1 << 7)    /* High watermark */
+
+/* FIFO watermark defaults, armed on the xrun side of each FIFO */
+#define WM_MARGIN_DIV               4           /* Of the FIFO depth */
+#define WM_HYSTERESIS_DIV           8
+#define WM_HOLDOFF                  488         /* ~1 ms of 256 cycles at 125 MHz */
+
+/* PrefetchScheduler: one burst of guard beyond the measured lead */
+#define PREFETCH_BURST_FRAMES       32          /* PCIE_AUDIO_MAX_BURST / 16 */
+#define PREFETCH_GUARD_FRAMES       PREFETCH_BURST_FRAMES
+
+/*
+ * Capture DMA contexts, one capture substream each (DMAEngine.captureContexts).
+ * Context 0 is the DMA_CAP block, n >= 1 the DMA_CAPn blocks, which share
+ * one layout and the bits of REG_DMA_CAP1_CTRL.
+ */
+#define CAP_CONTEXTS                4
+#define CAP_CONTEXT_STRIDE          (REG_DMA_CAP2_DESC_BASE - REG_DMA_CAP1_DESC_BASE)
+#define CAP_CONTEXT_PERIOD(n)       BIT(n)          /* REG_STATUS_CAP_CONTEXTS */
+#define CAP_CONTEXT_ERROR(n)        BIT(8 + (n))
+
+/* REG_DMA_CAP_ROUTE format, CapturePacker */
+#define CAP_ROUTE_S32               0
+#define CAP_ROUTE_S16               1
+
+/* The registers of one capture context */
+struct pcie_audio_cap_regs {
+    unsigned int desc_base;
+    unsigned int desc_count;
+    unsigned int current_desc;
+    unsigned int size;
+    unsigned int route;
+    unsigned int desc_active;
+    unsigned int ctrl;          /* REG_DMA_CAPn_CTRL, 0 for context 0 */
+};
+
+/*
+ * Output EQ, BiquadBank: up to EQ_MAX_SECTIONS biquads per channel, each
+ * y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2 with Q2.30 coefficients. The
+ * "Output EQ" bytes control of a channel holds its cascade in this layout.
+ */
+#define EQ_CHANNELS                 8           /* BiquadBank.maxChannels */
+#define EQ_MAX_SECTIONS             8
+#define EQ_COEFS                    5           /* b0, b1, b2, a1, a2 */
+#define EQ_UNITY                    BIT(30)     /* 1.0 in Q2.30 */
+#define EQ_SWITCH_TIMEOUT_US        2000        /* Bank switch, a frame plus the CDC */
+
+struct pcie_audio_eq_channel {
+    __le32 sections;                            /* 0 = unfiltered */
+    __le32 coef[EQ_MAX_SECTIONS][EQ_COEFS];
+} __packed;
+
+/*
+ * Output FIR, FirEngine: FIR_CAPS_LANES multipliers share the taps of the
+ * filtered channels, FIR_CAPS_DEPTH words of BRAM each. Every frame has to
+ * fit in the MCLK cycles of one frame period, see
+ * pcie_audio_fir_max_taps(). Coefficients are Q1.23, sign extended to 32
+ * bits, and are loaded by DMA in the engine's order, see
+ * pcie_audio_fir_index().
+ */
+#define FIR_MAX_CHANNELS            16          /* FirEngine.maxChannels */
+#define FIR_CHANNEL_OVERHEAD        4           /* FirEngine.channelOverhead */
+#define FIR_NOMINAL_MCLK            45158400    /* Slower MCLK, while unmeasured */
+#define FIR_LOAD_TIMEOUT_US         10000
+
+/* "Output FIR" control: this header, then taps coefficients per channel */
+struct pcie_audio_fir_header {
+    __le32 channels;                            /* The first ones, 0 = off */
+    __le32 taps;                                /* A multiple of the lanes */
+} __packed;
+
+/*
+ * Spectrum analyzer, SpectrumAnalyzer: size points of one input or output
+ * channel, windowed and transformed, the power of bins 0 .. size / 2 - 1
+ * averaged over average blocks. Each spectrum is written by DMA as IEEE
+ * singles relative to full scale squared, a full-scale sine on a bin
+ * reading 0.25, to the two slots at REG_SPEC_BASE in turn; see
+ * pcie_audio_spectrum_slot().
+ */
+#define SPEC_MIN_SIZE               256         /* 2^SpectrumAnalyzer.minSizeLog2 */
+#define SPEC_MAX_AVERAGE            128
+#define SPEC_SOURCE_INPUT           0
+#define SPEC_SOURCE_OUTPUT          1           /* After EQ and FIR */
+#define SPEC_WINDOW_RECTANGULAR     0
+#define SPEC_WINDOW_HANN            1
+#define SPEC_WINDOW_BLACKMAN_HARRIS 2
+#define SPEC_SLOT_BYTES(caps)       (2U << FIELD_GET(SPEC_CAPS_MASK, caps))
+
+/* "Spectrum Analyzer" control */
+struct pcie_audio_spectrum_config {
+    __le32 source;                              /* SPEC_SOURCE_* */
+    __le32 channel;
+    __le32 size;                                /* Points, 0 = off */
+    __le32 window;                              /* SPEC_WINDOW_* */
+    __le32 average;                             /* Blocks per spectrum */
+} __packed;
+
+/* Its TLV read: this header, then bins floats, bin k at k x rate / size Hz */
+struct pcie_audio_spectrum_header {
+    __le32 sequence;                            /* SPEC_STATUS_COUNT */
+    __le32 bins;
+} __packed;
+
+/*
+ * The serializer registers of a PCM stream: two channels as I2S, more as
+ * TDM, the slots always counting the stream's channels
+ */
+struct pcie_audio_format {
+    u32 format;                 /* REG_CTRL_FORMAT */
+    u32 bitdepth;               /* REG_CTRL_I2S_BITDEPTH */
+    u32 tdm;                    /* REG_CTRL_I2S_TDM */
+    u32 tdm_slots;              /* REG_CTRL_I2S_TDM_SLOTS */
+};
+
+int pcie_audio_build_ring(struct pcie_audio_dma_desc *ring, unsigned int max_desc,
+                          dma_addr_t ring_dma, dma_addr_t buf,
+                          size_t period_bytes, unsigned int periods);
+int pcie_audio_encode_rate(unsigned int rate, u32 *family, u32 *multi);
+void pcie_audio_encode_format(unsigned int physical_width, unsigned int channels,
+                              struct pcie_audio_format *fmt);
+unsigned long pcie_audio_hw_position(u32 current_desc, size_t period_bytes,
+                                     size_t buffer_bytes, unsigned int frame_bytes);
+unsigned int pcie_audio_hw_delay(unsigned int rate, bool capture);
+unsigned int pcie_audio_decode_irq(u32 pb_status, u32 cap_status, u32 dma_error);
+void pcie_audio_encode_watermark(unsigned int fifo_frames, bool capture,
+                                 u32 *watermark, u32 *filter);
+unsigned int pcie_audio_xrun_margin(u32 fifo_status, unsigned int fifo_frames, bool capture);
+unsigned int pcie_audio_prefetch_delay(u32 prefetch_status);
+int pcie_audio_cap_regs(unsigned int context, struct pcie_audio_cap_regs *regs);
+int pcie_audio_encode_route(unsigned int channels, u32 channel_mask,
+                            unsigned int physical_width, u32 *route);
+unsigned int pcie_audio_context_events(unsigned int events, u32 contexts,
+                                       unsigned int context);
+int pcie_audio_eq_validate(const struct pcie_audio_eq_channel *eq);
+u32 pcie_audio_eq_coef(const struct pcie_audio_eq_channel *eq, unsigned int section,
+                       unsigned int index);
+u32 pcie_audio_eq_coef_addr(unsigned int channel, unsigned int section, unsigned int index);
+u32 pcie_audio_eq_sections(u32 sections, unsigned int channel, unsigned int count);
+unsigned int pcie_audio_fir_max_taps(u32 caps, u32 mclk_hz, unsigned int rate,
+                                     unsigned int channels);
+int pcie_audio_fir_validate(u32 caps, u32 mclk_hz, unsigned int rate,
+                            unsigned int channels, unsigned int taps);
+unsigned int pcie_audio_fir_index(unsigned int channel, unsigned int tap,
+                                  unsigned int taps, unsigned int lanes);
+int pcie_audio_encode_spectrum(const struct pcie_audio_spectrum_config *cfg, u32 caps,
+                               unsigned int channels, u32 *ctrl);
+int pcie_audio_spectrum_slot(u32 status);
+
+#endif /* __PCIE_AUDIO_CORE_H */
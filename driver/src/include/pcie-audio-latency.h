@@ -0,0 +1,15 @@
+/* Generated by audio.LatencyBudget, do not edit */
+#ifndef __PCIE_AUDIO_LATENCY_H
+#define __PCIE_AUDIO_LATENCY_H
+
+/* { rate, playback frames, capture frames } for runtime->delay */
+#define PCIE_AUDIO_DELAY_TABLE { \
+    {  44100, 1894,  155 }, \
+    {  48000, 1894,  155 }, \
+    {  88200, 1894,  155 }, \
+    {  96000, 1894,  155 }, \
+    { 176400, 1894,  155 }, \
+    { 192000, 1894,  155 }, \
+}
+
+#endif /* __PCIE_AUDIO_LATENCY_H */
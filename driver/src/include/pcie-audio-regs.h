@@ -0,0 +1,357 @@
+/* Generated by audio.AudioRegisters, do not edit */
+#ifndef __PCIE_AUDIO_REGS_H
+#define __PCIE_AUDIO_REGS_H
+
+#include <linux/bitfield.h>
+#include <linux/bits.h>
+
+/* Control */
+/* RW: Serial format, AudioFormat */
+#define REG_CTRL_FORMAT                  0x000
+#define   CTRL_FORMAT_MASK               GENMASK(2, 0)
+#define   CTRL_FORMAT_I2S_STANDARD       0
+#define   CTRL_FORMAT_I2S_JUSTIFY_LEFT   1
+#define   CTRL_FORMAT_I2S_JUSTIFY_RIGHT  2
+#define   CTRL_FORMAT_TDM                3
+#define   CTRL_FORMAT_DSD_64             4
+#define   CTRL_FORMAT_DSD_128            5
+#define   CTRL_FORMAT_DSD_256            6
+/* RW: 0 = 44.1 kHz, 1 = 48 kHz family */
+#define REG_CTRL_SAMPLE_FAMILY           0x004
+#define   CTRL_SAMPLE_FAMILY_MASK        BIT(0)
+#define   CTRL_SAMPLE_FAMILY_SF_44K1     0
+#define   CTRL_SAMPLE_FAMILY_SF_48K      1
+/* RW: Rate multiplier - 1 */
+#define REG_CTRL_SAMPLE_MULTI            0x008
+#define   CTRL_SAMPLE_MULTI_MASK         GENMASK(3, 0)
+/* RW: DSD64/128/256 */
+#define REG_CTRL_DSD_MODE                0x00C
+#define   CTRL_DSD_MODE_MASK             GENMASK(1, 0)
+/* RW: 0 = auto, 1 = 44.1k, 2 = 48k */
+#define REG_CTRL_CLOCK_SRC               0x010
+#define   CTRL_CLOCK_SRC_MASK            GENMASK(1, 0)
+/* RW: Card drives BCLK/WS */
+#define REG_CTRL_MASTER_MODE             0x014
+#define   CTRL_MASTER_MODE_MASK          BIT(0)
+/* RW: Playback DMA and serializer */
+#define REG_CTRL_PB_ENABLE               0x018
+#define   CTRL_PB_ENABLE_MASK            BIT(0)
+/* RW: Capture DMA and serializer */
+#define REG_CTRL_CAP_ENABLE              0x01C
+#define   CTRL_CAP_ENABLE_MASK           BIT(0)
+/* RW: Holds the datapath in reset */
+#define REG_CTRL_RESET                   0x020
+#define   CTRL_RESET_MASK                BIT(0)
+/* RW: MCLK in Hz */
+#define REG_CTRL_MCLK_FREQ               0x030
+/* RW: Sample rate in Hz */
+#define REG_CTRL_TARGET_RATE             0x034
+/* RW: Playback FIFO threshold, frames */
+#define REG_CTRL_PB_THRESHOLD            0x038
+#define   CTRL_PB_THRESHOLD_MASK         GENMASK(15, 0)
+/* RW: Capture FIFO threshold, frames */
+#define REG_CTRL_CAP_THRESHOLD           0x03C
+#define   CTRL_CAP_THRESHOLD_MASK        GENMASK(15, 0)
+/* RW: Bits per sample */
+#define REG_CTRL_I2S_BITDEPTH            0x040
+#define   CTRL_I2S_BITDEPTH_MASK         GENMASK(7, 0)
+/* RW: 0 = left, 1 = right, 2 = I2S */
+#define REG_CTRL_I2S_ALIGNMENT           0x044
+#define   CTRL_I2S_ALIGNMENT_MASK        GENMASK(1, 0)
+/* RW: TDM framing */
+#define REG_CTRL_I2S_TDM                 0x048
+#define   CTRL_I2S_TDM_MASK              BIT(0)
+/* RW: TDM slots - 1 */
+#define REG_CTRL_I2S_TDM_SLOTS           0x04C
+#define   CTRL_I2S_TDM_SLOTS_MASK        GENMASK(3, 0)
+/* RW: MCLK divider */
+#define REG_CTRL_MCLK_DIV                0x050
+#define   CTRL_MCLK_DIV_MASK             GENMASK(7, 0)
+/* RW: BCLK divider */
+#define REG_CTRL_BCLK_DIV                0x054
+#define   CTRL_BCLK_DIV_MASK             GENMASK(7, 0)
+/* RW: Clock lock timeout, frames */
+#define REG_CTRL_SYNC_TIMEOUT            0x058
+#define   CTRL_SYNC_TIMEOUT_MASK         GENMASK(15, 0)
+/* RW: Detect the incoming rate */
+#define REG_CTRL_AUTO_RATE               0x05C
+#define   CTRL_AUTO_RATE_MASK            BIT(0)
+
+/* Playback DMA */
+/* RW: Ring bus address */
+#define REG_DMA_PB_DESC_BASE             0x100
+#define REG_DMA_PB_DESC_BASE_HI          0x104
+/* RW: Descriptors in the ring */
+#define REG_DMA_PB_DESC_COUNT            0x108
+#define   DMA_PB_DESC_COUNT_MASK         GENMASK(7, 0)
+/* RO: Descriptor being fetched, all before it done */
+#define REG_DMA_PB_CURRENT               0x10C
+#define   DMA_PB_CURRENT_MASK            GENMASK(7, 0)
+/* RW: Period bytes */
+#define REG_DMA_PB_SIZE                  0x110
+/* RW: Playback interrupts */
+#define REG_DMA_PB_IRQ_EN                0x114
+#define   DMA_PB_IRQ_EN_EVENTS           BIT(0) /* Period and xrun */
+#define   DMA_PB_IRQ_EN_WATERMARK        BIT(1) /* FIFO watermarks */
+/* RW: Refill threshold, bytes */
+#define REG_DMA_PB_THRESHOLD             0x118
+#define   DMA_PB_THRESHOLD_MASK          GENMASK(15, 0)
+/* RW: TX FIFO watermarks, 0 = off */
+#define REG_DMA_PB_WATERMARK             0x11C
+#define   DMA_PB_WATERMARK_LOW           GENMASK(15, 0) /* Frames, event when the level drops below */
+#define   DMA_PB_WATERMARK_HIGH          GENMASK(31, 16) /* Frames, event when the level rises above */
+/* RW: TX FIFO watermark rate limits */
+#define REG_DMA_PB_WM_FILTER             0x120
+#define   DMA_PB_WM_FILTER_HYSTERESIS    GENMASK(15, 0) /* Frames back past a watermark to re-arm it */
+#define   DMA_PB_WM_FILTER_HOLDOFF       GENMASK(31, 16) /* 256-cycle units between events */
+/* RW: Just-in-time refill, PrefetchScheduler */
+#define REG_DMA_PB_PREFETCH              0x124
+#define   DMA_PB_PREFETCH_ENABLE         BIT(0) /* Refill by drain rate and link latency */
+#define   DMA_PB_PREFETCH_GUARD          GENMASK(31, 16) /* Frames kept beyond the computed lead */
+
+/* Capture DMA */
+/* RW: Ring bus address */
+#define REG_DMA_CAP_DESC_BASE            0x200
+#define REG_DMA_CAP_DESC_BASE_HI         0x204
+/* RW: Descriptors in the ring */
+#define REG_DMA_CAP_DESC_COUNT           0x208
+#define   DMA_CAP_DESC_COUNT_MASK        GENMASK(7, 0)
+/* RO: Descriptor being filled, all before it done */
+#define REG_DMA_CAP_CURRENT              0x20C
+#define   DMA_CAP_CURRENT_MASK           GENMASK(7, 0)
+/* RW: Period bytes */
+#define REG_DMA_CAP_SIZE                 0x210
+/* RW: Capture interrupts */
+#define REG_DMA_CAP_IRQ_EN               0x214
+#define   DMA_CAP_IRQ_EN_EVENTS          BIT(0) /* Period and xrun */
+#define   DMA_CAP_IRQ_EN_WATERMARK       BIT(1) /* FIFO watermarks */
+/* RW: Drain threshold, bytes */
+#define REG_DMA_CAP_THRESHOLD            0x218
+#define   DMA_CAP_THRESHOLD_MASK         GENMASK(15, 0)
+/* RW: RX FIFO watermarks, 0 = off */
+#define REG_DMA_CAP_WATERMARK            0x21C
+#define   DMA_CAP_WATERMARK_LOW          GENMASK(15, 0) /* Frames, event when the level drops below */
+#define   DMA_CAP_WATERMARK_HIGH         GENMASK(31, 16) /* Frames, event when the level rises above */
+/* RW: RX FIFO watermark rate limits */
+#define REG_DMA_CAP_WM_FILTER            0x220
+#define   DMA_CAP_WM_FILTER_HYSTERESIS   GENMASK(15, 0) /* Frames back past a watermark to re-arm it */
+#define   DMA_CAP_WM_FILTER_HOLDOFF      GENMASK(31, 16) /* 256-cycle units between events */
+/* RW: Channels written, CapturePacker */
+#define REG_DMA_CAP_ROUTE                0x224
+#define   DMA_CAP_ROUTE_MASK             GENMASK(15, 0) /* Channel n in bit n, 0 = every channel */
+#define   DMA_CAP_ROUTE_FORMAT           GENMASK(17, 16) /* 0 = 32-bit, 1 = 16-bit containers */
+/* RW: Ring bus address */
+#define REG_DMA_CAP1_DESC_BASE           0x240
+#define REG_DMA_CAP1_DESC_BASE_HI        0x244
+/* RW: Descriptors in the ring */
+#define REG_DMA_CAP1_DESC_COUNT          0x248
+#define   DMA_CAP1_DESC_COUNT_MASK       GENMASK(7, 0)
+/* RO: As DMA_CAP_CURRENT */
+#define REG_DMA_CAP1_CURRENT             0x24C
+#define   DMA_CAP1_CURRENT_MASK          GENMASK(7, 0)
+/* RW: Period bytes */
+#define REG_DMA_CAP1_SIZE                0x250
+/* RW: Context control */
+#define REG_DMA_CAP1_CTRL                0x254
+#define   DMA_CAP1_CTRL_ENABLE           BIT(0) /* Context DMA running */
+#define   DMA_CAP1_CTRL_IRQ              BIT(1) /* Period interrupts */
+/* RW: Channels written, CapturePacker */
+#define REG_DMA_CAP1_ROUTE               0x258
+#define   DMA_CAP1_ROUTE_MASK            GENMASK(15, 0) /* Channel n in bit n, 0 = every channel */
+#define   DMA_CAP1_ROUTE_FORMAT          GENMASK(17, 16) /* 0 = 32-bit, 1 = 16-bit containers */
+/* RO: As STATUS_CAP_DESC_ACTIVE */
+#define REG_DMA_CAP1_ACTIVE              0x25C
+#define   DMA_CAP1_ACTIVE_MASK           GENMASK(7, 0)
+/* RW: Ring bus address */
+#define REG_DMA_CAP2_DESC_BASE           0x260
+#define REG_DMA_CAP2_DESC_BASE_HI        0x264
+/* RW: Descriptors in the ring */
+#define REG_DMA_CAP2_DESC_COUNT          0x268
+#define   DMA_CAP2_DESC_COUNT_MASK       GENMASK(7, 0)
+/* RO: As DMA_CAP_CURRENT */
+#define REG_DMA_CAP2_CURRENT             0x26C
+#define   DMA_CAP2_CURRENT_MASK          GENMASK(7, 0)
+/* RW: Period bytes */
+#define REG_DMA_CAP2_SIZE                0x270
+/* RW: Context control */
+#define REG_DMA_CAP2_CTRL                0x274
+#define   DMA_CAP2_CTRL_ENABLE           BIT(0) /* Context DMA running */
+#define   DMA_CAP2_CTRL_IRQ              BIT(1) /* Period interrupts */
+/* RW: Channels written, CapturePacker */
+#define REG_DMA_CAP2_ROUTE               0x278
+#define   DMA_CAP2_ROUTE_MASK            GENMASK(15, 0) /* Channel n in bit n, 0 = every channel */
+#define   DMA_CAP2_ROUTE_FORMAT          GENMASK(17, 16) /* 0 = 32-bit, 1 = 16-bit containers */
+/* RO: As STATUS_CAP_DESC_ACTIVE */
+#define REG_DMA_CAP2_ACTIVE              0x27C
+#define   DMA_CAP2_ACTIVE_MASK           GENMASK(7, 0)
+/* RW: Ring bus address */
+#define REG_DMA_CAP3_DESC_BASE           0x280
+#define REG_DMA_CAP3_DESC_BASE_HI        0x284
+/* RW: Descriptors in the ring */
+#define REG_DMA_CAP3_DESC_COUNT          0x288
+#define   DMA_CAP3_DESC_COUNT_MASK       GENMASK(7, 0)
+/* RO: As DMA_CAP_CURRENT */
+#define REG_DMA_CAP3_CURRENT             0x28C
+#define   DMA_CAP3_CURRENT_MASK          GENMASK(7, 0)
+/* RW: Period bytes */
+#define REG_DMA_CAP3_SIZE                0x290
+/* RW: Context control */
+#define REG_DMA_CAP3_CTRL                0x294
+#define   DMA_CAP3_CTRL_ENABLE           BIT(0) /* Context DMA running */
+#define   DMA_CAP3_CTRL_IRQ              BIT(1) /* Period interrupts */
+/* RW: Channels written, CapturePacker */
+#define REG_DMA_CAP3_ROUTE               0x298
+#define   DMA_CAP3_ROUTE_MASK            GENMASK(15, 0) /* Channel n in bit n, 0 = every channel */
+#define   DMA_CAP3_ROUTE_FORMAT          GENMASK(17, 16) /* 0 = 32-bit, 1 = 16-bit containers */
+/* RO: As STATUS_CAP_DESC_ACTIVE */
+#define REG_DMA_CAP3_ACTIVE              0x29C
+#define   DMA_CAP3_ACTIVE_MASK           GENMASK(7, 0)
+
+/* Status */
+/* RO: Audio clock locked */
+#define REG_STATUS_LOCKED                0x300
+#define   STATUS_LOCKED_MASK             BIT(0)
+/* RO: Measured rate, Hz */
+#define REG_STATUS_ACTUAL_RATE           0x304
+/* RO: Clock in use */
+#define REG_STATUS_CLOCK_SRC             0x308
+#define   STATUS_CLOCK_SRC_MASK          GENMASK(1, 0)
+/* W1C: Playback events */
+#define REG_STATUS_PB_UNDERRUN           0x30C
+#define   STATUS_PB_UNDERRUN_XRUN        BIT(0) /* TX FIFO ran empty */
+#define   STATUS_PB_UNDERRUN_PERIOD      BIT(1) /* Descriptor with DESC_FLAG_INT done */
+#define   STATUS_PB_UNDERRUN_LOW         BIT(2) /* TX FIFO below its low watermark */
+#define   STATUS_PB_UNDERRUN_HIGH        BIT(3) /* TX FIFO above its high watermark */
+#define   STATUS_PB_UNDERRUN_W1C         (STATUS_PB_UNDERRUN_XRUN | STATUS_PB_UNDERRUN_PERIOD | STATUS_PB_UNDERRUN_LOW | STATUS_PB_UNDERRUN_HIGH)
+/* W1C: Capture events */
+#define REG_STATUS_CAP_OVERRUN           0x310
+#define   STATUS_CAP_OVERRUN_XRUN        BIT(0) /* RX FIFO ran full */
+#define   STATUS_CAP_OVERRUN_PERIOD      BIT(1) /* Descriptor with DESC_FLAG_INT done */
+#define   STATUS_CAP_OVERRUN_LOW         BIT(2) /* RX FIFO below its low watermark */
+#define   STATUS_CAP_OVERRUN_HIGH        BIT(3) /* RX FIFO above its high watermark */
+#define   STATUS_CAP_OVERRUN_W1C         (STATUS_CAP_OVERRUN_XRUN | STATUS_CAP_OVERRUN_PERIOD | STATUS_CAP_OVERRUN_LOW | STATUS_CAP_OVERRUN_HIGH)
+/* W1C: DMA engine errors */
+#define REG_STATUS_DMA_ERROR             0x314
+#define   STATUS_DMA_ERROR_PB            BIT(0) /* Playback engine stopped on an error */
+#define   STATUS_DMA_ERROR_CAP           BIT(1) /* Capture engine stopped on an error */
+#define   STATUS_DMA_ERROR_W1C           (STATUS_DMA_ERROR_PB | STATUS_DMA_ERROR_CAP)
+/* RO: Stream does not match CTRL_FORMAT */
+#define REG_STATUS_FORMAT_ERROR          0x318
+#define   STATUS_FORMAT_ERROR_MASK       BIT(0)
+/* RO: Playback descriptors in flight */
+#define REG_STATUS_PB_DESC_ACTIVE        0x31C
+#define   STATUS_PB_DESC_ACTIVE_MASK     GENMASK(7, 0)
+/* RO: Capture descriptors in flight */
+#define REG_STATUS_CAP_DESC_ACTIVE       0x320
+#define   STATUS_CAP_DESC_ACTIVE_MASK    GENMASK(7, 0)
+/* RO: Bytes read since enable */
+#define REG_STATUS_PB_BYTES_PROC         0x324
+/* RO: Bytes written since enable */
+#define REG_STATUS_CAP_BYTES_PROC        0x328
+/* RO: TX FIFO level */
+#define REG_STATUS_PB_FIFO               0x32C
+#define   STATUS_PB_FIFO_LEVEL           GENMASK(15, 0) /* Frames */
+#define   STATUS_PB_FIFO_PEAK            GENMASK(31, 16) /* Lowest level since the last low event */
+/* RO: RX FIFO level */
+#define REG_STATUS_CAP_FIFO              0x330
+#define   STATUS_CAP_FIFO_LEVEL          GENMASK(15, 0) /* Frames */
+#define   STATUS_CAP_FIFO_PEAK           GENMASK(31, 16) /* Highest level since the last high event */
+/* RO: Prefetch scheduler state */
+#define REG_STATUS_PB_PREFETCH           0x334
+#define   STATUS_PB_PREFETCH_TARGET      GENMASK(15, 0) /* Frames queued before a refill, 0 = not measured */
+#define   STATUS_PB_PREFETCH_LATENCY     GENMASK(31, 16) /* Completion latency estimate, cycles */
+/* W1C: Capture fan-out context events */
+#define REG_STATUS_CAP_CONTEXTS          0x338
+#define   STATUS_CAP_CONTEXTS_PERIOD1    BIT(1) /* Context 1 descriptor with DESC_FLAG_INT done */
+#define   STATUS_CAP_CONTEXTS_PERIOD2    BIT(2) /* Context 2 descriptor with DESC_FLAG_INT done */
+#define   STATUS_CAP_CONTEXTS_PERIOD3    BIT(3) /* Context 3 descriptor with DESC_FLAG_INT done */
+#define   STATUS_CAP_CONTEXTS_ERROR1     BIT(9) /* Context 1 stopped on an error */
+#define   STATUS_CAP_CONTEXTS_ERROR2     BIT(10) /* Context 2 stopped on an error */
+#define   STATUS_CAP_CONTEXTS_ERROR3     BIT(11) /* Context 3 stopped on an error */
+#define   STATUS_CAP_CONTEXTS_W1C        (STATUS_CAP_CONTEXTS_PERIOD1 | STATUS_CAP_CONTEXTS_PERIOD2 | STATUS_CAP_CONTEXTS_PERIOD3 | STATUS_CAP_CONTEXTS_ERROR1 | STATUS_CAP_CONTEXTS_ERROR2 | STATUS_CAP_CONTEXTS_ERROR3)
+
+/* Clock status */
+/* RO: Measured MCLK, Hz */
+#define REG_STATUS_MCLK_FREQ             0x400
+/* RO: Measured BCLK, Hz */
+#define REG_STATUS_BCLK_FREQ             0x404
+/* RO: Measured word clock, Hz */
+#define REG_STATUS_SAMPLE_RATE           0x408
+/* RO: MCLK present */
+#define REG_STATUS_MCLK_VALID            0x40C
+#define   STATUS_MCLK_VALID_MASK         BIT(0)
+/* RO: BCLK present */
+#define REG_STATUS_BCLK_VALID            0x410
+#define   STATUS_BCLK_VALID_MASK         BIT(0)
+
+/* Output EQ */
+/* RW: Output EQ */
+#define REG_EQ_CTRL                      0x500
+#define   EQ_CTRL_ENABLE                 BIT(0) /* Filter the output, else pass it through */
+#define   EQ_CTRL_BANK                   BIT(1) /* Coefficient bank to run, switched between frames */
+/* RW: Biquads per channel */
+#define REG_EQ_SECTIONS                  0x504
+#define   EQ_SECTIONS_CH0                GENMASK(3, 0) /* Channel 0, 0 = unfiltered */
+#define   EQ_SECTIONS_CH1                GENMASK(7, 4) /* Channel 1, 0 = unfiltered */
+#define   EQ_SECTIONS_CH2                GENMASK(11, 8) /* Channel 2, 0 = unfiltered */
+#define   EQ_SECTIONS_CH3                GENMASK(15, 12) /* Channel 3, 0 = unfiltered */
+#define   EQ_SECTIONS_CH4                GENMASK(19, 16) /* Channel 4, 0 = unfiltered */
+#define   EQ_SECTIONS_CH5                GENMASK(23, 20) /* Channel 5, 0 = unfiltered */
+#define   EQ_SECTIONS_CH6                GENMASK(27, 24) /* Channel 6, 0 = unfiltered */
+#define   EQ_SECTIONS_CH7                GENMASK(31, 28) /* Channel 7, 0 = unfiltered */
+/* RW: Coefficient EQ_COEF_DATA writes */
+#define REG_EQ_COEF_ADDR                 0x508
+#define   EQ_COEF_ADDR_INDEX             GENMASK(2, 0) /* b0, b1, b2, a1, a2 */
+#define   EQ_COEF_ADDR_SECTION           GENMASK(6, 4)
+#define   EQ_COEF_ADDR_CHANNEL           GENMASK(10, 8)
+/* WO: Q2.30, into the bank EQ_CTRL does not select */
+#define REG_EQ_COEF_DATA                 0x50C
+/* RO: Coefficient bank running */
+#define REG_EQ_STATUS                    0x510
+#define   EQ_STATUS_MASK                 BIT(0)
+
+/* Output FIR */
+/* RW: Output FIR */
+#define REG_FIR_CTRL                     0x600
+#define   FIR_CTRL_ENABLE                BIT(0) /* Filter the output, else pass it through */
+#define   FIR_CTRL_CHANNELS              GENMASK(12, 8) /* Filtered channels, the first ones */
+/* RW: Taps per channel, a multiple of lanes */
+#define REG_FIR_TAPS                     0x604
+#define   FIR_TAPS_MASK                  GENMASK(15, 0)
+/* RW: Coefficient buffer bus address */
+#define REG_FIR_COEF_BASE                0x608
+#define REG_FIR_COEF_BASE_HI             0x60C
+/* WO: 1 loads FIR_TAPS x channels coefficients by DMA */
+#define REG_FIR_LOAD                     0x610
+#define   FIR_LOAD_MASK                  BIT(0)
+/* RO: Coefficient load */
+#define REG_FIR_STATUS                   0x614
+#define   FIR_STATUS_BUSY                BIT(0) /* Load running */
+#define   FIR_STATUS_ERROR               BIT(1) /* Last load failed, stopped at the error */
+/* RO: Engine size */
+#define REG_FIR_CAPS                     0x618
+#define   FIR_CAPS_LANES                 GENMASK(7, 0) /* Multipliers, taps are split over them */
+#define   FIR_CAPS_DEPTH                 GENMASK(31, 16) /* Words per lane: taps x channels <= lanes x depth */
+
+/* Spectrum analyzer */
+/* RW: Spectrum analyzer */
+#define REG_SPEC_CTRL                    0x700
+#define   SPEC_CTRL_ENABLE               BIT(0) /* Analyze, finishing the block running when cleared */
+#define   SPEC_CTRL_OUTPUT               BIT(1) /* Output path, after EQ and FIR, else input */
+#define   SPEC_CTRL_CHANNEL              GENMASK(12, 8)
+#define   SPEC_CTRL_SIZE                 GENMASK(19, 16) /* log2 of the FFT points, 8 up to SPEC_CAPS */
+#define   SPEC_CTRL_WINDOW               GENMASK(21, 20) /* 0 = rectangular, 1 = Hann, 2 = Blackman-Harris */
+#define   SPEC_CTRL_AVERAGE              GENMASK(26, 24) /* log2 of the blocks averaged per spectrum */
+/* RW: Two spectrum slots, 2^SPEC_CAPS x 2 bytes each */
+#define REG_SPEC_BASE                    0x708
+#define REG_SPEC_BASE_HI                 0x70C
+/* RO: Spectra written */
+#define REG_SPEC_STATUS                  0x710
+#define   SPEC_STATUS_COUNT              GENMASK(15, 0) /* Spectra since enable, wrapping */
+#define   SPEC_STATUS_ERROR              BIT(16) /* A write failed, stopped until disabled */
+#define   SPEC_STATUS_VALID              BIT(17) /* Slot (count - 1) & 1 holds the newest spectrum */
+/* RO: log2 of the largest FFT */
+#define REG_SPEC_CAPS                    0x714
+#define   SPEC_CAPS_MASK                 GENMASK(3, 0)
+
+#endif /* __PCIE_AUDIO_REGS_H */
@@ -2,8 +2,12 @@
 #define __PCIE_AUDIO_H
 
 #include <linux/types.h>
+#include <linux/io.h>
+#include <linux/mutex.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
+#include "pcie-audio-core.h"
+#include "pcie-audio-regs.h"
 
 #define DRIVER_NAME     "pcie-audio"
 #define DRIVER_VERSION  "1.0.0"
@@ -16,72 +20,10 @@
 #define MIN_PERIODS        2
 #define MAX_PERIODS        32
 #define DMA_DESC_COUNT     32
+#define DMA_RING_BYTES     (DMA_DESC_COUNT * sizeof(struct pcie_audio_dma_desc))
 #define FIFO_SIZE         1024
 #define MAX_DSD_RATE      (44100 * 128)  /* DSD128 */
 
-/* Register definitions */
-#define REG_CTRL_FORMAT           0x000
-#define REG_CTRL_SAMPLE_FAMILY    0x004
-#define REG_CTRL_SAMPLE_MULTI     0x008
-#define REG_CTRL_DSD_MODE         0x00C
-#define REG_CTRL_CLOCK_SRC        0x010
-#define REG_CTRL_MASTER_MODE      0x014
-#define REG_CTRL_PB_ENABLE        0x018
-#define REG_CTRL_CAP_ENABLE       0x01C
-#define REG_CTRL_RESET            0x020
-
-/* Advanced control registers */
-#define REG_CTRL_MCLK_FREQ       0x030
-#define REG_CTRL_TARGET_RATE     0x034
-#define REG_CTRL_PB_THRESHOLD    0x038
-#define REG_CTRL_CAP_THRESHOLD   0x03C
-#define REG_CTRL_I2S_BITDEPTH    0x040
-#define REG_CTRL_I2S_ALIGNMENT   0x044
-#define REG_CTRL_I2S_TDM         0x048
-#define REG_CTRL_I2S_TDM_SLOTS   0x04C
-#define REG_CTRL_MCLK_DIV        0x050
-#define REG_CTRL_BCLK_DIV        0x054
-#define REG_CTRL_SYNC_TIMEOUT    0x058
-#define REG_CTRL_AUTO_RATE       0x05C
-
-/* DMA registers */
-#define REG_DMA_PB_DESC_BASE     0x100
-#define REG_DMA_PB_DESC_COUNT    0x108
-#define REG_DMA_PB_CURRENT       0x10C
-#define REG_DMA_PB_SIZE          0x110
-#define REG_DMA_PB_IRQ_EN        0x114
-#define REG_DMA_PB_THRESHOLD     0x118
-
-#define REG_DMA_CAP_DESC_BASE    0x200
-#define REG_DMA_CAP_DESC_COUNT   0x208
-#define REG_DMA_CAP_CURRENT      0x20C
-#define REG_DMA_CAP_SIZE         0x210
-#define REG_DMA_CAP_IRQ_EN       0x214
-#define REG_DMA_CAP_THRESHOLD    0x218
-
-/* Status registers */
-#define REG_STATUS_LOCKED        0x300
-#define REG_STATUS_ACTUAL_RATE   0x304
-#define REG_STATUS_CLOCK_SRC     0x308
-#define REG_STATUS_PB_UNDERRUN   0x30C
-#define REG_STATUS_CAP_OVERRUN   0x310
-#define REG_STATUS_DMA_ERROR     0x314
-#define REG_STATUS_FORMAT_ERROR  0x318
-
-/* DMA descriptor structure */
-struct pcie_audio_dma_desc {
-    __le64 address;    /* Buffer physical address */
-    __le32 length;     /* Buffer length in bytes */
-    __le32 flags;      /* Control flags */
-    __le64 next;       /* Next descriptor physical address */
-} __packed;
-
-/* DMA descriptor flags */
-#define DESC_FLAG_INT      (1 << 0)    /* Generate interrupt */
-#define DESC_FLAG_LAST     (1 << 1)    /* Last descriptor in chain */
-#define DESC_FLAG_WRAP     (1 << 2)    /* Wrap to start of ring */
-#define DESC_FLAG_OWNED    (1 << 31)   /* Owned by hardware */
-
 /* Stream private data */
 struct pcie_audio_stream {
     struct snd_pcm_substream *substream;
@@ -93,12 +35,15 @@ struct pcie_audio_stream {
     size_t period_size;
     size_t buffer_size;
     unsigned int periods;
+    unsigned int hw_delay;    /* Frames past the DMA pointer, see LatencyBudget */
     
     /* Performance monitoring */
     unsigned long interrupts;
     unsigned long errors;
     ktime_t last_interrupt;
     unsigned int latency;
+    unsigned long near_misses;  /* Watermark events that were not xruns */
+    unsigned int min_margin;    /* Closest a near miss came, frames */
     
     /* Buffer management */
     unsigned int hw_ptr;      /* Hardware pointer in frames */
@@ -109,12 +54,18 @@ struct pcie_audio_stream {
     unsigned int rate;
     snd_pcm_format_t format;
     bool is_dsd;
+    
+    /* Capture DMA context, one per capture substream */
+    unsigned int context;
+    struct pcie_audio_cap_regs regs;
+    u32 channel_mask;         /* "Capture Channel Mask", 0 = the first channels */
 };
 
 /* Saved registers for power management */
 struct pcie_audio_saved_regs {
-    u32 ctrl_format;
+    struct pcie_audio_format format;
     u32 ctrl_sample_family;
+    u32 ctrl_sample_multi;
     u32 ctrl_master_mode;
     u32 dma_config;
     u32 clock_config;
@@ -130,7 +81,7 @@ struct pcie_audio {
     void __iomem *reg_base;
     
     struct pcie_audio_stream playback;
-    struct pcie_audio_stream capture;
+    struct pcie_audio_stream capture[CAP_CONTEXTS];
     
     /* Current configuration */
     unsigned int sample_rate;
@@ -147,6 +98,29 @@ struct pcie_audio {
         ktime_t start_time;
     } stats;
     
+    /* Output EQ, the "Output EQ" controls; see pcie_audio_load_eq() */
+    struct pcie_audio_eq_channel eq[EQ_CHANNELS];
+    struct mutex eq_lock;
+    
+    /* Output FIR, the "Output FIR" control; see pcie_audio_set_fir() */
+    struct {
+        unsigned int channels;    /* 0 = off */
+        unsigned int taps;
+        __le32 *coefs;            /* In the engine's order, DMA'd by the card */
+        dma_addr_t coefs_dma;
+        size_t bytes;
+    } fir;
+    struct mutex fir_lock;
+    
+    /* Spectrum analyzer, the "Spectrum Analyzer" control */
+    struct {
+        struct pcie_audio_spectrum_config config;   /* size 0 = off */
+        __le32 *buf;              /* Two slots, written by the card in turn */
+        dma_addr_t buf_dma;
+        size_t bytes;
+    } spectrum;
+    struct mutex spectrum_lock;
+    
     /* Power management */
     struct pcie_audio_saved_regs saved_registers;
     
@@ -156,9 +130,63 @@ struct pcie_audio {
     spinlock_t cap_lock;    /* For capture state */
 };
 
+/* Register access */
+static inline u32 pcie_audio_read(struct pcie_audio *chip, unsigned int reg)
+{
+    u32 val;
+    unsigned long flags;
+    
+    spin_lock_irqsave(&chip->reg_lock, flags);
+    val = readl(chip->reg_base + reg);
+    spin_unlock_irqrestore(&chip->reg_lock, flags);
+    
+    return val;
+}
+
+/*
+ * count consecutive registers from reg. The card answers a read of up to
+ * 128 bytes with one completion, so this costs one round trip where the
+ * CPU issues the copy as a single request, and never more than the readl()s
+ */
+static inline void pcie_audio_read_block(struct pcie_audio *chip, unsigned int reg,
+                                         u32 *buf, unsigned int count)
+{
+    unsigned long flags;
+    
+    spin_lock_irqsave(&chip->reg_lock, flags);
+    memcpy_fromio(buf, chip->reg_base + reg, count * sizeof(*buf));
+    spin_unlock_irqrestore(&chip->reg_lock, flags);
+}
+
+static inline void pcie_audio_write(struct pcie_audio *chip,
+                                  unsigned int reg, u32 val)
+{
+    unsigned long flags;
+    
+    spin_lock_irqsave(&chip->reg_lock, flags);
+    writel(val, chip->reg_base + reg);
+    spin_unlock_irqrestore(&chip->reg_lock, flags);
+}
+
 /* Function prototypes */
+int pcie_audio_init_hw(struct pcie_audio *chip);
+void pcie_audio_write_format(struct pcie_audio *chip, const struct pcie_audio_format *fmt);
+int pcie_audio_load_eq(struct pcie_audio *chip);
+int pcie_audio_load_fir(struct pcie_audio *chip);
+int pcie_audio_set_fir(struct pcie_audio *chip, unsigned int channels, unsigned int taps,
+                       const __le32 *coefs, unsigned int rate);
+int pcie_audio_load_spectrum(struct pcie_audio *chip);
+int pcie_audio_set_spectrum(struct pcie_audio *chip,
+                            const struct pcie_audio_spectrum_config *cfg);
+int pcie_audio_read_spectrum(struct pcie_audio *chip, __le32 *bins, u32 *sequence);
+void pcie_audio_pcie_init(struct pcie_audio *chip);
+int pcie_audio_setup_irq(struct pcie_audio *chip);
+void pcie_audio_free_irq(struct pcie_audio *chip);
 int pcie_audio_create_controls(struct pcie_audio *chip);
 int pcie_audio_proc_init(struct pcie_audio *chip);
 void pcie_audio_proc_free(struct pcie_audio *chip);
 
+extern const struct snd_pcm_hardware pcie_audio_hw;
+extern const struct snd_pcm_ops pcie_audio_pcm_ops;
+
 #endif /* __PCIE_AUDIO_H */
\ No newline at end of file
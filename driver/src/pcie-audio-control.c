@@ -1,4 +1,6 @@
 #include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
 #include <sound/control.h>
 #include "pcie-audio.h"
 
@@ -130,8 +132,8 @@ static int format_get(struct snd_kcontrol *kcontrol,
                      struct snd_ctl_elem_value *ucontrol)
 {
     struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
-    u32 val = pcie_audio_read(chip, REG_CTRL_FORMAT);
-    ucontrol->value.enumerated.item[0] = (val >> 31) & 1;
+    u32 val = FIELD_GET(CTRL_FORMAT_MASK, pcie_audio_read(chip, REG_CTRL_FORMAT));
+    ucontrol->value.enumerated.item[0] = val >= CTRL_FORMAT_DSD_64;
     return 0;
 }
 
@@ -139,13 +141,314 @@ static int format_put(struct snd_kcontrol *kcontrol,
                      struct snd_ctl_elem_value *ucontrol)
 {
     struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
-    u32 val = pcie_audio_read(chip, REG_CTRL_FORMAT);
-    val &= ~(1 << 31);
-    val |= (ucontrol->value.enumerated.item[0] & 1) << 31;
-    pcie_audio_write(chip, REG_CTRL_FORMAT, val);
+    u32 val = FIELD_GET(CTRL_FORMAT_MASK, pcie_audio_read(chip, REG_CTRL_FORMAT));
+    bool dsd = ucontrol->value.enumerated.item[0] & 1;
+    
+    /* Back from DSD as plain I2S; the next hw_params sets the framing */
+    if (dsd == (val >= CTRL_FORMAT_DSD_64))
+        return 0;
+    val = dsd ? CTRL_FORMAT_DSD_64 : CTRL_FORMAT_I2S_STANDARD;
+    pcie_audio_write(chip, REG_CTRL_FORMAT, FIELD_PREP(CTRL_FORMAT_MASK, val));
     return 1;
 }
 
+/*
+ * Channels each capture substream records, one value per capture DMA
+ * context: channel n in bit n, 0 for the first channels. Taken at the next
+ * hw_params, which rejects a mask that does not name the stream's channels.
+ */
+static int channel_mask_info(struct snd_kcontrol *kcontrol,
+                            struct snd_ctl_elem_info *uinfo)
+{
+    uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+    uinfo->count = CAP_CONTEXTS;
+    uinfo->value.integer.min = 0;
+    uinfo->value.integer.max = BIT(MAX_CHANNELS) - 1;
+    return 0;
+}
+
+static int channel_mask_get(struct snd_kcontrol *kcontrol,
+                           struct snd_ctl_elem_value *ucontrol)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    int i;
+    
+    for (i = 0; i < CAP_CONTEXTS; i++)
+        ucontrol->value.integer.value[i] = chip->capture[i].channel_mask;
+    return 0;
+}
+
+static int channel_mask_put(struct snd_kcontrol *kcontrol,
+                           struct snd_ctl_elem_value *ucontrol)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    int i, changed = 0;
+    
+    for (i = 0; i < CAP_CONTEXTS; i++)
+        if (ucontrol->value.integer.value[i] >= BIT(MAX_CHANNELS))
+            return -EINVAL;
+    
+    for (i = 0; i < CAP_CONTEXTS; i++) {
+        u32 mask = ucontrol->value.integer.value[i];
+        
+        if (chip->capture[i].channel_mask != mask) {
+            chip->capture[i].channel_mask = mask;
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+/*
+ * "Output EQ", one bytes control per channel (the control's index): the
+ * channel's biquad cascade as struct pcie_audio_eq_channel. A write loads
+ * every channel's cascade into the idle coefficient bank and switches to it
+ * between two frames.
+ */
+static int eq_info(struct snd_kcontrol *kcontrol,
+                  struct snd_ctl_elem_info *uinfo)
+{
+    uinfo->type = SNDRV_CTL_ELEM_TYPE_BYTES;
+    uinfo->count = sizeof(struct pcie_audio_eq_channel);
+    return 0;
+}
+
+static int eq_get(struct snd_kcontrol *kcontrol,
+                 struct snd_ctl_elem_value *ucontrol)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    unsigned int ch = snd_ctl_get_ioffidx(kcontrol, &ucontrol->id);
+    
+    mutex_lock(&chip->eq_lock);
+    memcpy(ucontrol->value.bytes.data, &chip->eq[ch], sizeof(chip->eq[ch]));
+    mutex_unlock(&chip->eq_lock);
+    return 0;
+}
+
+static int eq_put(struct snd_kcontrol *kcontrol,
+                 struct snd_ctl_elem_value *ucontrol)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    unsigned int ch = snd_ctl_get_ioffidx(kcontrol, &ucontrol->id);
+    struct pcie_audio_eq_channel eq;
+    int err;
+    
+    memcpy(&eq, ucontrol->value.bytes.data, sizeof(eq));
+    if (pcie_audio_eq_validate(&eq) < 0)
+        return -EINVAL;
+    
+    mutex_lock(&chip->eq_lock);
+    if (!memcmp(&chip->eq[ch], &eq, sizeof(eq))) {
+        mutex_unlock(&chip->eq_lock);
+        return 0;
+    }
+    chip->eq[ch] = eq;
+    err = pcie_audio_load_eq(chip);
+    mutex_unlock(&chip->eq_lock);
+    return err < 0 ? err : 1;
+}
+
+/*
+ * "Output FIR": too large for a bytes control, so its value is a TLV, the
+ * type and length words followed by struct pcie_audio_fir_header and taps
+ * Q1.23 coefficients per channel, channel by channel. The value reads as
+ * the header alone. A write is checked against the current playback rate
+ * and loaded by DMA; hw_params rejects a rate it does not fit.
+ */
+#define FIR_TLV_WORDS (2 + sizeof(struct pcie_audio_fir_header) / sizeof(u32))
+
+static int fir_info(struct snd_kcontrol *kcontrol,
+                   struct snd_ctl_elem_info *uinfo)
+{
+    uinfo->type = SNDRV_CTL_ELEM_TYPE_BYTES;
+    uinfo->count = sizeof(struct pcie_audio_fir_header);
+    return 0;
+}
+
+static int fir_get(struct snd_kcontrol *kcontrol,
+                  struct snd_ctl_elem_value *ucontrol)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    struct pcie_audio_fir_header header;
+    
+    mutex_lock(&chip->fir_lock);
+    header.channels = cpu_to_le32(chip->fir.channels);
+    header.taps = cpu_to_le32(chip->fir.taps);
+    mutex_unlock(&chip->fir_lock);
+    memcpy(ucontrol->value.bytes.data, &header, sizeof(header));
+    return 0;
+}
+
+static int fir_tlv_read(struct pcie_audio *chip, unsigned int size,
+                        unsigned int __user *tlv)
+{
+    unsigned int channels = chip->fir.channels, taps = chip->fir.taps;
+    unsigned int lanes = FIELD_GET(FIR_CAPS_LANES, pcie_audio_read(chip, REG_FIR_CAPS));
+    unsigned int words = FIR_TLV_WORDS + channels * taps;
+    unsigned int ch, tap;
+    __le32 *buf;
+    int err = 0;
+    
+    if (size < words * sizeof(u32))
+        return -ENOSPC;
+    buf = kmalloc_array(words, sizeof(*buf), GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+    
+    buf[0] = 0;
+    buf[1] = cpu_to_le32((words - 2) * sizeof(u32));
+    buf[2] = cpu_to_le32(channels);
+    buf[3] = cpu_to_le32(taps);
+    for (ch = 0; ch < channels; ch++)
+        for (tap = 0; tap < taps; tap++)
+            buf[FIR_TLV_WORDS + ch * taps + tap] =
+                chip->fir.coefs[pcie_audio_fir_index(ch, tap, taps, lanes)];
+    
+    if (copy_to_user(tlv, buf, words * sizeof(u32)))
+        err = -EFAULT;
+    kfree(buf);
+    return err;
+}
+
+static int fir_tlv_write(struct pcie_audio *chip, unsigned int size,
+                         const unsigned int __user *tlv)
+{
+    u32 caps = pcie_audio_read(chip, REG_FIR_CAPS);
+    size_t max = FIELD_GET(FIR_CAPS_LANES, caps) * FIELD_GET(FIR_CAPS_DEPTH, caps);
+    unsigned int channels, taps, rate;
+    __le32 *buf;
+    int err;
+    
+    if (size < FIR_TLV_WORDS * sizeof(u32) || size > (FIR_TLV_WORDS + max) * sizeof(u32))
+        return -EINVAL;
+    buf = memdup_user(tlv, size);
+    if (IS_ERR(buf))
+        return PTR_ERR(buf);
+    
+    channels = le32_to_cpu(buf[2]);
+    taps = le32_to_cpu(buf[3]);
+    if (channels && (channels > FIR_MAX_CHANNELS || !taps || taps > max ||
+                     size != (FIR_TLV_WORDS + channels * taps) * sizeof(u32))) {
+        kfree(buf);
+        return -EINVAL;
+    }
+    
+    rate = chip->playback.rate ? chip->playback.rate : 48000;
+    err = pcie_audio_set_fir(chip, channels, taps, buf + FIR_TLV_WORDS, rate);
+    kfree(buf);
+    return err;
+}
+
+static int fir_tlv(struct snd_kcontrol *kcontrol, int op_flag,
+                  unsigned int size, unsigned int __user *tlv)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    int err;
+    
+    mutex_lock(&chip->fir_lock);
+    if (op_flag == SNDRV_CTL_TLV_OP_READ)
+        err = fir_tlv_read(chip, size, tlv);
+    else if (op_flag == SNDRV_CTL_TLV_OP_WRITE)
+        err = fir_tlv_write(chip, size, tlv);
+    else
+        err = -ENXIO;
+    mutex_unlock(&chip->fir_lock);
+    return err;
+}
+
+/*
+ * "Spectrum Analyzer": the value is struct pcie_audio_spectrum_config, a
+ * size of 0 turns the analyzer off; a write restarts the average. Reading
+ * the TLV returns the newest spectrum, the type and length words followed
+ * by struct pcie_audio_spectrum_header and the bins, -EAGAIN before the
+ * first one. Polling it is enough, a spectrum takes at least 256 frames.
+ */
+#define SPEC_TLV_WORDS (2 + sizeof(struct pcie_audio_spectrum_header) / sizeof(u32))
+
+static int spectrum_info(struct snd_kcontrol *kcontrol,
+                        struct snd_ctl_elem_info *uinfo)
+{
+    uinfo->type = SNDRV_CTL_ELEM_TYPE_BYTES;
+    uinfo->count = sizeof(struct pcie_audio_spectrum_config);
+    return 0;
+}
+
+static int spectrum_get(struct snd_kcontrol *kcontrol,
+                       struct snd_ctl_elem_value *ucontrol)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    
+    mutex_lock(&chip->spectrum_lock);
+    memcpy(ucontrol->value.bytes.data, &chip->spectrum.config,
+           sizeof(chip->spectrum.config));
+    mutex_unlock(&chip->spectrum_lock);
+    return 0;
+}
+
+static int spectrum_put(struct snd_kcontrol *kcontrol,
+                       struct snd_ctl_elem_value *ucontrol)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    struct pcie_audio_spectrum_config cfg;
+    int err;
+    
+    memcpy(&cfg, ucontrol->value.bytes.data, sizeof(cfg));
+    
+    mutex_lock(&chip->spectrum_lock);
+    if (!memcmp(&chip->spectrum.config, &cfg, sizeof(cfg))) {
+        mutex_unlock(&chip->spectrum_lock);
+        return 0;
+    }
+    err = pcie_audio_set_spectrum(chip, &cfg);
+    mutex_unlock(&chip->spectrum_lock);
+    return err < 0 ? err : 1;
+}
+
+static int spectrum_tlv_read(struct pcie_audio *chip, unsigned int size,
+                             unsigned int __user *tlv)
+{
+    unsigned int bins = le32_to_cpu(chip->spectrum.config.size) / 2;
+    unsigned int words = SPEC_TLV_WORDS + bins;
+    u32 sequence;
+    __le32 *buf;
+    int err;
+    
+    if (!bins)
+        return -ENODATA;
+    if (size < words * sizeof(u32))
+        return -ENOSPC;
+    buf = kmalloc_array(words, sizeof(*buf), GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+    
+    err = pcie_audio_read_spectrum(chip, buf + SPEC_TLV_WORDS, &sequence);
+    if (!err) {
+        buf[0] = 0;
+        buf[1] = cpu_to_le32((words - 2) * sizeof(u32));
+        buf[2] = cpu_to_le32(sequence);
+        buf[3] = cpu_to_le32(bins);
+        if (copy_to_user(tlv, buf, words * sizeof(u32)))
+            err = -EFAULT;
+    }
+    kfree(buf);
+    return err;
+}
+
+static int spectrum_tlv(struct snd_kcontrol *kcontrol, int op_flag,
+                       unsigned int size, unsigned int __user *tlv)
+{
+    struct pcie_audio *chip = snd_kcontrol_chip(kcontrol);
+    int err;
+    
+    if (op_flag != SNDRV_CTL_TLV_OP_READ)
+        return -ENXIO;
+    
+    mutex_lock(&chip->spectrum_lock);
+    err = spectrum_tlv_read(chip, size, tlv);
+    mutex_unlock(&chip->spectrum_lock);
+    return err;
+}
+
 // Create control elements
 int pcie_audio_create_controls(struct pcie_audio *chip)
 {
@@ -180,6 +483,42 @@ int pcie_audio_create_controls(struct pcie_audio *chip)
             .get = format_get,
             .put = format_put,
         },
+        {
+            .iface = SNDRV_CTL_ELEM_IFACE_PCM,
+            .name = "Capture Channel Mask",
+            .info = channel_mask_info,
+            .get = channel_mask_get,
+            .put = channel_mask_put,
+        },
+        {
+            .iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+            .name = "Output EQ",
+            .count = EQ_CHANNELS,
+            .info = eq_info,
+            .get = eq_get,
+            .put = eq_put,
+        },
+        {
+            .iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+            .name = "Output FIR",
+            .access = SNDRV_CTL_ELEM_ACCESS_READ |
+                      SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE |
+                      SNDRV_CTL_ELEM_ACCESS_TLV_CALLBACK,
+            .info = fir_info,
+            .get = fir_get,
+            .tlv.c = fir_tlv,
+        },
+        {
+            .iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+            .name = "Spectrum Analyzer",
+            .access = SNDRV_CTL_ELEM_ACCESS_READWRITE |
+                      SNDRV_CTL_ELEM_ACCESS_TLV_READ |
+                      SNDRV_CTL_ELEM_ACCESS_TLV_CALLBACK,
+            .info = spectrum_info,
+            .get = spectrum_get,
+            .put = spectrum_put,
+            .tlv.c = spectrum_tlv,
+        },
     };
     
     int err, i;
@@ -0,0 +1,604 @@
+/*
+ * KUnit tests and microbenchmarks for the pure driver logic in
+ * pcie-audio-core.c. Built as pcie-audio-test.ko against a kernel with
+ * CONFIG_KUNIT, or run in userspace with "make kunit" in driver/cosim.
+ */
+
+#include <kunit/test.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/prandom.h>
+#include <linux/string.h>
+#include "pcie-audio-core.h"
+
+#define RING_DESC       32          /* DMA_DESC_COUNT */
+#define RING_DMA        0x10000000ULL
+#define BUF_DMA         0x20000000ULL
+#define BENCH_ITERS     1000000
+#define SEED            0x5eed
+
+static struct pcie_audio_dma_desc ring[RING_DESC + 1];
+
+static void ring_covers_buffer(struct kunit *test, size_t period_bytes,
+                               unsigned int periods)
+{
+    unsigned int i;
+
+    /* A sentinel past the ring must never be touched */
+    memset(ring, 0xA5, sizeof(ring));
+
+    KUNIT_ASSERT_EQ(test, pcie_audio_build_ring(ring, RING_DESC, RING_DMA, BUF_DMA,
+                                                period_bytes, periods), periods);
+
+    for (i = 0; i < periods; i++) {
+        unsigned int next = (i + 1) % periods;
+
+        KUNIT_EXPECT_EQ(test, le64_to_cpu(ring[i].address),
+                        BUF_DMA + (u64)i * period_bytes);
+        KUNIT_EXPECT_EQ(test, le32_to_cpu(ring[i].length), period_bytes);
+        KUNIT_EXPECT_TRUE(test, le32_to_cpu(ring[i].flags) & DESC_FLAG_INT);
+        KUNIT_EXPECT_EQ(test, !!(le32_to_cpu(ring[i].flags) & DESC_FLAG_WRAP),
+                        i == periods - 1);
+        KUNIT_EXPECT_EQ(test, le64_to_cpu(ring[i].next),
+                        RING_DMA + next * sizeof(ring[0]));
+    }
+
+    /* The last descriptor ends exactly at the end of the buffer */
+    KUNIT_EXPECT_EQ(test, le64_to_cpu(ring[periods - 1].address) + period_bytes,
+                    BUF_DMA + (u64)periods * period_bytes);
+    KUNIT_EXPECT_EQ(test, ring[periods].length, 0xA5A5A5A5);
+}
+
+static void build_ring_full_test(struct kunit *test)
+{
+    ring_covers_buffer(test, 4096, RING_DESC);
+}
+
+/*
+ * Regression: the ring used to always hold DMA_DESC_COUNT descriptors, so
+ * with fewer periods the engine walked past the end of the buffer.
+ */
+static void build_ring_few_periods_test(struct kunit *test)
+{
+    ring_covers_buffer(test, 4096, 4);
+    ring_covers_buffer(test, 1024, 2);
+}
+
+static void build_ring_invalid_test(struct kunit *test)
+{
+    KUNIT_EXPECT_EQ(test, pcie_audio_build_ring(ring, RING_DESC, RING_DMA, BUF_DMA,
+                                                4096, RING_DESC + 1), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_build_ring(ring, RING_DESC, RING_DMA, BUF_DMA,
+                                                4096, 0), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_build_ring(ring, RING_DESC, RING_DMA, BUF_DMA,
+                                                0, 4), -EINVAL);
+}
+
+static void encode_rate_test(struct kunit *test)
+{
+    /* Raw register values, so the test fails if the field layout moves */
+    static const struct {
+        unsigned int rate;
+        u32 family;
+        u32 multi;
+    } table[] = {
+        { 44100,  0, 0 },
+        { 88200,  0, 1 },
+        { 176400, 0, 3 },
+        { 48000,  1, 0 },
+        { 96000,  1, 1 },
+        { 192000, 1, 3 },
+        { 768000, 1, 15 },
+    };
+    unsigned int i;
+    u32 family, multi;
+
+    for (i = 0; i < ARRAY_SIZE(table); i++) {
+        KUNIT_EXPECT_EQ(test, pcie_audio_encode_rate(table[i].rate, &family, &multi), 0);
+        KUNIT_EXPECT_EQ(test, family, table[i].family);
+        KUNIT_EXPECT_EQ(test, multi, table[i].multi);
+    }
+
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_rate(32000, &family, &multi), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_rate(0, &family, &multi), -EINVAL);
+    /* The multiplier field holds 16 at most */
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_rate(44100 * 17, &family, &multi), -EINVAL);
+}
+
+static void encode_format_test(struct kunit *test)
+{
+    struct pcie_audio_format fmt;
+
+    pcie_audio_encode_format(32, 2, &fmt);
+    KUNIT_EXPECT_EQ(test, fmt.format, 0);           /* I2S_STANDARD */
+    KUNIT_EXPECT_EQ(test, fmt.bitdepth, 32);
+    KUNIT_EXPECT_EQ(test, fmt.tdm, 0);
+    KUNIT_EXPECT_EQ(test, fmt.tdm_slots, 1);
+
+    pcie_audio_encode_format(24, 1, &fmt);
+    KUNIT_EXPECT_EQ(test, fmt.format, 0);
+    KUNIT_EXPECT_EQ(test, fmt.bitdepth, 24);
+    KUNIT_EXPECT_EQ(test, fmt.tdm_slots, 0);
+
+    pcie_audio_encode_format(32, 8, &fmt);
+    KUNIT_EXPECT_EQ(test, fmt.format, 3);           /* TDM */
+    KUNIT_EXPECT_EQ(test, fmt.bitdepth, 32);
+    KUNIT_EXPECT_EQ(test, fmt.tdm, 1);
+    KUNIT_EXPECT_EQ(test, fmt.tdm_slots, 7);
+
+    /* Every value fits its field */
+    KUNIT_EXPECT_EQ(test, fmt.format & ~CTRL_FORMAT_MASK, 0);
+    KUNIT_EXPECT_EQ(test, fmt.tdm_slots & ~CTRL_I2S_TDM_SLOTS_MASK, 0);
+}
+
+static void hw_position_test(struct kunit *test)
+{
+    /* 4 periods of 1024 bytes, 8-byte frames */
+    KUNIT_EXPECT_EQ(test, pcie_audio_hw_position(0, 1024, 4096, 8), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_hw_position(1, 1024, 4096, 8), 128);
+    KUNIT_EXPECT_EQ(test, pcie_audio_hw_position(3, 1024, 4096, 8), 384);
+
+    /* Index read as the engine wrapped */
+    KUNIT_EXPECT_EQ(test, pcie_audio_hw_position(4, 1024, 4096, 8), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_hw_position(5, 1024, 4096, 8), 128);
+
+    /* All-ones reads from a surprise-removed device stay in the buffer */
+    KUNIT_EXPECT_LT(test, pcie_audio_hw_position(~0U, 1024, 4096, 8), 512);
+
+    KUNIT_EXPECT_EQ(test, pcie_audio_hw_position(1, 1024, 0, 8), 0);
+}
+
+static void hw_position_random_test(struct kunit *test)
+{
+    struct rnd_state rnd;
+    unsigned int i;
+
+    prandom_seed_state(&rnd, SEED);
+
+    for (i = 0; i < 10000; i++) {
+        unsigned int frame_bytes = 4 * (1 + prandom_u32_state(&rnd) % 8);
+        unsigned int periods = 2 + prandom_u32_state(&rnd) % (RING_DESC - 1);
+        size_t period_bytes = frame_bytes * (256 + prandom_u32_state(&rnd) % 1024);
+        size_t buffer_bytes = period_bytes * periods;
+        u32 desc = prandom_u32_state(&rnd) % (2 * periods);
+        unsigned long pos;
+
+        pos = pcie_audio_hw_position(desc, period_bytes, buffer_bytes, frame_bytes);
+        KUNIT_EXPECT_LT(test, pos, buffer_bytes / frame_bytes);
+        KUNIT_EXPECT_EQ(test, pos, (desc % periods) * period_bytes / frame_bytes);
+    }
+}
+
+static void hw_delay_test(struct kunit *test)
+{
+    unsigned int rates[] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+    unsigned int i;
+
+    /* FIFO contents dominate: the same frame count at every rate */
+    for (i = 0; i < ARRAY_SIZE(rates); i++) {
+        KUNIT_EXPECT_EQ(test, pcie_audio_hw_delay(rates[i], false),
+                        pcie_audio_hw_delay(48000, false));
+        KUNIT_EXPECT_GT(test, pcie_audio_hw_delay(rates[i], false),
+                        pcie_audio_hw_delay(rates[i], true));
+        KUNIT_EXPECT_GT(test, pcie_audio_hw_delay(rates[i], true), 0);
+    }
+
+    KUNIT_EXPECT_EQ(test, pcie_audio_hw_delay(32000, false), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_hw_delay(0, true), 0);
+}
+
+static void decode_irq_test(struct kunit *test)
+{
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(0, 0, 0), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(STATUS_PERIOD, 0, 0),
+                    PCIE_AUDIO_EV_PB_PERIOD);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(STATUS_XRUN | STATUS_PERIOD, 0, 0),
+                    PCIE_AUDIO_EV_PB_XRUN);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(0, STATUS_PERIOD, 0),
+                    PCIE_AUDIO_EV_CAP_PERIOD);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(0, STATUS_XRUN, 0),
+                    PCIE_AUDIO_EV_CAP_XRUN);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(0, 0, DMA_ERROR_PB),
+                    PCIE_AUDIO_EV_PB_DMA_ERROR);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(0, 0, DMA_ERROR_CAP),
+                    PCIE_AUDIO_EV_CAP_DMA_ERROR);
+
+    /* An error the driver cannot attribute stops both directions */
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(0, 0, 0x80),
+                    PCIE_AUDIO_EV_PB_DMA_ERROR | PCIE_AUDIO_EV_CAP_DMA_ERROR);
+
+    /* Bits above the low byte belong to nobody */
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(0x100, 0xFF00, 0), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(STATUS_PERIOD, STATUS_XRUN, DMA_ERROR_PB),
+                    PCIE_AUDIO_EV_PB_PERIOD | PCIE_AUDIO_EV_CAP_XRUN |
+                    PCIE_AUDIO_EV_PB_DMA_ERROR);
+
+    /* Watermarks: only the xrun side is a near miss, and never a period */
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(STATUS_LOW, STATUS_HIGH, 0),
+                    PCIE_AUDIO_EV_PB_NEAR_XRUN | PCIE_AUDIO_EV_CAP_NEAR_XRUN);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(STATUS_HIGH, STATUS_LOW, 0), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(STATUS_LOW | STATUS_PERIOD, 0, 0),
+                    PCIE_AUDIO_EV_PB_NEAR_XRUN | PCIE_AUDIO_EV_PB_PERIOD);
+    KUNIT_EXPECT_EQ(test, pcie_audio_decode_irq(0, STATUS_HIGH | STATUS_XRUN, 0),
+                    PCIE_AUDIO_EV_CAP_XRUN);
+}
+
+static void watermark_test(struct kunit *test)
+{
+    u32 watermark, filter;
+
+    pcie_audio_encode_watermark(1024, false, &watermark, &filter);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_PB_WATERMARK_LOW, watermark), 256);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_PB_WATERMARK_HIGH, watermark), 0);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_PB_WM_FILTER_HYSTERESIS, filter), 128);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_PB_WM_FILTER_HOLDOFF, filter), WM_HOLDOFF);
+
+    pcie_audio_encode_watermark(1024, true, &watermark, &filter);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_CAP_WATERMARK_LOW, watermark), 0);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_CAP_WATERMARK_HIGH, watermark), 768);
+
+    /* Playback reports its lowest level, capture its highest */
+    KUNIT_EXPECT_EQ(test, pcie_audio_xrun_margin(FIELD_PREP(STATUS_PB_FIFO_PEAK, 37) | 500,
+                                                 1024, false), 37);
+    KUNIT_EXPECT_EQ(test, pcie_audio_xrun_margin(FIELD_PREP(STATUS_CAP_FIFO_PEAK, 1000),
+                                                 1024, true), 24);
+    KUNIT_EXPECT_EQ(test, pcie_audio_xrun_margin(FIELD_PREP(STATUS_CAP_FIFO_PEAK, 1024),
+                                                 1024, true), 0);
+}
+
+static void prefetch_delay_test(struct kunit *test)
+{
+    /* Not measured yet: keep the static estimate */
+    KUNIT_EXPECT_EQ(test, pcie_audio_prefetch_delay(FIELD_PREP(STATUS_PB_PREFETCH_LATENCY, 200)),
+                    0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_prefetch_delay(FIELD_PREP(STATUS_PB_PREFETCH_TARGET, 64) |
+                                                    FIELD_PREP(STATUS_PB_PREFETCH_LATENCY, 200)),
+                    64 + PREFETCH_BURST_FRAMES / 2);
+}
+
+static void cap_regs_test(struct kunit *test)
+{
+    struct pcie_audio_cap_regs regs;
+
+    KUNIT_ASSERT_EQ(test, pcie_audio_cap_regs(0, &regs), 0);
+    KUNIT_EXPECT_EQ(test, regs.desc_base, REG_DMA_CAP_DESC_BASE);
+    KUNIT_EXPECT_EQ(test, regs.desc_active, REG_STATUS_CAP_DESC_ACTIVE);
+    KUNIT_EXPECT_EQ(test, regs.ctrl, 0);
+
+    KUNIT_ASSERT_EQ(test, pcie_audio_cap_regs(2, &regs), 0);
+    KUNIT_EXPECT_EQ(test, regs.desc_base, REG_DMA_CAP2_DESC_BASE);
+    KUNIT_EXPECT_EQ(test, regs.desc_count, REG_DMA_CAP2_DESC_COUNT);
+    KUNIT_EXPECT_EQ(test, regs.current_desc, REG_DMA_CAP2_CURRENT);
+    KUNIT_EXPECT_EQ(test, regs.size, REG_DMA_CAP2_SIZE);
+    KUNIT_EXPECT_EQ(test, regs.route, REG_DMA_CAP2_ROUTE);
+    KUNIT_EXPECT_EQ(test, regs.desc_active, REG_DMA_CAP2_ACTIVE);
+    KUNIT_EXPECT_EQ(test, regs.ctrl, REG_DMA_CAP2_CTRL);
+
+    KUNIT_ASSERT_EQ(test, pcie_audio_cap_regs(CAP_CONTEXTS - 1, &regs), 0);
+    KUNIT_EXPECT_EQ(test, regs.ctrl, REG_DMA_CAP3_CTRL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_cap_regs(CAP_CONTEXTS, &regs), -EINVAL);
+}
+
+static void encode_route_test(struct kunit *test)
+{
+    u32 route = 0;
+
+    /* No mask: the first channels */
+    KUNIT_ASSERT_EQ(test, pcie_audio_encode_route(2, 0, 32, &route), 0);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_CAP_ROUTE_MASK, route), 0x3);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_CAP_ROUTE_FORMAT, route), CAP_ROUTE_S32);
+
+    KUNIT_ASSERT_EQ(test, pcie_audio_encode_route(2, 0x42, 16, &route), 0);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_CAP_ROUTE_MASK, route), 0x42);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(DMA_CAP_ROUTE_FORMAT, route), CAP_ROUTE_S16);
+
+    /* S24_LE still travels in 32-bit containers */
+    KUNIT_ASSERT_EQ(test, pcie_audio_encode_route(8, 0, 32, &route), 0);
+    KUNIT_EXPECT_EQ(test, route, FIELD_PREP(DMA_CAP_ROUTE_MASK, 0xFF));
+
+    /* The mask must name exactly the stream's channels */
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_route(3, 0x42, 32, &route), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_route(1, 0x10000, 32, &route), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_route(0, 0, 32, &route), -EINVAL);
+}
+
+static void context_events_test(struct kunit *test)
+{
+    unsigned int events = PCIE_AUDIO_EV_PB_PERIOD | PCIE_AUDIO_EV_CAP_PERIOD |
+                          PCIE_AUDIO_EV_CAP_NEAR_XRUN;
+
+    KUNIT_EXPECT_EQ(test, pcie_audio_context_events(events, 0, 0),
+                    PCIE_AUDIO_EV_CAP_PERIOD | PCIE_AUDIO_EV_CAP_NEAR_XRUN);
+
+    /* Context 0's period is not another context's, the FIFO is shared */
+    KUNIT_EXPECT_EQ(test, pcie_audio_context_events(events, 0, 1),
+                    PCIE_AUDIO_EV_CAP_NEAR_XRUN);
+    KUNIT_EXPECT_EQ(test, pcie_audio_context_events(PCIE_AUDIO_EV_CAP_XRUN,
+                                                    CAP_CONTEXT_PERIOD(2), 2),
+                    PCIE_AUDIO_EV_CAP_XRUN | PCIE_AUDIO_EV_CAP_PERIOD);
+    KUNIT_EXPECT_EQ(test, pcie_audio_context_events(0, CAP_CONTEXT_ERROR(3), 3),
+                    PCIE_AUDIO_EV_CAP_DMA_ERROR);
+    KUNIT_EXPECT_EQ(test, pcie_audio_context_events(0, CAP_CONTEXT_ERROR(3), 1), 0);
+    KUNIT_EXPECT_EQ(test, CAP_CONTEXT_PERIOD(1) | CAP_CONTEXT_ERROR(3),
+                    STATUS_CAP_CONTEXTS_PERIOD1 | STATUS_CAP_CONTEXTS_ERROR3);
+}
+
+static void eq_test(struct kunit *test)
+{
+    struct pcie_audio_eq_channel eq = {
+        .sections = cpu_to_le32(2),
+        .coef = { [1] = { cpu_to_le32(0x12345678), 0, 0, cpu_to_le32(0xC0000000) } },
+    };
+
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_validate(&eq), 2);
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_coef(&eq, 1, 0), 0x12345678);
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_coef(&eq, 1, 3), 0xC0000000);
+
+    /* Past the cascade: unity, b0 = 1.0 */
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_coef(&eq, 2, 0), EQ_UNITY);
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_coef(&eq, 7, 4), 0);
+
+    eq.sections = cpu_to_le32(EQ_MAX_SECTIONS + 1);
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_validate(&eq), -EINVAL);
+
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_coef_addr(5, 3, 4), 0x534);
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_sections(0, 0, 8), 0x8);
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_sections(0xFFFFFFFF, 7, 2), 0x2FFFFFFF);
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_sections(0x00000340, 2, 0), 0x00000040);
+    KUNIT_EXPECT_EQ(test, pcie_audio_eq_sections(0x00000340, 1, 5), 0x00000350);
+}
+
+static void fir_test(struct kunit *test)
+{
+    u32 caps = FIELD_PREP(FIR_CAPS_LANES, 8) | FIELD_PREP(FIR_CAPS_DEPTH, 1024);
+    bool seen[64] = { false };
+    unsigned int ch, tap, word;
+
+    /* 1024 cycles a frame at 48 kHz: 8 x (123 + 4) + 2 fit */
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_max_taps(caps, 49152000, 48000, 8), 984);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_max_taps(caps, 49152000, 192000, 8), 216);
+    /* Two channels: the BRAM, 512 words each, is nearly the limit */
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_max_taps(caps, 49152000, 48000, 2), 4056);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_max_taps(caps, 49152000, 44100, 1), 8192);
+    /* Unmeasured MCLK: the slower one */
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_max_taps(caps, 0, 48000, 8), 904);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_max_taps(caps, 49152000, 192000, 64), 0);
+
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_validate(caps, 49152000, 48000, 8, 984), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_validate(caps, 49152000, 48000, 8, 992), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_validate(caps, 49152000, 48000, 8, 100), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_validate(caps, 49152000, 48000, 17, 8), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_validate(caps, 49152000, 48000, 0, 0), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_validate(0, 49152000, 48000, 2, 8), -ENODEV);
+
+    /* 16 taps on 4 lanes: tap 5 of channel 1 is lane 1, word 1 of its segment */
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_index(1, 5, 16, 4), 21);
+    KUNIT_EXPECT_EQ(test, pcie_audio_fir_index(0, 12, 16, 4), 3);
+
+    /* Every word of 4 channels x 16 taps exactly once */
+    for (ch = 0; ch < 4; ch++) {
+        for (tap = 0; tap < 16; tap++) {
+            word = pcie_audio_fir_index(ch, tap, 16, 4);
+            KUNIT_ASSERT_LT(test, word, 64);
+            KUNIT_EXPECT_FALSE(test, seen[word]);
+            seen[word] = true;
+        }
+    }
+}
+
+static void spectrum_test(struct kunit *test)
+{
+    struct pcie_audio_spectrum_config cfg = {
+        .source = cpu_to_le32(SPEC_SOURCE_OUTPUT),
+        .channel = cpu_to_le32(3),
+        .size = cpu_to_le32(4096),
+        .window = cpu_to_le32(SPEC_WINDOW_HANN),
+        .average = cpu_to_le32(8),
+    };
+    u32 caps = 12;
+    u32 ctrl = 0;
+
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, caps, 8, &ctrl), 0);
+    KUNIT_EXPECT_EQ(test, ctrl, SPEC_CTRL_ENABLE | SPEC_CTRL_OUTPUT |
+                    FIELD_PREP(SPEC_CTRL_CHANNEL, 3) | FIELD_PREP(SPEC_CTRL_SIZE, 12) |
+                    FIELD_PREP(SPEC_CTRL_WINDOW, 1) | FIELD_PREP(SPEC_CTRL_AVERAGE, 3));
+    KUNIT_EXPECT_EQ(test, SPEC_SLOT_BYTES(caps), 8192);
+
+    /* Past the analyzer, off the card, not powers of 2 */
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, 11, 8, &ctrl), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, caps, 2, &ctrl), -EINVAL);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, 0, 8, &ctrl), -ENODEV);
+    cfg.size = cpu_to_le32(1000);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, caps, 8, &ctrl), -EINVAL);
+    cfg.size = cpu_to_le32(128);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, caps, 8, &ctrl), -EINVAL);
+    cfg.size = cpu_to_le32(256);
+    cfg.average = cpu_to_le32(0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, caps, 8, &ctrl), -EINVAL);
+    cfg.average = cpu_to_le32(256);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, caps, 8, &ctrl), -EINVAL);
+    cfg.average = cpu_to_le32(1);
+    cfg.window = cpu_to_le32(3);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, caps, 8, &ctrl), -EINVAL);
+    cfg.window = cpu_to_le32(SPEC_WINDOW_RECTANGULAR);
+    KUNIT_EXPECT_EQ(test, pcie_audio_encode_spectrum(&cfg, caps, 8, &ctrl), 0);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(SPEC_CTRL_SIZE, ctrl), 8);
+    KUNIT_EXPECT_EQ(test, FIELD_GET(SPEC_CTRL_AVERAGE, ctrl), 0);
+
+    /* Slots alternate, from 0; the count wraps, the valid bit stays */
+    KUNIT_EXPECT_EQ(test, pcie_audio_spectrum_slot(0), -EAGAIN);
+    KUNIT_EXPECT_EQ(test, pcie_audio_spectrum_slot(SPEC_STATUS_VALID | 1), 0);
+    KUNIT_EXPECT_EQ(test, pcie_audio_spectrum_slot(SPEC_STATUS_VALID | 2), 1);
+    KUNIT_EXPECT_EQ(test, pcie_audio_spectrum_slot(SPEC_STATUS_VALID), 1);
+    KUNIT_EXPECT_EQ(test, pcie_audio_spectrum_slot(SPEC_STATUS_VALID | SPEC_STATUS_ERROR),
+                    -EIO);
+}
+
+/*
+ * Microbenchmarks: ns per call with randomized inputs. BENCH_PARAMS parameter
+ * sets are drawn before the clock starts, so the timed loops cycle through
+ * them without paying for the PRNG. The seed is logged; pass it back as
+ * bench_seed to repeat a run. The accumulated result keeps the calls from
+ * being optimized away.
+ */
+#define BENCH_PARAMS    4096        /* A power of two */
+
+static unsigned long bench_seed;
+module_param(bench_seed, ulong, 0444);
+MODULE_PARM_DESC(bench_seed, "Seed of the benchmark inputs, 0 = from the clock");
+
+static struct bench_params {
+    unsigned int rate;          /* Either family up to 16x, or 32 kHz-based */
+    unsigned int width;         /* Physical sample width */
+    unsigned int channels;
+    unsigned int frame_bytes;
+    size_t period_bytes;
+    unsigned int periods;
+    u32 desc;                   /* Current descriptor, up to one wrap late */
+    u32 pb_status;
+    u32 cap_status;
+    u32 dma_error;
+} bench_params[BENCH_PARAMS];
+
+static void bench_randomize(struct kunit *test)
+{
+    static const unsigned int bases[] = { 44100, 48000, 32000 };
+    static const unsigned int widths[] = { 16, 24, 32 };
+    struct rnd_state rnd;
+    u64 seed = bench_seed ? bench_seed : ktime_get_ns();
+    unsigned int i;
+
+    kunit_info(test, "bench_seed=%llu\n", (unsigned long long)seed);
+    prandom_seed_state(&rnd, seed);
+
+    for (i = 0; i < BENCH_PARAMS; i++) {
+        struct bench_params *p = &bench_params[i];
+
+        p->rate = bases[prandom_u32_state(&rnd) % ARRAY_SIZE(bases)] *
+                  (1 + prandom_u32_state(&rnd) % 16);
+        p->width = widths[prandom_u32_state(&rnd) % ARRAY_SIZE(widths)];
+        p->channels = 1 + prandom_u32_state(&rnd) % 8;
+        p->frame_bytes = p->width / 8 * p->channels;
+        p->period_bytes = p->frame_bytes * (64 + prandom_u32_state(&rnd) % 8129);
+        p->periods = 2 + prandom_u32_state(&rnd) % (RING_DESC - 1);
+        p->desc = prandom_u32_state(&rnd) % (2 * p->periods);
+        p->pb_status = prandom_u32_state(&rnd) & STATUS_PB_UNDERRUN_W1C;
+        p->cap_status = prandom_u32_state(&rnd) & STATUS_CAP_OVERRUN_W1C;
+        p->dma_error = prandom_u32_state(&rnd) & STATUS_DMA_ERROR_W1C;
+    }
+}
+
+static void bench_report(struct kunit *test, const char *what, u64 start, u64 calls,
+                         u64 sink)
+{
+    u64 ns = ktime_get_ns() - start;
+
+    kunit_info(test, "%s: %llu.%02llu ns/call (sink %llx)\n", what,
+               (unsigned long long)(ns / calls),
+               (unsigned long long)(ns % calls * 100 / calls),
+               (unsigned long long)sink);
+}
+
+static void bench_build_ring(struct kunit *test)
+{
+    u64 start, descs = 0, sink = 0;
+    unsigned int i;
+
+    bench_randomize(test);
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_ITERS / RING_DESC; i++) {
+        const struct bench_params *p = &bench_params[i % BENCH_PARAMS];
+        int n = pcie_audio_build_ring(ring, RING_DESC, RING_DMA, BUF_DMA,
+                                      p->period_bytes, p->periods);
+
+        descs += n;
+        sink += n + le32_to_cpu(ring[0].length);
+    }
+    bench_report(test, "build_ring (per descriptor)", start, descs, sink);
+}
+
+static void bench_encode(struct kunit *test)
+{
+    struct pcie_audio_format fmt;
+    u64 start, sink = 0;
+    unsigned int i;
+    u32 family = 0, multi = 0;
+
+    bench_randomize(test);
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_ITERS; i++) {
+        const struct bench_params *p = &bench_params[i % BENCH_PARAMS];
+
+        sink += pcie_audio_encode_rate(p->rate, &family, &multi);
+        pcie_audio_encode_format(p->width, p->channels, &fmt);
+        sink += family + multi + fmt.format + fmt.bitdepth + fmt.tdm_slots;
+    }
+    bench_report(test, "encode_rate + encode_format", start, BENCH_ITERS, sink);
+}
+
+static void bench_hw_position(struct kunit *test)
+{
+    u64 start, sink = 0;
+    unsigned int i;
+
+    bench_randomize(test);
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_ITERS; i++) {
+        const struct bench_params *p = &bench_params[i % BENCH_PARAMS];
+
+        sink += pcie_audio_hw_position(p->desc, p->period_bytes,
+                                       p->period_bytes * p->periods, p->frame_bytes);
+    }
+    bench_report(test, "hw_position", start, BENCH_ITERS, sink);
+}
+
+static void bench_decode_irq(struct kunit *test)
+{
+    u64 start, sink = 0;
+    unsigned int i;
+
+    bench_randomize(test);
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_ITERS; i++) {
+        const struct bench_params *p = &bench_params[i % BENCH_PARAMS];
+
+        sink += pcie_audio_decode_irq(p->pb_status, p->cap_status, p->dma_error);
+    }
+    bench_report(test, "decode_irq", start, BENCH_ITERS, sink);
+}
+
+static struct kunit_case pcie_audio_core_test_cases[] = {
+    KUNIT_CASE(build_ring_full_test),
+    KUNIT_CASE(build_ring_few_periods_test),
+    KUNIT_CASE(build_ring_invalid_test),
+    KUNIT_CASE(encode_rate_test),
+    KUNIT_CASE(encode_format_test),
+    KUNIT_CASE(hw_position_test),
+    KUNIT_CASE(hw_position_random_test),
+    KUNIT_CASE(hw_delay_test),
+    KUNIT_CASE(decode_irq_test),
+    KUNIT_CASE(watermark_test),
+    KUNIT_CASE(prefetch_delay_test),
+    KUNIT_CASE(cap_regs_test),
+    KUNIT_CASE(encode_route_test),
+    KUNIT_CASE(context_events_test),
+    KUNIT_CASE(eq_test),
+    KUNIT_CASE(fir_test),
+    KUNIT_CASE(spectrum_test),
+    KUNIT_CASE(bench_build_ring),
+    KUNIT_CASE(bench_encode),
+    KUNIT_CASE(bench_hw_position),
+    KUNIT_CASE(bench_decode_irq),
+    {}
+};
+
+static struct kunit_suite pcie_audio_core_test_suite = {
+    .name = "pcie-audio-core",
+    .test_cases = pcie_audio_core_test_cases,
+};
+kunit_test_suite(pcie_audio_core_test_suite);
+
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+MODULE_LICENSE("GPL");
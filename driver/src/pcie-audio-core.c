@@ -0,0 +1,441 @@
+#include <linux/bitops.h>
+#include <linux/compiler.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <asm/byteorder.h>
+#include <kunit/visibility.h>
+#include "pcie-audio-core.h"
+#include "pcie-audio-latency.h"
+
+/*
+ * One descriptor per period, each pointing at its own period of the buffer,
+ * interrupting on completion; the last one wraps back to the first. Returns
+ * the number of descriptors used.
+ */
+int pcie_audio_build_ring(struct pcie_audio_dma_desc *ring, unsigned int max_desc,
+                          dma_addr_t ring_dma, dma_addr_t buf,
+                          size_t period_bytes, unsigned int periods)
+{
+    unsigned int i;
+
+    if (!periods || periods > max_desc || !period_bytes)
+        return -EINVAL;
+
+    for (i = 0; i < periods; i++) {
+        struct pcie_audio_dma_desc *desc = &ring[i];
+        unsigned int next = i + 1 < periods ? i + 1 : 0;
+
+        desc->address = cpu_to_le64(buf + (u64)i * period_bytes);
+        desc->length = cpu_to_le32(period_bytes);
+        desc->flags = cpu_to_le32(DESC_FLAG_INT |
+                                  (next ? 0 : DESC_FLAG_WRAP));
+        desc->next = cpu_to_le64(ring_dma + next * sizeof(*desc));
+    }
+
+    return periods;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_build_ring);
+
+/*
+ * REG_CTRL_SAMPLE_FAMILY and REG_CTRL_SAMPLE_MULTI: the base rate's family
+ * and its multiple minus one
+ */
+int pcie_audio_encode_rate(unsigned int rate, u32 *family, u32 *multi)
+{
+    unsigned int base, n;
+
+    if (rate && rate % 44100 == 0) {
+        base = 44100;
+        *family = FIELD_PREP(CTRL_SAMPLE_FAMILY_MASK, CTRL_SAMPLE_FAMILY_SF_44K1);
+    } else if (rate && rate % 48000 == 0) {
+        base = 48000;
+        *family = FIELD_PREP(CTRL_SAMPLE_FAMILY_MASK, CTRL_SAMPLE_FAMILY_SF_48K);
+    } else {
+        return -EINVAL;
+    }
+
+    n = rate / base;
+    if (n - 1 > FIELD_MAX(CTRL_SAMPLE_MULTI_MASK))
+        return -EINVAL;
+
+    *multi = FIELD_PREP(CTRL_SAMPLE_MULTI_MASK, n - 1);
+    return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_encode_rate);
+
+void pcie_audio_encode_format(unsigned int physical_width, unsigned int channels,
+                              struct pcie_audio_format *fmt)
+{
+    bool tdm = channels > 2;
+
+    fmt->format = FIELD_PREP(CTRL_FORMAT_MASK,
+                             tdm ? CTRL_FORMAT_TDM : CTRL_FORMAT_I2S_STANDARD);
+    fmt->bitdepth = FIELD_PREP(CTRL_I2S_BITDEPTH_MASK, physical_width);
+    fmt->tdm = FIELD_PREP(CTRL_I2S_TDM_MASK, tdm);
+    fmt->tdm_slots = FIELD_PREP(CTRL_I2S_TDM_SLOTS_MASK, channels - 1);
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_encode_format);
+
+/*
+ * Hardware position in frames, wrapped into the buffer. The DMA engines
+ * report no progress inside a descriptor, so the position has period
+ * granularity: every descriptor before the current one is done.
+ */
+unsigned long pcie_audio_hw_position(u32 current_desc, size_t period_bytes,
+                                     size_t buffer_bytes, unsigned int frame_bytes)
+{
+    u64 pos = (u64)current_desc * period_bytes;
+
+    if (!buffer_bytes || !frame_bytes)
+        return 0;
+
+    /* At most one buffer past the end unless the read came back all ones,
+     * e.g. from a removed device; keep the division off the common path */
+    if (unlikely(pos >= 2 * (u64)buffer_bytes))
+        div64_u64_rem(pos, buffer_bytes, &pos);
+    else if (pos >= buffer_bytes)
+        pos -= buffer_bytes;
+
+    return (unsigned long)pos / frame_bytes;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_hw_position);
+
+static const struct {
+    unsigned int rate;
+    unsigned int playback;
+    unsigned int capture;
+} delay_table[] = PCIE_AUDIO_DELAY_TABLE;
+
+/*
+ * Frames between the DMA pointer and the pins for runtime->delay: the
+ * typical FIFO and serializer latency from audio.LatencyBudget. Rates
+ * outside the table get 0 rather than a guess.
+ */
+unsigned int pcie_audio_hw_delay(unsigned int rate, bool capture)
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(delay_table); i++) {
+        if (delay_table[i].rate == rate)
+            return capture ? delay_table[i].capture : delay_table[i].playback;
+    }
+
+    return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_hw_delay);
+
+/*
+ * Each status register keeps its events in its low byte. A DMA error names
+ * the direction that stopped; bits the driver does not know stop both. Only
+ * the watermark on a FIFO's xrun side is a near miss, low for playback and
+ * high for capture; the other one is neither that nor a period.
+ */
+unsigned int pcie_audio_decode_irq(u32 pb_status, u32 cap_status, u32 dma_error)
+{
+    unsigned int events = 0;
+
+    pb_status &= 0xFF;
+    cap_status &= 0xFF;
+
+    if (pb_status & STATUS_XRUN) {
+        events |= PCIE_AUDIO_EV_PB_XRUN;
+    } else {
+        if (pb_status & STATUS_LOW)
+            events |= PCIE_AUDIO_EV_PB_NEAR_XRUN;
+        if (pb_status & ~(u32)(STATUS_LOW | STATUS_HIGH))
+            events |= PCIE_AUDIO_EV_PB_PERIOD;
+    }
+
+    if (cap_status & STATUS_XRUN) {
+        events |= PCIE_AUDIO_EV_CAP_XRUN;
+    } else {
+        if (cap_status & STATUS_HIGH)
+            events |= PCIE_AUDIO_EV_CAP_NEAR_XRUN;
+        if (cap_status & ~(u32)(STATUS_LOW | STATUS_HIGH))
+            events |= PCIE_AUDIO_EV_CAP_PERIOD;
+    }
+
+    if (dma_error & ~(u32)(DMA_ERROR_PB | DMA_ERROR_CAP))
+        dma_error |= DMA_ERROR_PB | DMA_ERROR_CAP;
+    if (dma_error & DMA_ERROR_PB)
+        events |= PCIE_AUDIO_EV_PB_DMA_ERROR;
+    if (dma_error & DMA_ERROR_CAP)
+        events |= PCIE_AUDIO_EV_CAP_DMA_ERROR;
+
+    return events;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_decode_irq);
+
+/*
+ * REG_DMA_*_WATERMARK and REG_DMA_*_WM_FILTER for a fifo_frames deep FIFO:
+ * a watermark a quarter of the FIFO away from the xrun, playback low and
+ * capture high, the other one off.
+ */
+void pcie_audio_encode_watermark(unsigned int fifo_frames, bool capture,
+                                 u32 *watermark, u32 *filter)
+{
+    unsigned int margin = fifo_frames / WM_MARGIN_DIV;
+
+    if (capture)
+        *watermark = FIELD_PREP(DMA_CAP_WATERMARK_HIGH, fifo_frames - margin);
+    else
+        *watermark = FIELD_PREP(DMA_PB_WATERMARK_LOW, margin);
+    *filter = FIELD_PREP(DMA_PB_WM_FILTER_HYSTERESIS, fifo_frames / WM_HYSTERESIS_DIV) |
+              FIELD_PREP(DMA_PB_WM_FILTER_HOLDOFF, WM_HOLDOFF);
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_encode_watermark);
+
+/*
+ * Frames a near miss stayed away from the xrun, from REG_STATUS_PB_FIFO or
+ * REG_STATUS_CAP_FIFO: the lowest playback level, or the room left above
+ * the highest capture level.
+ */
+unsigned int pcie_audio_xrun_margin(u32 fifo_status, unsigned int fifo_frames, bool capture)
+{
+    unsigned int peak = FIELD_GET(STATUS_PB_FIFO_PEAK, fifo_status);
+
+    if (!capture)
+        return peak;
+    return peak < fifo_frames ? fifo_frames - peak : 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_xrun_margin);
+
+/*
+ * Playback frames past the DMA pointer with the prefetch scheduler on, from
+ * REG_STATUS_PB_PREFETCH: the queue refills at the target and a burst lands
+ * on top, so it averages half a burst above it. 0 until the scheduler has
+ * measured, the static table still holds then.
+ */
+unsigned int pcie_audio_prefetch_delay(u32 prefetch_status)
+{
+    unsigned int target = FIELD_GET(STATUS_PB_PREFETCH_TARGET, prefetch_status);
+
+    return target ? target + PREFETCH_BURST_FRAMES / 2 : 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_prefetch_delay);
+
+/*
+ * The registers of capture context n: context 0 is the DMA_CAP block the
+ * FIFO watermarks and xrun status belong to, n >= 1 the DMA_CAPn blocks.
+ */
+int pcie_audio_cap_regs(unsigned int context, struct pcie_audio_cap_regs *regs)
+{
+    unsigned int offset;
+
+    if (context >= CAP_CONTEXTS)
+        return -EINVAL;
+
+    if (!context) {
+        regs->desc_base = REG_DMA_CAP_DESC_BASE;
+        regs->desc_count = REG_DMA_CAP_DESC_COUNT;
+        regs->current_desc = REG_DMA_CAP_CURRENT;
+        regs->size = REG_DMA_CAP_SIZE;
+        regs->route = REG_DMA_CAP_ROUTE;
+        regs->desc_active = REG_STATUS_CAP_DESC_ACTIVE;
+        regs->ctrl = 0;
+        return 0;
+    }
+
+    offset = (context - 1) * CAP_CONTEXT_STRIDE;
+    regs->desc_base = REG_DMA_CAP1_DESC_BASE + offset;
+    regs->desc_count = REG_DMA_CAP1_DESC_COUNT + offset;
+    regs->current_desc = REG_DMA_CAP1_CURRENT + offset;
+    regs->size = REG_DMA_CAP1_SIZE + offset;
+    regs->route = REG_DMA_CAP1_ROUTE + offset;
+    regs->desc_active = REG_DMA_CAP1_ACTIVE + offset;
+    regs->ctrl = REG_DMA_CAP1_CTRL + offset;
+    return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_cap_regs);
+
+/*
+ * REG_DMA_CAP*_ROUTE for a stream of channels channels: the channels set in
+ * channel_mask, or the first ones for a mask of 0, in 16-bit containers for
+ * S16_LE and 32-bit ones otherwise. The mask must name exactly channels
+ * channels, the packer writes one sample per channel set.
+ */
+int pcie_audio_encode_route(unsigned int channels, u32 channel_mask,
+                            unsigned int physical_width, u32 *route)
+{
+    u32 mask = channel_mask;
+
+    if (!channels || channels > 16)
+        return -EINVAL;
+    if (!mask)
+        mask = GENMASK(channels - 1, 0);
+    if (mask & ~DMA_CAP_ROUTE_MASK || hweight32(mask) != channels)
+        return -EINVAL;
+
+    *route = FIELD_PREP(DMA_CAP_ROUTE_MASK, mask) |
+             FIELD_PREP(DMA_CAP_ROUTE_FORMAT,
+                        physical_width == 16 ? CAP_ROUTE_S16 : CAP_ROUTE_S32);
+    return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_encode_route);
+
+/*
+ * Capture events of one context: context 0 takes the decoded events as they
+ * are, context n >= 1 its period and error bits of REG_STATUS_CAP_CONTEXTS.
+ * Every context shares the capture FIFO, so its xrun and near misses.
+ */
+unsigned int pcie_audio_context_events(unsigned int events, u32 contexts,
+                                       unsigned int context)
+{
+    unsigned int shared = PCIE_AUDIO_EV_CAP_XRUN | PCIE_AUDIO_EV_CAP_NEAR_XRUN;
+
+    if (!context)
+        return events & (shared | PCIE_AUDIO_EV_CAP_PERIOD | PCIE_AUDIO_EV_CAP_DMA_ERROR);
+
+    events &= shared;
+    if (contexts & CAP_CONTEXT_PERIOD(context))
+        events |= PCIE_AUDIO_EV_CAP_PERIOD;
+    if (contexts & CAP_CONTEXT_ERROR(context))
+        events |= PCIE_AUDIO_EV_CAP_DMA_ERROR;
+    return events;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_context_events);
+
+/* Sections in a channel's cascade, -EINVAL past what the bank runs */
+int pcie_audio_eq_validate(const struct pcie_audio_eq_channel *eq)
+{
+    u32 sections = le32_to_cpu(eq->sections);
+
+    return sections > EQ_MAX_SECTIONS ? -EINVAL : sections;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_eq_validate);
+
+/*
+ * REG_EQ_COEF_DATA for one coefficient. Sections past the cascade are
+ * unity, b0 = 1 and the rest 0, which the datapath passes bit for bit, so
+ * running more sections than a channel has changes nothing.
+ */
+u32 pcie_audio_eq_coef(const struct pcie_audio_eq_channel *eq, unsigned int section,
+                       unsigned int index)
+{
+    if (section >= le32_to_cpu(eq->sections))
+        return index ? 0 : EQ_UNITY;
+    return le32_to_cpu(eq->coef[section][index]);
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_eq_coef);
+
+u32 pcie_audio_eq_coef_addr(unsigned int channel, unsigned int section, unsigned int index)
+{
+    return FIELD_PREP(EQ_COEF_ADDR_CHANNEL, channel) |
+           FIELD_PREP(EQ_COEF_ADDR_SECTION, section) |
+           FIELD_PREP(EQ_COEF_ADDR_INDEX, index);
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_eq_coef_addr);
+
+/* REG_EQ_SECTIONS with channel's count replaced, the fields are 4 bits apart */
+u32 pcie_audio_eq_sections(u32 sections, unsigned int channel, unsigned int count)
+{
+    unsigned int shift = channel * 4;
+
+    return (sections & ~(EQ_SECTIONS_CH0 << shift)) |
+           (FIELD_PREP(EQ_SECTIONS_CH0, count) << shift);
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_eq_sections);
+
+/*
+ * Most taps per channel the engine runs for channels channels at rate: a
+ * frame takes 2 + channels x (taps / lanes + FIR_CHANNEL_OVERHEAD) MCLK
+ * cycles, and the taps of all channels share lanes x depth words
+ */
+unsigned int pcie_audio_fir_max_taps(u32 caps, u32 mclk_hz, unsigned int rate,
+                                     unsigned int channels)
+{
+    unsigned int lanes = FIELD_GET(FIR_CAPS_LANES, caps);
+    unsigned int depth = FIELD_GET(FIR_CAPS_DEPTH, caps);
+    unsigned int cycles, segment;
+
+    if (!rate || !channels)
+        return 0;
+    cycles = (mclk_hz ? mclk_hz : FIR_NOMINAL_MCLK) / rate;
+    if (cycles < 2 + channels * (FIR_CHANNEL_OVERHEAD + 1))
+        return 0;
+    segment = (cycles - 2) / channels - FIR_CHANNEL_OVERHEAD;
+    if (segment > depth / channels)
+        segment = depth / channels;
+    return segment * lanes;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_fir_max_taps);
+
+/* -ENODEV without an engine, -EINVAL for a filter it cannot run at rate */
+int pcie_audio_fir_validate(u32 caps, u32 mclk_hz, unsigned int rate,
+                            unsigned int channels, unsigned int taps)
+{
+    unsigned int lanes = FIELD_GET(FIR_CAPS_LANES, caps);
+
+    if (!channels)
+        return 0;
+    if (!lanes)
+        return -ENODEV;
+    if (channels > FIR_MAX_CHANNELS || !taps || taps % lanes ||
+        taps > pcie_audio_fir_max_taps(caps, mclk_hz, rate, channels))
+        return -EINVAL;
+    return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_fir_validate);
+
+/*
+ * Word of the coefficient buffer holding tap of channel: lane l runs taps
+ * l S .. l S + S - 1, S = taps / lanes, and the engine writes buffer word w
+ * to lane w % lanes
+ */
+unsigned int pcie_audio_fir_index(unsigned int channel, unsigned int tap,
+                                  unsigned int taps, unsigned int lanes)
+{
+    unsigned int segment = taps / lanes;
+
+    return (channel * segment + tap % segment) * lanes + tap / segment;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_fir_index);
+
+/*
+ * REG_SPEC_CTRL running cfg, -EINVAL for one the analyzer cannot run: sizes
+ * and averages are powers of 2, sizes up to 2^SPEC_CAPS, channel one of the
+ * card's channels. -ENODEV without an analyzer
+ */
+int pcie_audio_encode_spectrum(const struct pcie_audio_spectrum_config *cfg, u32 caps,
+                               unsigned int channels, u32 *ctrl)
+{
+    u32 source = le32_to_cpu(cfg->source);
+    u32 channel = le32_to_cpu(cfg->channel);
+    u32 size = le32_to_cpu(cfg->size);
+    u32 window = le32_to_cpu(cfg->window);
+    u32 average = le32_to_cpu(cfg->average);
+
+    if (!FIELD_GET(SPEC_CAPS_MASK, caps))
+        return -ENODEV;
+    if (source > SPEC_SOURCE_OUTPUT || channel >= channels ||
+        !is_power_of_2(size) || size < SPEC_MIN_SIZE ||
+        size > BIT(FIELD_GET(SPEC_CAPS_MASK, caps)) ||
+        window > SPEC_WINDOW_BLACKMAN_HARRIS ||
+        !is_power_of_2(average) || average > SPEC_MAX_AVERAGE)
+        return -EINVAL;
+
+    *ctrl = SPEC_CTRL_ENABLE |
+            FIELD_PREP(SPEC_CTRL_OUTPUT, source) |
+            FIELD_PREP(SPEC_CTRL_CHANNEL, channel) |
+            FIELD_PREP(SPEC_CTRL_SIZE, ilog2(size)) |
+            FIELD_PREP(SPEC_CTRL_WINDOW, window) |
+            FIELD_PREP(SPEC_CTRL_AVERAGE, ilog2(average));
+    return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_encode_spectrum);
+
+/*
+ * Slot holding the newest spectrum by REG_SPEC_STATUS: -EAGAIN before the
+ * first one, -EIO once a write failed
+ */
+int pcie_audio_spectrum_slot(u32 status)
+{
+    if (status & SPEC_STATUS_ERROR)
+        return -EIO;
+    if (!(status & SPEC_STATUS_VALID))
+        return -EAGAIN;
+    return (FIELD_GET(SPEC_STATUS_COUNT, status) - 1) & 1;
+}
+EXPORT_SYMBOL_IF_KUNIT(pcie_audio_spectrum_slot);
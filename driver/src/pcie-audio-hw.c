@@ -2,32 +2,19 @@
 #include <linux/delay.h>
 #include "pcie-audio.h"
 
-static inline u32 pcie_audio_read(struct pcie_audio *chip, unsigned int reg)
+/* The serializer registers of pcie_audio_encode_format() */
+void pcie_audio_write_format(struct pcie_audio *chip, const struct pcie_audio_format *fmt)
 {
-    u32 val;
-    unsigned long flags;
-    
-    spin_lock_irqsave(&chip->reg_lock, flags);
-    val = readl(chip->reg_base + reg);
-    spin_unlock_irqrestore(&chip->reg_lock, flags);
-    
-    return val;
-}
-
-static inline void pcie_audio_write(struct pcie_audio *chip,
-                                  unsigned int reg, u32 val)
-{
-    unsigned long flags;
-    
-    spin_lock_irqsave(&chip->reg_lock, flags);
-    writel(val, chip->reg_base + reg);
-    spin_unlock_irqrestore(&chip->reg_lock, flags);
+    pcie_audio_write(chip, REG_CTRL_FORMAT, fmt->format);
+    pcie_audio_write(chip, REG_CTRL_I2S_BITDEPTH, fmt->bitdepth);
+    pcie_audio_write(chip, REG_CTRL_I2S_TDM, fmt->tdm);
+    pcie_audio_write(chip, REG_CTRL_I2S_TDM_SLOTS, fmt->tdm_slots);
 }
 
 int pcie_audio_init_hw(struct pcie_audio *chip)
 {
+    struct pcie_audio_format fmt;
     unsigned long timeout;
-    u32 val;
     
     // Reset the hardware
     pcie_audio_write(chip, REG_CTRL_RESET, 1);
@@ -35,29 +22,18 @@ int pcie_audio_init_hw(struct pcie_audio *chip)
     pcie_audio_write(chip, REG_CTRL_RESET, 0);
     msleep(1);  // Wait for hardware to stabilize
     
-    // Configure DMA engine
-    val = 0;
-    val |= (512 << 16);           // Burst size
-    val |= (1 << 8);             // Enable scatter-gather
-    val |= (1 << 1);             // Enable completion interrupt
-    val |= (1 << 0);             // Master enable
-    pcie_audio_write(chip, REG_DMA_CONFIG, val);
-    
     // Set default thresholds
     pcie_audio_write(chip, REG_DMA_PB_THRESHOLD, 1024);
     pcie_audio_write(chip, REG_DMA_CAP_THRESHOLD, 1024);
     
-    // Configure default audio format
-    val = 0;
-    val |= (24 << 8);            // 24-bit depth
-    val |= (8 - 1);              // 8 channels
-    pcie_audio_write(chip, REG_CTRL_FORMAT, val);
+    // Configure default audio format: 24-bit, 8 channels
+    pcie_audio_encode_format(24, MAX_CHANNELS, &fmt);
+    pcie_audio_write_format(chip, &fmt);
     
     // Configure clock management
-    val = 0;
-    val |= (48000 << 16);        // Sync timeout (1ms at 48kHz)
-    val |= (1 << 0);             // Enable auto rate detection
-    pcie_audio_write(chip, REG_CTRL_SYNC_TIMEOUT, val);
+    pcie_audio_write(chip, REG_CTRL_SYNC_TIMEOUT,
+                     FIELD_PREP(CTRL_SYNC_TIMEOUT_MASK, 48000)); // 1s at 48kHz
+    pcie_audio_write(chip, REG_CTRL_AUTO_RATE, CTRL_AUTO_RATE_MASK);
     
     // Wait for clock lock
     timeout = jiffies + msecs_to_jiffies(1000);
@@ -71,18 +47,10 @@ int pcie_audio_init_hw(struct pcie_audio *chip)
     return 0;  // Continue anyway, clock might lock later
     
 clock_locked:
-    // Configure PCIe parameters
-    val = 0;
-    val |= (chip->pci->current_state << 24);  // Link speed
-    val |= (512 << 16);                       // Max payload
-    val |= (1 << 8);                          // Relaxed ordering
-    val |= (1 << 0);                          // Enable features
-    pcie_audio_write(chip, REG_PCIE_CONFIG, val);
-    
     // Clear all status registers
-    pcie_audio_write(chip, REG_STATUS_PB_UNDERRUN, 0xFFFFFFFF);
-    pcie_audio_write(chip, REG_STATUS_CAP_OVERRUN, 0xFFFFFFFF);
-    pcie_audio_write(chip, REG_STATUS_DMA_ERROR, 0xFFFFFFFF);
+    pcie_audio_write(chip, REG_STATUS_PB_UNDERRUN, STATUS_PB_UNDERRUN_W1C);
+    pcie_audio_write(chip, REG_STATUS_CAP_OVERRUN, STATUS_CAP_OVERRUN_W1C);
+    pcie_audio_write(chip, REG_STATUS_DMA_ERROR, STATUS_DMA_ERROR_W1C);
     
     return 0;
 }
@@ -110,4 +78,235 @@ void pcie_audio_pcie_init(struct pcie_audio *chip)
     pcie_capability_clear_and_set_word(chip->pci, PCI_EXP_DEVCTL,
                                      PCI_EXP_DEVCTL_PAYLOAD,
                                      0x2000);  // 512 bytes max payload
-}
\ No newline at end of file
+}
+
+/* Waits for the filters to run on bank, they switch between two frames */
+static int pcie_audio_wait_eq_bank(struct pcie_audio *chip, unsigned int bank)
+{
+    unsigned int waited;
+    
+    for (waited = 0; waited < EQ_SWITCH_TIMEOUT_US; waited += 10) {
+        if (FIELD_GET(EQ_STATUS_MASK, pcie_audio_read(chip, REG_EQ_STATUS)) == bank)
+            return 0;
+        udelay(10);
+    }
+    return -ETIMEDOUT;
+}
+
+/*
+ * Loads chip->eq, every channel's cascade, into the coefficient bank the
+ * filters do not run on and switches to it, so no frame runs on a
+ * half-written filter. Sections past a cascade are unity in every bank the
+ * driver wrote, so while the switch is pending REG_EQ_SECTIONS covers the
+ * longer of each channel's old and new cascade, and drops to the new one
+ * once the switch is done. Called with eq_lock held.
+ */
+int pcie_audio_load_eq(struct pcie_audio *chip)
+{
+    u32 ctrl = pcie_audio_read(chip, REG_EQ_CTRL);
+    u32 old = pcie_audio_read(chip, REG_EQ_SECTIONS);
+    u32 covering = old, sections = 0;
+    unsigned int bank = !FIELD_GET(EQ_CTRL_BANK, ctrl);
+    unsigned int ch, s, i;
+    int err;
+    
+    /* The last switch has to be done before its old bank is overwritten */
+    err = pcie_audio_wait_eq_bank(chip, !bank);
+    if (err)
+        return err;
+    
+    for (ch = 0; ch < EQ_CHANNELS; ch++) {
+        const struct pcie_audio_eq_channel *eq = &chip->eq[ch];
+        unsigned int count = le32_to_cpu(eq->sections);
+        
+        for (s = 0; s < EQ_MAX_SECTIONS; s++) {
+            for (i = 0; i < EQ_COEFS; i++) {
+                pcie_audio_write(chip, REG_EQ_COEF_ADDR, pcie_audio_eq_coef_addr(ch, s, i));
+                pcie_audio_write(chip, REG_EQ_COEF_DATA, pcie_audio_eq_coef(eq, s, i));
+            }
+        }
+        
+        sections = pcie_audio_eq_sections(sections, ch, count);
+        if (count > ((old >> (ch * 4)) & EQ_SECTIONS_CH0))
+            covering = pcie_audio_eq_sections(covering, ch, count);
+    }
+    
+    pcie_audio_write(chip, REG_EQ_SECTIONS, covering);
+    pcie_audio_write(chip, REG_EQ_CTRL, (sections ? EQ_CTRL_ENABLE : 0) |
+                                        FIELD_PREP(EQ_CTRL_BANK, bank));
+    err = pcie_audio_wait_eq_bank(chip, bank);
+    if (err)
+        return err;
+    
+    pcie_audio_write(chip, REG_EQ_SECTIONS, sections);
+    return 0;
+}
+
+/* Waits for the coefficient DMA FIR_LOAD started */
+static int pcie_audio_wait_fir_load(struct pcie_audio *chip)
+{
+    unsigned int waited;
+    u32 status;
+    
+    for (waited = 0; waited < FIR_LOAD_TIMEOUT_US; waited += 10) {
+        status = pcie_audio_read(chip, REG_FIR_STATUS);
+        if (!(status & FIR_STATUS_BUSY))
+            return status & FIR_STATUS_ERROR ? -EIO : 0;
+        udelay(10);
+    }
+    return -ETIMEDOUT;
+}
+
+/*
+ * Loads chip->fir into the engine: the card reads the coefficients from
+ * chip->fir.coefs itself. The engine passes the output through while they
+ * are loaded, and clears its history when enabled again. Called with
+ * fir_lock held.
+ */
+int pcie_audio_load_fir(struct pcie_audio *chip)
+{
+    u32 channels = FIELD_PREP(FIR_CTRL_CHANNELS, chip->fir.channels);
+    int err;
+    
+    pcie_audio_write(chip, REG_FIR_CTRL, 0);
+    if (!chip->fir.channels)
+        return 0;
+    
+    pcie_audio_write(chip, REG_FIR_COEF_BASE, lower_32_bits(chip->fir.coefs_dma));
+    pcie_audio_write(chip, REG_FIR_COEF_BASE_HI, upper_32_bits(chip->fir.coefs_dma));
+    pcie_audio_write(chip, REG_FIR_TAPS, chip->fir.taps);
+    pcie_audio_write(chip, REG_FIR_CTRL, channels);
+    pcie_audio_write(chip, REG_FIR_LOAD, FIR_LOAD_MASK);
+    err = pcie_audio_wait_fir_load(chip);
+    if (err)
+        return err;
+    
+    pcie_audio_write(chip, REG_FIR_CTRL, FIR_CTRL_ENABLE | channels);
+    return 0;
+}
+
+/*
+ * Sets and loads the filter of the first channels channels, coefs taps Q1.23
+ * coefficients each in natural order, after checking the engine can run it
+ * at rate. The coefficient buffer is allocated once at the engine's size.
+ * Called with fir_lock held.
+ */
+int pcie_audio_set_fir(struct pcie_audio *chip, unsigned int channels, unsigned int taps,
+                       const __le32 *coefs, unsigned int rate)
+{
+    u32 caps = pcie_audio_read(chip, REG_FIR_CAPS);
+    u32 mclk = pcie_audio_read(chip, REG_STATUS_MCLK_FREQ);
+    unsigned int lanes = FIELD_GET(FIR_CAPS_LANES, caps);
+    unsigned int ch, tap;
+    int err;
+    
+    err = pcie_audio_fir_validate(caps, mclk, rate, channels, taps);
+    if (err)
+        return err;
+    
+    if (channels && !chip->fir.coefs) {
+        chip->fir.bytes = lanes * FIELD_GET(FIR_CAPS_DEPTH, caps) * sizeof(__le32);
+        chip->fir.coefs = dma_alloc_coherent(&chip->pci->dev, chip->fir.bytes,
+                                             &chip->fir.coefs_dma, GFP_KERNEL);
+        if (!chip->fir.coefs)
+            return -ENOMEM;
+    }
+    
+    for (ch = 0; ch < channels; ch++)
+        for (tap = 0; tap < taps; tap++)
+            chip->fir.coefs[pcie_audio_fir_index(ch, tap, taps, lanes)] =
+                coefs[ch * taps + tap];
+    
+    chip->fir.channels = channels;
+    chip->fir.taps = taps;
+    return pcie_audio_load_fir(chip);
+}
+
+/*
+ * Programs chip->spectrum.config into the analyzer, or turns it off for a
+ * size of 0. It is disabled first, which restarts the average, the slots
+ * and the count. The two slots are allocated once at the analyzer's
+ * largest size. Called with spectrum_lock held.
+ */
+int pcie_audio_load_spectrum(struct pcie_audio *chip)
+{
+    u32 caps;
+    u32 ctrl;
+    int err;
+    
+    pcie_audio_write(chip, REG_SPEC_CTRL, 0);
+    if (!le32_to_cpu(chip->spectrum.config.size))
+        return 0;
+    
+    caps = pcie_audio_read(chip, REG_SPEC_CAPS);
+    err = pcie_audio_encode_spectrum(&chip->spectrum.config, caps, MAX_CHANNELS, &ctrl);
+    if (err)
+        return err;
+    
+    if (!chip->spectrum.buf) {
+        chip->spectrum.bytes = 2 * SPEC_SLOT_BYTES(caps);
+        chip->spectrum.buf = dma_alloc_coherent(&chip->pci->dev, chip->spectrum.bytes,
+                                                &chip->spectrum.buf_dma, GFP_KERNEL);
+        if (!chip->spectrum.buf)
+            return -ENOMEM;
+    }
+    
+    pcie_audio_write(chip, REG_SPEC_BASE, lower_32_bits(chip->spectrum.buf_dma));
+    pcie_audio_write(chip, REG_SPEC_BASE_HI, upper_32_bits(chip->spectrum.buf_dma));
+    pcie_audio_write(chip, REG_SPEC_CTRL, ctrl);
+    return 0;
+}
+
+/*
+ * Checks and programs cfg; the analyzer keeps its configuration when cfg is
+ * rejected. Called with spectrum_lock held.
+ */
+int pcie_audio_set_spectrum(struct pcie_audio *chip,
+                            const struct pcie_audio_spectrum_config *cfg)
+{
+    u32 ctrl;
+    int err;
+    
+    if (le32_to_cpu(cfg->size)) {
+        err = pcie_audio_encode_spectrum(cfg, pcie_audio_read(chip, REG_SPEC_CAPS),
+                                         MAX_CHANNELS, &ctrl);
+        if (err)
+            return err;
+    }
+    
+    chip->spectrum.config = *cfg;
+    return pcie_audio_load_spectrum(chip);
+}
+
+/*
+ * Copies the newest spectrum, size / 2 floats, to bins. Once the count
+ * moves the card starts on the slot being copied, so a copy the count moved
+ * during is retried; a spectrum takes at least 256 frames, so one retry
+ * nearly always does. Called with spectrum_lock held.
+ */
+int pcie_audio_read_spectrum(struct pcie_audio *chip, __le32 *bins, u32 *sequence)
+{
+    unsigned int count = le32_to_cpu(chip->spectrum.config.size) / 2;
+    size_t slot_words = chip->spectrum.bytes / 2 / sizeof(__le32);
+    unsigned int tries;
+    u32 status, after;
+    int slot;
+    
+    if (!count || !chip->spectrum.buf)
+        return -ENODATA;
+    
+    for (tries = 0; tries < 3; tries++) {
+        status = pcie_audio_read(chip, REG_SPEC_STATUS);
+        slot = pcie_audio_spectrum_slot(status);
+        if (slot < 0)
+            return slot;
+        memcpy(bins, chip->spectrum.buf + slot * slot_words, count * sizeof(*bins));
+        rmb();
+        after = pcie_audio_read(chip, REG_SPEC_STATUS);
+        if (after == status) {
+            *sequence = FIELD_GET(SPEC_STATUS_COUNT, status);
+            return 0;
+        }
+    }
+    return -EBUSY;
+}
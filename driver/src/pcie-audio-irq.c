@@ -1,23 +1,84 @@
 #include <linux/interrupt.h>
 #include "pcie-audio.h"
 
+/* Word of a status register in the interrupt handler's snapshot */
+#define STATUS_WORD(reg)    (((reg) - REG_STATUS_PB_UNDERRUN) / 4)
+
+/*
+ * A FIFO crossed its watermark on the xrun side: record how close it came.
+ * The caller wakes the application with snd_pcm_period_elapsed() so it
+ * refills or drains before the period would have told it to.
+ */
+static void pcie_audio_near_miss(struct pcie_audio_stream *stream, u32 fifo_status,
+                                 bool capture)
+{
+    unsigned int margin = pcie_audio_xrun_margin(fifo_status, FIFO_SIZE, capture);
+
+    stream->near_misses++;
+    if (margin < stream->min_margin)
+        stream->min_margin = margin;
+}
+
+/*
+ * One capture context's events. The contexts share the capture FIFO, so an
+ * xrun stops every running context and a near miss wakes each of them.
+ */
+static void pcie_audio_capture_irq(struct pcie_audio *chip, struct pcie_audio_stream *stream,
+                                   unsigned int events, u32 fifo_status, ktime_t now)
+{
+    if (!events || !stream->substream)
+        return;
+    
+    stream->interrupts++;
+    stream->latency = ktime_to_us(ktime_sub(now, stream->last_interrupt));
+    stream->last_interrupt = now;
+    
+    if (events & PCIE_AUDIO_EV_CAP_DMA_ERROR) {
+        chip->stats.dma_errors++;
+        stream->errors++;
+        snd_pcm_stop_xrun(stream->substream);
+    } else if (events & PCIE_AUDIO_EV_CAP_XRUN) {
+        stream->errors++;
+        snd_pcm_stop_xrun(stream->substream);
+    } else {
+        if (events & PCIE_AUDIO_EV_CAP_NEAR_XRUN)
+            pcie_audio_near_miss(stream, fifo_status, true);
+        snd_pcm_period_elapsed(stream->substream);
+    }
+}
+
+/* Write-1-to-clear the bits of a status register, skipping an empty write */
+static void pcie_audio_ack(struct pcie_audio *chip, unsigned int reg, u32 bits)
+{
+    if (bits)
+        pcie_audio_write(chip, reg, bits);
+}
+
 static irqreturn_t pcie_audio_interrupt(int irq, void *dev_id)
 {
     struct pcie_audio *chip = dev_id;
-    unsigned int status;
+    u32 status[STATUS_WORD(REG_STATUS_CAP_CONTEXTS) + 1];
+    unsigned int events, delay, i;
+    u32 contexts;
     unsigned long flags;
     ktime_t now = ktime_get();
     
-    // Read and clear interrupt status
-    status = pcie_audio_read(chip, REG_STATUS_PB_UNDERRUN) |
-             (pcie_audio_read(chip, REG_STATUS_CAP_OVERRUN) << 8) |
-             (pcie_audio_read(chip, REG_STATUS_DMA_ERROR) << 16);
+    // Read and clear interrupt status. The event registers, FIFO levels,
+    // prefetch state and capture context events come back in one completion
+    // of at most 128 bytes
+    BUILD_BUG_ON(sizeof(status) > 128);
+    pcie_audio_read_block(chip, REG_STATUS_PB_UNDERRUN, status, ARRAY_SIZE(status));
+    events = pcie_audio_decode_irq(status[STATUS_WORD(REG_STATUS_PB_UNDERRUN)],
+                                   status[STATUS_WORD(REG_STATUS_CAP_OVERRUN)],
+                                   status[STATUS_WORD(REG_STATUS_DMA_ERROR)]);
+    contexts = status[STATUS_WORD(REG_STATUS_CAP_CONTEXTS)] & STATUS_CAP_CONTEXTS_W1C;
     
-    if (!status)
+    if (!events && !contexts)
         return IRQ_NONE;
     
     // Handle playback interrupts
-    if (status & 0xFF) {
+    if (events & (PCIE_AUDIO_EV_PB_PERIOD | PCIE_AUDIO_EV_PB_XRUN |
+                  PCIE_AUDIO_EV_PB_DMA_ERROR | PCIE_AUDIO_EV_PB_NEAR_XRUN)) {
         spin_lock_irqsave(&chip->pb_lock, flags);
         
         if (chip->playback.substream) {
@@ -26,11 +87,25 @@ static irqreturn_t pcie_audio_interrupt(int irq, void *dev_id)
                                                chip->playback.last_interrupt));
             chip->playback.last_interrupt = now;
             
-            if (status & (1 << 0)) {
+            /* A DMA error stops only the direction that hit it; the xrun
+             * makes ALSA re-prepare and restart just this stream */
+            if (events & PCIE_AUDIO_EV_PB_DMA_ERROR) {
+                chip->stats.dma_errors++;
+                chip->playback.errors++;
+                snd_pcm_stop_xrun(chip->playback.substream);
+            } else if (events & PCIE_AUDIO_EV_PB_XRUN) {
                 chip->stats.pb_underruns++;
                 chip->playback.errors++;
                 snd_pcm_stop_xrun(chip->playback.substream);
             } else {
+                if (events & PCIE_AUDIO_EV_PB_NEAR_XRUN)
+                    pcie_audio_near_miss(&chip->playback,
+                                         status[STATUS_WORD(REG_STATUS_PB_FIFO)], false);
+                /* Once the prefetch scheduler has measured, its target is
+                 * what sits between the DMA pointer and the pins */
+                delay = pcie_audio_prefetch_delay(status[STATUS_WORD(REG_STATUS_PB_PREFETCH)]);
+                if (delay)
+                    chip->playback.hw_delay = delay;
                 snd_pcm_period_elapsed(chip->playback.substream);
             }
         }
@@ -38,48 +113,30 @@ static irqreturn_t pcie_audio_interrupt(int irq, void *dev_id)
         spin_unlock_irqrestore(&chip->pb_lock, flags);
     }
     
-    // Handle capture interrupts
-    if (status & 0xFF00) {
+    // Handle capture interrupts, context by context
+    if (events & (PCIE_AUDIO_EV_CAP_PERIOD | PCIE_AUDIO_EV_CAP_XRUN |
+                  PCIE_AUDIO_EV_CAP_DMA_ERROR | PCIE_AUDIO_EV_CAP_NEAR_XRUN) || contexts) {
         spin_lock_irqsave(&chip->cap_lock, flags);
         
-        if (chip->capture.substream) {
-            chip->capture.interrupts++;
-            chip->capture.latency = ktime_to_us(ktime_sub(now,
-                                              chip->capture.last_interrupt));
-            chip->capture.last_interrupt = now;
-            
-            if (status & (1 << 8)) {
-                chip->stats.cap_overruns++;
-                chip->capture.errors++;
-                snd_pcm_stop_xrun(chip->capture.substream);
-            } else {
-                snd_pcm_period_elapsed(chip->capture.substream);
-            }
-        }
+        if (events & PCIE_AUDIO_EV_CAP_XRUN)
+            chip->stats.cap_overruns++;
+        for (i = 0; i < CAP_CONTEXTS; i++)
+            pcie_audio_capture_irq(chip, &chip->capture[i],
+                                   pcie_audio_context_events(events, contexts, i),
+                                   status[STATUS_WORD(REG_STATUS_CAP_FIFO)], now);
         
         spin_unlock_irqrestore(&chip->cap_lock, flags);
     }
     
-    // Handle DMA errors
-    if (status & 0xFF0000) {
-        chip->stats.dma_errors++;
-        
-        // Reset DMA engine
-        pcie_audio_write(chip, REG_CTRL_PB_ENABLE, 0);
-        pcie_audio_write(chip, REG_CTRL_CAP_ENABLE, 0);
-        
-        // Re-initialize DMA
-        pcie_audio_write(chip, REG_DMA_CONFIG, 
-            (512 << 16) |        // Burst size
-            (1 << 8) |          // Enable scatter-gather
-            (1 << 1) |          // Enable completion interrupt
-            (1 << 0));          // Master enable
-    }
-    
-    // Clear interrupt status
-    pcie_audio_write(chip, REG_STATUS_PB_UNDERRUN, 0xFFFFFFFF);
-    pcie_audio_write(chip, REG_STATUS_CAP_OVERRUN, 0xFFFFFFFF);
-    pcie_audio_write(chip, REG_STATUS_DMA_ERROR, 0xFFFFFFFF);
+    // Clear only the events handled above; one latched since the snapshot
+    // stays set and raises the interrupt again
+    pcie_audio_ack(chip, REG_STATUS_PB_UNDERRUN,
+                   status[STATUS_WORD(REG_STATUS_PB_UNDERRUN)] & STATUS_PB_UNDERRUN_W1C);
+    pcie_audio_ack(chip, REG_STATUS_CAP_OVERRUN,
+                   status[STATUS_WORD(REG_STATUS_CAP_OVERRUN)] & STATUS_CAP_OVERRUN_W1C);
+    pcie_audio_ack(chip, REG_STATUS_DMA_ERROR,
+                   status[STATUS_WORD(REG_STATUS_DMA_ERROR)] & STATUS_DMA_ERROR_W1C);
+    pcie_audio_ack(chip, REG_STATUS_CAP_CONTEXTS, contexts);
     
     return IRQ_HANDLED;
 }
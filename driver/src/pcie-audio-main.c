@@ -27,6 +27,9 @@ static int pcie_audio_probe(struct pci_dev *pci,
     spin_lock_init(&chip->reg_lock);
     spin_lock_init(&chip->pb_lock);
     spin_lock_init(&chip->cap_lock);
+    mutex_init(&chip->eq_lock);
+    mutex_init(&chip->fir_lock);
+    mutex_init(&chip->spectrum_lock);
 
     // Enable PCI device
     err = pcim_enable_device(pci);
@@ -61,8 +64,8 @@ static int pcie_audio_probe(struct pci_dev *pci,
     if (err < 0)
         goto error_free;
 
-    // Create PCM device
-    err = snd_pcm_new(card, "PCIe Audio", 0, 1, 1, &chip->pcm);
+    // Create PCM device, one capture substream per capture DMA context
+    err = snd_pcm_new(card, "PCIe Audio", 0, 1, CAP_CONTEXTS, &chip->pcm);
     if (err < 0)
         goto error_irq;
 
@@ -135,6 +138,16 @@ static void pcie_audio_remove(struct pci_dev *pci)
     // Free IRQ
     pcie_audio_free_irq(chip);
 
+    // Free the FIR coefficients, the reset stopped their DMA
+    if (chip->fir.coefs)
+        dma_free_coherent(&pci->dev, chip->fir.bytes,
+                          chip->fir.coefs, chip->fir.coefs_dma);
+
+    // And the spectrum slots, the reset stopped the analyzer writing them
+    if (chip->spectrum.buf)
+        dma_free_coherent(&pci->dev, chip->spectrum.bytes,
+                          chip->spectrum.buf, chip->spectrum.buf_dma);
+
     // Free sound card
     snd_card_free(card);
 }
@@ -147,9 +160,14 @@ static int pcie_audio_suspend(struct device *dev)
     struct pcie_audio *chip = card->private_data;
 
     // Save important registers
-    chip->saved_registers.ctrl_format = pcie_audio_read(chip, REG_CTRL_FORMAT);
+    chip->saved_registers.format.format = pcie_audio_read(chip, REG_CTRL_FORMAT);
+    chip->saved_registers.format.bitdepth = pcie_audio_read(chip, REG_CTRL_I2S_BITDEPTH);
+    chip->saved_registers.format.tdm = pcie_audio_read(chip, REG_CTRL_I2S_TDM);
+    chip->saved_registers.format.tdm_slots = pcie_audio_read(chip, REG_CTRL_I2S_TDM_SLOTS);
     chip->saved_registers.ctrl_sample_family = 
         pcie_audio_read(chip, REG_CTRL_SAMPLE_FAMILY);
+    chip->saved_registers.ctrl_sample_multi = 
+        pcie_audio_read(chip, REG_CTRL_SAMPLE_MULTI);
     chip->saved_registers.ctrl_master_mode = 
         pcie_audio_read(chip, REG_CTRL_MASTER_MODE);
     chip->saved_registers.dma_config = 
@@ -169,15 +187,34 @@ static int pcie_audio_resume(struct device *dev)
     pcie_audio_init_hw(chip);
 
     // Restore registers
-    pcie_audio_write(chip, REG_CTRL_FORMAT, 
-                     chip->saved_registers.ctrl_format);
+    pcie_audio_write_format(chip, &chip->saved_registers.format);
     pcie_audio_write(chip, REG_CTRL_SAMPLE_FAMILY,
                      chip->saved_registers.ctrl_sample_family);
+    pcie_audio_write(chip, REG_CTRL_SAMPLE_MULTI,
+                     chip->saved_registers.ctrl_sample_multi);
     pcie_audio_write(chip, REG_CTRL_MASTER_MODE,
                      chip->saved_registers.ctrl_master_mode);
     pcie_audio_write(chip, REG_DMA_PB_THRESHOLD,
                      chip->saved_registers.dma_config);
 
+    // Reload the output EQ, the reset cleared it
+    mutex_lock(&chip->eq_lock);
+    if (pcie_audio_load_eq(chip))
+        dev_warn(&pci->dev, "Output EQ not restored\n");
+    mutex_unlock(&chip->eq_lock);
+
+    // And the output FIR, from the coefficients still in host memory
+    mutex_lock(&chip->fir_lock);
+    if (pcie_audio_load_fir(chip))
+        dev_warn(&pci->dev, "Output FIR not restored\n");
+    mutex_unlock(&chip->fir_lock);
+
+    // The spectrum analyzer starts over, its slots are still allocated
+    mutex_lock(&chip->spectrum_lock);
+    if (pcie_audio_load_spectrum(chip))
+        dev_warn(&pci->dev, "Spectrum analyzer not restored\n");
+    mutex_unlock(&chip->spectrum_lock);
+
     snd_power_change_state(card, SNDRV_CTL_POWER_D0);
     return 0;
 }
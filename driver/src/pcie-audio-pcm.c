@@ -4,69 +4,92 @@
 #include <sound/pcm_params.h>
 #include "pcie-audio.h"
 
+const struct snd_pcm_hardware pcie_audio_hw = {
+    .info = SNDRV_PCM_INFO_MMAP |
+            SNDRV_PCM_INFO_MMAP_VALID |
+            SNDRV_PCM_INFO_INTERLEAVED |
+            SNDRV_PCM_INFO_BLOCK_TRANSFER,
+    .formats = SNDRV_PCM_FMTBIT_S24_LE | SNDRV_PCM_FMTBIT_S32_LE,
+    .rates = SNDRV_PCM_RATE_44100 | SNDRV_PCM_RATE_48000 |
+             SNDRV_PCM_RATE_88200 | SNDRV_PCM_RATE_96000 |
+             SNDRV_PCM_RATE_176400 | SNDRV_PCM_RATE_192000,
+    .rate_min = 44100,
+    .rate_max = 192000,
+    .channels_min = 1,
+    .channels_max = MAX_CHANNELS,
+    .buffer_bytes_max = MAX_BUFFER_SIZE,
+    .period_bytes_min = MIN_PERIOD_SIZE,
+    .period_bytes_max = MAX_PERIOD_SIZE,
+    .periods_min = MIN_PERIODS,
+    .periods_max = MAX_PERIODS,
+};
+
+/*
+ * The ALSA core only fills in runtime->period_size and ->periods after
+ * .hw_params returns, so the geometry has to come from the hw_params.
+ * The ring is allocated once at its full size and reused.
+ */
 static int setup_dma_descriptors(struct pcie_audio *chip,
-                               struct pcie_audio_stream *stream)
+                               struct pcie_audio_stream *stream,
+                               struct snd_pcm_hw_params *params)
 {
     struct snd_pcm_runtime *runtime = stream->substream->runtime;
-    struct pcie_audio_dma_desc *desc;
-    dma_addr_t buf = runtime->dma_addr;
-    size_t period_bytes = frames_to_bytes(runtime, runtime->period_size);
-    unsigned int i;
-    
-    // Free existing descriptors if any
-    if (stream->desc) {
-        dma_free_coherent(&chip->pci->dev,
-                         stream->desc_count * sizeof(struct pcie_audio_dma_desc),
-                         stream->desc, stream->desc_dma);
+    size_t period_bytes = params_period_bytes(params);
+    int count;
+    
+    if (!stream->desc) {
+        stream->desc = dma_alloc_coherent(&chip->pci->dev, DMA_RING_BYTES,
+                                         &stream->desc_dma, GFP_KERNEL);
+        if (!stream->desc)
+            return -ENOMEM;
     }
     
-    // Allocate descriptor ring
-    stream->desc_count = DMA_DESC_COUNT;
-    stream->desc = dma_alloc_coherent(&chip->pci->dev,
-                                     stream->desc_count * sizeof(struct pcie_audio_dma_desc),
-                                     &stream->desc_dma,
-                                     GFP_KERNEL);
-    if (!stream->desc)
-        return -ENOMEM;
-    
-    // Initialize descriptors
-    for (i = 0; i < stream->desc_count; i++) {
-        desc = &stream->desc[i];
-        desc->address = buf + (i * period_bytes);
-        desc->length = period_bytes;
-        desc->flags = (i % 2 == 1) ? DESC_FLAG_INT : 0;  // Interrupt on every other descriptor
-        desc->next = stream->desc_dma +
-                    ((i + 1) % stream->desc_count) * sizeof(struct pcie_audio_dma_desc);
-        
-        if (i == stream->desc_count - 1)
-            desc->flags |= DESC_FLAG_WRAP;
-    }
+    count = pcie_audio_build_ring(stream->desc, DMA_DESC_COUNT, stream->desc_dma,
+                                  runtime->dma_addr, period_bytes,
+                                  params_periods(params));
+    if (count < 0)
+        return count;
     
+    stream->desc_count = count;
     stream->period_size = period_bytes;
     stream->buffer_size = runtime->dma_bytes;
-    stream->periods = runtime->periods;
+    stream->periods = params_periods(params);
     stream->current_desc = 0;
     
     return 0;
 }
 
-static int pcie_audio_pcm_open(struct snd_pcm_substream *substream)
+/* Capture substream n records through capture DMA context n */
+static struct pcie_audio_stream *pcie_audio_get_stream(struct snd_pcm_substream *substream)
 {
     struct pcie_audio *chip = snd_pcm_substream_chip(substream);
-    struct pcie_audio_stream *stream;
-    
+
     if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
-        stream = &chip->playback;
-    else
-        stream = &chip->capture;
+        return &chip->playback;
+    return &chip->capture[substream->number];
+}
+
+static int pcie_audio_pcm_open(struct snd_pcm_substream *substream)
+{
+    struct pcie_audio_stream *stream = pcie_audio_get_stream(substream);
     
     stream->substream = substream;
     substream->runtime->hw = pcie_audio_hw;
     
+    /* Capture records through its context, which can also pack S16_LE */
+    if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
+        stream->context = substream->number;
+        if (pcie_audio_cap_regs(stream->context, &stream->regs) < 0)
+            return -EINVAL;
+        substream->runtime->hw.formats |= SNDRV_PCM_FMTBIT_S16_LE;
+    }
+    
     stream->last_interrupt = ktime_get();
     stream->interrupts = 0;
     stream->errors = 0;
     stream->latency = 0;
+    stream->near_misses = 0;
+    stream->min_margin = FIFO_SIZE;
     
     return 0;
 }
@@ -76,14 +99,10 @@ static int pcie_audio_pcm_close(struct snd_pcm_substream *substream)
     struct pcie_audio *chip = snd_pcm_substream_chip(substream);
     struct pcie_audio_stream *stream;
     
-    if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
-        stream = &chip->playback;
-    else
-        stream = &chip->capture;
+    stream = pcie_audio_get_stream(substream);
     
     if (stream->desc) {
-        dma_free_coherent(&chip->pci->dev,
-                         stream->desc_count * sizeof(struct pcie_audio_dma_desc),
+        dma_free_coherent(&chip->pci->dev, DMA_RING_BYTES,
                          stream->desc, stream->desc_dma);
         stream->desc = NULL;
     }
@@ -97,12 +116,11 @@ static int pcie_audio_hw_params(struct snd_pcm_substream *substream,
 {
     struct pcie_audio *chip = snd_pcm_substream_chip(substream);
     struct pcie_audio_stream *stream;
+    struct pcie_audio_format fmt;
+    u32 family, multi, watermark, wm_filter, route = 0;
     int err;
     
-    if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
-        stream = &chip->playback;
-    else
-        stream = &chip->capture;
+    stream = pcie_audio_get_stream(substream);
     
     // Allocate DMA buffer
     err = snd_pcm_lib_malloc_pages(substream, params_buffer_bytes(params));
@@ -110,7 +128,7 @@ static int pcie_audio_hw_params(struct snd_pcm_substream *substream,
         return err;
     
     // Setup DMA descriptors
-    err = setup_dma_descriptors(chip, stream);
+    err = setup_dma_descriptors(chip, stream, params);
     if (err < 0) {
         snd_pcm_lib_free_pages(substream);
         return err;
@@ -121,32 +139,73 @@ static int pcie_audio_hw_params(struct snd_pcm_substream *substream,
     stream->rate = params_rate(params);
     stream->format = params_format(params);
     
-    // Setup hardware registers
+    /* The output FIR has fewer cycles per frame at a higher rate */
     if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
-        pcie_audio_write(chip, REG_DMA_PB_DESC_BASE, stream->desc_dma);
+        mutex_lock(&chip->fir_lock);
+        err = 0;
+        if (chip->fir.channels)
+            err = pcie_audio_fir_validate(pcie_audio_read(chip, REG_FIR_CAPS),
+                                          pcie_audio_read(chip, REG_STATUS_MCLK_FREQ),
+                                          stream->rate, chip->fir.channels,
+                                          chip->fir.taps);
+        mutex_unlock(&chip->fir_lock);
+        if (err < 0) {
+            snd_pcm_lib_free_pages(substream);
+            return err;
+        }
+    }
+    
+    if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
+        err = pcie_audio_encode_route(stream->channels, stream->channel_mask,
+                                      params_physical_width(params), &route);
+        if (err < 0) {
+            snd_pcm_lib_free_pages(substream);
+            return err;
+        }
+    }
+    
+    // Setup hardware registers, with an early warning a quarter of the FIFO
+    // before the xrun
+    pcie_audio_encode_watermark(FIFO_SIZE, substream->stream == SNDRV_PCM_STREAM_CAPTURE,
+                                &watermark, &wm_filter);
+    if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+        pcie_audio_write(chip, REG_DMA_PB_DESC_BASE, lower_32_bits(stream->desc_dma));
+        pcie_audio_write(chip, REG_DMA_PB_DESC_BASE_HI, upper_32_bits(stream->desc_dma));
         pcie_audio_write(chip, REG_DMA_PB_DESC_COUNT, stream->desc_count);
         pcie_audio_write(chip, REG_DMA_PB_SIZE, stream->period_size);
         pcie_audio_write(chip, REG_DMA_PB_THRESHOLD, stream->period_size / 2);
+        pcie_audio_write(chip, REG_DMA_PB_WATERMARK, watermark);
+        pcie_audio_write(chip, REG_DMA_PB_WM_FILTER, wm_filter);
+        pcie_audio_write(chip, REG_DMA_PB_PREFETCH, DMA_PB_PREFETCH_ENABLE |
+                         FIELD_PREP(DMA_PB_PREFETCH_GUARD, PREFETCH_GUARD_FRAMES));
     } else {
-        pcie_audio_write(chip, REG_DMA_CAP_DESC_BASE, stream->desc_dma);
-        pcie_audio_write(chip, REG_DMA_CAP_DESC_COUNT, stream->desc_count);
-        pcie_audio_write(chip, REG_DMA_CAP_SIZE, stream->period_size);
-        pcie_audio_write(chip, REG_DMA_CAP_THRESHOLD, stream->period_size / 2);
+        pcie_audio_write(chip, stream->regs.desc_base, lower_32_bits(stream->desc_dma));
+        pcie_audio_write(chip, stream->regs.desc_base + 4, upper_32_bits(stream->desc_dma));
+        pcie_audio_write(chip, stream->regs.desc_count, stream->desc_count);
+        pcie_audio_write(chip, stream->regs.size, stream->period_size);
+        pcie_audio_write(chip, stream->regs.route, route);
+        /* The FIFO all contexts share is context 0's */
+        if (!stream->context) {
+            pcie_audio_write(chip, REG_DMA_CAP_THRESHOLD, stream->period_size / 2);
+            pcie_audio_write(chip, REG_DMA_CAP_WATERMARK, watermark);
+            pcie_audio_write(chip, REG_DMA_CAP_WM_FILTER, wm_filter);
+        }
     }
     
-    // Configure format
-    u32 format_ctrl = 0;
-    format_ctrl |= params_physical_width(params) << 8;
-    format_ctrl |= stream->channels - 1;
-    pcie_audio_write(chip, REG_CTRL_FORMAT, format_ctrl);
-    
-    // Configure sample rate
-    u32 rate_ctrl = (stream->rate % 44100 == 0) ? 0 : (1 << 31);
-    u32 base_rate = rate_ctrl ? 48000 : 44100;
-    u32 multi = stream->rate / base_rate;
-    rate_ctrl |= (multi - 1) << 8;
+    // Configure format and sample rate
+    err = pcie_audio_encode_rate(stream->rate, &family, &multi);
+    if (err < 0) {
+        snd_pcm_lib_free_pages(substream);
+        return err;
+    }
     
-    pcie_audio_write(chip, REG_CTRL_SAMPLE_FAMILY, rate_ctrl);
+    /* A fan-out context records a subset of the serializer's frames */
+    if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK || !stream->context) {
+        pcie_audio_encode_format(params_physical_width(params), stream->channels, &fmt);
+        pcie_audio_write_format(chip, &fmt);
+    }
+    pcie_audio_write(chip, REG_CTRL_SAMPLE_FAMILY, family);
+    pcie_audio_write(chip, REG_CTRL_SAMPLE_MULTI, multi);
     pcie_audio_write(chip, REG_CTRL_TARGET_RATE, stream->rate);
     
     return 0;
@@ -162,24 +221,28 @@ static int pcie_audio_prepare(struct snd_pcm_substream *substream)
     struct pcie_audio *chip = snd_pcm_substream_chip(substream);
     struct pcie_audio_stream *stream;
     
-    if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
-        stream = &chip->playback;
-    else
-        stream = &chip->capture;
+    stream = pcie_audio_get_stream(substream);
     
     stream->current_desc = 0;
     stream->hw_ptr = 0;
     stream->prev_hw_ptr = 0;
+    stream->hw_delay = pcie_audio_hw_delay(substream->runtime->rate,
+                                           substream->stream == SNDRV_PCM_STREAM_CAPTURE);
     
     // Clear status and reset DMA
     if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
         pcie_audio_write(chip, REG_CTRL_PB_ENABLE, 0);
         pcie_audio_write(chip, REG_DMA_PB_IRQ_EN, 0);
-        pcie_audio_write(chip, REG_STATUS_PB_UNDERRUN, 0xFFFFFFFF);
+        pcie_audio_write(chip, REG_STATUS_PB_UNDERRUN, STATUS_PB_UNDERRUN_W1C);
+    } else if (stream->context) {
+        pcie_audio_write(chip, stream->regs.ctrl, 0);
+        pcie_audio_write(chip, REG_STATUS_CAP_CONTEXTS,
+                         CAP_CONTEXT_PERIOD(stream->context) |
+                         CAP_CONTEXT_ERROR(stream->context));
     } else {
         pcie_audio_write(chip, REG_CTRL_CAP_ENABLE, 0);
         pcie_audio_write(chip, REG_DMA_CAP_IRQ_EN, 0);
-        pcie_audio_write(chip, REG_STATUS_CAP_OVERRUN, 0xFFFFFFFF);
+        pcie_audio_write(chip, REG_STATUS_CAP_OVERRUN, STATUS_CAP_OVERRUN_W1C);
     }
     
     return 0;
@@ -191,10 +254,7 @@ static int pcie_audio_trigger(struct snd_pcm_substream *substream, int cmd)
     struct pcie_audio_stream *stream;
     unsigned long flags;
     
-    if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
-        stream = &chip->playback;
-    else
-        stream = &chip->capture;
+    stream = pcie_audio_get_stream(substream);
     
     spin_lock_irqsave(substream->stream == SNDRV_PCM_STREAM_PLAYBACK ?
                       &chip->pb_lock : &chip->cap_lock, flags);
@@ -203,10 +263,15 @@ static int pcie_audio_trigger(struct snd_pcm_substream *substream, int cmd)
         case SNDRV_PCM_TRIGGER_START:
         case SNDRV_PCM_TRIGGER_RESUME:
             if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
-                pcie_audio_write(chip, REG_DMA_PB_IRQ_EN, 1);
+                pcie_audio_write(chip, REG_DMA_PB_IRQ_EN,
+                                 DMA_PB_IRQ_EN_EVENTS | DMA_PB_IRQ_EN_WATERMARK);
                 pcie_audio_write(chip, REG_CTRL_PB_ENABLE, 1);
+            } else if (stream->context) {
+                pcie_audio_write(chip, stream->regs.ctrl,
+                                 DMA_CAP1_CTRL_ENABLE | DMA_CAP1_CTRL_IRQ);
             } else {
-                pcie_audio_write(chip, REG_DMA_CAP_IRQ_EN, 1);
+                pcie_audio_write(chip, REG_DMA_CAP_IRQ_EN,
+                                 DMA_CAP_IRQ_EN_EVENTS | DMA_CAP_IRQ_EN_WATERMARK);
                 pcie_audio_write(chip, REG_CTRL_CAP_ENABLE, 1);
             }
             stream->last_interrupt = ktime_get();
@@ -217,6 +282,8 @@ static int pcie_audio_trigger(struct snd_pcm_substream *substream, int cmd)
             if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
                 pcie_audio_write(chip, REG_CTRL_PB_ENABLE, 0);
                 pcie_audio_write(chip, REG_DMA_PB_IRQ_EN, 0);
+            } else if (stream->context) {
+                pcie_audio_write(chip, stream->regs.ctrl, 0);
             } else {
                 pcie_audio_write(chip, REG_CTRL_CAP_ENABLE, 0);
                 pcie_audio_write(chip, REG_DMA_CAP_IRQ_EN, 0);
@@ -238,23 +305,21 @@ static snd_pcm_uframes_t pcie_audio_pointer(struct snd_pcm_substream *substream)
 {
     struct pcie_audio *chip = snd_pcm_substream_chip(substream);
     struct pcie_audio_stream *stream;
-    unsigned int current_desc, offset;
-    snd_pcm_uframes_t frames;
+    unsigned int current_desc;
     
     if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
         stream = &chip->playback;
         current_desc = pcie_audio_read(chip, REG_DMA_PB_CURRENT);
-        offset = pcie_audio_read(chip, REG_STATUS_PB_DESC_ACTIVE);
     } else {
-        stream = &chip->capture;
-        current_desc = pcie_audio_read(chip, REG_DMA_CAP_CURRENT);
-        offset = pcie_audio_read(chip, REG_STATUS_CAP_DESC_ACTIVE);
+        stream = pcie_audio_get_stream(substream);
+        current_desc = pcie_audio_read(chip, stream->regs.current_desc);
     }
     
-    frames = (current_desc * stream->period_size + offset) /
-             frames_to_bytes(substream->runtime, 1);
+    /* Frames in the DMA FIFOs, AudioCDC and the serializer */
+    substream->runtime->delay = stream->hw_delay;
     
-    return frames;
+    return pcie_audio_hw_position(current_desc, stream->period_size, stream->buffer_size,
+                                  frames_to_bytes(substream->runtime, 1));
 }
 
 const struct snd_pcm_ops pcie_audio_pcm_ops = {
@@ -7,7 +7,7 @@ static void pcie_audio_proc_read(struct snd_info_entry *entry,
                                 struct snd_info_buffer *buffer)
 {
     struct pcie_audio *chip = entry->private_data;
-    unsigned int status;
+    unsigned int status, i;
     
     // Hardware Status
     snd_iprintf(buffer, "PCIe Audio Interface Status\n\n");
@@ -37,6 +37,9 @@ static void pcie_audio_proc_read(struct snd_info_entry *entry,
         snd_iprintf(buffer, "  Period Size: %lu bytes\n", 
                    frames_to_bytes(runtime, runtime->period_size));
         snd_iprintf(buffer, "  Avg Latency: %u us\n", chip->playback.latency);
+        snd_iprintf(buffer, "  Near Misses: %lu\n", chip->playback.near_misses);
+        if (chip->playback.near_misses)
+            snd_iprintf(buffer, "  Closest Miss: %u frames\n", chip->playback.min_margin);
     }
     
     // Capture
@@ -47,12 +50,23 @@ static void pcie_audio_proc_read(struct snd_info_entry *entry,
                 pcie_audio_read(chip, REG_STATUS_CAP_BYTES_PROC));
     snd_iprintf(buffer, "  Overruns: %lu\n", chip->stats.cap_overruns);
     
-    if (chip->capture.substream) {
-        struct snd_pcm_runtime *runtime = chip->capture.substream->runtime;
-        snd_iprintf(buffer, "  Buffer Size: %lu bytes\n", runtime->dma_bytes);
-        snd_iprintf(buffer, "  Period Size: %lu bytes\n",
+    for (i = 0; i < CAP_CONTEXTS; i++) {
+        struct pcie_audio_stream *stream = &chip->capture[i];
+        struct snd_pcm_runtime *runtime;
+        
+        if (!stream->substream)
+            continue;
+        runtime = stream->substream->runtime;
+        snd_iprintf(buffer, "  Context %u:\n", i);
+        snd_iprintf(buffer, "    Channels: %u (mask 0x%x)\n", stream->channels,
+                    stream->channel_mask);
+        snd_iprintf(buffer, "    Buffer Size: %lu bytes\n", runtime->dma_bytes);
+        snd_iprintf(buffer, "    Period Size: %lu bytes\n",
                    frames_to_bytes(runtime, runtime->period_size));
-        snd_iprintf(buffer, "  Avg Latency: %u us\n", chip->capture.latency);
+        snd_iprintf(buffer, "    Avg Latency: %u us\n", stream->latency);
+        snd_iprintf(buffer, "    Near Misses: %lu\n", stream->near_misses);
+        if (stream->near_misses)
+            snd_iprintf(buffer, "    Closest Miss: %u frames\n", stream->min_margin);
     }
     
     // Error Statistics
@@ -62,9 +76,11 @@ static void pcie_audio_proc_read(struct snd_info_entry *entry,
     
     // Format and Clock Settings
     snd_iprintf(buffer, "\nCurrent Settings:\n");
-    status = pcie_audio_read(chip, REG_CTRL_FORMAT);
-    snd_iprintf(buffer, "Format: %s\n", (status >> 31) ? "DSD" : "I2S");
-    snd_iprintf(buffer, "Bit Depth: %u\n", (status >> 8) & 0xFF);
+    status = FIELD_GET(CTRL_FORMAT_MASK, pcie_audio_read(chip, REG_CTRL_FORMAT));
+    snd_iprintf(buffer, "Format: %s\n", status >= CTRL_FORMAT_DSD_64 ? "DSD" :
+                                        status == CTRL_FORMAT_TDM ? "TDM" : "I2S");
+    status = FIELD_GET(CTRL_I2S_BITDEPTH_MASK, pcie_audio_read(chip, REG_CTRL_I2S_BITDEPTH));
+    snd_iprintf(buffer, "Bit Depth: %u\n", status);
     
     status = pcie_audio_read(chip, REG_CTRL_MASTER_MODE);
     snd_iprintf(buffer, "Clock Mode: %s\n", status ? "Master" : "Slave");
@@ -9,6 +9,7 @@ class AudioCDC(config: AudioConfig) extends Component {
     val pcie = new Bundle {
       val txData = slave Stream(Vec(Bits(config.i2sDataWidth bits), config.channelCount))
       val rxData = master Stream(Vec(Bits(config.i2sDataWidth bits), config.channelCount))
+      val spectrum = master Stream(Fragment(Bits(32 bits)))   // Analyzer bins
       
       val control = new Bundle {
         val format = in(AudioFormat())
@@ -16,6 +17,9 @@ class AudioCDC(config: AudioConfig) extends Component {
         val sampleRateMulti = in UInt(4 bits)
         val dsdMode = in UInt(2 bits)
         val masterMode = in Bool()
+        val eq = in(EqConfig())
+        val fir = in(FirConfig())
+        val spectrum = in(SpectrumConfig())
       }
       
       val status = new Bundle {
@@ -24,6 +28,22 @@ class AudioCDC(config: AudioConfig) extends Component {
         val bufferLevel = out UInt(16 bits)
         val underrun = out Bool()
         val overrun = out Bool()
+        val eqBank = out Bool()
+      }
+      
+      // FIFO watermark events, see FifoWatermark
+      val watermark = new Bundle {
+        val pbEnable = in Bool()
+        val capEnable = in Bool()
+        val pb = in(WatermarkConfig())
+        val cap = in(WatermarkConfig())
+        val pbLow = out Bool()
+        val pbHigh = out Bool()
+        val capLow = out Bool()
+        val capHigh = out Bool()
+        val pbPeak = out UInt(16 bits)    // Lowest TX level since pbLow
+        val capPeak = out UInt(16 bits)   // Highest RX level since capHigh
+        val capLevel = out UInt(16 bits)
       }
     }
     
@@ -31,6 +51,7 @@ class AudioCDC(config: AudioConfig) extends Component {
     val audio = new Bundle {
       val txData = master Stream(Vec(Bits(config.i2sDataWidth bits), config.channelCount))
       val rxData = slave Stream(Vec(Bits(config.i2sDataWidth bits), config.channelCount))
+      val spectrum = slave Stream(Fragment(Bits(32 bits)))
       
       val control = new Bundle {
         val format = out(AudioFormat())
@@ -38,11 +59,15 @@ class AudioCDC(config: AudioConfig) extends Component {
         val sampleRateMulti = out UInt(4 bits)
         val dsdMode = out UInt(2 bits)
         val masterMode = out Bool()
+        val eq = out(EqConfig())
+        val fir = out(FirConfig())
+        val spectrum = out(SpectrumConfig())
       }
       
       val status = new Bundle {
         val clockLocked = in Bool()
         val actualRate = in UInt(32 bits)
+        val eqBank = in Bool()
       }
     }
   }
@@ -69,6 +94,16 @@ class AudioCDC(config: AudioConfig) extends Component {
   rxFifo.io.push << io.audio.rxData
   io.pcie.rxData << rxFifo.io.pop
   
+  // Spectrum bins, a few in flight; the analyzer holds back while full
+  val spectrumFifo = StreamFifoCC(
+    dataType = Fragment(Bits(32 bits)),
+    depth = 16,
+    pushClock = AudioClockDomain,
+    popClock = ClockDomain.current
+  )
+  spectrumFifo.io.push << io.audio.spectrum
+  io.pcie.spectrum << spectrumFifo.io.pop
+  
   // Cross control signals (PCIe -> Audio)
   val controlCrossing = new Area {
     // Use BufferCC for control signals
@@ -101,6 +136,31 @@ class AudioCDC(config: AudioConfig) extends Component {
       init = False,
       bufferDepth = 2
     )
+    
+    // The bank bit flips while running, section counts change with unity
+    // sections past them; BiquadBank takes both between frames, and the
+    // counts only once all their bits have crossed
+    io.audio.control.eq := BufferCC(
+      input = io.pcie.control.eq,
+      init = io.pcie.control.eq.getZero,
+      bufferDepth = 2
+    )
+    
+    // Taps and channels only change with the FIR off; FirEngine waits for
+    // them to settle anyway before it re-primes
+    io.audio.control.fir := BufferCC(
+      input = io.pcie.control.fir,
+      init = io.pcie.control.fir.getZero,
+      bufferDepth = 2
+    )
+    
+    // SpectrumAnalyzer takes a new configuration at a block boundary, once
+    // all its bits have crossed
+    io.audio.control.spectrum := BufferCC(
+      input = io.pcie.control.spectrum,
+      init = io.pcie.control.spectrum.getZero,
+      bufferDepth = 2
+    )
   }
   
   // Cross status signals (Audio -> PCIe)
@@ -118,40 +178,39 @@ class AudioCDC(config: AudioConfig) extends Component {
       bufferDepth = 2
     )
     
-    // FIFO status
-    io.pcie.status.bufferLevel := txFifo.io.occupancy.resized
+    io.pcie.status.eqBank := BufferCC(
+      input = io.audio.status.eqBank,
+      init = False,
+      bufferDepth = 2
+    )
+    
+    // FIFO status, counted on the PCIe side of each FIFO
+    io.pcie.status.bufferLevel := txFifo.io.pushOccupancy.resized
+    io.pcie.watermark.capLevel := rxFifo.io.popOccupancy.resized
     
     // Error conditions
     io.pcie.status.underrun := txFifo.io.empty && io.audio.txData.ready
     io.pcie.status.overrun := rxFifo.io.full && io.audio.rxData.valid
   }
   
-  // Optional - Buffer monitoring and management
+  // Watermark events on the FIFO levels seen from the PCIe domain: playback
+  // heading for empty, capture heading for full
   val bufferMonitor = new Area {
-    // Track FIFO levels in PCIe domain
-    val txLevel = RegNext(txFifo.io.occupancy)
-    val rxLevel = RegNext(rxFifo.io.occupancy)
-    
-    // Thresholds for buffer warnings (configurable)
-    val txLowThreshold = U(config.fifoDepth / 4)
-    val txHighThreshold = U((config.fifoDepth * 3) / 4)
-    val rxLowThreshold = U(config.fifoDepth / 4)
-    val rxHighThreshold = U((config.fifoDepth * 3) / 4)
-    
-    // Warning flags
-    val txLow = txLevel < txLowThreshold
-    val txHigh = txLevel > txHighThreshold
-    val rxLow = rxLevel < rxLowThreshold
-    val rxHigh = rxLevel > rxHighThreshold
-    
-    // Buffer recovery logic
-    val recoveryMode = RegInit(False)
-    
-    when(txLow || rxHigh) {
-      recoveryMode := True
-    }.elsewhen(txLevel > txLowThreshold && rxLevel < rxHighThreshold) {
-      recoveryMode := False
-    }
+    val tx = new FifoWatermark(widthOf(txFifo.io.pushOccupancy))
+    tx.io.level := txFifo.io.pushOccupancy
+    tx.io.enable := io.pcie.watermark.pbEnable
+    tx.io.config := io.pcie.watermark.pb
+    io.pcie.watermark.pbLow := tx.io.low
+    io.pcie.watermark.pbHigh := tx.io.high
+    io.pcie.watermark.pbPeak := tx.io.lowPeak
+    
+    val rx = new FifoWatermark(widthOf(rxFifo.io.popOccupancy))
+    rx.io.level := rxFifo.io.popOccupancy
+    rx.io.enable := io.pcie.watermark.capEnable
+    rx.io.config := io.pcie.watermark.cap
+    io.pcie.watermark.capLow := rx.io.low
+    io.pcie.watermark.capHigh := rx.io.high
+    io.pcie.watermark.capPeak := rx.io.highPeak
   }
   
   // Debug features (synthesis time removable)
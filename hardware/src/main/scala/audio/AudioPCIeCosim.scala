@@ -0,0 +1,34 @@
+package audio
+
+import spinal.core._
+
+// Verilog for the driver co-simulation (driver/cosim) plus the register map
+// the register bridge decodes, one "offset access name" line per 32-bit word,
+// so the driver's REG_* defines and accesses can be checked against the RTL
+object AudioPCIeCosim {
+  // The variant the driver is built against
+  def config: AudioConfig = AudioVariants("pro8").config
+
+  def main(args: Array[String]): Unit = {
+    val targetDirectory = args.headOption.getOrElse("driver/cosim/rtl")
+    new java.io.File(targetDirectory).mkdirs()
+
+    val report = SpinalConfig(targetDirectory = targetDirectory).generateVerilog(
+      new AudioPCIeTop(config)
+    )
+
+    writeRegisterMap(report.toplevel, s"$targetDirectory/${report.toplevelName}.regmap")
+  }
+
+  def writeRegisterMap(top: AudioPCIeTop, path: String): Unit = {
+    val out = new java.io.PrintWriter(path)
+    try {
+      for(register <- top.regInterface.map.registers; word <- 0 until register.words) {
+        val name = if(word == 0) register.name else s"${register.name}_HI"
+        out.println("0x%03X %-3s %s".format(register.offset + 4 * word, register.access.name, name))
+      }
+    } finally {
+      out.close()
+    }
+  }
+}
@@ -2,7 +2,7 @@ package audio
 
 import spinal.core._
 import spinal.lib._
-import spinal.lib.bus.amba4.axi._
+import spinal.lib.bus.simple._
 
 class AudioPCIeTop(audioConfig: AudioConfig) extends Component {
   val io = new Bundle {
@@ -24,6 +24,9 @@ class AudioPCIeTop(audioConfig: AudioConfig) extends Component {
         val keepBits = Bits(16 bits)
       })
       
+      // Bus/device/function the core was enumerated as, for completions
+      val completerId = in Bits(16 bits)
+      
       val cfg = new Bundle {
         val addr = in UInt(12 bits)
         val write = in Bool()
@@ -81,98 +84,175 @@ class AudioPCIeTop(audioConfig: AudioConfig) extends Component {
   )
   
   // Audio processor
-  val audioProcessor = new AudioProcessor(audioConfig)
+  val audioProcessor = new AudioProcessor(audioConfig, pcieClock)
   
   // Clock domain crossing
   val clockCrossing = new AudioCDC(audioConfig)
   
+  // BAR0: register accesses arrive as memory request TLPs on rx and reads
+  // are answered with completions on tx, see BarDecoder
+  val barDecoder = new BarDecoder
+  barDecoder.io.rx.valid := io.pcie.rx.valid
+  barDecoder.io.rx.payload.data := io.pcie.rx.data
+  barDecoder.io.rx.payload.keep := io.pcie.rx.keepBits
+  barDecoder.io.rx.payload.last := io.pcie.rx.last
+  io.pcie.rx.ready := barDecoder.io.rx.ready
+  barDecoder.io.completerId := io.pcie.completerId
+  
   // Register interface
   val regInterface = new Area {
-    val axiLite = Axi4(
-      config = Axi4Config(
-        addressWidth = 12,
-        dataWidth = 32,
-        idWidth = 1
-      )
-    )
-    
-    val bridge = Axi4SlaveFactory(axiLite)
+    val bridge = PipelinedMemoryBusSlaveFactory(barDecoder.io.bus)
     
-    // Map registers
-    bridge.readAndWrite(audioReg.control.format, 0x000)
-    bridge.readAndWrite(audioReg.control.sampleRateFamily, 0x004)
-    bridge.readAndWrite(audioReg.control.sampleRateMulti, 0x008)
-    bridge.readAndWrite(audioReg.control.dsdMode, 0x00C)
-    bridge.readAndWrite(audioReg.control.clockSource, 0x010)
-    bridge.readAndWrite(audioReg.control.masterMode, 0x014)
-    bridge.readAndWrite(audioReg.control.playbackEnable, 0x018)
-    bridge.readAndWrite(audioReg.control.captureEnable, 0x01C)
-    bridge.readAndWrite(audioReg.control.reset, 0x020)
+    // Every register of AudioRegisters, bound to the bank
+    val map = new RegisterMap(bridge)
+    import AudioRegisters._
+    import audioReg.{control, dma, status}
+
+    map.drive(CtrlFormat, control.format)
+    map.drive(CtrlSampleFamily, control.sampleRateFamily)
+    map.drive(CtrlSampleMulti, control.sampleRateMulti)
+    map.drive(CtrlDsdMode, control.dsdMode)
+    map.drive(CtrlClockSrc, control.clockSource)
+    map.drive(CtrlMasterMode, control.masterMode)
+    map.drive(CtrlPbEnable, control.playbackEnable)
+    map.drive(CtrlCapEnable, control.captureEnable)
+    map.drive(CtrlReset, control.reset)
     
     // Advanced control registers
-    bridge.readAndWrite(audioReg.control.mclkFrequency, 0x030)
-    bridge.readAndWrite(audioReg.control.targetSampleRate, 0x034)
-    bridge.readAndWrite(audioReg.control.pbBufferThreshold, 0x038)
-    bridge.readAndWrite(audioReg.control.capBufferThreshold, 0x03C)
-    bridge.readAndWrite(audioReg.control.i2sFormat.bitDepth, 0x040)
-    bridge.readAndWrite(audioReg.control.i2sFormat.alignment, 0x044)
-    bridge.readAndWrite(audioReg.control.i2sFormat.tdm, 0x048)
-    bridge.readAndWrite(audioReg.control.i2sFormat.tdmSlots, 0x04C)
+    map.drive(CtrlMclkFreq, control.mclkFrequency)
+    map.drive(CtrlTargetRate, control.targetSampleRate)
+    map.drive(CtrlPbThreshold, control.pbBufferThreshold)
+    map.drive(CtrlCapThreshold, control.capBufferThreshold)
+    map.drive(CtrlI2sBitdepth, control.i2sFormat.bitDepth)
+    map.drive(CtrlI2sAlignment, control.i2sFormat.alignment)
+    map.drive(CtrlI2sTdm, control.i2sFormat.tdm)
+    map.drive(CtrlI2sTdmSlots, control.i2sFormat.tdmSlots)
+    map.drive(CtrlMclkDiv, control.clockConfig.mclkDiv)
+    map.drive(CtrlBclkDiv, control.clockConfig.bclkDiv)
+    map.drive(CtrlSyncTimeout, control.clockConfig.syncTimeout)
+    map.drive(CtrlAutoRate, control.clockConfig.autoRateDetect)
     
-    // Map all DMA registers
-    bridge.readAndWrite(audioReg.dma.pbDescBaseAddr, 0x100)
-    bridge.readAndWrite(audioReg.dma.pbDescCount, 0x108)
-    bridge.read(audioReg.dma.pbCurrentDesc, 0x10C)
-    bridge.readAndWrite(audioReg.dma.pbBufferSize, 0x110)
-    bridge.readAndWrite(audioReg.dma.pbInterruptEnable, 0x114)
+    // DMA registers
+    map.drive(DmaPbDescBase, dma.pbDescBaseAddr)
+    map.drive(DmaPbDescCount, dma.pbDescCount)
+    map.read(DmaPbCurrent, dma.pbCurrentDesc)
+    map.drive(DmaPbSize, dma.pbBufferSize)
+    map.drive(DmaPbIrqEn, dma.pbInterruptEnable, dma.pbWatermarkIrqEnable)
+    map.drive(DmaPbThreshold, dma.pbThreshold)
+    map.drive(DmaPbWatermark, dma.pbWatermark.low, dma.pbWatermark.high)
+    map.drive(DmaPbWmFilter, dma.pbWatermark.hysteresis, dma.pbWatermark.holdoff)
+    map.drive(DmaPbPrefetch, dma.pbPrefetchEnable, dma.pbPrefetchGuard)
     
-    bridge.readAndWrite(audioReg.dma.capDescBaseAddr, 0x200)
-    bridge.readAndWrite(audioReg.dma.capDescCount, 0x208)
-    bridge.read(audioReg.dma.capCurrentDesc, 0x20C)
-    bridge.readAndWrite(audioReg.dma.capBufferSize, 0x210)
-    bridge.readAndWrite(audioReg.dma.capInterruptEnable, 0x214)
+    map.drive(DmaCapDescBase, dma.capDescBaseAddr)
+    map.drive(DmaCapDescCount, dma.capDescCount)
+    map.read(DmaCapCurrent, dma.capCurrentDesc)
+    map.drive(DmaCapSize, dma.capBufferSize)
+    map.drive(DmaCapIrqEn, dma.capInterruptEnable, dma.capWatermarkIrqEnable)
+    map.drive(DmaCapThreshold, dma.capThreshold)
+    map.drive(DmaCapWatermark, dma.capWatermark.low, dma.capWatermark.high)
+    map.drive(DmaCapWmFilter, dma.capWatermark.hysteresis, dma.capWatermark.holdoff)
+    map.drive(DmaCapRoute, dma.capRoute.mask, dma.capRoute.format)
     
-    // Map status registers
-    bridge.read(audioReg.status.locked, 0x300)
-    bridge.read(audioReg.status.actualRate, 0x304)
-    bridge.read(audioReg.status.clockSource, 0x308)
-    bridge.read(audioReg.status.pbUnderrun, 0x30C)
-    bridge.read(audioReg.status.capOverrun, 0x310)
-    bridge.read(audioReg.status.dmaError, 0x314)
+    // Capture fan-out contexts 1 and up
+    for((regs, i) <- dma.capFanout.zipWithIndex; n = i + 1) {
+      map.drive(DmaCapNDescBase(n), regs.descBaseAddr)
+      map.drive(DmaCapNDescCount(n), regs.descCount)
+      map.read(DmaCapNCurrent(n), regs.currentDesc)
+      map.drive(DmaCapNSize(n), regs.bufferSize)
+      map.drive(DmaCapNCtrl(n), regs.enable, regs.interruptEnable)
+      map.drive(DmaCapNRoute(n), regs.route.mask, regs.route.format)
+      map.read(DmaCapNActive(n), regs.descActive)
+    }
+    
+    // Status registers, the events latch until written back
+    map.read(StatusLocked, status.locked)
+    map.read(StatusActualRate, status.actualRate)
+    map.read(StatusClockSrc, status.clockSource)
+    val watermark = clockCrossing.io.pcie.watermark
+    val pbEvents = map.latch(
+      StatusPbUnderrun,
+      status.pbUnderrun, dmaEngine.io.control.pbComplete, watermark.pbLow, watermark.pbHigh
+    )
+    val capture = dmaEngine.io.control.capture
+    val capEvents = map.latch(
+      StatusCapOverrun,
+      status.capOverrun, capture(0).complete, watermark.capLow, watermark.capHigh
+    )
+    val dmaErrors = map.latch(StatusDmaError, dmaEngine.io.control.pbError, capture(0).error)
+    map.read(StatusFormatError, status.formatError)
+    map.read(StatusPbDescActive, status.dmaStatus.pbDescriptorsActive)
+    map.read(StatusCapDescActive, status.dmaStatus.capDescriptorsActive)
+    map.read(StatusPbBytesProc, status.dmaStatus.pbBytesProcessed)
+    map.read(StatusCapBytesProc, status.dmaStatus.capBytesProcessed)
+    map.read(StatusPbFifo, status.bufferStatus.pbFifoLevel, status.bufferStatus.pbFifoPeak)
+    map.read(StatusCapFifo, status.bufferStatus.capFifoLevel, status.bufferStatus.capFifoPeak)
+    map.read(
+      StatusPbPrefetch,
+      status.dmaStatus.pbPrefetchTarget, status.dmaStatus.pbLinkLatency
+    )
+    val contextEvents =
+      map.latch(StatusCapContexts, capture.tail.map(_.complete) ++ capture.tail.map(_.error): _*)
     
     // Extended status registers
-    bridge.read(audioReg.status.clockStatus.mclkFrequency, 0x400)
-    bridge.read(audioReg.status.clockStatus.bclkFrequency, 0x404)
-    bridge.read(audioReg.status.clockStatus.actualSampleRate, 0x408)
-    bridge.read(audioReg.status.clockStatus.mclkValid, 0x40C)
-    bridge.read(audioReg.status.clockStatus.bclkValid, 0x410)
+    map.read(StatusMclkFreq, status.clockStatus.mclkFrequency)
+    map.read(StatusBclkFreq, status.clockStatus.bclkFrequency)
+    map.read(StatusSampleRate, status.clockStatus.actualSampleRate)
+    map.read(StatusMclkValid, status.clockStatus.mclkValid)
+    map.read(StatusBclkValid, status.clockStatus.bclkValid)
+
+    // Output EQ: coefficients go to the bank the filters do not run on
+    map.drive(EqCtrl, control.eq.enable, control.eq.bank)
+    map.drive(EqSections, control.eq.sections: _*)
+    map.drive(
+      EqCoefAddr,
+      control.eqCoefAddress.index, control.eqCoefAddress.section, control.eqCoefAddress.channel
+    )
+    val coefWrite = map.write(EqCoefData)
+    map.read(EqStatus, status.eqBank)
+
+    // Output FIR: coefficients are loaded by DMA, see DMAEngine.firLoader
+    map.drive(FirCtrl, control.fir.enable, control.fir.channels)
+    map.drive(FirTaps, control.fir.taps)
+    map.drive(FirCoefBase, control.firCoefBase)
+    val firLoad = map.write(FirLoad)
+    map.read(FirStatus, status.firLoadBusy, status.firLoadError)
+    map.read(
+      FirCaps,
+      U(audioConfig.firLanes, 8 bits), U(audioConfig.firTapsPerLane, 16 bits)
+    )
+    
+    // Spectrum analyzer: spectra are written by DMA, see DMAEngine.spectrumWriter
+    map.drive(
+      SpecCtrl,
+      control.spectrum.enable, control.spectrum.output, control.spectrum.channel,
+      control.spectrum.size, control.spectrum.window, control.spectrum.average
+    )
+    map.drive(SpecBase, control.spectrumBase)
+    map.read(SpecStatus, status.spectrumCount, status.spectrumError, status.spectrumValid)
+    map.read(SpecCaps, U(log2Up(audioConfig.spectrumMaxSize), 4 bits))
+
+    map.checkComplete()
   }
   
-  // Interrupt handling
+  // Interrupt handling: raised while an enabled event is latched in the
+  // status registers, until the driver writes it back
   val interruptControl = new Area {
-    val sources = new Bundle {
-      val pbComplete = Bool()
-      val pbUnderrun = Bool()
-      val capComplete = Bool()
-      val capOverrun = Bool()
-      val clockUnlock = Bool()
-      val dmaError = Bool()
-    }
+    import regInterface.{pbEvents, capEvents, dmaErrors, contextEvents}
+    import audioReg.dma
     
-    // Interrupt status and masking
-    val status = Reg(Bits(32 bits)) init(0)
-    val mask = Reg(Bits(32 bits)) init(0)
+    // Status bits: xrun, period, low and high watermark
+    def pending(events: Seq[Bool], enable: Bool, watermarkEnable: Bool): Bool =
+      (enable && (events(0) || events(1))) || (watermarkEnable && (events(2) || events(3)))
     
-    // Map interrupt sources
-    sources.pbComplete := dmaEngine.io.control.pbComplete
-    sources.pbUnderrun := audioReg.status.pbUnderrun
-    sources.capComplete := dmaEngine.io.control.capComplete
-    sources.capOverrun := audioReg.status.capOverrun
-    sources.clockUnlock := !clockCrossing.io.pcie.status.clockLocked
-    sources.dmaError := audioReg.status.dmaError
+    val playback = pending(pbEvents, dma.pbInterruptEnable, dma.pbWatermarkIrqEnable)
+    val capture = pending(capEvents, dma.capInterruptEnable, dma.capWatermarkIrqEnable)
     
-    // Generate interrupt
-    io.interrupt := (status & mask).orR
+    // Fan-out contexts: period events where enabled, and errors
+    val (periods, errors) = contextEvents.splitAt(dma.capFanout.size)
+    val fanout = dma.capFanout.zip(periods).map { case (regs, period) =>
+      regs.interruptEnable && period
+    } ++ errors
+    io.interrupt := playback || capture || (dmaErrors ++ fanout).reduce(_ || _)
   }
   
   // Reset logic
@@ -193,8 +273,95 @@ class AudioPCIeTop(audioConfig: AudioConfig) extends Component {
     }
   }
   
-  // Connect DMA engine to PCIe
-  dmaEngine.io.axi <> io.pcie.tx  // Simplified - actual implementation needs AXI-to-PCIe bridge
+  // tx carries the BAR0 completions. The DMA engine's AXI master still needs
+  // an AXI-to-PCIe bridge; the driver cosim serves it directly
+  io.pcie.tx.valid := barDecoder.io.tx.valid
+  io.pcie.tx.data := barDecoder.io.tx.payload.data
+  io.pcie.tx.keepBits := barDecoder.io.tx.payload.keep
+  io.pcie.tx.last := barDecoder.io.tx.payload.last
+  barDecoder.io.tx.ready := io.pcie.tx.ready
+  
+  // DMA engine control from the register bank
+  dmaEngine.io.control.pbEnable := audioReg.control.playbackEnable
+  dmaEngine.io.control.pbDescBaseAddr := audioReg.dma.pbDescBaseAddr
+  dmaEngine.io.control.pbDescCount := audioReg.dma.pbDescCount
+  val capContexts = dmaEngine.io.control.capture
+  capContexts(0).enable := audioReg.control.captureEnable
+  capContexts(0).descBaseAddr := audioReg.dma.capDescBaseAddr
+  capContexts(0).descCount := audioReg.dma.capDescCount
+  capContexts(0).route := audioReg.dma.capRoute
+  for((port, regs) <- capContexts.tail.zip(audioReg.dma.capFanout)) {
+    port.enable := regs.enable
+    port.descBaseAddr := regs.descBaseAddr
+    port.descCount := regs.descCount
+    port.route := regs.route
+    regs.currentDesc := port.currentDesc
+    regs.descActive := port.descActive
+  }
+  audioReg.dma.capCurrentDesc := capContexts(0).currentDesc
+  dmaEngine.io.control.pbPrefetchEnable := audioReg.dma.pbPrefetchEnable
+  dmaEngine.io.control.pbPrefetchGuard := audioReg.dma.pbPrefetchGuard
+  dmaEngine.io.control.pbQueuedDownstream := clockCrossing.io.pcie.status.bufferLevel
+  
+  // Status registers the DMA engine and the CDC report
+  audioReg.status.locked := clockCrossing.io.pcie.status.clockLocked
+  audioReg.status.actualRate := clockCrossing.io.pcie.status.actualRate
+  audioReg.status.pbUnderrun := clockCrossing.io.pcie.status.underrun
+  audioReg.status.capOverrun := clockCrossing.io.pcie.status.overrun
+  audioReg.status.dmaError :=
+    dmaEngine.io.control.pbError || capContexts.map(_.error).reduce(_ || _)
+  audioReg.status.formatError := False // No format detection yet
+  audioReg.status.dmaStatus.pbDescriptorsActive := dmaEngine.io.control.pbDescActive
+  audioReg.status.dmaStatus.capDescriptorsActive := capContexts(0).descActive
+  audioReg.status.dmaStatus.pbBytesProcessed := dmaEngine.io.control.pbBytesProcessed
+  audioReg.status.dmaStatus.capBytesProcessed := capContexts(0).bytesProcessed
+  audioReg.status.dmaStatus.pbPrefetchTarget := dmaEngine.io.control.pbPrefetchTarget
+  audioReg.status.dmaStatus.pbLinkLatency := dmaEngine.io.control.pbLinkLatency
+  audioReg.status.bufferStatus.pbFifoLevel := clockCrossing.io.pcie.status.bufferLevel
+  audioReg.status.bufferStatus.capFifoLevel := clockCrossing.io.pcie.watermark.capLevel
+  audioReg.status.bufferStatus.pbFifoPeak := clockCrossing.io.pcie.watermark.pbPeak
+  audioReg.status.bufferStatus.capFifoPeak := clockCrossing.io.pcie.watermark.capPeak
+  
+  // FIFO watermarks from the register bank; capture runs while any of its
+  // contexts does
+  clockCrossing.io.pcie.watermark.pbEnable := audioReg.control.playbackEnable
+  clockCrossing.io.pcie.watermark.capEnable :=
+    audioReg.control.captureEnable || audioReg.dma.capFanout.map(_.enable).reduce(_ || _)
+  clockCrossing.io.pcie.watermark.pb := audioReg.dma.pbWatermark
+  clockCrossing.io.pcie.watermark.cap := audioReg.dma.capWatermark
+  
+  // Output EQ: configuration across the CDC, coefficients straight from the bridge
+  clockCrossing.io.pcie.control.eq := audioReg.control.eq
+  audioProcessor.io.eq.config := clockCrossing.io.audio.control.eq
+  clockCrossing.io.audio.status.eqBank := audioProcessor.io.eq.bank
+  audioReg.status.eqBank := clockCrossing.io.pcie.status.eqBank
+  audioProcessor.io.eq.coef.valid := regInterface.coefWrite.valid
+  audioProcessor.io.eq.coef.payload.bank := !audioReg.control.eq.bank
+  audioProcessor.io.eq.coef.payload.address := audioReg.control.eqCoefAddress
+  audioProcessor.io.eq.coef.payload.value := regInterface.coefWrite.payload
+  
+  // Output FIR: configuration across the CDC, coefficients from the DMA engine
+  clockCrossing.io.pcie.control.fir := audioReg.control.fir
+  audioProcessor.io.fir.config := clockCrossing.io.audio.control.fir
+  audioProcessor.io.fir.coef << dmaEngine.io.firCoef
+  val firLoad = dmaEngine.io.control.firLoad
+  firLoad.start := regInterface.firLoad.valid && regInterface.firLoad.payload(0)
+  firLoad.base := audioReg.control.firCoefBase
+  firLoad.words := (audioReg.control.fir.taps * audioReg.control.fir.channels).resized
+  audioReg.status.firLoadBusy := firLoad.busy
+  audioReg.status.firLoadError := firLoad.error
+  
+  // Spectrum analyzer: configuration across the CDC, bins back to the DMA engine
+  clockCrossing.io.pcie.control.spectrum := audioReg.control.spectrum
+  audioProcessor.io.spectrum.config := clockCrossing.io.audio.control.spectrum
+  clockCrossing.io.audio.spectrum << audioProcessor.io.spectrum.bins
+  dmaEngine.io.spectrumBins << clockCrossing.io.pcie.spectrum
+  val spectrum = dmaEngine.io.control.spectrum
+  spectrum.enable := audioReg.control.spectrum.enable
+  spectrum.base := audioReg.control.spectrumBase
+  audioReg.status.spectrumCount := spectrum.count
+  audioReg.status.spectrumError := spectrum.error
+  audioReg.status.spectrumValid := spectrum.valid
   
   // Connect audio processor
   audioProcessor.io.format := clockCrossing.io.audio.control.format
@@ -229,31 +396,3 @@ class AudioPCIeTop(audioConfig: AudioConfig) extends Component {
     when(audioReg.status.dmaError) { dmaErrorCount := dmaErrorCount + 1 }
   }
 }
-
-// Generate Verilog
-object AudioPCIeTopVerilog {
-  def main(args: Array[String]): Unit = {
-    val config = SpinalConfig(
-      defaultConfigForClockDomains = ClockDomainConfig(
-        resetKind = SYNC,
-        resetActiveLevel = LOW
-      ),
-      targetDirectory = "rtl/generated"
-    )
-    
-    config.generateVerilog(new AudioPCIeTop(
-      AudioConfig(
-        channelCount = 8,
-        i2sDataWidth = 24,
-        dsdBitWidth = 1,
-        useMultipleClocks = true,
-        supportDsd = true,
-        bufferSize = 8192,
-        bufferCount = 4,
-        maxBurstSize = 512,
-        fifoDepth = 1024,
-        dmaDescriptorCount = 32
-      )
-    ))
-  }
-}
\ No newline at end of file
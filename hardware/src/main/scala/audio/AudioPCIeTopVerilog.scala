@@ -1,20 +1,150 @@
 package audio
 
+import java.io.File
+import java.nio.file.{Files, StandardCopyOption}
+import java.util.concurrent.Executors
+import org.json4s._
+import org.json4s.JsonDSL._
+import org.json4s.native.JsonMethods._
+import spinal.core._
+import scala.concurrent.{Await, ExecutionContext, Future}
+import scala.concurrent.duration.Duration
+
+// Generates every variant of hardware/variants.json in one run, one
+// directory per variant holding the HDL, a manifest.json with the variant's
+// parameters, files and registers, and pcie-audio-regs.h with its register
+// map (see AudioRegisters) and parameters.
+// Variants with the same AudioConfig are elaborated once and copied, the
+// rest are elaborated in parallel.
+//
+//   sbt generateVerilog
+//   sbt "hardware/runMain audio.AudioPCIeTopVerilog --vhdl --variant pro16"
 object AudioPCIeTopVerilog {
-  def main(args: Array[String]) {
-    SpinalVerilog(new AudioPCIeTop(
-      AudioConfig(
-        channelCount = 8,
-        i2sDataWidth = 24,
-        dsdBitWidth = 1,
-        useMultipleClocks = true,
-        supportDsd = true,
-        bufferSize = 8192,
-        bufferCount = 4,
-        maxBurstSize = 512,
-        fifoDepth = 1024,
-        dmaDescriptorCount = 32
+  sealed abstract class Hdl(val name: String)
+  case object Verilog extends Hdl("verilog")
+  case object SystemVerilog extends Hdl("systemverilog")
+  case object Vhdl extends Hdl("vhdl")
+
+  def spinalConfig(targetDirectory: String) = SpinalConfig(
+    defaultConfigForClockDomains = ClockDomainConfig(
+      resetKind = SYNC,
+      resetActiveLevel = LOW
+    ),
+    targetDirectory = targetDirectory
+  )
+
+  case class Output(files: Seq[File], registers: Seq[AudioRegisters.Register])
+
+  def elaborate(config: AudioConfig, hdl: Hdl, directory: File): Output = {
+    directory.mkdirs()
+    val spinal = spinalConfig(directory.getPath)
+    val report = hdl match {
+      case Verilog       => spinal.generateVerilog(new AudioPCIeTop(config))
+      case SystemVerilog => spinal.generateSystemVerilog(new AudioPCIeTop(config))
+      case Vhdl          => spinal.generateVhdl(new AudioPCIeTop(config))
+    }
+    Output(
+      report.generatedSourcesPaths.toSeq.map(new File(_)),
+      report.toplevel.regInterface.map.registers
+    )
+  }
+
+  def writeManifest(
+    variant: AudioVariants.Variant,
+    hdl: Hdl,
+    output: Output,
+    elaboratedAs: String,
+    path: File
+  ): Unit = {
+    val registers = output.registers.map { register =>
+      ("offset" -> "0x%03X".format(register.offset)) ~
+        ("access" -> register.access.name) ~
+        ("name" -> register.name) ~
+        ("width" -> register.width)
+    }
+    val manifest =
+      ("variant" -> variant.name) ~
+        ("top" -> "AudioPCIeTop") ~
+        ("hdl" -> hdl.name) ~
+        ("elaboratedAs" -> elaboratedAs) ~
+        ("files" -> output.files.map(_.getName)) ~
+        ("parameters" -> variant.parameters) ~
+        ("registers" -> registers)
+    val out = new java.io.PrintWriter(path)
+    try out.println(pretty(render(manifest))) finally out.close()
+  }
+
+  // The register header plus the parameters the driver sizes its buffers by
+  def writeRegisterHeader(variant: AudioVariants.Variant, path: File): Unit = {
+    val config = variant.config
+    AudioRegisters.writeHeader(
+      path,
+      "__PCIE_AUDIO_REGS_" + variant.name.toUpperCase.replaceAll("[^A-Z0-9]", "_") + "_H",
+      s"audio.AudioPCIeTopVerilog for ${variant.name}",
+      Seq(
+        "PCIE_AUDIO_CHANNELS" -> config.channelCount,
+        "PCIE_AUDIO_SAMPLE_BITS" -> config.i2sDataWidth,
+        "PCIE_AUDIO_FIFO_DEPTH" -> config.fifoDepth,
+        "PCIE_AUDIO_MAX_BURST" -> config.maxBurstSize,
+        "PCIE_AUDIO_DESC_COUNT" -> config.dmaDescriptorCount
       )
-    ))
+    )
+  }
+
+  def generate(
+    variants: Seq[AudioVariants.Variant],
+    hdl: Hdl,
+    targetDirectory: String,
+    jobs: Int
+  ): Unit = {
+    val pool = Executors.newFixedThreadPool(jobs)
+    implicit val context: ExecutionContext = ExecutionContext.fromExecutor(pool)
+    try {
+      // The first variant of each distinct config is elaborated, the others
+      // share its output
+      val groups = variants.groupBy(_.config).values.toSeq.map(_.sortBy(variants.indexOf(_)))
+      val done = groups.map { group =>
+        Future {
+          val first = group.head
+          val firstDir = new File(targetDirectory, first.name)
+          val output = elaborate(first.config, hdl, firstDir)
+          for(variant <- group) {
+            val dir = new File(targetDirectory, variant.name)
+            dir.mkdirs()
+            if(variant ne first) {
+              for(file <- output.files) {
+                val to = new File(dir, file.getName).toPath
+                Files.copy(file.toPath, to, StandardCopyOption.REPLACE_EXISTING)
+              }
+            }
+            writeManifest(variant, hdl, output, first.name, new File(dir, "manifest.json"))
+            writeRegisterHeader(variant, new File(dir, "pcie-audio-regs.h"))
+            println(s"${variant.name}: ${dir.getPath} (elaborated as ${first.name})")
+          }
+        }
+      }
+      done.foreach(Await.result(_, Duration.Inf))
+    } finally {
+      pool.shutdown()
+    }
+  }
+
+  def main(args: Array[String]): Unit = {
+    def arg(name: String): Option[String] =
+      args.sliding(2).collectFirst { case Array(`name`, value) => value }
+
+    val hdl =
+      if(args.contains("--systemverilog")) SystemVerilog
+      else if(args.contains("--vhdl")) Vhdl
+      else Verilog
+    val all = AudioVariants.load(arg("--config").getOrElse(AudioVariants.defaultPath))
+    val variants = arg("--variant") match {
+      case Some(name) => all.filter(_.name == name)
+      case None       => all
+    }
+    require(variants.nonEmpty, s"No variant ${arg("--variant").getOrElse("")}")
+    val jobs = arg("--jobs").map(_.toInt).getOrElse(Runtime.getRuntime.availableProcessors)
+
+    generate(variants, hdl, arg("--out").getOrElse("rtl/generated"), jobs)
   }
-}
\ No newline at end of file
+}
@@ -3,7 +3,9 @@ package audio
 import spinal.core._
 import spinal.lib._
 
-class AudioProcessor(config: AudioConfig) extends Component {
+// hostClock: the register bridge's domain, EQ and FIR coefficients are
+// written in it
+class AudioProcessor(config: AudioConfig, hostClock: ClockDomain) extends Component {
   val io = new Bundle {
     // Clock interface
     val clocks = new Bundle {
@@ -40,8 +42,8 @@ class AudioProcessor(config: AudioConfig) extends Component {
     } else null
     
     // Stream interfaces for data
-    val rxStreams = Vec(master Stream(Bits(config.dataWidth bits)), config.channelCount)
-    val txStreams = Vec(slave Stream(Bits(config.dataWidth bits)), config.channelCount)
+    val rxStreams = Vec(master Stream(Bits(config.i2sDataWidth bits)), config.channelCount)
+    val txStreams = Vec(slave Stream(Bits(config.i2sDataWidth bits)), config.channelCount)
     
     // Control/Status interface
     val control = new Bundle {
@@ -65,6 +67,25 @@ class AudioProcessor(config: AudioConfig) extends Component {
       val syncError = out Bool()
       val bufferLevel = out UInt(log2Up(config.fifoDepth) bits)
     }
+    
+    // Output EQ, see BiquadBank
+    val eq = new Bundle {
+      val config = in(EqConfig())
+      val coef = slave Flow(BiquadCoefWrite())   // In hostClock
+      val bank = out Bool()
+    }
+    
+    // Output FIR, see FirEngine
+    val fir = new Bundle {
+      val config = in(FirConfig())
+      val coef = slave Flow(FirCoefWrite())      // In hostClock
+    }
+    
+    // Spectrum analyzer, see SpectrumAnalyzer
+    val spectrum = new Bundle {
+      val config = in(SpectrumConfig())
+      val bins = master Stream(Fragment(Bits(32 bits)))
+    }
   }
   
   // Clock generation and management
@@ -128,11 +149,11 @@ class AudioProcessor(config: AudioConfig) extends Component {
                                        AudioFormat.I2S_JUSTIFY_RIGHT)
     
     // Shift registers for each channel
-    val rxShiftRegs = Vec(Reg(Bits(config.dataWidth bits)), config.channelCount)
-    val txShiftRegs = Vec(Reg(Bits(config.dataWidth bits)), config.channelCount)
+    val rxShiftRegs = Vec(Reg(Bits(config.i2sDataWidth bits)), config.channelCount)
+    val txShiftRegs = Vec(Reg(Bits(config.i2sDataWidth bits)), config.channelCount)
     
     // Bit counters
-    val bitCounter = Counter(config.dataWidth)
+    val bitCounter = Counter(config.i2sDataWidth)
     val channelCounter = Counter(config.channelCount)
     
     when(enabled) {
@@ -168,7 +189,7 @@ class AudioProcessor(config: AudioConfig) extends Component {
       
       // Output bits
       for(i <- 0 until config.channelCount) {
-        io.i2s.tx(i) := txShiftRegs(i)(config.dataWidth - 1 - bitCounter.value)
+        io.i2s.tx(i) := txShiftRegs(i)(config.i2sDataWidth - 1 - bitCounter.value)
       }
     }
   }
@@ -184,8 +205,8 @@ class AudioProcessor(config: AudioConfig) extends Component {
     val bitCounter = Counter(io.control.tdmConfig.slotWidth)
     
     // Data buffers for TDM
-    val rxBuffer = Vec(Reg(Bits(config.dataWidth bits)), config.tdmSlots)
-    val txBuffer = Vec(Reg(Bits(config.dataWidth bits)), config.tdmSlots)
+    val rxBuffer = Vec(Reg(Bits(config.i2sDataWidth bits)), config.tdmSlots)
+    val txBuffer = Vec(Reg(Bits(config.i2sDataWidth bits)), config.tdmSlots)
     val rxShiftReg = Reg(Bits(config.tdmSlotWidth bits))
     val txShiftReg = Reg(Bits(config.tdmSlotWidth bits))
     
@@ -350,6 +371,55 @@ class AudioProcessor(config: AudioConfig) extends Component {
     }
   }
   
+  // Output EQ between the CDC FIFO and the serializers. DSD is a bitstream,
+  // it always passes through.
+  val outputEq = new Area {
+    val biquads = new BiquadBank(config.channelCount, config.i2sDataWidth, hostClock)
+    biquads.io.config.enable := io.eq.config.enable && !dsdProcessor.enabled
+    biquads.io.config.bank := io.eq.config.bank
+    biquads.io.config.sections := io.eq.config.sections
+    biquads.io.coef << io.eq.coef
+    biquads.io.input << io.txData
+    io.eq.bank := biquads.io.bank
+    
+    val txData = biquads.io.output
+  }
+  
+  // Speaker correction FIR after the EQ; DSD passes through it as well
+  val outputFir = new Area {
+    val engine = new FirEngine(
+      config.channelCount, config.i2sDataWidth, config.firLanes, config.firTapsPerLane, hostClock
+    )
+    engine.io.config.enable := io.fir.config.enable && !dsdProcessor.enabled
+    engine.io.config.channels := io.fir.config.channels
+    engine.io.config.taps := io.fir.config.taps
+    engine.io.coef << io.fir.coef
+    engine.io.input << outputEq.txData
+    
+    val txData = engine.io.output
+  }
+  
+  // Spectrum analyzer on one channel of the capture input, or of the output
+  // after EQ and FIR as the serializers take it. Idle while DSD runs
+  val analyzer = new Area {
+    val spectrum = new SpectrumAnalyzer(config.i2sDataWidth, config.spectrumMaxSize)
+    val selected = io.spectrum.config
+    val channel = selected.channel.resize(log2Up(config.channelCount) bits)
+    spectrum.io.config.enable := selected.enable && !dsdProcessor.enabled
+    spectrum.io.config.output := selected.output
+    spectrum.io.config.channel := selected.channel
+    spectrum.io.config.size := selected.size
+    spectrum.io.config.window := selected.window
+    spectrum.io.config.average := selected.average
+    spectrum.io.sample.valid := Mux(selected.output, outputFir.txData.fire, io.rxData.fire)
+    spectrum.io.sample.payload := Mux(
+      selected.output,
+      outputFir.txData.payload(channel),
+      io.rxData.payload(channel)
+    )
+    io.spectrum.bins << spectrum.io.bins
+  }
+  
   // Audio data processing
   val dataProcessor = new Area {
     // I2S processing
@@ -365,9 +435,9 @@ class AudioProcessor(config: AudioConfig) extends Component {
       when(enabled) {
         // Load new data at frame boundaries
         when(bitCounter.willOverflow && channelCounter.willOverflow) {
-          when(io.txData.valid) {
-            txShiftRegs := io.txData.payload
-            io.txData.ready := True
+          when(outputFir.txData.valid) {
+            txShiftRegs := outputFir.txData.payload
+            outputFir.txData.ready := True
           }
           
           // Output captured data
@@ -406,11 +476,11 @@ class AudioProcessor(config: AudioConfig) extends Component {
       when(enabled) {
         // Load new DSD data
         when(bitCounter.willOverflow) {
-          when(io.txData.valid) {
+          when(outputFir.txData.valid) {
             for(i <- 0 until config.channelCount) {
-              txBuffers(i) := io.txData.payload(i)(7 downto 0)
+              txBuffers(i) := outputFir.txData.payload(i)(7 downto 0)
             }
-            io.txData.ready := True
+            outputFir.txData.ready := True
           }
           
           // Output captured DSD data
@@ -439,7 +509,7 @@ class AudioProcessor(config: AudioConfig) extends Component {
     
     // Detect data underflow/overflow
     val txUnderflow = RegNext(dataProcessor.i2sLogic.enabled && 
-                             !io.txData.valid && 
+                             !outputFir.txData.valid && 
                              dataProcessor.i2sLogic.bitCounter.willOverflow) init(False)
     
     val rxOverflow = RegNext(dataProcessor.i2sLogic.enabled && 
@@ -0,0 +1,491 @@
+package audio
+
+import spinal.core._
+import spinal.lib.Flow
+import spinal.lib.bus.misc.BusSlaveFactory
+import scala.collection.mutable
+
+// The BAR0 register file: offset, access type and fields of every register
+// AudioPCIeTop decodes. AudioPCIeTop binds each register to its RegisterBank
+// signals through a RegisterMap, which checks the field widths against the
+// signals, so the driver's pcie-audio-regs.h and the simulation's
+// RegisterPort, both generated from here, cannot drift from the RTL:
+//
+//   sbt "hardware/runMain audio.AudioRegisters"
+//   sbt "hardware/runMain audio.AudioRegisters --header driver/src/include/pcie-audio-regs.h"
+object AudioRegisters {
+  sealed abstract class Access(val name: String)
+  case object RW extends Access("RW")
+  case object RO extends Access("RO")
+  case object W1C extends Access("W1C") // Set by hardware, written 1 to clear
+  case object WO extends Access("WO")   // Each write is an event, reads return 0
+
+  case class Field(register: Register, name: String, lsb: Int, width: Int, doc: String) {
+    def msb: Int = lsb + width - 1
+    def mask: BigInt = ((BigInt(1) << width) - 1) << lsb
+    def get(value: BigInt): BigInt = (value & mask) >> lsb
+    def prep(field: BigInt): BigInt = (field << lsb) & mask
+  }
+
+  // Registers wider than the 32-bit bus take consecutive words, low first
+  sealed abstract class Register(
+    val name: String,
+    val offset: Int,
+    val access: Access,
+    val doc: String
+  ) {
+    private val fieldBuffer = mutable.ArrayBuffer[Field]()
+
+    protected def field(name: String, lsb: Int, width: Int, doc: String = ""): Field = {
+      val f = Field(this, name, lsb, width, doc)
+      fieldBuffer += f
+      f
+    }
+
+    def fields: Seq[Field] = fieldBuffer
+    def width: Int = fields.map(_.msb + 1).max
+    def words: Int = (width + 31) / 32
+  }
+
+  // A register holding one value from bit 0
+  sealed abstract class Value(name: String, offset: Int, access: Access, width: Int, doc: String)
+      extends Register(name, offset, access, doc) {
+    val value = field("value", 0, width)
+  }
+
+  // Control, the driver's configuration
+  case object CtrlFormat extends Value("CTRL_FORMAT", 0x000, RW, 3, "Serial format, AudioFormat")
+  case object CtrlSampleFamily
+      extends Value("CTRL_SAMPLE_FAMILY", 0x004, RW, 1, "0 = 44.1 kHz, 1 = 48 kHz family")
+  case object CtrlSampleMulti
+      extends Value("CTRL_SAMPLE_MULTI", 0x008, RW, 4, "Rate multiplier - 1")
+  case object CtrlDsdMode extends Value("CTRL_DSD_MODE", 0x00C, RW, 2, "DSD64/128/256")
+  case object CtrlClockSrc
+      extends Value("CTRL_CLOCK_SRC", 0x010, RW, 2, "0 = auto, 1 = 44.1k, 2 = 48k")
+  case object CtrlMasterMode extends Value("CTRL_MASTER_MODE", 0x014, RW, 1, "Card drives BCLK/WS")
+  case object CtrlPbEnable
+      extends Value("CTRL_PB_ENABLE", 0x018, RW, 1, "Playback DMA and serializer")
+  case object CtrlCapEnable
+      extends Value("CTRL_CAP_ENABLE", 0x01C, RW, 1, "Capture DMA and serializer")
+  case object CtrlReset extends Value("CTRL_RESET", 0x020, RW, 1, "Holds the datapath in reset")
+  case object CtrlMclkFreq extends Value("CTRL_MCLK_FREQ", 0x030, RW, 32, "MCLK in Hz")
+  case object CtrlTargetRate extends Value("CTRL_TARGET_RATE", 0x034, RW, 32, "Sample rate in Hz")
+  case object CtrlPbThreshold
+      extends Value("CTRL_PB_THRESHOLD", 0x038, RW, 16, "Playback FIFO threshold, frames")
+  case object CtrlCapThreshold
+      extends Value("CTRL_CAP_THRESHOLD", 0x03C, RW, 16, "Capture FIFO threshold, frames")
+  case object CtrlI2sBitdepth extends Value("CTRL_I2S_BITDEPTH", 0x040, RW, 8, "Bits per sample")
+  case object CtrlI2sAlignment
+      extends Value("CTRL_I2S_ALIGNMENT", 0x044, RW, 2, "0 = left, 1 = right, 2 = I2S")
+  case object CtrlI2sTdm extends Value("CTRL_I2S_TDM", 0x048, RW, 1, "TDM framing")
+  case object CtrlI2sTdmSlots extends Value("CTRL_I2S_TDM_SLOTS", 0x04C, RW, 4, "TDM slots - 1")
+  case object CtrlMclkDiv extends Value("CTRL_MCLK_DIV", 0x050, RW, 8, "MCLK divider")
+  case object CtrlBclkDiv extends Value("CTRL_BCLK_DIV", 0x054, RW, 8, "BCLK divider")
+  case object CtrlSyncTimeout
+      extends Value("CTRL_SYNC_TIMEOUT", 0x058, RW, 16, "Clock lock timeout, frames")
+  case object CtrlAutoRate extends Value("CTRL_AUTO_RATE", 0x05C, RW, 1, "Detect the incoming rate")
+
+  // Descriptor rings, one block per direction
+  case object DmaPbDescBase extends Value("DMA_PB_DESC_BASE", 0x100, RW, 64, "Ring bus address")
+  case object DmaPbDescCount
+      extends Value("DMA_PB_DESC_COUNT", 0x108, RW, 8, "Descriptors in the ring")
+  case object DmaPbCurrent
+      extends Value("DMA_PB_CURRENT", 0x10C, RO, 8, "Descriptor being fetched, all before it done")
+  case object DmaPbSize extends Value("DMA_PB_SIZE", 0x110, RW, 32, "Period bytes")
+  case object DmaPbIrqEn extends Register("DMA_PB_IRQ_EN", 0x114, RW, "Playback interrupts") {
+    val events = field("events", 0, 1, "Period and xrun")
+    val watermark = field("watermark", 1, 1, "FIFO watermarks")
+  }
+  case object DmaPbThreshold
+      extends Value("DMA_PB_THRESHOLD", 0x118, RW, 16, "Refill threshold, bytes")
+  case object DmaPbWatermark
+      extends Register("DMA_PB_WATERMARK", 0x11C, RW, "TX FIFO watermarks, 0 = off") {
+    val low = field("low", 0, 16, "Frames, event when the level drops below")
+    val high = field("high", 16, 16, "Frames, event when the level rises above")
+  }
+  case object DmaPbWmFilter
+      extends Register("DMA_PB_WM_FILTER", 0x120, RW, "TX FIFO watermark rate limits") {
+    val hysteresis = field("hysteresis", 0, 16, "Frames back past a watermark to re-arm it")
+    val holdoff = field("holdoff", 16, 16, "256-cycle units between events")
+  }
+  case object DmaPbPrefetch
+      extends Register("DMA_PB_PREFETCH", 0x124, RW, "Just-in-time refill, PrefetchScheduler") {
+    val enable = field("enable", 0, 1, "Refill by drain rate and link latency")
+    val guard = field("guard", 16, 16, "Frames kept beyond the computed lead")
+  }
+
+  case object DmaCapDescBase extends Value("DMA_CAP_DESC_BASE", 0x200, RW, 64, "Ring bus address")
+  case object DmaCapDescCount
+      extends Value("DMA_CAP_DESC_COUNT", 0x208, RW, 8, "Descriptors in the ring")
+  case object DmaCapCurrent
+      extends Value("DMA_CAP_CURRENT", 0x20C, RO, 8, "Descriptor being filled, all before it done")
+  case object DmaCapSize extends Value("DMA_CAP_SIZE", 0x210, RW, 32, "Period bytes")
+  case object DmaCapIrqEn extends Register("DMA_CAP_IRQ_EN", 0x214, RW, "Capture interrupts") {
+    val events = field("events", 0, 1, "Period and xrun")
+    val watermark = field("watermark", 1, 1, "FIFO watermarks")
+  }
+  case object DmaCapThreshold
+      extends Value("DMA_CAP_THRESHOLD", 0x218, RW, 16, "Drain threshold, bytes")
+  case object DmaCapWatermark
+      extends Register("DMA_CAP_WATERMARK", 0x21C, RW, "RX FIFO watermarks, 0 = off") {
+    val low = field("low", 0, 16, "Frames, event when the level drops below")
+    val high = field("high", 16, 16, "Frames, event when the level rises above")
+  }
+  case object DmaCapWmFilter
+      extends Register("DMA_CAP_WM_FILTER", 0x220, RW, "RX FIFO watermark rate limits") {
+    val hysteresis = field("hysteresis", 0, 16, "Frames back past a watermark to re-arm it")
+    val holdoff = field("holdoff", 16, 16, "256-cycle units between events")
+  }
+  case object DmaCapRoute
+      extends Register("DMA_CAP_ROUTE", 0x224, RW, "Channels written, CapturePacker") {
+    val mask = field("mask", 0, 16, "Channel n in bit n, 0 = every channel")
+    val format = field("format", 16, 2, "0 = 32-bit, 1 = 16-bit containers")
+  }
+
+  // Capture fan-out contexts 1 and up, 32 bytes each from 0x240, laid out
+  // as the DMA_CAP block up to its IRQ_EN. See DMAEngine.captureContexts
+  def capContextBase(n: Int): Int = 0x240 + (n - 1) * 0x20
+  case class DmaCapNDescBase(n: Int)
+      extends Value(s"DMA_CAP${n}_DESC_BASE", capContextBase(n), RW, 64, "Ring bus address")
+  case class DmaCapNDescCount(n: Int) extends Value(
+    s"DMA_CAP${n}_DESC_COUNT", capContextBase(n) + 0x08, RW, 8, "Descriptors in the ring"
+  )
+  case class DmaCapNCurrent(n: Int) extends Value(
+    s"DMA_CAP${n}_CURRENT", capContextBase(n) + 0x0C, RO, 8, "As DMA_CAP_CURRENT"
+  )
+  case class DmaCapNSize(n: Int)
+      extends Value(s"DMA_CAP${n}_SIZE", capContextBase(n) + 0x10, RW, 32, "Period bytes")
+  case class DmaCapNCtrl(n: Int)
+      extends Register(s"DMA_CAP${n}_CTRL", capContextBase(n) + 0x14, RW, "Context control") {
+    val enable = field("enable", 0, 1, "Context DMA running")
+    val irq = field("irq", 1, 1, "Period interrupts")
+  }
+  case class DmaCapNRoute(n: Int) extends Register(
+    s"DMA_CAP${n}_ROUTE", capContextBase(n) + 0x18, RW, "Channels written, CapturePacker"
+  ) {
+    val mask = field("mask", 0, 16, "Channel n in bit n, 0 = every channel")
+    val format = field("format", 16, 2, "0 = 32-bit, 1 = 16-bit containers")
+  }
+  case class DmaCapNActive(n: Int) extends Value(
+    s"DMA_CAP${n}_ACTIVE", capContextBase(n) + 0x1C, RO, 8, "As STATUS_CAP_DESC_ACTIVE"
+  )
+
+  def capContext(n: Int): Seq[Register] = Seq(
+    DmaCapNDescBase(n), DmaCapNDescCount(n), DmaCapNCurrent(n), DmaCapNSize(n), DmaCapNCtrl(n),
+    DmaCapNRoute(n), DmaCapNActive(n)
+  )
+
+  // Status. The event registers latch until the driver writes the bit back.
+  case object StatusLocked extends Value("STATUS_LOCKED", 0x300, RO, 1, "Audio clock locked")
+  case object StatusActualRate
+      extends Value("STATUS_ACTUAL_RATE", 0x304, RO, 32, "Measured rate, Hz")
+  case object StatusClockSrc extends Value("STATUS_CLOCK_SRC", 0x308, RO, 2, "Clock in use")
+  case object StatusPbUnderrun
+      extends Register("STATUS_PB_UNDERRUN", 0x30C, W1C, "Playback events") {
+    val xrun = field("xrun", 0, 1, "TX FIFO ran empty")
+    val period = field("period", 1, 1, "Descriptor with DESC_FLAG_INT done")
+    val low = field("low", 2, 1, "TX FIFO below its low watermark")
+    val high = field("high", 3, 1, "TX FIFO above its high watermark")
+  }
+  case object StatusCapOverrun
+      extends Register("STATUS_CAP_OVERRUN", 0x310, W1C, "Capture events") {
+    val xrun = field("xrun", 0, 1, "RX FIFO ran full")
+    val period = field("period", 1, 1, "Descriptor with DESC_FLAG_INT done")
+    val low = field("low", 2, 1, "RX FIFO below its low watermark")
+    val high = field("high", 3, 1, "RX FIFO above its high watermark")
+  }
+  case object StatusDmaError extends Register("STATUS_DMA_ERROR", 0x314, W1C, "DMA engine errors") {
+    val pb = field("pb", 0, 1, "Playback engine stopped on an error")
+    val cap = field("cap", 1, 1, "Capture engine stopped on an error")
+  }
+  case object StatusFormatError
+      extends Value("STATUS_FORMAT_ERROR", 0x318, RO, 1, "Stream does not match CTRL_FORMAT")
+  case object StatusPbDescActive
+      extends Value("STATUS_PB_DESC_ACTIVE", 0x31C, RO, 8, "Playback descriptors in flight")
+  case object StatusCapDescActive
+      extends Value("STATUS_CAP_DESC_ACTIVE", 0x320, RO, 8, "Capture descriptors in flight")
+  case object StatusPbBytesProc
+      extends Value("STATUS_PB_BYTES_PROC", 0x324, RO, 32, "Bytes read since enable")
+  case object StatusCapBytesProc
+      extends Value("STATUS_CAP_BYTES_PROC", 0x328, RO, 32, "Bytes written since enable")
+  case object StatusPbFifo extends Register("STATUS_PB_FIFO", 0x32C, RO, "TX FIFO level") {
+    val level = field("level", 0, 16, "Frames")
+    val peak = field("peak", 16, 16, "Lowest level since the last low event")
+  }
+  case object StatusCapFifo extends Register("STATUS_CAP_FIFO", 0x330, RO, "RX FIFO level") {
+    val level = field("level", 0, 16, "Frames")
+    val peak = field("peak", 16, 16, "Highest level since the last high event")
+  }
+  case object StatusPbPrefetch
+      extends Register("STATUS_PB_PREFETCH", 0x334, RO, "Prefetch scheduler state") {
+    val target = field("target", 0, 16, "Frames queued before a refill, 0 = not measured")
+    val latency = field("latency", 16, 16, "Completion latency estimate, cycles")
+  }
+  case object StatusCapContexts
+      extends Register("STATUS_CAP_CONTEXTS", 0x338, W1C, "Capture fan-out context events") {
+    val period = for(n <- 1 until DMAEngine.captureContexts)
+      yield field(s"period$n", n, 1, s"Context $n descriptor with DESC_FLAG_INT done")
+    val error = for(n <- 1 until DMAEngine.captureContexts)
+      yield field(s"error$n", 8 + n, 1, s"Context $n stopped on an error")
+  }
+
+  // Output EQ, BiquadBank
+  case object EqCtrl extends Register("EQ_CTRL", 0x500, RW, "Output EQ") {
+    val enable = field("enable", 0, 1, "Filter the output, else pass it through")
+    val bank = field("bank", 1, 1, "Coefficient bank to run, switched between frames")
+  }
+  case object EqSections extends Register("EQ_SECTIONS", 0x504, RW, "Biquads per channel") {
+    val channel = for(n <- 0 until BiquadBank.maxChannels)
+      yield field(s"ch$n", 4 * n, 4, s"Channel $n, 0 = unfiltered")
+  }
+  case object EqCoefAddr
+      extends Register("EQ_COEF_ADDR", 0x508, RW, "Coefficient EQ_COEF_DATA writes") {
+    val index = field("index", 0, 3, "b0, b1, b2, a1, a2")
+    val section = field("section", 4, 3)
+    val channel = field("channel", 8, 3)
+  }
+  case object EqCoefData extends Value(
+    "EQ_COEF_DATA", 0x50C, WO, 32, "Q2.30, into the bank EQ_CTRL does not select"
+  )
+  case object EqStatus extends Value("EQ_STATUS", 0x510, RO, 1, "Coefficient bank running")
+
+  // Output FIR, FirEngine
+  case object FirCtrl extends Register("FIR_CTRL", 0x600, RW, "Output FIR") {
+    val enable = field("enable", 0, 1, "Filter the output, else pass it through")
+    val channels = field("channels", 8, 5, "Filtered channels, the first ones")
+  }
+  case object FirTaps
+      extends Value("FIR_TAPS", 0x604, RW, 16, "Taps per channel, a multiple of lanes")
+  case object FirCoefBase
+      extends Value("FIR_COEF_BASE", 0x608, RW, 64, "Coefficient buffer bus address")
+  case object FirLoad extends Value(
+    "FIR_LOAD", 0x610, WO, 1, "1 loads FIR_TAPS x channels coefficients by DMA"
+  )
+  case object FirStatus extends Register("FIR_STATUS", 0x614, RO, "Coefficient load") {
+    val busy = field("busy", 0, 1, "Load running")
+    val error = field("error", 1, 1, "Last load failed, stopped at the error")
+  }
+  case object FirCaps extends Register("FIR_CAPS", 0x618, RO, "Engine size") {
+    val lanes = field("lanes", 0, 8, "Multipliers, taps are split over them")
+    val depth = field("depth", 16, 16, "Words per lane: taps x channels <= lanes x depth")
+  }
+
+  // Spectrum analyzer, SpectrumAnalyzer
+  case object SpecCtrl extends Register("SPEC_CTRL", 0x700, RW, "Spectrum analyzer") {
+    val enable = field("enable", 0, 1, "Analyze, finishing the block running when cleared")
+    val output = field("output", 1, 1, "Output path, after EQ and FIR, else input")
+    val channel = field("channel", 8, 5)
+    val size = field("size", 16, 4, "log2 of the FFT points, 8 up to SPEC_CAPS")
+    val window = field("window", 20, 2, "0 = rectangular, 1 = Hann, 2 = Blackman-Harris")
+    val average = field("average", 24, 3, "log2 of the blocks averaged per spectrum")
+  }
+  case object SpecBase extends Value(
+    "SPEC_BASE", 0x708, RW, 64, "Two spectrum slots, 2^SPEC_CAPS x 2 bytes each"
+  )
+  case object SpecStatus extends Register("SPEC_STATUS", 0x710, RO, "Spectra written") {
+    val count = field("count", 0, 16, "Spectra since enable, wrapping")
+    val error = field("error", 16, 1, "A write failed, stopped until disabled")
+    val valid = field("valid", 17, 1, "Slot (count - 1) & 1 holds the newest spectrum")
+  }
+  case object SpecCaps extends Value("SPEC_CAPS", 0x714, RO, 4, "log2 of the largest FFT")
+
+  // Clock monitor
+  case object StatusMclkFreq extends Value("STATUS_MCLK_FREQ", 0x400, RO, 32, "Measured MCLK, Hz")
+  case object StatusBclkFreq extends Value("STATUS_BCLK_FREQ", 0x404, RO, 32, "Measured BCLK, Hz")
+  case object StatusSampleRate
+      extends Value("STATUS_SAMPLE_RATE", 0x408, RO, 32, "Measured word clock, Hz")
+  case object StatusMclkValid extends Value("STATUS_MCLK_VALID", 0x40C, RO, 1, "MCLK present")
+  case object StatusBclkValid extends Value("STATUS_BCLK_VALID", 0x410, RO, 1, "BCLK present")
+
+  val all: Seq[Register] = Seq(
+    CtrlFormat, CtrlSampleFamily, CtrlSampleMulti, CtrlDsdMode, CtrlClockSrc, CtrlMasterMode,
+    CtrlPbEnable, CtrlCapEnable, CtrlReset, CtrlMclkFreq, CtrlTargetRate, CtrlPbThreshold,
+    CtrlCapThreshold, CtrlI2sBitdepth, CtrlI2sAlignment, CtrlI2sTdm, CtrlI2sTdmSlots, CtrlMclkDiv,
+    CtrlBclkDiv, CtrlSyncTimeout, CtrlAutoRate,
+    DmaPbDescBase, DmaPbDescCount, DmaPbCurrent, DmaPbSize, DmaPbIrqEn, DmaPbThreshold,
+    DmaPbWatermark, DmaPbWmFilter, DmaPbPrefetch,
+    DmaCapDescBase, DmaCapDescCount, DmaCapCurrent, DmaCapSize, DmaCapIrqEn, DmaCapThreshold,
+    DmaCapWatermark, DmaCapWmFilter, DmaCapRoute
+  ) ++ (1 until DMAEngine.captureContexts).flatMap(capContext) ++ Seq(
+    StatusLocked, StatusActualRate, StatusClockSrc, StatusPbUnderrun, StatusCapOverrun,
+    StatusDmaError, StatusFormatError, StatusPbDescActive, StatusCapDescActive,
+    StatusPbBytesProc, StatusCapBytesProc, StatusPbFifo, StatusCapFifo,
+    StatusPbPrefetch, StatusCapContexts,
+    StatusMclkFreq, StatusBclkFreq, StatusSampleRate, StatusMclkValid, StatusBclkValid,
+    EqCtrl, EqSections, EqCoefAddr, EqCoefData, EqStatus,
+    FirCtrl, FirTaps, FirCoefBase, FirLoad, FirStatus, FirCaps,
+    SpecCtrl, SpecBase, SpecStatus, SpecCaps
+  )
+
+  // Section of the C header each 256-byte block goes under
+  private val blocks = Map(
+    0x000 -> "Control",
+    0x100 -> "Playback DMA",
+    0x200 -> "Capture DMA",
+    0x300 -> "Status",
+    0x400 -> "Clock status",
+    0x500 -> "Output EQ",
+    0x600 -> "Output FIR",
+    0x700 -> "Spectrum analyzer"
+  )
+
+  // Registers holding a SpinalEnum; the C header lists its encodings
+  private val enums: Map[Register, SpinalEnum] = Map(
+    CtrlFormat -> AudioFormat,
+    CtrlSampleFamily -> SampleRateFamily
+  )
+
+  // C name of a field mask: REG_NAME_MASK for single-value registers
+  def maskName(field: Field): String = field.register match {
+    case _: Value => s"${field.register.name}_MASK"
+    case r        => s"${r.name}_${field.name.toUpperCase}"
+  }
+
+  private def mask(field: Field): String =
+    if(field.width == 1) s"BIT(${field.lsb})" else s"GENMASK(${field.msb}, ${field.lsb})"
+
+  // Offsets, field masks for FIELD_GET()/FIELD_PREP(), the clearable bits of
+  // every W1C register and the values of enum registers; `parameters` are
+  // emitted as defines first
+  def writeHeader(
+    path: java.io.File,
+    guard: String,
+    generator: String,
+    parameters: Seq[(String, Int)] = Nil
+  ): Unit = {
+    val out = new java.io.PrintWriter(path)
+    def define(name: String, value: String): Unit = out.println(f"#define $name%-32s $value")
+    try {
+      out.println(s"/* Generated by $generator, do not edit */")
+      out.println(s"#ifndef $guard")
+      out.println(s"#define $guard")
+      out.println()
+      out.println("#include <linux/bitfield.h>")
+      out.println("#include <linux/bits.h>")
+      if(parameters.nonEmpty) {
+        out.println()
+        for((name, value) <- parameters) define(name, value.toString)
+      }
+      for(register <- all.sortBy(_.offset)) {
+        blocks.get(register.offset).foreach { title =>
+          out.println()
+          out.println(s"/* $title */")
+        }
+        out.println(s"/* ${register.access.name}: ${register.doc} */")
+        define(s"REG_${register.name}", f"0x${register.offset}%03X")
+        if(register.words > 1) {
+          define(s"REG_${register.name}_HI", f"0x${register.offset + 4}%03X")
+        } else {
+          for(field <- register.fields if field.width < 32) {
+            val comment = if(field.doc.isEmpty) "" else s" /* ${field.doc} */"
+            define("  " + maskName(field), mask(field) + comment)
+          }
+          if(register.access == W1C) {
+            val bits = register.fields.map(maskName).mkString("(", " | ", ")")
+            define(s"  ${register.name}_W1C", bits)
+          }
+          for(encoding <- enums.get(register).toSeq; element <- encoding.elements) {
+            define(s"  ${register.name}_${element.getName()}", element.position.toString)
+          }
+        }
+      }
+      out.println()
+      out.println(s"#endif /* $guard */")
+    } finally {
+      out.close()
+    }
+  }
+
+  def report(): String = {
+    val rows = for(register <- all.sortBy(_.offset); field <- register.fields) yield {
+      val bits = if(field.width == 1) s"${field.lsb}" else s"${field.msb}:${field.lsb}"
+      f"  0x${register.offset}%03X ${register.access.name}%-3s ${register.name}%-24s " +
+        f"${field.name}%-8s $bits%6s  ${if(field.doc.isEmpty) register.doc else field.doc}"
+    }
+    ("BAR0 registers:" +: rows).mkString("\n")
+  }
+
+  def main(args: Array[String]): Unit = {
+    args.sliding(2).collectFirst { case Array("--header", path) => path } match {
+      case Some(path) =>
+        writeHeader(new java.io.File(path), "__PCIE_AUDIO_REGS_H", "audio.AudioRegisters")
+        println(s"Wrote $path")
+      case None => println(report())
+    }
+  }
+}
+
+// Binds AudioRegisters to RegisterBank signals on the register bridge. Each
+// field has to be bound to a signal of its width, and AudioPCIeTop checks
+// that every register was bound, so the description is the elaborated map.
+class RegisterMap(bridge: BusSlaveFactory) {
+  import AudioRegisters._
+
+  private val bound = mutable.LinkedHashSet[Register]()
+
+  def registers: Seq[Register] = bound.toSeq.sortBy(_.offset)
+
+  private def claim(register: Register, access: Access): Unit = {
+    require(register.access == access, s"${register.name} is ${register.access.name}")
+    require(bound.add(register), s"${register.name} bound twice")
+  }
+
+  private def bind(register: Register, access: Access, signals: Seq[Data]): Unit = {
+    require(
+      signals.size == register.fields.size,
+      s"${register.name} has ${register.fields.size} fields, got ${signals.size} signals"
+    )
+    for((field, signal) <- register.fields.zip(signals)) {
+      require(
+        widthOf(signal) == field.width,
+        s"${register.name}.${field.name} is ${field.width} bits, " +
+          s"${signal.getName()} is ${widthOf(signal)}"
+      )
+    }
+    claim(register, access)
+  }
+
+  // RW: a bus register drives the bank signal and reads back
+  def drive(register: Register, signals: Data*): Unit = {
+    bind(register, RW, signals)
+    for((field, signal) <- register.fields.zip(signals)) {
+      bridge.driveAndRead(signal, register.offset, field.lsb)
+    }
+  }
+
+  def read(register: Register, signals: Data*): Unit = {
+    bind(register, RO, signals)
+    for((field, signal) <- register.fields.zip(signals)) {
+      bridge.read(signal, register.offset, field.lsb)
+    }
+  }
+
+  // W1C: each bit latches its event until the driver writes it back; a new
+  // event in the clearing cycle wins. The next value is built here rather
+  // than with readAndClearOnSet, whose clear the factory emits last and so
+  // would drop that event. Returns the latched bits.
+  def latch(register: Register, events: Bool*): Seq[Bool] = {
+    bind(register, W1C, events)
+    val name = register.name.toLowerCase
+    val written = bridge.isWriting(register.offset).setName(s"${name}_written")
+    val data = Bits(register.width bits).setName(s"${name}_data")
+    bridge.nonStopWrite(data)
+    for((field, event) <- register.fields.zip(events)) yield {
+      val flag = RegInit(False).setName(s"${name}_${field.name}")
+      bridge.read(flag, register.offset, field.lsb)
+      flag := (flag && !(written && data(field.lsb))) || event
+      flag
+    }
+  }
+
+  // WO: fires with the whole written word on every write
+  def write(register: Register): Flow[Bits] = {
+    claim(register, WO)
+    bridge.createAndDriveFlow(Bits(register.width bits), register.offset)
+  }
+
+  def checkComplete(): Unit = {
+    val missing = all.filterNot(bound.contains)
+    require(missing.isEmpty, s"Registers not bound: ${missing.map(_.name).mkString(", ")}")
+  }
+}
@@ -0,0 +1,75 @@
+package audio
+
+import java.io.File
+import org.json4s._
+import org.json4s.native.JsonMethods._
+
+// Named AudioConfig variants (the SKUs) read from a JSON file. Every variant
+// is the "defaults" object with its own fields laid over it:
+//
+//   {
+//     "defaults": { "channelCount": 8, "i2sDataWidth": 24, "fifoDepth": 1024, ... },
+//     "variants": { "pro8": {}, "pro16": { "channelCount": 16 } }
+//   }
+object AudioVariants {
+  case class Variant(name: String, config: AudioConfig, parameters: JObject)
+
+  val defaultPath = "hardware/variants.json"
+
+  private implicit val formats: Formats = DefaultFormats
+
+  private def config(name: String, p: JValue): AudioConfig = {
+    def field[T: Manifest](key: String): T = (p \ key).extractOpt[T].getOrElse {
+      throw new IllegalArgumentException(s"Variant $name: missing or invalid $key")
+    }
+    AudioConfig(
+      channelCount = field[Int]("channelCount"),
+      i2sDataWidth = field[Int]("i2sDataWidth"),
+      dsdBitWidth = field[Int]("dsdBitWidth"),
+      useMultipleClocks = field[Boolean]("useMultipleClocks"),
+      supportDsd = field[Boolean]("supportDsd"),
+      bufferSize = field[Int]("bufferSize"),
+      bufferCount = field[Int]("bufferCount"),
+      maxBurstSize = field[Int]("maxBurstSize"),
+      fifoDepth = field[Int]("fifoDepth"),
+      dmaDescriptorCount = field[Int]("dmaDescriptorCount"),
+      firLanes = field[Int]("firLanes"),
+      firTapsPerLane = field[Int]("firTapsPerLane"),
+      spectrumMaxSize = field[Int]("spectrumMaxSize")
+    )
+  }
+
+  def fromJson(json: String): Seq[Variant] = {
+    val root = parse(json)
+    val defaults = (root \ "defaults") match {
+      case o: JObject => o
+      case _          => JObject()
+    }
+    (root \ "variants") match {
+      case JObject(fields) =>
+        fields.map {
+          case (name, overrides: JObject) =>
+            val parameters = (defaults merge overrides).asInstanceOf[JObject]
+            Variant(name, config(name, parameters), parameters)
+          case (name, _) =>
+            throw new IllegalArgumentException(s"Variant $name is not an object")
+        }
+      case _ => throw new IllegalArgumentException("No \"variants\" object")
+    }
+  }
+
+  // Relative paths are tried from the repository root and from the project
+  // directory sbt starts forked runs in
+  def load(path: String = defaultPath): Seq[Variant] = {
+    val file = Seq(new File(path), new File("..", path)).find(_.exists).getOrElse {
+      throw new IllegalArgumentException(s"$path not found")
+    }
+    val source = scala.io.Source.fromFile(file)
+    try fromJson(source.mkString) finally source.close()
+  }
+
+  def apply(name: String, path: String = defaultPath): Variant =
+    load(path).find(_.name == name).getOrElse {
+      throw new IllegalArgumentException(s"No variant $name in $path")
+    }
+}
@@ -0,0 +1,249 @@
+package audio
+
+import spinal.core._
+import spinal.lib._
+import spinal.lib.bus.simple._
+
+// One 128-bit beat of a TLP stream, DW0 in bits 31:0 as the hard PCIe cores'
+// AXI streams carry them, with a byte enable per data byte
+case class TlpBeat() extends Bundle {
+  val data = Bits(128 bits)
+  val keep = Bits(16 bits)
+  val last = Bool()
+}
+
+// Memory request TLPs to BAR0, decoded into accesses of the register bus.
+// The PCIe core only forwards requests that hit one of the function's BARs
+// and BAR0 is the only one, so the low 12 address bits select the register.
+//
+// - MWr: one register write per DWORD, with the first/last byte enables
+// - MRd: one register read per DWORD, all returned in a single CplD, so a
+//   driver reading a block of registers (the status block, a 64-bit pair)
+//   waits for one round trip instead of one per register. Up to
+//   maxReadDwords per request, the smallest Max_Payload_Size; longer and
+//   locked reads get an Unsupported Request completion
+// - Anything else (messages, completions, I/O) is dropped
+//
+// Read latency is fixed: the register bus answers each read the cycle after
+// it is issued and never stalls, so the first completion beat is valid
+// readLatency(dwords) cycles after the request's header beat is accepted, and
+// the rest follow back to back while tx is ready.
+object BarDecoder {
+  val maxReadDwords = 32
+
+  val busConfig = PipelinedMemoryBusConfig(addressWidth = 12, dataWidth = 32)
+
+  def readLatency(dwords: Int): Int = dwords + 2
+
+  // TLP fmt/type of the requests served and the completions sent
+  val MRD = B"00000"
+  val MRD_LOCKED = B"00001"
+  val CPL = B"01010"
+  val CPL_SC = B"000"
+  val CPL_UR = B"001"
+
+  def dword(beat: Bits, index: UInt): Bits = beat.subdivideIn(32 bits)(index)
+  def dword(beat: Bits, index: Int): Bits = beat(32 * index, 32 bits)
+
+  // Disabled bytes below the first enabled one, and above the last one
+  def lowDisabled(be: Bits): UInt =
+    Mux(be(0), U(0, 2 bits), Mux(be(1), U(1, 2 bits), Mux(be(2), U(2, 2 bits), U(3, 2 bits))))
+  def highDisabled(be: Bits): UInt =
+    Mux(be(3), U(0, 2 bits), Mux(be(2), U(1, 2 bits), Mux(be(1), U(2, 2 bits), U(3, 2 bits))))
+}
+
+class BarDecoder extends Component {
+  import BarDecoder._
+
+  val io = new Bundle {
+    val rx = slave Stream(TlpBeat())
+    val tx = master Stream(TlpBeat())
+    val bus = master(PipelinedMemoryBus(BarDecoder.busConfig))
+
+    // Bus/device/function the core was enumerated as
+    val completerId = in Bits(16 bits)
+  }
+
+  // Fields of the header at the head of rx
+  val header = new Area {
+    val dw0 = dword(io.rx.payload.data, 0)
+    val dw1 = dword(io.rx.payload.data, 1)
+    val is4dw = dw0(29)
+    val hasData = dw0(30)
+    val tlpType = dw0(28 downto 24)
+    val trafficClass = dw0(22 downto 20)
+    val attributes = dw0(13 downto 12)
+    // 0 encodes 1024 DWORDs
+    val length = Mux(dw0(9 downto 0) === 0, U(1024, 11 bits), dw0(9 downto 0).asUInt.resized)
+    val requesterId = dw1(31 downto 16)
+    val tag = dw1(15 downto 8)
+    val lastBe = dw1(7 downto 4)
+    val firstBe = dw1(3 downto 0)
+    val addressLow = Mux(is4dw, dword(io.rx.payload.data, 3), dword(io.rx.payload.data, 2))
+    val address = addressLow(11 downto 2).asUInt
+
+    val isWrite = tlpType === MRD && hasData
+    val isRead = (tlpType === MRD || tlpType === MRD_LOCKED) && !hasData
+    val supported = tlpType === MRD && length <= maxReadDwords
+  }
+
+  // The request being served
+  val request = new Area {
+    val address = Reg(UInt(10 bits))
+    val remaining = Reg(UInt(11 bits))   // DWORDs not issued yet
+    val first = Reg(Bool())
+    val firstBe = Reg(Bits(4 bits))
+    val lastBe = Reg(Bits(4 bits))
+    val slot = Reg(UInt(2 bits))         // DWORD of the rx beat holding the next write data
+  }
+
+  // Completions are assembled in full before the first beat leaves, which is
+  // what keeps their latency fixed
+  val completion = new Area {
+    val fifo = StreamFifo(TlpBeat(), maxReadDwords / 4 + 1)
+    val beat = Reg(Vec(Bits(32 bits), 4))
+    val slot = Reg(UInt(2 bits))
+    val pending = Reg(UInt(6 bits)) init(0)   // Reads issued and not answered yet
+    val sending = RegInit(False)
+
+    io.tx << fifo.io.pop.continueWhen(sending)
+    when(io.tx.fire && io.tx.payload.last) { sending := False }
+
+    fifo.io.push.valid := False
+    fifo.io.push.payload.assignDontCare()
+
+    def start(status: Bits, dwords: UInt, hasData: Bool): Unit = {
+      val byteCount = Mux(
+        dwords === 1,
+        Mux(header.firstBe === 0, U(1, 12 bits),
+          (U(4, 12 bits) - lowDisabled(header.firstBe) - highDisabled(header.firstBe))),
+        (dwords << 2).resize(12 bits) - lowDisabled(header.firstBe) - highDisabled(header.lastBe)
+      )
+      beat(0) := B"0" ## hasData ## B"0" ## CPL ## B"0" ## header.trafficClass ## B"000000" ##
+        header.attributes ## B"00" ## Mux(hasData, dwords.resize(10 bits), U(0, 10 bits))
+      beat(1) := io.completerId ## status ## B"0" ## byteCount
+      beat(2) := header.requesterId ## header.tag ## B"0" ##
+        header.address(4 downto 0) ## lowDisabled(header.firstBe)
+      slot := 3
+    }
+  }
+
+  io.rx.ready := False
+  io.bus.cmd.valid := False
+  io.bus.cmd.write := False
+  io.bus.cmd.address := request.address @@ U"00"
+  io.bus.cmd.data := dword(io.rx.payload.data, request.slot)
+  io.bus.cmd.mask := Mux(
+    request.first,
+    request.firstBe,
+    Mux(request.remaining === 1, request.lastBe, B"1111")
+  )
+
+  val fsm = new Area {
+    val state = Reg(UInt(3 bits)) init(0)
+
+    val IDLE = 0
+    val WRITE = 1
+    val READ = 2
+    val UNSUPPORTED = 3
+    val DROP = 4
+
+    switch(state) {
+      is(IDLE) {
+        when(io.rx.valid && !completion.sending) {
+          request.address := header.address
+          request.remaining := header.length
+          request.first := True
+          request.firstBe := header.firstBe
+          request.lastBe := header.lastBe
+
+          when(header.isWrite) {
+            // Data follows a 4DW header in the next beat, a 3DW one in DW3
+            io.rx.ready := header.is4dw
+            request.slot := Mux(header.is4dw, U(0, 2 bits), U(3, 2 bits))
+            state := WRITE
+          } elsewhen(header.isRead) {
+            io.rx.ready := True
+            completion.start(Mux(header.supported, CPL_SC, CPL_UR), header.length, header.supported)
+            state := Mux(header.supported, U(READ, 3 bits), U(UNSUPPORTED, 3 bits))
+          } otherwise {
+            io.rx.ready := True
+            when(!io.rx.payload.last) { state := DROP }
+          }
+        }
+      }
+
+      is(WRITE) {
+        // A zero byte enable (a flush write) issues nothing
+        io.bus.cmd.valid := io.rx.valid && io.bus.cmd.mask =/= 0
+        io.bus.cmd.write := True
+        when(io.rx.valid && (io.bus.cmd.ready || io.bus.cmd.mask === 0)) {
+          request.address := request.address + 1
+          request.remaining := request.remaining - 1
+          request.first := False
+          request.slot := request.slot + 1
+          io.rx.ready := request.slot === 3 || request.remaining === 1
+          when(request.remaining === 1) {
+            state := Mux(io.rx.payload.last, U(IDLE, 3 bits), U(DROP, 3 bits))
+          }
+        }
+      }
+
+      is(READ) {
+        io.bus.cmd.valid := request.remaining =/= 0
+        when(io.bus.cmd.fire) {
+          request.address := request.address + 1
+          request.remaining := request.remaining - 1
+        }
+        when(request.remaining === 0 && completion.pending === 0) {
+          state := IDLE
+        }
+      }
+
+      is(UNSUPPORTED) {
+        // Header only, pushed as the completion's single beat
+        completion.fifo.io.push.valid := True
+        completion.fifo.io.push.payload.data := completion.beat.asBits
+        completion.fifo.io.push.payload.keep := B"0000_1111_1111_1111"
+        completion.fifo.io.push.payload.last := True
+        completion.sending := True
+        state := IDLE
+      }
+
+      is(DROP) {
+        io.rx.ready := True
+        when(io.rx.fire && io.rx.payload.last) { state := IDLE }
+      }
+    }
+  }
+
+  // Read data into the completion, a beat pushed whenever one fills up
+  val readData = new Area {
+    val issued = io.bus.cmd.fire && !io.bus.cmd.write
+    val answered = io.bus.rsp.valid
+    completion.pending := completion.pending + U(issued) - U(answered)
+
+    val assembled = Vec(Bits(32 bits), 4)
+    for(i <- 0 until 4) {
+      assembled(i) := Mux(completion.slot === i, io.bus.rsp.payload.data, completion.beat(i))
+    }
+    val lastDword = fsm.state === fsm.READ && request.remaining === 0 && completion.pending === 1
+
+    when(answered) {
+      completion.beat(completion.slot) := io.bus.rsp.payload.data
+      completion.slot := completion.slot + 1
+      when(completion.slot === 3 || lastDword) {
+        completion.fifo.io.push.valid := True
+        completion.fifo.io.push.payload.data := assembled.asBits
+        completion.fifo.io.push.payload.keep := completion.slot.mux(
+          0 -> B"0000_0000_0000_1111",
+          1 -> B"0000_0000_1111_1111",
+          2 -> B"0000_1111_1111_1111",
+          3 -> B"1111_1111_1111_1111"
+        )
+        completion.fifo.io.push.payload.last := lastDword
+      }
+      when(lastDword) { completion.sending := True }
+    }
+  }
+}
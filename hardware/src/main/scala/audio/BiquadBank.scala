@@ -0,0 +1,190 @@
+package audio
+
+import spinal.core._
+import spinal.lib._
+
+// Room-correction EQ on the output path: a cascade of biquad sections per
+// channel, time-multiplexed over one set of five multipliers.
+//
+// - Direct Form I, y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2, in one 67-bit
+//   accumulator, rounded to nearest and saturated to 32 bits per section
+// - Samples are 32-bit, MSB aligned; coefficients Q2.30, in [-2, 2)
+// - config.sections(n) sections run on channel n, 0 passes it through, as
+//   do channels from maxChannels up
+// - Two coefficient banks. The host writes the one config.bank does not
+//   select, and the datapath switches banks between frames, so no frame
+//   ever runs on a half-written filter
+//
+// A frame takes frameCycles() audio clock cycles, which have to fit in one
+// frame period. Enabling the bank clears the filter history first. The
+// reference model below is bit-exact against the datapath.
+object BiquadBank {
+  val maxChannels = 8
+  val maxSections = 8
+  val coefficients = 5       // b0, b1, b2, a1, a2
+  val fracBits = 30          // Q2.30
+
+  // Accept and output, two cycles per section, one per bypassed channel
+  def frameCycles(sections: Seq[Int]): Int =
+    2 + sections.map(n => if(n == 0) 1 else 2 * n).sum
+
+  def quantize(coefficient: Double): BigInt = {
+    val q = BigInt(Math.round(coefficient * (1L << fracBits)))
+    q.max(-(BigInt(1) << 31)).min((BigInt(1) << 31) - 1)
+  }
+
+  def saturate(value: BigInt): BigInt = value.max(-(BigInt(1) << 31)).min((BigInt(1) << 31) - 1)
+
+  case class History(x1: BigInt = 0, x2: BigInt = 0, y1: BigInt = 0, y2: BigInt = 0)
+
+  // One section, as the datapath computes it: its output and next history
+  def section(c: Seq[BigInt], h: History, x: BigInt): (BigInt, History) = {
+    val acc = c(0) * x + c(1) * h.x1 + c(2) * h.x2 - c(3) * h.y1 - c(4) * h.y2
+    val y = saturate((acc + (BigInt(1) << (fracBits - 1))) >> fracBits)
+    (y, History(x, h.x1, y, h.y1))
+  }
+
+  // The bank in software: coefs(channel)(section) are b0, b1, b2, a1, a2.
+  // Assigning coefs or sections between frames is a bank switch.
+  class Reference(var coefs: Seq[Seq[Seq[BigInt]]], var sections: Seq[Int]) {
+    private val history = Array.fill(coefs.size, maxSections)(History())
+
+    def apply(frame: Seq[BigInt]): Seq[BigInt] = frame.zipWithIndex.map { case (sample, ch) =>
+      (0 until sections.lift(ch).getOrElse(0)).foldLeft(sample) { (x, s) =>
+        val (y, next) = section(coefs(ch)(s), history(ch)(s), x)
+        history(ch)(s) = next
+        y
+      }
+    }
+  }
+}
+
+class BiquadBank(channels: Int, sampleWidth: Int, coefClock: ClockDomain) extends Component {
+  import BiquadBank._
+  require(channels >= 2 && sampleWidth <= 32)
+  val filtered = channels.min(maxChannels)
+
+  val io = new Bundle {
+    val config = in(EqConfig())
+    val coef = slave Flow(BiquadCoefWrite())   // In coefClock
+    val input = slave Stream(Vec(Bits(sampleWidth bits), channels))
+    val output = master Stream(Vec(Bits(sampleWidth bits), channels))
+    val bank = out Bool()                       // Bank the filters run on
+  }
+
+  val addressWidth = log2Up(maxChannels) + log2Up(maxSections)
+
+  // Coefficients by bank, channel and section, one memory per coefficient
+  val coefs = Seq.fill(coefficients)(Mem(SInt(32 bits), 2 << addressWidth))
+  val host = new ClockingArea(coefClock) {
+    val write = io.coef.payload
+    val address = (write.bank ## write.address.channel ## write.address.section).asUInt
+    for((mem, i) <- coefs.zipWithIndex) {
+      mem.write(address, write.value.asSInt, io.coef.valid && write.address.index === i)
+    }
+  }
+
+  // x1, x2, y1, y2 of every section
+  val history = Mem(Vec(SInt(32 bits), 4), 1 << addressWidth)
+
+  val IDLE = 0
+  val CLEAR = 1
+  val READ = 2
+  val MAC = 3
+  val OUT = 4
+
+  val fsm = new Area {
+    val state = Reg(UInt(3 bits)) init(IDLE)
+    val live = RegInit(False)
+    val primed = RegInit(False)
+    val channel = Reg(UInt(log2Up(maxChannels) bits)) init(0)
+    val section = Reg(UInt(log2Up(maxSections) bits)) init(0)
+    val clearIndex = Reg(UInt(addressWidth bits)) init(0)
+    val frame = Reg(Vec(SInt(32 bits), channels))
+    val sections = Reg(cloneOf(io.config.sections))
+    val settled = RegNext(io.config.sections) === io.config.sections   // Not mid-crossing
+    val count = Mux(sections(channel) > maxSections, U(maxSections), sections(channel))
+    val address = channel @@ section
+    val slot = channel.resize(log2Up(channels) bits)
+
+    val c = coefs.map(_.readSync((live ## address).asUInt, state === READ, clockCrossing = true))
+    val h = history.readSync(address, state === READ)
+    val x = frame(slot)
+    val acc = (c(0) * x).resize(67 bits) + (c(1) * h(0)).resize(67 bits) +
+      (c(2) * h(1)).resize(67 bits) - (c(3) * h(2)).resize(67 bits) -
+      (c(4) * h(3)).resize(67 bits)
+    val rounded = (acc + S(BigInt(1) << (fracBits - 1), 67 bits)) >> fracBits
+    val y = rounded.sat(widthOf(rounded) - 32)
+
+    val write = state === CLEAR || state === MAC
+    val written = Vec(SInt(32 bits), 4)
+    written := Vec(x, h(0), y, h(2))
+    when(state === CLEAR) { written.foreach(_ := 0) }
+    history.write(Mux(state === CLEAR, clearIndex, address), written, write)
+
+    def nextChannel(): Unit = {
+      section := 0
+      when(channel === filtered - 1) {
+        state := OUT
+      } otherwise {
+        channel := channel + 1
+        state := READ
+      }
+    }
+
+    io.input.ready := False
+    io.output.valid := False
+    io.output.payload := Vec(frame.map(_.asBits(31 downto 32 - sampleWidth)))
+
+    when(!io.config.enable) { primed := False }
+
+    switch(state) {
+      is(IDLE) {
+        // Frame boundary: bank, section counts and bypass change here only
+        live := io.config.bank
+        when(settled) { sections := io.config.sections }
+        when(!io.config.enable) {
+          io.output.valid := io.input.valid
+          io.output.payload := io.input.payload
+          io.input.ready := io.output.ready
+        } elsewhen(!primed) {
+          clearIndex := 0
+          state := CLEAR
+        } otherwise {
+          io.input.ready := True
+          when(io.input.valid) {
+            for(i <- 0 until channels) frame(i) := io.input.payload(i).resizeLeft(32).asSInt
+            channel := 0
+            section := 0
+            state := READ
+          }
+        }
+      }
+      is(CLEAR) {
+        clearIndex := clearIndex + 1
+        when(clearIndex.andR) {
+          primed := True
+          state := IDLE
+        }
+      }
+      is(READ) {
+        when(section >= count) { nextChannel() } otherwise { state := MAC }
+      }
+      is(MAC) {
+        frame(slot) := y
+        when(section +^ 1 >= count) {
+          nextChannel()
+        } otherwise {
+          section := section + 1
+          state := READ
+        }
+      }
+      is(OUT) {
+        io.output.valid := True
+        when(io.output.ready) { state := IDLE }
+      }
+    }
+
+    io.bank := live
+  }
+}
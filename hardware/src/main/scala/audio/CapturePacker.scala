@@ -0,0 +1,70 @@
+package audio
+
+import spinal.core._
+import spinal.lib._
+
+// Packs one capture DMA context's share of each frame into 128-bit AXI
+// beats, so a context pays bus and host memory only for the channels it
+// records:
+//
+// - The channels set in route.mask, lowest first; a mask of 0 takes all
+// - S32: 32-bit containers, the sample in the top bits. S16: the sample's
+//   top 16 bits
+// - Frames follow each other across beat boundaries, as in the ALSA buffer
+//
+// A disabled packer takes every frame and drops it, so it never holds the
+// other contexts back, and starts from an empty beat when enabled again.
+object CapturePacker {
+  val S32 = 0
+  val S16 = 1
+}
+
+class CapturePacker(channels: Int, sampleWidth: Int) extends Component {
+  import CapturePacker._
+
+  val io = new Bundle {
+    val enable = in Bool()
+    val route = in(CaptureRoute())
+    val frames = slave Stream(Vec(Bits(sampleWidth bits), channels))
+    val beats = master Stream(Bits(128 bits))
+  }
+
+  // Everything is counted in 16-bit words, the smallest container
+  val frameWords = 2 * channels
+  val bufferWords = 8 + frameWords
+
+  val all = B((1 << channels) - 1, channels bits)
+  val mask = Mux(io.route.mask === 0, all, io.route.mask.resize(channels))
+  val half = io.route.format === S16
+
+  // The selected containers back to back, channel 0 in the low bits
+  val packed = (0 until channels).reverse.foldLeft(B(0, frameWords * 16 bits)) { (acc, i) =>
+    val container = io.frames.payload(i).resizeLeft(32)
+    val word = Mux(half, container(31 downto 16).resize(32), container)
+    val shifted = Mux(half, acc |<< 16, acc |<< 32)
+    Mux(mask(i), shifted | word.resize(frameWords * 16), acc)
+  }
+  val count = CountOne(mask).resize(log2Up(frameWords + 1))
+  val words = Mux(half, count, count |<< 1)
+
+  // A frame is taken while less than a beat is buffered, so it always fits
+  val buffer = Reg(Bits(bufferWords * 16 bits)) init(0)
+  val fill = Reg(UInt(log2Up(bufferWords + 1) bits)) init(0)
+
+  io.beats.valid := io.enable && fill >= 8
+  io.beats.payload := buffer(127 downto 0)
+  io.frames.ready := !io.enable || fill < 8
+
+  when(io.beats.fire) {
+    buffer := buffer |>> 128
+    fill := fill - 8
+  }
+  when(io.enable && io.frames.fire) {
+    buffer := buffer | (packed.resize(bufferWords * 16) |<< (fill << 4))
+    fill := (fill + words).resized
+  }
+  when(!io.enable) {
+    buffer := 0
+    fill := 0
+  }
+}
@@ -4,6 +4,61 @@ import spinal.core._
 import spinal.lib._
 import spinal.lib.bus.amba4.axi._
 
+object DMAEngine {
+  // Capture DMA contexts, each writing its own channel subset of the same
+  // capFifo frames to its own ring. Context 0 is the DMA_CAP block
+  val captureContexts = 4
+}
+
+// One capture DMA context: the driver's ring and route in, its progress and
+// events out
+case class CaptureContextPort() extends Bundle with IMasterSlave {
+  val enable = Bool()
+  val descBaseAddr = UInt(64 bits)
+  val descCount = UInt(8 bits)
+  val route = CaptureRoute()
+  val complete = Bool()
+  val error = Bool()
+  val currentDesc = UInt(8 bits)
+  val descActive = UInt(8 bits)
+  val bytesProcessed = UInt(32 bits)
+
+  override def asMaster(): Unit = {
+    out(enable, descBaseAddr, descCount, route)
+    in(complete, error, currentDesc, descActive, bytesProcessed)
+  }
+}
+
+// FIR coefficient load: `words` 32-bit words from the host buffer at `base`,
+// see FirEngine.layout
+case class FirLoadPort() extends Bundle with IMasterSlave {
+  val start = Bool()
+  val base = UInt(64 bits)
+  val words = UInt(20 bits)
+  val busy = Bool()
+  val error = Bool()
+
+  override def asMaster(): Unit = {
+    out(start, base, words)
+    in(busy, error)
+  }
+}
+
+// Spectrum analyzer output: whole spectra to two alternating slots at
+// `base`, see spectrumWriter
+case class SpectrumPort() extends Bundle with IMasterSlave {
+  val enable = Bool()
+  val base = UInt(64 bits)
+  val count = UInt(16 bits)
+  val error = Bool()
+  val valid = Bool()
+
+  override def asMaster(): Unit = {
+    out(enable, base)
+    in(count, error, valid)
+  }
+}
+
 class DMAEngine(config: AudioConfig, pcieConfig: PCIeConfig) extends Component {
   val io = new Bundle {
     // AXI Master interface for PCIe
@@ -31,23 +86,36 @@ class DMAEngine(config: AudioConfig, pcieConfig: PCIeConfig) extends Component {
       val pbComplete = out Bool()
       val pbError = out Bool()
       
-      // Capture control
-      val capEnable = in Bool()
-      val capDescBaseAddr = in UInt(64 bits)
-      val capDescCount = in UInt(8 bits)
-      val capComplete = out Bool()
-      val capError = out Bool()
+      // Just-in-time playback refill, see PrefetchScheduler
+      val pbPrefetchEnable = in Bool()
+      val pbPrefetchGuard = in UInt(16 bits)
+      val pbQueuedDownstream = in UInt(16 bits)   // Frames past pbFifo, in AudioCDC
+      val pbPrefetchTarget = out UInt(16 bits)
+      val pbLinkLatency = out UInt(16 bits)
+      
+      // Capture contexts, see DMAEngine.captureContexts
+      val capture = Vec(slave(CaptureContextPort()), DMAEngine.captureContexts)
+      
+      // FIR coefficient load, see firLoader
+      val firLoad = slave(FirLoadPort())
+      
+      // Spectrum analyzer output, see spectrumWriter
+      val spectrum = slave(SpectrumPort())
       
       // Status
       val pbBytesProcessed = out UInt(32 bits)
-      val capBytesProcessed = out UInt(32 bits)
       val pbDescActive = out UInt(8 bits)
-      val capDescActive = out UInt(8 bits)
     }
     
     // Audio data interfaces
     val audioIn = slave Stream(Vec(Bits(config.i2sDataWidth bits), config.channelCount))
     val audioOut = master Stream(Vec(Bits(config.i2sDataWidth bits), config.channelCount))
+    
+    // FIR coefficients, in load order
+    val firCoef = master Flow(FirCoefWrite())
+    
+    // Spectrum analyzer bins, IEEE singles, the last of each spectrum flagged
+    val spectrumBins = slave Stream(Fragment(Bits(32 bits)))
   }
   
   // DMA FIFOs for buffering
@@ -65,15 +133,15 @@ class DMAEngine(config: AudioConfig, pcieConfig: PCIeConfig) extends Component {
   val pbDescCache = new Area {
     val descriptors = Array.fill(config.dmaDescriptorCount)(Reg(DMADescriptor()))
     val currentIdx = Reg(UInt(log2Up(config.dmaDescriptorCount) bits)) init(0)
-    val active = Reg(UInt(8 bits)) init(0)
+    val active = Reg(UInt(8 bits)) init(0) // Descriptors with a burst in flight
     val bytesProcessed = Reg(UInt(32 bits)) init(0)
   }
   
-  val capDescCache = new Area {
-    val descriptors = Array.fill(config.dmaDescriptorCount)(Reg(DMADescriptor()))
-    val currentIdx = Reg(UInt(log2Up(config.dmaDescriptorCount) bits)) init(0)
-    val active = Reg(UInt(8 bits)) init(0)
-    val bytesProcessed = Reg(UInt(32 bits)) init(0)
+  // The read channel is playback's; firLoader takes it between playback bursts
+  val readChannel = new Area {
+    val firOwned = Bool()
+    io.axi.ar.valid := False
+    io.axi.ar.id := 0
   }
   
   // Playback DMA state machine
@@ -81,6 +149,7 @@ class DMAEngine(config: AudioConfig, pcieConfig: PCIeConfig) extends Component {
     val state = Reg(UInt(3 bits)) init(0)
     val burstCounter = Reg(UInt(log2Up(config.maxBurstSize/16) bits)) init(0)
     val burstActive = Reg(Bool) init(False)
+    val error = Reg(Bool) init(False)
     
     // State machine definitions
     val IDLE = 0
@@ -89,10 +158,25 @@ class DMAEngine(config: AudioConfig, pcieConfig: PCIeConfig) extends Component {
     val WRITE_FIFO = 3
     val UPDATE_DESC = 4
     val COMPLETE = 5
+    val ERROR = 6
+    
+    // Refills only as early as the drain rate and link latency require
+    val prefetch = new PrefetchScheduler(LatencyBudget.burstFrames(config))
+    prefetch.io.enable := io.control.pbEnable && io.control.pbPrefetchEnable
+    prefetch.io.guard := io.control.pbPrefetchGuard
+    prefetch.io.level := (pbFifo.io.occupancy +^ io.control.pbQueuedDownstream).resized
+    prefetch.io.drained := pbFifo.io.pop.fire
+    prefetch.io.issued := io.axi.ar.fire && !readChannel.firOwned
+    prefetch.io.landed := state === READ_DATA && io.axi.r.valid && burstCounter === 0
+    io.control.pbPrefetchTarget := prefetch.io.target
+    io.control.pbLinkLatency := prefetch.io.latency
+    
+    val space = pbFifo.io.availability >= (config.maxBurstSize/(config.i2sDataWidth/8))
+    val wants = io.control.pbEnable && space && prefetch.io.refill
     
     switch(state) {
       is(IDLE) {
-        when(io.control.pbEnable && pbFifo.io.availability >= (config.maxBurstSize/(config.i2sDataWidth/8))) {
+        when(wants && !readChannel.firOwned) {
           state := FETCH_DESC
         }
       }
@@ -112,6 +196,7 @@ class DMAEngine(config: AudioConfig, pcieConfig: PCIeConfig) extends Component {
             state := READ_DATA
             burstCounter := 0
             burstActive := True
+            pbDescCache.active := 1
           }
         } otherwise {
           state := COMPLETE
@@ -126,14 +211,22 @@ class DMAEngine(config: AudioConfig, pcieConfig: PCIeConfig) extends Component {
             samples(i) := io.axi.r.data(i * config.i2sDataWidth until (i + 1) * config.i2sDataWidth)
           }
           
-          pbFifo.io.push.valid := True
+          // Poisoned or failed completions never reach the FIFO
+          val okay = io.axi.r.resp === B"00"
+          pbFifo.io.push.valid := okay
           pbFifo.io.push.payload := samples
+          when(!okay) { error := True }
           
           burstCounter := burstCounter + 1
           
           when(io.axi.r.last || burstCounter === (config.maxBurstSize/16 - 1)) {
-            state := UPDATE_DESC
+            when(error || !okay) {
+              state := ERROR
+            } otherwise {
+              state := UPDATE_DESC
+            }
             burstActive := False
+            pbDescCache.active := 0
           }
         }
       }
@@ -161,98 +254,406 @@ class DMAEngine(config: AudioConfig, pcieConfig: PCIeConfig) extends Component {
           state := IDLE
         }
       }
+      
+      // Stopped until the driver disables the direction; the failed
+      // descriptor is not marked complete, so the restart re-fetches it
+      is(ERROR) {
+        when(!io.control.pbEnable) {
+          error := False
+          state := IDLE
+        }
+      }
     }
+    
+    io.control.pbError := error
   }
   
-  // Capture DMA state machine
-  val capDmaFsm = new Area {
+  // FIR coefficient load: whole bursts from the host buffer, each started
+  // while playback is idle and not asking for the bus, so a load never holds
+  // a refill back by more than one burst. Beats are split into their four
+  // words, low first; the words past `words` in the last beat are dropped
+  val firLoader = new Area {
+    val port = io.control.firLoad
+    val burstBeats = config.maxBurstSize / 16
+    
+    val IDLE = 0
+    val WAIT = 1
+    val REQUEST = 2
+    val DATA = 3
+    
+    val state = Reg(UInt(2 bits)) init(IDLE)
+    val address = Reg(UInt(64 bits)) init(0)
+    val beatsLeft = Reg(UInt(19 bits)) init(0)   // Not requested yet
+    val wordsLeft = Reg(UInt(20 bits)) init(0)   // Not written yet
+    val index = Reg(UInt(20 bits)) init(0)
+    val beat = Reg(Bits(128 bits)) init(0)
+    val inBeat = Reg(UInt(3 bits)) init(0)       // Words of beat not written
+    val error = RegInit(False)
+    val len = Mux(beatsLeft < burstBeats, beatsLeft, U(burstBeats, 19 bits))
+    
+    readChannel.firOwned := state === REQUEST || state === DATA
+    io.axi.r.ready := Mux(
+      readChannel.firOwned,
+      state === DATA && inBeat === 0,
+      pbDmaFsm.state === pbDmaFsm.READ_DATA && pbFifo.io.push.ready
+    )
+    
+    io.firCoef.valid := inBeat =/= 0 && wordsLeft =/= 0
+    io.firCoef.payload.index := index
+    io.firCoef.payload.value := beat(31 downto 0)
+    when(inBeat =/= 0) {
+      beat := beat |>> 32
+      inBeat := inBeat - 1
+      when(wordsLeft =/= 0) {
+        wordsLeft := wordsLeft - 1
+        index := index + 1
+      }
+    }
+    
+    switch(state) {
+      is(IDLE) {
+        when(port.start) {
+          address := port.base
+          beatsLeft := ((port.words +^ 3) >> 2).resized
+          wordsLeft := port.words
+          index := 0
+          error := False
+          state := WAIT
+        }
+      }
+      
+      is(WAIT) {
+        when(beatsLeft === 0) {
+          when(inBeat === 0) { state := IDLE }
+        } elsewhen(pbDmaFsm.state === pbDmaFsm.IDLE && !pbDmaFsm.wants) {
+          state := REQUEST
+        }
+      }
+      
+      is(REQUEST) {
+        io.axi.ar.valid := True
+        io.axi.ar.id := 1
+        io.axi.ar.addr := address
+        io.axi.ar.len := (len - 1).resized
+        io.axi.ar.size := 4  // 16 bytes
+        io.axi.ar.burst := 1 // INCR
+        io.axi.ar.cache := B"0011"
+        io.axi.ar.prot := B"000"
+        
+        when(io.axi.ar.ready) {
+          address := address + (len << 4)
+          beatsLeft := beatsLeft - len
+          state := DATA
+        }
+      }
+      
+      // A failed completion ends the load: nothing of it or after it is
+      // written, the rest of the burst is drained
+      is(DATA) {
+        when(io.axi.r.fire) {
+          val okay = io.axi.r.resp === B"00"
+          beat := io.axi.r.data
+          inBeat := Mux(okay && !error, U(4, 3 bits), U(0, 3 bits))
+          when(!okay) {
+            error := True
+            beatsLeft := 0
+            wordsLeft := 0
+          }
+          when(io.axi.r.last) { state := WAIT }
+        }
+      }
+    }
+    
+    port.busy := state =/= IDLE
+    port.error := error
+  }
+  
+  // Capture fan-out: every context packs its channels of each capFifo frame
+  // into a beat FIFO of its own, and a frame leaves capFifo once all of them
+  // took it. The contexts and spectrumWriter take turns on the write channel
+  // a burst at a time
+  val capFanout = new Area {
+    val burstBeats = config.maxBurstSize / 16
+    val frames = StreamFork(capFifo.io.pop, DMAEngine.captureContexts)
+    val writers = DMAEngine.captureContexts + 1
+    
+    val busy = RegInit(False)
+    val owner = Reg(UInt(log2Up(writers) bits)) init(0)
+    val priority = Reg(Bits(writers bits)) init(1)
+    val requests = Bits(writers bits)
+    val grant = OHMasking.roundRobin(requests, priority)
+    when(!busy && requests =/= 0) {
+      busy := True
+      owner := OHToUInt(grant)
+      priority := grant.rotateLeft(1)
+    }
+    
+    io.axi.aw.valid := False
+    io.axi.w.valid := False
+    io.axi.w.last := False
+    
+    // Write responses arrive after the burst; an error response stops its
+    // context at its next descriptor
+    io.axi.b.ready := True
+  }
+  
+  class CaptureContext(index: Int, port: CaptureContextPort, frames: Stream[Vec[Bits]])
+      extends Area {
+    import capFanout.{burstBeats, busy, owner, grant}
+    
+    val packer = new CapturePacker(config.channelCount, config.i2sDataWidth)
+    packer.io.enable := port.enable
+    packer.io.route := port.route
+    packer.io.frames << frames
+    val beats = StreamFifo(Bits(128 bits), 2 * burstBeats)
+    beats.io.push << packer.io.beats
+    beats.io.pop.ready := False
+    
+    val descCache = new Area {
+      val descriptors = Array.fill(config.dmaDescriptorCount)(Reg(DMADescriptor()))
+      val currentIdx = Reg(UInt(log2Up(config.dmaDescriptorCount) bits)) init(0)
+      val active = Reg(UInt(8 bits)) init(0) // Descriptors with a burst in flight
+      val bytesProcessed = Reg(UInt(32 bits)) init(0)
+    }
+    
     val state = Reg(UInt(3 bits)) init(0)
-    val burstCounter = Reg(UInt(log2Up(config.maxBurstSize/16) bits)) init(0)
-    val burstActive = Reg(Bool) init(False)
+    val burstCounter = Reg(UInt(log2Up(burstBeats) bits)) init(0)
+    val error = Reg(Bool) init(False)
+    
+    val IDLE = 0
+    val FETCH_DESC = 1
+    val WRITE_DATA = 2
+    val UPDATE_DESC = 3
+    val COMPLETE = 4
+    val ERROR = 5
+    
+    val response = io.axi.b
+    when(response.valid && response.id === index && response.resp =/= B"00") { error := True }
+    
+    val ready = state === IDLE && !error && port.enable && beats.io.occupancy >= burstBeats
+    capFanout.requests(index) := ready
+    port.complete := False
     
     switch(state) {
       is(IDLE) {
-        when(io.control.capEnable && capFifo.io.occupancy >= (config.maxBurstSize/(config.i2sDataWidth/8))) {
+        when(error) {
+          state := ERROR
+        } elsewhen(ready && !busy && grant(index)) {
           state := FETCH_DESC
         }
       }
       
       is(FETCH_DESC) {
-        when(!capDescCache.descriptors(capDescCache.currentIdx).complete) {
-          // Setup AXI write
+        when(!descCache.descriptors(descCache.currentIdx).complete) {
           io.axi.aw.valid := True
-          io.axi.aw.addr := capDescCache.descriptors(capDescCache.currentIdx).address
-          io.axi.aw.len := (config.maxBurstSize/16 - 1)
+          io.axi.aw.id := index
+          io.axi.aw.addr := descCache.descriptors(descCache.currentIdx).address
+          io.axi.aw.len := burstBeats - 1
           io.axi.aw.size := 4  // 16 bytes
           io.axi.aw.burst := 1 // INCR
           io.axi.aw.cache := B"0011"
           io.axi.aw.prot := B"000"
           
           when(io.axi.aw.ready) {
-            state := READ_DATA
+            state := WRITE_DATA
             burstCounter := 0
-            burstActive := True
+            descCache.active := 1
           }
         } otherwise {
+          busy := False
           state := COMPLETE
         }
       }
       
-      is(READ_DATA) {
-        when(capFifo.io.pop.valid) {
-          val samples = capFifo.io.pop.payload
-          val axiData = Bits(128 bits)
-          
-          // Pack audio samples into AXI data
-          for(i <- 0 until config.channelCount) {
-            axiData(i * config.i2sDataWidth until (i + 1) * config.i2sDataWidth) := samples(i)
-          }
-          
-          io.axi.w.valid := True
-          io.axi.w.data := axiData
-          io.axi.w.strb := ((1 << (config.channelCount * (config.i2sDataWidth/8))) - 1)
-          
+      // A burst is only started with all of its beats packed
+      is(WRITE_DATA) {
+        io.axi.w.valid := True
+        io.axi.w.data := beats.io.pop.payload
+        io.axi.w.strb := B(0xFFFF, 16 bits)
+        io.axi.w.last := burstCounter === burstBeats - 1
+        beats.io.pop.ready := io.axi.w.ready
+        
+        when(io.axi.w.ready) {
           burstCounter := burstCounter + 1
-          io.axi.w.last := burstCounter === (config.maxBurstSize/16 - 1)
-          
           when(io.axi.w.last) {
+            busy := False
             state := UPDATE_DESC
-            burstActive := False
           }
         }
       }
       
       is(UPDATE_DESC) {
-        capDescCache.descriptors(capDescCache.currentIdx).complete := True
-        capDescCache.bytesProcessed := capDescCache.bytesProcessed + config.maxBurstSize
+        descCache.active := 0
+        descCache.descriptors(descCache.currentIdx).complete := True
+        descCache.bytesProcessed := descCache.bytesProcessed + config.maxBurstSize
         
-        when(capDescCache.descriptors(capDescCache.currentIdx).interrupt) {
-          io.control.capComplete := True
+        when(descCache.descriptors(descCache.currentIdx).interrupt) {
+          port.complete := True
         }
         
-        when(capDescCache.descriptors(capDescCache.currentIdx).lastInChain) {
-          capDescCache.currentIdx := 0
+        when(descCache.descriptors(descCache.currentIdx).lastInChain) {
+          descCache.currentIdx := 0
           state := COMPLETE
         } otherwise {
-          capDescCache.currentIdx := capDescCache.currentIdx + 1
+          descCache.currentIdx := descCache.currentIdx + 1
           state := IDLE
         }
       }
       
       is(COMPLETE) {
-        io.control.capComplete := True
-        when(!io.control.capEnable) {
+        port.complete := True
+        when(!port.enable) {
+          state := IDLE
+        }
+      }
+      
+      is(ERROR) {
+        when(!port.enable) {
+          error := False
           state := IDLE
         }
       }
     }
+    
+    port.error := error
+    port.currentDesc := descCache.currentIdx.resized
+    port.descActive := descCache.active
+    port.bytesProcessed := descCache.bytesProcessed
+  }
+  
+  val capContexts = for(i <- 0 until DMAEngine.captureContexts)
+    yield new CaptureContext(i, io.control.capture(i), capFanout.frames(i))
+  
+  // Spectrum output: bins packed four to a beat, low first, each spectrum
+  // into the slot after the one last written, in whole bursts. A spectrum is
+  // 2 x points bytes, so a multiple of the burst, and a slot holds the
+  // largest. SPEC_STATUS.count moves once the response to a spectrum's last
+  // burst is back, so the slot it points at is never being written. Only
+  // spectra whose first bin arrives while enabled are kept
+  val spectrumWriter = new Area {
+    import capFanout.{burstBeats, busy, grant}
+    val port = io.control.spectrum
+    val index = DMAEngine.captureContexts
+    val slotBytes = config.spectrumMaxSize * 2
+    require(isPow2(config.maxBurstSize) && config.maxBurstSize <= 512)
+    require(config.maxBurstSize < slotBytes)
+    
+    val IDLE = 0
+    val ADDRESS = 1
+    val DATA = 2
+    val RESPONSE = 3
+    
+    val state = Reg(UInt(2 bits)) init(IDLE)
+    val slot = RegInit(False)
+    val offset = Reg(UInt(log2Up(slotBytes) bits)) init(0)
+    val burstCounter = Reg(UInt(log2Up(burstBeats) bits)) init(0)
+    val closing = RegInit(False)                 // The burst ends a spectrum
+    val count = Reg(UInt(16 bits)) init(0)
+    val valid = RegInit(False)                   // A spectrum since enable
+    val error = RegInit(False)
+    
+    val beats = StreamFifo(Fragment(Bits(128 bits)), 2 * burstBeats)
+    beats.io.pop.ready := False
+    beats.io.flush := state === IDLE && (!port.enable || error)
+    
+    // Bins of a spectrum not kept are taken and dropped
+    val packer = new Area {
+      val bins = io.spectrumBins
+      val word = Reg(UInt(2 bits)) init(0)
+      val words = Reg(Bits(96 bits)) init(0)
+      val first = RegInit(True)
+      val keep = RegInit(False)
+      val accept = port.enable && !error
+      val keeping = Mux(first, accept, keep) && accept
+      
+      beats.io.push.valid := bins.valid && keeping && word === 3
+      beats.io.push.payload.fragment := bins.fragment ## words
+      beats.io.push.payload.last := bins.last
+      bins.ready := !keeping || word =/= 3 || beats.io.push.ready
+      when(bins.fire) {
+        word := word + 1
+        words := bins.fragment ## words(95 downto 32)
+        first := bins.last
+        keep := keeping
+      }
+    }
+    
+    val response = io.axi.b
+    val ready = state === IDLE && !error && port.enable && beats.io.occupancy >= burstBeats
+    capFanout.requests(index) := ready
+    
+    switch(state) {
+      is(IDLE) {
+        when(!port.enable) {
+          slot := False
+          offset := 0
+          count := 0
+          valid := False
+          error := False
+        } elsewhen(ready && !busy && grant(index)) {
+          state := ADDRESS
+        }
+      }
+      
+      is(ADDRESS) {
+        io.axi.aw.valid := True
+        io.axi.aw.id := index
+        io.axi.aw.addr := port.base + (slot ## offset).asUInt.resized
+        io.axi.aw.len := burstBeats - 1
+        io.axi.aw.size := 4  // 16 bytes
+        io.axi.aw.burst := 1 // INCR
+        io.axi.aw.cache := B"0011"
+        io.axi.aw.prot := B"000"
+        
+        when(io.axi.aw.ready) {
+          burstCounter := 0
+          closing := False
+          state := DATA
+        }
+      }
+      
+      is(DATA) {
+        io.axi.w.valid := True
+        io.axi.w.data := beats.io.pop.payload.fragment
+        io.axi.w.strb := B(0xFFFF, 16 bits)
+        io.axi.w.last := burstCounter === burstBeats - 1
+        beats.io.pop.ready := io.axi.w.ready
+        
+        when(io.axi.w.ready) {
+          burstCounter := burstCounter + 1
+          when(beats.io.pop.payload.last) { closing := True }
+          when(io.axi.w.last) {
+            busy := False
+            offset := offset + config.maxBurstSize
+            state := RESPONSE
+          }
+        }
+      }
+      
+      // A failed write stops the writer until the driver disables it
+      is(RESPONSE) {
+        when(response.valid && response.id === index) {
+          when(response.resp =/= B"00") {
+            error := True
+          } elsewhen(closing) {
+            slot := !slot
+            offset := 0
+            count := count + 1
+            valid := True
+          }
+          state := IDLE
+        }
+      }
+    }
+    
+    port.count := count
+    port.error := error
+    port.valid := valid
   }
   
   // Connect status outputs
   io.control.pbBytesProcessed := pbDescCache.bytesProcessed
-  io.control.capBytesProcessed := capDescCache.bytesProcessed
   io.control.pbDescActive := pbDescCache.active
-  io.control.capDescActive := capDescCache.active
   
   // Connect audio streams
   io.audioOut << pbFifo.io.pop
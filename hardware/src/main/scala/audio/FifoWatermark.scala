@@ -0,0 +1,75 @@
+package audio
+
+import spinal.core._
+import spinal.lib._
+
+// Low and high watermark events of a FIFO level, so the driver hears about a
+// FIFO heading for an xrun while there is still time to act on it.
+//
+// - low fires when the level drops below config.low, high when it rises
+//   above config.high; a threshold of 0 turns its event off
+// - Hysteresis: a fired event re-arms only once the level is back
+//   config.hysteresis frames past its threshold, so a level dithering around
+//   it fires once
+// - Rate limiting: after firing, an event stays quiet for config.holdoff
+//   units of holdoffCycles even when re-armed. A level still past the
+//   threshold when the holdoff ends fires then, the event is late, never lost
+//
+// lowPeak/highPeak are the lowest/highest level since their event last
+// fired, how close that episode came to the xrun.
+object FifoWatermark {
+  val holdoffCycles = 256
+}
+
+class FifoWatermark(levelWidth: Int) extends Component {
+  import FifoWatermark._
+
+  val io = new Bundle {
+    val level = in UInt(levelWidth bits)
+    val enable = in Bool()   // The direction is running
+    val config = in(WatermarkConfig())
+    val low = out Bool()
+    val high = out Bool()
+    val lowPeak = out UInt(16 bits)
+    val highPeak = out UInt(16 bits)
+  }
+
+  val level = io.level.resize(17 bits)
+  val tick = CounterFreeRun(holdoffCycles).willOverflow
+
+  // One event: `past` the threshold, re-armed once `back` behind it
+  class Event(past: Bool, back: Bool) extends Area {
+    val armed = RegInit(True)
+    val quiet = Reg(UInt(16 bits)) init(0)   // Holdoff units left
+    val fire = io.enable && armed && past && quiet === 0
+
+    when(quiet =/= 0 && tick) { quiet := quiet - 1 }
+    when(fire) {
+      armed := False
+      quiet := io.config.holdoff
+    } elsewhen(back || !io.enable) {
+      armed := True
+    }
+  }
+
+  val low = new Event(
+    past = io.config.low =/= 0 && level < io.config.low,
+    back = level >= io.config.low +^ io.config.hysteresis
+  )
+  val high = new Event(
+    past = io.config.high =/= 0 && level > io.config.high,
+    back = level +^ io.config.hysteresis <= io.config.high
+  )
+  io.low := low.fire
+  io.high := high.fire
+
+  val peaks = new Area {
+    val lowest = Reg(UInt(16 bits)) init(U(0xFFFF, 16 bits))
+    val highest = Reg(UInt(16 bits)) init(0)
+
+    when(low.fire || level < lowest) { lowest := level.resized }
+    when(high.fire || level > highest) { highest := level.resized }
+    io.lowPeak := lowest
+    io.highPeak := highest
+  }
+}
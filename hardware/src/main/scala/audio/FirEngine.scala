@@ -0,0 +1,258 @@
+package audio
+
+import spinal.core._
+import spinal.lib._
+
+// Speaker correction FIR on the output path, convolving sample by sample, so
+// the correction adds no block latency. `lanes` multipliers share the taps:
+//
+// - Lane l holds taps l S .. l S + S - 1 of every filtered channel, S =
+//   config.taps / lanes, coefficients and history in one BRAM each of
+//   `depth` words, channel c at c S. The history segments chain into one
+//   delay line: each frame, lane l takes the sample lane l - 1 evicts
+// - Coefficients Q1.23, in [-1, 1); the taps of a channel are summed
+//   exactly and rounded to nearest, saturated to the sample width once
+// - config.channels channels are filtered, the first ones, the others pass
+//   through, as does everything while config.taps x config.channels does
+//   not fit in depth x lanes
+//
+// A frame takes frameCycles() audio clock cycles, which have to fit in one
+// frame period: lanes x the cycles per frame is the MAC budget channels and
+// taps share, see maxTaps(). Enabling the engine or changing its channels or
+// taps clears the history first.
+//
+// Coefficients are written in the host buffer order layout() gives, word w
+// to lane w % lanes at w / lanes, from DMAEngine's coefficient loader. The
+// driver loads them with the engine disabled.
+object FirEngine {
+  val coefWidth = 24
+  val fracBits = 23          // Q1.23
+  val maxChannels = 16
+  val channelOverhead = 4    // Cycles per channel besides its S taps
+
+  // Accept and output, and per channel: evict, shift, S taps, drain, sum
+  def frameCycles(channels: Int, segment: Int): Int =
+    2 + channels * (segment + channelOverhead)
+
+  // Most taps per channel at `rate`, limited by the cycles a frame period
+  // has at clockHz and by the BRAM
+  def maxTaps(lanes: Int, depth: Int, channels: Int, clockHz: Long, rate: Int): Int = {
+    val cycles = (clockHz / rate).toInt
+    val segment = Math.min((cycles - 2) / channels - channelOverhead, depth / channels)
+    Math.max(segment, 0) * lanes
+  }
+
+  def quantize(coefficient: Double): BigInt = {
+    val q = BigInt(Math.round(coefficient * (1L << fracBits)))
+    q.max(-(BigInt(1) << (coefWidth - 1))).min((BigInt(1) << (coefWidth - 1)) - 1)
+  }
+
+  def saturate(value: BigInt, width: Int): BigInt =
+    value.max(-(BigInt(1) << (width - 1))).min((BigInt(1) << (width - 1)) - 1)
+
+  // Host buffer words of coefs(channel)(tap), every channel with the same tap
+  // count, a multiple of lanes
+  def layout(coefs: Seq[Seq[BigInt]], lanes: Int): Seq[BigInt] = {
+    val segment = coefs.head.size / lanes
+    for(c <- coefs.indices; i <- 0 until segment; l <- 0 until lanes)
+      yield coefs(c)(l * segment + i)
+  }
+
+  // The engine in software: channels past coefs.size pass through
+  class Reference(coefs: Seq[Seq[BigInt]], sampleWidth: Int) {
+    private val history = coefs.map(c => Vector.fill(c.size)(BigInt(0))).toArray
+
+    def apply(frame: Seq[BigInt]): Seq[BigInt] = frame.zipWithIndex.map { case (x, ch) =>
+      if(ch >= coefs.size) x else {
+        history(ch) = x +: history(ch).init
+        val acc = coefs(ch).zip(history(ch)).map { case (h, s) => h * s }.sum
+        saturate((acc + (BigInt(1) << (fracBits - 1))) >> fracBits, sampleWidth)
+      }
+    }
+  }
+
+  // Taps per channel the MAC budget and BRAM allow, by channels and rate
+  def report(lanes: Int, depth: Int, sampleWidth: Int, channels: Int, clockHz: Long): String = {
+    val rates = Seq(48000, 96000, 192000)
+    val counts = Seq(1, 2, 4, 8, 16).filter(_ <= channels)
+    val rows = counts.map { c =>
+      f"  $c%8d" + rates.map(r => f"${maxTaps(lanes, depth, c, clockHz, r)}%10d").mkString
+    }
+    val bits = lanes * depth * (coefWidth + sampleWidth)
+    (s"FIR engine, $lanes lanes x $depth words, $bits BRAM bits, $lanes multipliers, " +
+      f"taps per channel at ${clockHz / 1e6}%.4f MHz:" +:
+      (f"  ${"channels"}%8s" + rates.map(r => f"$r%10d").mkString) +: rows).mkString("\n")
+  }
+
+  //   sbt "hardware/runMain audio.FirEngine"
+  def main(args: Array[String]): Unit = {
+    for(variant <- AudioVariants.load()) {
+      val config = variant.config
+      println(s"${variant.name}:")
+      for(clock <- SynthReport.audioClocks("mclk")) {
+        val hz = Math.round(clock.mhz * 1e6)
+        println(report(config.firLanes, config.firTapsPerLane, config.i2sDataWidth,
+          config.channelCount.min(maxChannels), hz))
+      }
+    }
+  }
+}
+
+class FirEngine(
+  channels: Int,
+  sampleWidth: Int,
+  lanes: Int,
+  depth: Int,
+  coefClock: ClockDomain
+) extends Component {
+  import FirEngine._
+  require(lanes >= 2 && isPow2(lanes) && isPow2(depth) && depth <= 32768)
+  val filtered = channels.min(maxChannels)
+
+  val io = new Bundle {
+    val config = in(FirConfig())
+    val coef = slave Flow(FirCoefWrite())   // In coefClock
+    val input = slave Stream(Vec(Bits(sampleWidth bits), channels))
+    val output = master Stream(Vec(Bits(sampleWidth bits), channels))
+  }
+
+  val laneBits = log2Up(lanes)
+  val addressWidth = log2Up(depth)
+  val accWidth = coefWidth + sampleWidth + log2Up(lanes * depth)
+
+  val coefs = Seq.fill(lanes)(Mem(SInt(coefWidth bits), depth))
+  val host = new ClockingArea(coefClock) {
+    val write = io.coef.payload
+    val lane = write.index(laneBits - 1 downto 0)
+    val address = (write.index >> laneBits).resize(addressWidth)
+    for((mem, l) <- coefs.zipWithIndex) {
+      mem.write(address, write.value(coefWidth - 1 downto 0).asSInt, io.coef.valid && lane === l)
+    }
+  }
+
+  val history = Seq.fill(lanes)(Mem(SInt(sampleWidth bits), depth))
+
+  val IDLE = 0
+  val CLEAR = 1
+  val EVICT = 2
+  val SHIFT = 3
+  val MAC = 4
+  val SUM = 5
+  val OUT = 6
+
+  val fsm = new Area {
+    val state = Reg(UInt(3 bits)) init(IDLE)
+    val primed = RegInit(False)
+    val active = Reg(UInt(5 bits)) init(0)                  // Filtered channels
+    val segment = Reg(UInt(addressWidth + 1 bits)) init(0)  // Taps per lane
+    val channel = Reg(UInt(log2Up(filtered) bits)) init(0)
+    val base = Reg(UInt(addressWidth bits)) init(0)         // Channel's words
+    val wp = Reg(UInt(addressWidth bits)) init(0)           // Oldest sample
+    val rp = Reg(UInt(addressWidth bits)) init(0)
+    val k = Reg(UInt(addressWidth bits)) init(0)
+    val clearIndex = Reg(UInt(addressWidth bits)) init(0)
+    val frame = Reg(Vec(SInt(sampleWidth bits), channels))
+    val acc = Reg(Vec(SInt(accWidth bits), lanes))
+    val slot = channel.resize(log2Up(channels) bits)
+
+    // Configuration as the engine runs it, checked against the BRAM
+    val requested = io.config.taps >> laneBits
+    val fits = requested =/= 0 && io.config.channels =/= 0 &&
+      io.config.channels <= filtered && requested * io.config.channels <= depth
+    val run = io.config.enable && fits
+    val settled = RegNext(io.config.asBits) === io.config.asBits   // Not mid-crossing
+    val changed = requested =/= segment || io.config.channels =/= active
+
+    val c = coefs.map(_.readSync(base + k, state === MAC, clockCrossing = true))
+    val h = history.map(_.readSync(base + Mux(state === EVICT, wp, rp),
+      state === EVICT || state === MAC))
+    val product = RegNext(state === MAC) init(False)   // c and h valid
+
+    // Lane 0 takes the new sample, every other lane what the one before evicts
+    for(l <- 0 until lanes) {
+      val sample = if(l == 0) frame(slot) else h(l - 1)
+      history(l).write(
+        Mux(state === CLEAR, clearIndex, base + wp),
+        Mux(state === CLEAR, S(0, sampleWidth bits), sample),
+        state === CLEAR || state === SHIFT
+      )
+    }
+    when(product) {
+      for(l <- 0 until lanes) acc(l) := acc(l) + (c(l) * h(l)).resize(accWidth)
+    }
+
+    val total = acc.reduce(_ + _)
+    val rounded = (total + S(BigInt(1) << (fracBits - 1), accWidth bits)) >> fracBits
+    val y = rounded.sat(widthOf(rounded) - sampleWidth)
+
+    io.input.ready := False
+    io.output.valid := False
+    io.output.payload := Vec(frame.map(_.asBits))
+
+    when(!run) { primed := False }
+
+    switch(state) {
+      is(IDLE) {
+        // Frame boundary: channels and taps change here only
+        when(!run) {
+          io.output.valid := io.input.valid
+          io.output.payload := io.input.payload
+          io.input.ready := io.output.ready
+        } elsewhen(!primed || (settled && changed)) {
+          segment := requested.resized
+          active := io.config.channels
+          clearIndex := 0
+          wp := 0
+          state := CLEAR
+        } otherwise {
+          io.input.ready := True
+          when(io.input.valid) {
+            for(i <- 0 until channels) frame(i) := io.input.payload(i).asSInt
+            channel := 0
+            base := 0
+            state := EVICT
+          }
+        }
+      }
+      is(CLEAR) {
+        clearIndex := clearIndex + 1
+        when(clearIndex.andR) {
+          primed := True
+          state := IDLE
+        }
+      }
+      is(EVICT) {
+        state := SHIFT
+      }
+      is(SHIFT) {
+        acc.foreach(_ := 0)
+        rp := wp
+        k := 0
+        state := MAC
+      }
+      is(MAC) {
+        rp := Mux(rp === 0, (segment - 1).resize(addressWidth), rp - 1)
+        k := k + 1
+        when(k === segment - 1) { state := SUM }
+      }
+      // One cycle for the last product, one to sum the lanes
+      is(SUM) {
+        when(!product) {
+          frame(slot) := y
+          when(channel === active - 1) {
+            wp := Mux(wp === segment - 1, U(0, addressWidth bits), wp + 1)
+            state := OUT
+          } otherwise {
+            channel := channel + 1
+            base := base + segment.resize(addressWidth)
+            state := EVICT
+          }
+        }
+      }
+      is(OUT) {
+        io.output.valid := True
+        when(io.output.ready) { state := IDLE }
+      }
+    }
+  }
+}
@@ -0,0 +1,182 @@
+package audio
+
+import spinal.core._
+
+// Static latency budget of the DMA path: typical and worst-case latency of
+// every stage between the host buffer and the I2S pins, worked out from the
+// AudioConfig, the DMAEngine and AudioCDC constants and the serializer
+// framing. LatencyTracer and the TLM levels check it against simulation, and
+// the driver's runtime->delay table is generated from it:
+//
+//   sbt "hardware/runMain audio.LatencyBudget --rate 96000 --period 256 --periods 2"
+//   sbt "hardware/runMain audio.LatencyBudget --header driver/src/include/pcie-audio-latency.h"
+object LatencyBudget {
+  // inDelay stages hold frames the DMA pointer has already passed (playback)
+  // or not reached yet (capture), which is what runtime->delay reports
+  case class Stage(name: String, typicalPs: Double, worstPs: Double, inDelay: Boolean)
+
+  // Figures the RTL does not fix: user clock, completer and MCLK ratio
+  case class Platform(
+    pciePeriodPs: Long = 8000,         // 125 MHz user clock
+    completionLatencyNs: Double = 800, // Read request to first completion beat
+    completionWorstNs: Double = 4000,  // Loaded root complex
+    mclkMultiple: Int = 256
+  )
+
+  case class Budget(rate: Int, playback: Seq[Stage], capture: Seq[Stage]) {
+    def framePeriodPs: Double = 1e12 / rate
+    def frames(ps: Double): Double = ps / framePeriodPs
+
+    def stage(capture: Boolean, name: String): Stage =
+      (if(capture) this.capture else playback).find(_.name == name).get
+
+    private def delay(stages: Seq[Stage]): Int =
+      Math.round(frames(stages.filter(_.inDelay).map(_.typicalPs).sum)).toInt
+
+    def playbackDelayFrames: Int = delay(playback)
+    def captureDelayFrames: Int = delay(capture)
+
+    def report(): String = {
+      def table(title: String, stages: Seq[Stage]): String = {
+        val rows = stages.map { s =>
+          val delay = if(s.inDelay) "*" else ""
+          f"  ${s.name}%-12s ${s.typicalPs / 1e6}%12.3f ${frames(s.typicalPs)}%10.2f " +
+            f"${s.worstPs / 1e6}%12.3f ${frames(s.worstPs)}%10.2f $delay"
+        }
+        (f"$title\n  ${"stage"}%-12s ${"typical us"}%12s ${"frames"}%10s " +
+          f"${"worst us"}%12s ${"frames"}%10s" +: rows).mkString("\n")
+      }
+      table(s"Playback budget at $rate Hz (* = in runtime->delay):", playback) + "\n" +
+        table(s"Capture budget at $rate Hz:", capture) + "\n" +
+        s"  runtime->delay: playback $playbackDelayFrames, capture $captureDelayFrames frames"
+    }
+  }
+
+  // DMAEngine constants: one 128-bit beat per frame, a burst is issued once
+  // a maxBurstSize worth of samples fits (playback) or is waiting (capture)
+  def burstFrames(config: AudioConfig): Int = config.maxBurstSize / 16
+  def issueFrames(config: AudioConfig): Int = config.maxBurstSize / (config.i2sDataWidth / 8)
+  val fsmOverheadCycles = 3 // IDLE -> FETCH_DESC -> (burst) -> UPDATE_DESC
+
+  // StreamFifoCC pointer synchronisation: two pop-side flops plus the gray update
+  val cdcSyncCycles = 3
+
+  // Bit clocks per frame, and from the word clock edge to the first data bit
+  private def framing(config: AudioConfig, format: AudioFormat.E): (Int, Int) = {
+    val i2sBits = config.wordClockMultiples.head
+    format match {
+      case AudioFormat.I2S_STANDARD      => (i2sBits, 1)
+      case AudioFormat.I2S_JUSTIFY_LEFT  => (i2sBits, 0)
+      case AudioFormat.I2S_JUSTIFY_RIGHT => (i2sBits, i2sBits / 2 - config.i2sDataWidth)
+      case AudioFormat.TDM               => (config.tdmSlots * config.tdmSlotWidth, 1)
+      case _                             => (1, 0) // DSD: one word per frame, no framing
+    }
+  }
+
+  def apply(
+    config: AudioConfig,
+    rate: Int,
+    format: AudioFormat.E,
+    periodFrames: Int,
+    periods: Int,
+    platform: Platform = Platform()
+  ): Budget = {
+    val framePs = 1e12 / rate
+    val pciePs = platform.pciePeriodPs.toDouble
+    val mclkPs = framePs / platform.mclkMultiple
+    val syncPs = pciePs + cdcSyncCycles * mclkPs
+    val fifoDepth = config.fifoDepth
+    val burst = burstFrames(config)
+    val issue = issueFrames(config)
+    val (bitsPerFrame, offsetBits) = framing(config, format)
+    val offsetPs = offsetBits * framePs / bitsPerFrame
+    val bufferFrames = periodFrames * periods
+
+    // One read in flight: a request waits for the previous burst to land
+    val descriptorPs = (fsmOverheadCycles - 1) * pciePs
+    val readTypicalPs = platform.completionLatencyNs * 1000 + burst / 2.0 * pciePs
+    val readWorstPs = platform.completionWorstNs * 1000 + burst * pciePs
+
+    // pbFifo refills by a burst whenever it has issueFrames of space, and
+    // keeps txFifo full; frames leave at the frame rate
+    val playback = Seq(
+      Stage("alsa buffer", (bufferFrames - periodFrames / 2.0) * framePs,
+        bufferFrames * framePs, inDelay = false),
+      Stage("descriptor", descriptorPs, descriptorPs + readWorstPs, inDelay = false),
+      Stage("burst fill", readTypicalPs, readWorstPs, inDelay = false),
+      Stage("pbFifo", (fifoDepth - issue + burst / 2.0) * framePs,
+        fifoDepth * framePs + pciePs, inDelay = true),
+      Stage("txFifo", fifoDepth * framePs, fifoDepth * framePs + syncPs, inDelay = true),
+      Stage("serializer", offsetPs, framePs + offsetPs + mclkPs, inDelay = true)
+    )
+
+    // A frame is pushed once it has been shifted in; capFifo holds frames
+    // until issueFrames are waiting, then writes a burst of them
+    val capture = Seq(
+      Stage("serializer", framePs + offsetPs, framePs + offsetPs + mclkPs, inDelay = true),
+      Stage("rxFifo", syncPs, fifoDepth * framePs + syncPs, inDelay = true),
+      Stage("capFifo", (issue - burst / 2.0) * framePs, fifoDepth * framePs, inDelay = true),
+      Stage("descriptor", descriptorPs, descriptorPs, inDelay = true),
+      Stage("burst write", (1 + burst / 2.0) * pciePs, (1 + burst) * pciePs, inDelay = true),
+      Stage("alsa buffer", periodFrames / 2.0 * framePs, bufferFrames * framePs, inDelay = false)
+    )
+
+    Budget(rate, playback, capture)
+  }
+
+  // The rates the driver advertises, in the order of its delay table
+  val driverRates = Seq(44100, 48000, 88200, 96000, 176400, 192000)
+
+  // runtime->delay per rate for the PCM formats the driver exposes (I2S);
+  // the ALSA buffer geometry does not enter into it
+  def writeDriverHeader(
+    config: AudioConfig,
+    path: String,
+    platform: Platform = Platform()
+  ): Unit = {
+    val out = new java.io.PrintWriter(path)
+    try {
+      out.println("/* Generated by audio.LatencyBudget, do not edit */")
+      out.println("#ifndef __PCIE_AUDIO_LATENCY_H")
+      out.println("#define __PCIE_AUDIO_LATENCY_H")
+      out.println()
+      out.println("/* { rate, playback frames, capture frames } for runtime->delay */")
+      out.println("#define PCIE_AUDIO_DELAY_TABLE { \\")
+      for(rate <- driverRates) {
+        val budget = LatencyBudget(config, rate, AudioFormat.I2S_STANDARD, 1024, 4, platform)
+        out.println(
+          f"    { $rate%6d, ${budget.playbackDelayFrames}%4d, ${budget.captureDelayFrames}%4d }, \\"
+        )
+      }
+      out.println("}")
+      out.println()
+      out.println("#endif /* __PCIE_AUDIO_LATENCY_H */")
+    } finally {
+      out.close()
+    }
+  }
+
+  def main(args: Array[String]): Unit = {
+    def arg(name: String): Option[String] =
+      args.sliding(2).collectFirst { case Array(`name`, value) => value }
+
+    val config = AudioPCIeCosim.config
+    arg("--header") match {
+      case Some(path) =>
+        writeDriverHeader(config, path)
+        println(s"Wrote $path")
+      case None =>
+        val format = arg("--format")
+          .map(name => AudioFormat.elements.find(_.getName() == name).get)
+          .getOrElse(AudioFormat.I2S_STANDARD)
+        val budget = LatencyBudget(
+          config,
+          arg("--rate").map(_.toInt).getOrElse(48000),
+          format,
+          arg("--period").map(_.toInt).getOrElse(1024),
+          arg("--periods").map(_.toInt).getOrElse(4)
+        )
+        println(budget.report())
+    }
+  }
+}
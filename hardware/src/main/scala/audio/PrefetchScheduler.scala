@@ -0,0 +1,114 @@
+package audio
+
+import spinal.core._
+import spinal.lib._
+
+// Just-in-time playback refill: instead of topping pbFifo up whenever a burst
+// fits, which keeps both playback FIFOs full and adds up to 2 x fifoDepth
+// frames of latency, a burst is requested only once the frames queued
+// between DMAEngine and the serializer drop below what will drain while that
+// burst is on its way, plus a guard the driver sets.
+//
+// - Drain rate: frames leaving pbFifo per window of 2^windowLog2 cycles,
+//   which is the serializer's rate once the queue is past its initial fill
+// - Lead time: the read request to first completion beat latency of the
+//   link, tracked per burst. A slower completion raises the estimate at
+//   once, faster ones lower it by 1/2^decayLog2 of the difference, so a
+//   single fast completion after a slow one does not cut the margin
+// - target = drain over (lead + overhead + burst transfer) + 1 + guard
+//
+// Until the first window and the first completion since enable have been
+// measured the scheduler asks for a burst whenever one fits, as without it,
+// so a stream starts with full FIFOs and drains down to the target.
+object PrefetchScheduler {
+  val windowLog2 = 16        // 524 us at 125 MHz
+  val decayLog2 = 4
+
+  // The same target in software, for the transaction-level model
+  def target(
+    framesPerWindow: Int,
+    latencyCycles: Int,
+    burstFrames: Int,
+    guardFrames: Int
+  ): Int = {
+    val leadCycles = latencyCycles.toLong + LatencyBudget.fsmOverheadCycles + burstFrames
+    val drained = (framesPerWindow * leadCycles) >> windowLog2
+    Math.min(0xFFFF, drained.toInt + 1 + guardFrames)
+  }
+
+  // One latency sample folded into the estimate
+  def track(estimate: Int, sample: Int): Int =
+    if(sample >= estimate) sample else estimate - ((estimate - sample) >> decayLog2)
+}
+
+class PrefetchScheduler(burstFrames: Int) extends Component {
+  import PrefetchScheduler._
+
+  val io = new Bundle {
+    val enable = in Bool()           // Playback running with the scheduler on
+    val guard = in UInt(16 bits)     // Frames kept beyond the computed lead
+    val level = in UInt(16 bits)     // Frames queued between DMAEngine and the serializer
+    val drained = in Bool()          // A frame left pbFifo
+    val issued = in Bool()           // A read request was accepted
+    val landed = in Bool()           // The first beat of its completion arrived
+
+    val refill = out Bool()
+    val target = out UInt(16 bits)   // 0 until measured
+    val latency = out UInt(16 bits)  // Completion latency estimate, cycles
+  }
+
+  val rate = new Area {
+    val window = CounterFreeRun(BigInt(1) << windowLog2)
+    val count = Reg(UInt(16 bits)) init(0)
+    val framesPerWindow = Reg(UInt(16 bits)) init(0)
+    val measured = RegInit(False)
+
+    when(io.drained && count =/= count.maxValue) { count := count + 1 }
+    when(window.willOverflow) {
+      framesPerWindow := count + U(io.drained)
+      count := 0
+      measured := True
+    }
+    when(!io.enable) {
+      window.clear()
+      count := 0
+      measured := False
+    }
+  }
+
+  val link = new Area {
+    val waiting = RegInit(False)
+    val cycles = Reg(UInt(16 bits)) init(0)
+    val estimate = Reg(UInt(16 bits)) init(0)
+    val measured = RegInit(False)
+
+    when(waiting && cycles =/= cycles.maxValue) { cycles := cycles + 1 }
+    when(io.issued) {
+      waiting := True
+      cycles := 0
+    }
+    when(waiting && io.landed) {
+      waiting := False
+      measured := True
+      when(cycles >= estimate) {
+        estimate := cycles
+      } otherwise {
+        estimate := estimate - ((estimate - cycles) >> decayLog2)
+      }
+    }
+    when(!io.enable) { measured := False }
+  }
+
+  val schedule = new Area {
+    val overhead = U(LatencyBudget.fsmOverheadCycles + burstFrames, 16 bits)
+    val leadCycles = link.estimate +^ overhead
+    val drained = (rate.framesPerWindow * leadCycles) >> windowLog2
+    val sum = drained.resize(18 bits) + io.guard + 1
+    val target = RegNext(Mux(sum > 0xFFFF, U(0xFFFF, 16 bits), sum.resize(16 bits))) init(0)
+    val ready = rate.measured && link.measured
+
+    io.target := Mux(ready, target, U(0, 16 bits))
+    io.latency := link.estimate
+    io.refill := !io.enable || !ready || io.level < target
+  }
+}
@@ -0,0 +1,74 @@
+package audio
+
+import spinal.core._
+import spinal.core.sim._
+import scala.collection.mutable
+import scala.reflect.ClassTag
+
+// Options that change the compiled simulation, and so are part of its key.
+// Full-design waves are off unless -Daudio.sim.waves=true: they make long
+// runs I/O bound, and benchmarks must not pay for them. Tests that need to
+// see failures arm a WaveCapture on the hierarchies they exercise instead.
+case class SimOptions(
+  waves: Boolean = SimOptions.wavesByDefault
+)
+
+object SimOptions {
+  val wavesByDefault: Boolean = sys.props.get("audio.sim.waves").contains("true")
+}
+
+// Compiled simulations shared by every suite in the test JVM. Elaborating and
+// Verilating AudioPCIeTop dominates a sim run, and most tests build the same
+// component with the same config, so each (component, config, options) is
+// compiled once and doSim'd as often as needed.
+//
+// With -Daudio.sim.cache=<dir> the Verilator builds are also kept on disk,
+// keyed by a hash of the generated RTL, so a later run only re-elaborates.
+object SimCompileCache {
+  val persistentPath: Option[String] = sys.props.get("audio.sim.cache")
+
+  private class Entry(build: => SimCompiled[_ <: Component]) {
+    lazy val compiled: SimCompiled[_ <: Component] = build
+  }
+
+  private val entries = mutable.HashMap[String, Entry]()
+  private var hitCount, missCount = 0
+
+  // `params` identifies the component's elaboration: its config case classes
+  // and any other constructor arguments. Entries are compiled outside the
+  // cache lock, so different keys build in parallel.
+  def apply[T <: Component: ClassTag](params: Any*)(dut: => T): SimCompiled[T] =
+    compile(SimOptions(), params: _*)(dut)
+
+  def compile[T <: Component: ClassTag](options: SimOptions, params: Any*)(
+    dut: => T
+  ): SimCompiled[T] = {
+    val name = implicitly[ClassTag[T]].runtimeClass.getSimpleName
+    val key = s"$name(${params.mkString(",")})/$options"
+    val entry = synchronized {
+      entries.get(key) match {
+        case Some(e) =>
+          hitCount += 1
+          e
+        case None =>
+          missCount += 1
+          val e = new Entry(config(name, key, options).compile(dut))
+          entries(key) = e
+          e
+      }
+    }
+    entry.compiled.asInstanceOf[SimCompiled[T]]
+  }
+
+  def hits: Int = synchronized(hitCount)
+  def misses: Int = synchronized(missCount)
+
+  // Each entry gets its own workspace: two configs of one toplevel must not
+  // overwrite each other's loaded model
+  private def config(name: String, key: String, options: SimOptions): SpinalSimConfig = {
+    var simConfig = SimConfig.workspaceName("%s_%08x".format(name, key.hashCode))
+    if(options.waves) simConfig = simConfig.withFstWave
+    persistentPath.foreach(path => simConfig = simConfig.cachePath(path))
+    simConfig
+  }
+}
@@ -0,0 +1,341 @@
+package audio
+
+import spinal.core._
+import spinal.lib._
+
+// Spectrum analyzer on one channel of the input or the output path, so a
+// monitoring display needs neither a capture stream nor FFTs on the host.
+//
+// - Blocks of N = 2^config.size samples, 256 up to maxSize, windowed, then a
+//   radix-2 decimation-in-time FFT in place in one BRAM, one butterfly at a
+//   time. Every stage halves, so nothing overflows: bin k is X(k) / N
+// - Windows rectangular, Hann and 4-term Blackman-Harris, all
+//   a0 - a1 cos(2 pi n / N) + a2 cos(4 pi n / N) - a3 cos(6 pi n / N), the
+//   cosines read from the twiddle table
+// - |X(k) / N|^2 of bins 0 .. N/2 - 1 is summed over 2^config.average
+//   blocks, then streamed out as IEEE single floats relative to full scale
+//   squared, the last bin flagged. A full-scale sine on a bin reads 0.25
+//
+// Samples go to a circular buffer of maxSize, and a transform starts on the
+// latest N of them, so loading a block outruns the samples overwriting it.
+// A transform takes cyclesPerSample() audio clock cycles per sample, which
+// have to fit in one frame period; one that is late, the output held back,
+// skips samples, it never mixes blocks. Changing the configuration restarts
+// the average. A block started is finished even when the analyzer is
+// disabled, so the stream only ever carries whole spectra. The reference
+// model below is bit-exact against the datapath.
+object SpectrumAnalyzer {
+  val minSizeLog2 = 8
+  val fracBits = 16          // Q1.16 twiddles and window
+  val tableWidth = 18
+  val maxAverageLog2 = 7
+
+  val RECTANGULAR = 0
+  val HANN = 1
+  val BLACKMAN_HARRIS = 2
+
+  // a0 .. a3 of each window, Q0.16; each sums to 1.0 exactly
+  val windows: Seq[Seq[Int]] = Seq(
+    Seq(1.0, 0.0, 0.0, 0.0),
+    Seq(0.5, 0.5, 0.0, 0.0),
+    Seq(0.35875, 0.48829, 0.14128, 0.01168)
+  ).map(_.map(a => Math.round(a * (1 << fracBits)).toInt))
+
+  // Load, butterflies and power, per sample of a 2^sizeLog2-point block
+  def cyclesPerSample(sizeLog2: Int): Int = 6 + 2 * sizeLog2
+
+  // cos and sin of 2 pi k / 2^maxLog2, k < 2^maxLog2 / 2
+  def table(maxLog2: Int): Seq[(Int, Int)] = (0 until (1 << maxLog2) / 2).map { k =>
+    val angle = 2 * Math.PI * k / (1 << maxLog2)
+    (Math.round(Math.cos(angle) * (1 << fracBits)).toInt,
+      Math.round(Math.sin(angle) * (1 << fracBits)).toInt)
+  }
+
+  // An IEEE single of value / 2^scale, the mantissa truncated
+  def toFloat(value: BigInt, scale: Int): Int = if(value == 0) 0 else {
+    val msb = value.bitLength - 1
+    val mantissa = if(msb >= 23) value >> (msb - 23) else value << (23 - msb)
+    ((127 + msb - scale) << 23) | (mantissa & 0x7FFFFF).toInt
+  }
+
+  // The analyzer in software: spectrum() is one block's power per bin,
+  // apply() the floats of 2^averageLog2 blocks
+  class Reference(sampleWidth: Int, maxSize: Int) {
+    val maxLog2 = log2Up(maxSize)
+    private val cosSin = table(maxLog2)
+
+    private def cosAt(k: Int): BigInt = {
+      val i = k & (maxSize - 1)
+      if(i >= maxSize / 2) -cosSin(i - maxSize / 2)._1 else cosSin(i)._1
+    }
+
+    def window(n: Int, sizeLog2: Int, kind: Int): BigInt = {
+      val a = windows(kind)
+      val k = n << (maxLog2 - sizeLog2)
+      ((BigInt(a(0)) << fracBits) - a(1) * cosAt(k) + a(2) * cosAt(2 * k) -
+        a(3) * cosAt(3 * k)) >> fracBits
+    }
+
+    def spectrum(block: Seq[BigInt], sizeLog2: Int, kind: Int): Seq[BigInt] = {
+      val n = 1 << sizeLog2
+      val re = new Array[BigInt](n)
+      val im = Array.fill(n)(BigInt(0))
+      for(i <- 0 until n) {
+        val reversed = Integer.reverse(i) >>> (32 - sizeLog2)
+        re(reversed) = (block(i) * window(i, sizeLog2, kind)) >> fracBits
+      }
+      for(stage <- 0 until sizeLog2; t <- 0 until n / 2) {
+        val half = 1 << stage
+        val j = t & (half - 1)
+        val a = ((t >> stage) << (stage + 1)) | j
+        val b = a + half
+        val (c, s) = cosSin(j << (maxLog2 - 1 - stage))
+        val tr = (c * re(b) + s * im(b)) >> fracBits
+        val ti = (c * im(b) - s * re(b)) >> fracBits
+        val (ar, ai) = (re(a), im(a))
+        re(a) = (ar + tr) >> 1
+        im(a) = (ai + ti) >> 1
+        re(b) = (ar - tr) >> 1
+        im(b) = (ai - ti) >> 1
+      }
+      (0 until n / 2).map(k => re(k) * re(k) + im(k) * im(k))
+    }
+
+    def apply(blocks: Seq[Seq[BigInt]], sizeLog2: Int, kind: Int, averageLog2: Int): Seq[Int] = {
+      require(blocks.size == 1 << averageLog2)
+      val sums = blocks.map(spectrum(_, sizeLog2, kind)).transpose.map(_.sum)
+      sums.map(toFloat(_, 2 * (sampleWidth - 1) + averageLog2))
+    }
+  }
+}
+
+class SpectrumAnalyzer(sampleWidth: Int, maxSize: Int) extends Component {
+  import SpectrumAnalyzer._
+  require(isPow2(maxSize) && maxSize >= (1 << minSizeLog2) && maxSize <= 32768)
+
+  val io = new Bundle {
+    val config = in(SpectrumConfig())
+    val sample = slave Flow(Bits(sampleWidth bits))     // The selected channel
+    val bins = master Stream(Fragment(Bits(32 bits)))   // IEEE single per bin
+  }
+
+  val maxLog2 = log2Up(maxSize)
+  val dataWidth = sampleWidth + 2
+  val accWidth = 2 * dataWidth + maxAverageLog2
+
+  // Twiddles: cos and sin of 2 pi k / maxSize, folded for k up to maxSize
+  val cosTable = Mem(table(maxLog2).map(e => S(e._1, tableWidth bits)))
+  val sinTable = Mem(table(maxLog2).map(e => S(e._2, tableWidth bits)))
+
+  val samples = Mem(SInt(sampleWidth bits), maxSize)
+  val work = Mem(Vec(SInt(dataWidth bits), 2), maxSize)
+  val sums = Mem(UInt(accWidth bits), maxSize / 2)
+
+  val IDLE = 0
+  val LOAD = 1
+  val STAGE = 2
+  val POWER = 3
+
+  val fsm = new Area {
+    val state = Reg(UInt(2 bits)) init(IDLE)
+    val phase = Reg(UInt(3 bits)) init(0)
+    val live = Reg(SpectrumConfig())
+    live.init(live.getZero)   // Disabled
+    val stage = Reg(UInt(4 bits)) init(0)
+    val index = Reg(UInt(maxLog2 bits)) init(0)
+    val start = Reg(UInt(maxLog2 bits)) init(0)
+    val averaged = Reg(UInt(maxAverageLog2 bits)) init(0)   // Blocks in sums
+    val x = Reg(SInt(sampleWidth bits))
+    val weight = Reg(SInt(2 * tableWidth bits))
+    val a = Reg(Vec(SInt(dataWidth bits), 2))
+    val twiddle = Reg(Vec(SInt(tableWidth bits), 2))
+    val lower = Reg(Vec(SInt(dataWidth bits), 2))   // b', written after a'
+
+    // Configuration as the analyzer runs it
+    val sizeLog2 = Mux(
+      live.size < minSizeLog2,
+      U(minSizeLog2, 4 bits),
+      Mux(live.size > maxLog2, U(maxLog2, 4 bits), live.size)
+    )
+    val points = U(1, maxLog2 + 1 bits) |<< sizeLog2
+    val lastBin = (points >> 1) - 1
+    val spread = U(maxLog2, 4 bits) - sizeLog2
+    val blocks = U(1, maxAverageLog2 + 1 bits) |<< live.average
+    val lastBlock = averaged === (blocks - 1).resized
+    val settled = RegNext(io.config.asBits) === io.config.asBits   // Not mid-crossing
+    val changed = io.config.asBits =/= live.asBits
+
+    // Samples since the block started, up to maxSize
+    val capture = new Area {
+      val wp = Reg(UInt(maxLog2 bits)) init(0)
+      val count = Reg(UInt(maxLog2 + 1 bits)) init(0)
+      val restart = False
+      samples.write(wp, io.sample.payload.asSInt, io.sample.valid)
+      when(io.sample.valid) { wp := wp + 1 }
+      when(restart) {
+        count := U(io.sample.valid).resized
+      } elsewhen(io.sample.valid && count =/= maxSize) {
+        count := count + 1
+      }
+    }
+
+    // One read port per memory, addressed by state and phase
+    val half = U(1, maxLog2 bits) |<< stage
+    val low = index & (half - 1)
+    val upperIndex = ((index & ~(half - 1)) |<< 1) | low
+    val lowerIndex = upperIndex | half
+    val k = index |<< spread
+    val tableIndex = UInt(maxLog2 bits)
+    tableIndex := low |<< (U(maxLog2 - 1, 4 bits) - stage)
+    val workIndex = UInt(maxLog2 bits)
+    workIndex := upperIndex
+    when(state === LOAD) {
+      tableIndex := k
+      when(phase === 1) { tableIndex := k |<< 1 }
+      when(phase === 2) { tableIndex := k + (k |<< 1) }
+    }
+    when(state === STAGE && phase === 1) { workIndex := lowerIndex }
+    when(state === POWER) { workIndex := index }
+
+    val negate = RegNext(tableIndex.msb)
+    val cosRead = cosTable.readSync(tableIndex(maxLog2 - 2 downto 0))
+    val sinRead = sinTable.readSync(tableIndex(maxLog2 - 2 downto 0))
+    val cosine = Mux(negate, -cosRead, cosRead)
+    val sampleRead = samples.readSync(start + index, state === LOAD && phase === 0)
+    val workRead = work.readSync(workIndex, phase <= 1)
+    val sumRead = sums.readSync(index.resized, state === POWER && phase === 0)
+
+    def coef(i: Int): SInt = live.window.mux(
+      RECTANGULAR -> S(windows(RECTANGULAR)(i), tableWidth bits),
+      HANN -> S(windows(HANN)(i), tableWidth bits),
+      default -> S(windows(BLACKMAN_HARRIS)(i), tableWidth bits)
+    )
+
+    // Window: x w(n) >> 16, to the bit-reversed slot
+    val w = weight >> fracBits
+    val windowed = ((x * w) >> fracBits).resize(dataWidth)
+
+    // Butterfly on a and workRead: (a +- W b) / 2
+    val b = workRead
+    val tr = (twiddle(0) * b(0) + twiddle(1) * b(1)) >> fracBits
+    val ti = (twiddle(0) * b(1) - twiddle(1) * b(0)) >> fracBits
+    val width = widthOf(tr) + 1
+    val sumRe = ((a(0).resize(width) + tr.resize(width)) >> 1).resize(dataWidth)
+    val sumIm = ((a(1).resize(width) + ti.resize(width)) >> 1).resize(dataWidth)
+    val diffRe = ((a(0).resize(width) - tr.resize(width)) >> 1).resize(dataWidth)
+    val diffIm = ((a(1).resize(width) - ti.resize(width)) >> 1).resize(dataWidth)
+
+    val writeIndex = UInt(maxLog2 bits)
+    val writeData = Vec(SInt(dataWidth bits), 2)
+    writeIndex := upperIndex
+    writeData := Vec(sumRe, sumIm)
+    val writeEnable = False
+    work.write(writeIndex, writeData, writeEnable)
+
+    // Power, summed, then as a float relative to full scale squared
+    val power = (b(0) * b(0)).asUInt.resize(accWidth) + (b(1) * b(1)).asUInt.resize(accWidth)
+    val sum = Mux(averaged === 0, power, sumRead + power)
+    val msb = OHToUInt(OHMasking.last(sum.asBits))
+    val normalized = sum |<< (U(accWidth - 1) - msb)
+    val exponent = U(127 - 2 * (sampleWidth - 1), 8 bits) + msb.resize(8) - live.average.resize(8)
+    val float = Mux(
+      sum === 0,
+      B(0, 32 bits),
+      B"0" ## exponent ## normalized(accWidth - 2 downto accWidth - 24)
+    )
+
+    io.bins.valid := False
+    io.bins.payload.fragment := float
+    io.bins.payload.last := index === lastBin.resized
+
+    switch(state) {
+      // Block boundary: a new configuration restarts the average; a sample
+      // written in the start cycle would land on the block's first one
+      is(IDLE) {
+        when(!io.config.enable || (settled && changed)) {
+          live := io.config
+          averaged := 0
+          capture.restart := True
+        } elsewhen(capture.count >= points && !io.sample.valid) {
+          start := capture.wp - points.resize(maxLog2)
+          index := 0
+          phase := 0
+          capture.restart := True
+          state := LOAD
+        }
+      }
+      // Five cycles a sample: read, then the three window terms, then write
+      is(LOAD) {
+        phase := phase + 1
+        switch(phase) {
+          is(1) {
+            x := sampleRead
+            weight := (coef(0) << fracBits).resize(2 * tableWidth) - coef(1) * cosine
+          }
+          is(2) { weight := weight + coef(2) * cosine }
+          is(3) { weight := weight - coef(3) * cosine }
+          is(4) {
+            writeIndex := index.reversed >> spread
+            writeData := Vec(windowed, S(0, dataWidth bits))
+            writeEnable := True
+            phase := 0
+            index := index + 1
+            when(index === (points - 1).resized) {
+              index := 0
+              stage := 0
+              state := STAGE
+            }
+          }
+        }
+      }
+      // Four cycles a butterfly: read upper, read lower, write both
+      is(STAGE) {
+        phase := phase + 1
+        switch(phase) {
+          is(1) {
+            a := workRead
+            twiddle := Vec(cosine, sinRead)
+          }
+          is(2) {
+            writeEnable := True
+            lower := Vec(diffRe, diffIm)
+          }
+          is(3) {
+            writeIndex := lowerIndex
+            writeData := lower
+            writeEnable := True
+            phase := 0
+            index := index + 1
+            when(index === lastBin.resized) {
+              index := 0
+              stage := stage + 1
+              when(stage === sizeLog2 - 1) { state := POWER }
+            }
+          }
+        }
+      }
+      // Two cycles a bin, the second held until the output takes the bin
+      is(POWER) {
+        when(phase === 0) {
+          phase := 1
+        } otherwise {
+          val done = True
+          when(lastBlock) {
+            io.bins.valid := True
+            done := io.bins.ready
+          } otherwise {
+            sums.write(index.resized, sum)
+          }
+          when(done) {
+            phase := 0
+            index := index + 1
+            when(index === lastBin.resized) {
+              averaged := Mux(lastBlock, U(0, maxAverageLog2 bits), averaged + 1)
+              state := IDLE
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,234 @@
+package audio
+
+import java.io.File
+import org.json4s._
+import org.json4s.native.JsonMethods._
+import org.json4s.native.Serialization
+import spinal.core._
+import scala.sys.process._
+
+// Area and fmax of the generated RTL from the open ECP5 flow: Yosys
+// synth_ecp5, then nextpnr-ecp5 out of context (the AXI and stream ports are
+// far wider than any package). Each target records LUT/FF/BRAM/DSP usage
+// and the fmax of its PCIe and audio clock domains, and is compared with
+// hardware/synth/baselines.json so timing and area regressions show up
+// before a vendor tool is opened:
+//
+//   sbt synth                  // every variant, exit status 1 on a regression
+//   sbt synthUpdateBaseline    // accept the current numbers
+object SynthReport {
+  // Clock port of a target, the domain it belongs to and its constraint
+  case class Clock(port: String, domain: String, mhz: Double)
+
+  case class Target(name: String, device: String, clocks: Seq[Clock], top: () => Component)
+
+  case class Usage(luts: Int, ffs: Int, brams: Int, dsps: Int)
+
+  // fmax per domain ("pcie", "audio") is the slowest clock net of the domain
+  case class Result(target: String, device: String, usage: Usage, fmaxMHz: Map[String, Double])
+
+  val pcieClock = Clock("clk", "pcie", 125.0)
+
+  // 512 x 96 kHz, the fastest MCLK either family runs at
+  def audioClocks(prefix: String): Seq[Clock] = Seq(
+    Clock(s"${prefix}_mclk44k1", "audio", 45.1584),
+    Clock(s"${prefix}_mclk48k", "audio", 49.152)
+  )
+
+  // The PCIe parameters AudioPCIeTop instantiates DMAEngine with
+  val pcieConfig = PCIeConfig(
+    maxReadRequestSize = 512,
+    maxPayloadSize = 256,
+    completionTimeout = 0xA,
+    relaxedOrdering = true,
+    extendedTags = true,
+    maxTags = 32
+  )
+
+  // The FIR engine on its own is named by its size, so each configuration
+  // keeps its own baseline
+  def firName(config: AudioConfig): String =
+    s"FirEngine_L${config.firLanes}_D${config.firTapsPerLane}"
+
+  // AudioProcessor needs the larger part for the FIR engine's multipliers
+  def targets(config: AudioConfig): Seq[Target] = Seq(
+    Target("DMAEngine", "25k", Seq(pcieClock), () => new DMAEngine(config, pcieConfig)),
+    Target("AudioCDC", "25k", Seq(pcieClock), () => new AudioCDC(config)),
+    Target(
+      "AudioProcessor",
+      "85k",
+      pcieClock +: audioClocks("io_clocks"),
+      () => new AudioProcessor(config, ClockDomain.current)
+    ),
+    Target(
+      firName(config),
+      "85k",
+      Seq(Clock("clk", "audio", 49.152)),
+      () => new FirEngine(
+        config.channelCount, config.i2sDataWidth, config.firLanes, config.firTapsPerLane,
+        ClockDomain.current
+      ).setDefinitionName(firName(config))
+    ),
+    Target(
+      "AudioPCIeTop",
+      "85k",
+      pcieClock +: audioClocks("io_audio"),
+      () => new AudioPCIeTop(config)
+    )
+  )
+
+  // Area and fmax may move by this much before it counts as a regression;
+  // placement is seeded, so the noise is in the tools' version, not the run
+  val areaTolerance = 0.02
+  val fmaxTolerance = 0.03
+
+  private implicit val formats: Formats = DefaultFormats
+
+  private def run(command: Seq[String], directory: File, log: String): Unit = {
+    val exit =
+      try Process(command, directory).!(ProcessLogger(new File(directory, log)))
+      catch {
+        case _: java.io.IOException =>
+          throw new IllegalStateException(s"${command.head} not found on PATH")
+      }
+    if(exit != 0) {
+      throw new IllegalStateException(s"${command.head} failed, see ${directory.getPath}/$log")
+    }
+  }
+
+  // One LUT4 per LUT and two per CCU2C carry cell; DP16KD and PDPW16KD are
+  // block RAMs
+  private def usage(cells: Map[String, Int]): Usage = {
+    def count(types: String*) = types.map(cells.getOrElse(_, 0)).sum
+    Usage(
+      luts = count("LUT4") + 2 * count("CCU2C"),
+      ffs = count("TRELLIS_FF"),
+      brams = count("DP16KD", "PDPW16KD"),
+      dsps = count("MULT18X18D", "ALU54B")
+    )
+  }
+
+  private def domain(target: Target, net: String): String =
+    target.clocks.find(clock => net.contains(clock.port)).map(_.domain).getOrElse {
+      if(net.contains("mclk") || net.contains("audio")) "audio" else "pcie"
+    }
+
+  def synthesize(target: Target, directory: String): Result = {
+    val dir = new File(directory, target.name)
+    dir.mkdirs()
+    // Same clock domain setup as the rtl/generated output
+    AudioPCIeTopVerilog.spinalConfig(dir.getPath).generateVerilog(target.top())
+
+    val top = target.name
+    run(
+      Seq(
+        "yosys", "-q", "-p",
+        s"read_verilog $top.v; synth_ecp5 -top $top -json $top.json; " +
+          s"tee -q -o $top.stat.json stat -json"
+      ),
+      dir,
+      "yosys.log"
+    )
+
+    val constraints = new java.io.PrintWriter(new File(dir, "clocks.py"))
+    try {
+      for(clock <- target.clocks) {
+        constraints.println(s"""ctx.addClock("${clock.port}", ${clock.mhz})""")
+      }
+    } finally {
+      constraints.close()
+    }
+    run(
+      Seq(
+        "nextpnr-ecp5", s"--${target.device}", "--out-of-context", "--seed", "1",
+        "--json", s"$top.json", "--pre-pack", "clocks.py", "--report", s"$top.report.json",
+        "--timing-allow-fail"
+      ),
+      dir,
+      "nextpnr.log"
+    )
+
+    val stat = parse(new File(dir, s"$top.stat.json"))
+    val cells = (stat \ "design" \ "num_cells_by_type").extract[Map[String, Int]]
+    val report = parse(new File(dir, s"$top.report.json"))
+    val fmax = (report \ "fmax").extract[Map[String, JValue]].toSeq
+      .map { case (net, timing) => domain(target, net) -> (timing \ "achieved").extract[Double] }
+      .groupBy(_._1)
+      .map { case (name, nets) => name -> nets.map(_._2).min }
+    Result(top, target.device, usage(cells), fmax)
+  }
+
+  // Regressions of `result` against its baseline, as readable lines
+  def compare(result: Result, baseline: Result): Seq[String] = {
+    def area(name: String, now: Int, was: Int) =
+      if(now > was * (1 + areaTolerance) + 1) Some(s"${result.target} $name $was -> $now")
+      else None
+    val areas = Seq(
+      area("LUTs", result.usage.luts, baseline.usage.luts),
+      area("FFs", result.usage.ffs, baseline.usage.ffs),
+      area("BRAMs", result.usage.brams, baseline.usage.brams),
+      area("DSPs", result.usage.dsps, baseline.usage.dsps)
+    ).flatten
+    val timing = for {
+      (name, was) <- baseline.fmaxMHz.toSeq
+      now = result.fmaxMHz.getOrElse(name, 0.0)
+      if now < was * (1 - fmaxTolerance)
+    } yield f"${result.target} $name fmax $was%.1f -> $now%.1f MHz"
+    areas ++ timing
+  }
+
+  def loadBaselines(path: String): Map[String, Result] =
+    if(new File(path).exists) {
+      val source = scala.io.Source.fromFile(path)
+      try Serialization.read[Map[String, Result]](source.mkString) finally source.close()
+    } else Map()
+
+  def saveBaselines(path: String, results: Seq[Result]): Unit = {
+    val out = new java.io.PrintWriter(path)
+    try out.println(Serialization.writePretty(results.map(r => r.target -> r).toMap))
+    finally out.close()
+  }
+
+  def report(results: Seq[Result], baselines: Map[String, Result]): String = {
+    val rows = results.map { r =>
+      def fmax(name: String) = r.fmaxMHz.get(name).map(f => f"$f%.1f").getOrElse("-")
+      val base =
+        baselines.get(r.target).map(b => s"vs ${b.usage.luts} LUTs").getOrElse("no baseline")
+      f"  ${r.target}%-28s ${r.device}%-4s ${r.usage.luts}%7d ${r.usage.ffs}%7d " +
+        f"${r.usage.brams}%6d ${r.usage.dsps}%5d ${fmax("pcie")}%8s ${fmax("audio")}%8s  $base"
+    }
+    (f"ECP5 synthesis:\n  ${"target"}%-28s ${"dev"}%-4s ${"LUTs"}%7s ${"FFs"}%7s " +
+      f"${"BRAMs"}%6s ${"DSPs"}%5s ${"pcie"}%8s ${"audio"}%8s" +: rows).mkString("\n")
+  }
+
+  def main(args: Array[String]): Unit = {
+    def arg(name: String): Option[String] =
+      args.sliding(2).collectFirst { case Array(`name`, value) => value }
+
+    val directory = arg("--dir").getOrElse("rtl/generated/synth")
+    val baselinePath = arg("--baseline").getOrElse("hardware/synth/baselines.json")
+    val onlyTarget = arg("--target")
+    val onlyVariant = arg("--variant")
+    val variants = AudioVariants.load().filter(v => onlyVariant.forall(_ == v.name))
+
+    // Baselines are kept per variant and target, e.g. "pro8/DMAEngine"
+    val results = for {
+      variant <- variants
+      target <- targets(variant.config) if onlyTarget.forall(_ == target.name)
+    } yield {
+      val result = synthesize(target, s"$directory/${variant.name}")
+      result.copy(target = s"${variant.name}/${result.target}")
+    }
+    val baselines = loadBaselines(baselinePath)
+    println(report(results, baselines))
+
+    if(args.contains("--update-baseline")) {
+      saveBaselines(baselinePath, (baselines ++ results.map(r => r.target -> r)).values.toSeq)
+      println(s"Baselines written to $baselinePath")
+    } else {
+      val regressions = results.flatMap(r => baselines.get(r.target).toSeq.flatMap(compare(r, _)))
+      regressions.foreach(line => println(s"REGRESSION $line"))
+      if(regressions.nonEmpty) sys.exit(1)
+    }
+  }
+}
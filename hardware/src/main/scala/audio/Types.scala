@@ -22,7 +22,7 @@ object SampleRateFamily extends SpinalEnum {
 case class AudioConfig(
   // Basic configuration
   channelCount: Int,          // Total number of channels (8 in, 8 out)
-  dataWidth: Int,             // Sample width (up to 32-bit)
+  i2sDataWidth: Int,          // Sample width (up to 32-bit)
   
   // Audio format support
   supportI2s: Boolean = true,
@@ -34,10 +34,11 @@ case class AudioConfig(
   tdmSlotWidth: Int = 32,     // TDM slot width
   
   // DSD specific
-  dsdWidth: Int = 1,          // DSD bit width (DSD64 = 1, DSD128 = 2, etc.)
+  dsdBitWidth: Int = 1,       // DSD bit width (DSD64 = 1, DSD128 = 2, etc.)
   dsdChannels: Int = 8,       // Number of DSD channels
   
   // Clock configuration
+  useMultipleClocks: Boolean = true, // Separate 44.1 kHz and 48 kHz family MCLKs
   masterClockMultiples: Seq[Int] = Seq(256, 512), // Supported MCLK ratios
   wordClockMultiples: Seq[Int] = Seq(64, 128),    // Supported WCLK ratios
   
@@ -52,7 +53,10 @@ case class AudioConfig(
   
   // Advanced features
   supportSRC: Boolean = true, // Sample rate conversion support
-  supportMix: Boolean = true  // Internal mixing support
+  supportMix: Boolean = true, // Internal mixing support
+  firLanes: Int = 8,          // FIR engine multipliers, see FirEngine
+  firTapsPerLane: Int = 1024, // FIR engine BRAM words per lane
+  spectrumMaxSize: Int = 4096 // Largest FFT, see SpectrumAnalyzer
 )
 
 // PCIe configuration parameters
@@ -65,6 +69,78 @@ case class PCIeConfig(
   maxTags: Int
 )
 
+// FIFO watermarks, in frames; a threshold of 0 turns its event off. See
+// FifoWatermark
+case class WatermarkConfig() extends Bundle {
+  val low = UInt(16 bits)
+  val high = UInt(16 bits)
+  val hysteresis = UInt(16 bits)
+  val holdoff = UInt(16 bits)        // 256-cycle units
+}
+
+// Channels and sample container a capture DMA context writes, see
+// CapturePacker
+case class CaptureRoute() extends Bundle {
+  val mask = Bits(16 bits)           // Channel n in bit n, 0 = every channel
+  val format = UInt(2 bits)          // CapturePacker.S32 or S16
+}
+
+// Registers of capture fan-out contexts 1 and up; context 0 is the DMA_CAP
+// block. See DMAEngine.captureContexts
+case class CaptureContextRegs() extends Bundle {
+  val descBaseAddr = UInt(64 bits)
+  val descCount = UInt(8 bits)
+  val currentDesc = UInt(8 bits)
+  val bufferSize = UInt(32 bits)
+  val enable = Bool
+  val interruptEnable = Bool
+  val route = CaptureRoute()
+  val descActive = UInt(8 bits)
+}
+
+// Output EQ configuration, see BiquadBank
+case class EqConfig() extends Bundle {
+  val enable = Bool
+  val bank = Bool                    // Coefficient bank to run
+  val sections = Vec(UInt(4 bits), BiquadBank.maxChannels)
+}
+
+// One coefficient of one section, see BiquadBank
+case class BiquadCoefAddress() extends Bundle {
+  val channel = UInt(3 bits)
+  val section = UInt(3 bits)
+  val index = UInt(3 bits)           // b0, b1, b2, a1, a2
+}
+
+case class BiquadCoefWrite() extends Bundle {
+  val bank = Bool
+  val address = BiquadCoefAddress()
+  val value = Bits(32 bits)          // Q2.30
+}
+
+// Output FIR configuration, see FirEngine
+case class FirConfig() extends Bundle {
+  val enable = Bool
+  val channels = UInt(5 bits)        // Filtered, the first ones
+  val taps = UInt(16 bits)           // Per channel, a multiple of the lanes
+}
+
+// One word of the host coefficient buffer, see FirEngine.layout
+case class FirCoefWrite() extends Bundle {
+  val index = UInt(20 bits)
+  val value = Bits(32 bits)          // Q1.23, sign extended
+}
+
+// Spectrum analyzer configuration, see SpectrumAnalyzer
+case class SpectrumConfig() extends Bundle {
+  val enable = Bool
+  val output = Bool                  // Output path, else input
+  val channel = UInt(5 bits)
+  val size = UInt(4 bits)            // log2 of the FFT points
+  val window = UInt(2 bits)
+  val average = UInt(3 bits)         // log2 of the blocks averaged
+}
+
 // Register bank definition
 case class RegisterBank() extends Bundle {
   // Control registers
@@ -100,6 +176,18 @@ case class RegisterBank() extends Bundle {
       val syncTimeout = UInt(16 bits)
       val autoRateDetect = Bool
     }
+    
+    // Output EQ
+    val eq = EqConfig()
+    val eqCoefAddress = BiquadCoefAddress()
+    
+    // Output FIR
+    val fir = FirConfig()
+    val firCoefBase = UInt(64 bits)
+    
+    // Spectrum analyzer
+    val spectrum = SpectrumConfig()
+    val spectrumBase = UInt(64 bits)
   }
   
   // DMA registers
@@ -110,7 +198,11 @@ case class RegisterBank() extends Bundle {
     val pbCurrentDesc = UInt(8 bits)
     val pbBufferSize = UInt(32 bits)
     val pbInterruptEnable = Bool
+    val pbWatermarkIrqEnable = Bool
     val pbThreshold = UInt(16 bits)
+    val pbWatermark = WatermarkConfig()
+    val pbPrefetchEnable = Bool
+    val pbPrefetchGuard = UInt(16 bits)
     
     // Capture
     val capDescBaseAddr = UInt(64 bits)
@@ -118,7 +210,11 @@ case class RegisterBank() extends Bundle {
     val capCurrentDesc = UInt(8 bits)
     val capBufferSize = UInt(32 bits)
     val capInterruptEnable = Bool
+    val capWatermarkIrqEnable = Bool
     val capThreshold = UInt(16 bits)
+    val capWatermark = WatermarkConfig()
+    val capRoute = CaptureRoute()
+    val capFanout = Vec(CaptureContextRegs(), DMAEngine.captureContexts - 1)
   }
   
   // Status registers
@@ -130,6 +226,12 @@ case class RegisterBank() extends Bundle {
     val capOverrun = Bool
     val dmaError = Bool
     val formatError = Bool
+    val eqBank = Bool                  // Coefficient bank the EQ runs on
+    val firLoadBusy = Bool
+    val firLoadError = Bool
+    val spectrumCount = UInt(16 bits)  // Spectra written
+    val spectrumError = Bool
+    val spectrumValid = Bool
     
     // Extended status
     val clockStatus = new Bundle {
@@ -143,6 +245,8 @@ case class RegisterBank() extends Bundle {
     val bufferStatus = new Bundle {
       val pbFifoLevel = UInt(16 bits)
       val capFifoLevel = UInt(16 bits)
+      val pbFifoPeak = UInt(16 bits)   // Lowest since the last low watermark event
+      val capFifoPeak = UInt(16 bits)  // Highest since the last high watermark event
       val pbUnderrunCount = UInt(16 bits)
       val capOverrunCount = UInt(16 bits)
     }
@@ -152,6 +256,8 @@ case class RegisterBank() extends Bundle {
       val capDescriptorsActive = UInt(8 bits)
       val pbBytesProcessed = UInt(32 bits)
       val capBytesProcessed = UInt(32 bits)
+      val pbPrefetchTarget = UInt(16 bits)
+      val pbLinkLatency = UInt(16 bits)
     }
   }
 }
@@ -0,0 +1,149 @@
+package audio
+
+import java.io.PrintWriter
+
+// Sweep of streaming scenarios over the axes that move latency and xrun
+// margins, run in parallel through SimScheduler. The transaction-level model
+// covers the full cross product in minutes; --rtl runs each point on the
+// DMAEngine RTL as well, which for the full matrix is an overnight job on a
+// 32-core machine.
+//
+//   sbt "simulation/runMain audio.BenchmarkMatrix --out matrix.csv"
+//   sbt "simulation/runMain audio.BenchmarkMatrix --quick --rtl --jobs 8"
+case class MatrixAxes(
+  sampleRates: Seq[Int],
+  periodFrames: Seq[Int],
+  periods: Seq[Int],
+  completionLatencyNs: Seq[Double],
+  hostJitter: Seq[(String, HostJitter)]
+) {
+  def size: Int =
+    sampleRates.size * periodFrames.size * periods.size *
+      completionLatencyNs.size * hostJitter.size
+}
+
+object BenchmarkMatrix {
+  val full = MatrixAxes(
+    sampleRates = Seq(44100, 48000, 88200, 96000, 176400, 192000),
+    periodFrames = Seq(64, 128, 256, 512, 1024),
+    periods = Seq(2, 3, 4),
+    completionLatencyNs = Seq(400, 800, 1600, 3200),
+    hostJitter = Seq(
+      "none"    -> HostJitter.none,
+      "rt"      -> HostJitter.rtKernel,
+      "desktop" -> HostJitter.desktop
+    )
+  )
+
+  val quick = MatrixAxes(
+    sampleRates = Seq(48000, 192000),
+    periodFrames = Seq(128, 1024),
+    periods = Seq(2),
+    completionLatencyNs = Seq(800),
+    hostJitter = Seq("none" -> HostJitter.none)
+  )
+
+  def scenarios(axes: MatrixAxes, base: Scenario): Seq[Scenario] =
+    for {
+      rate              <- axes.sampleRates
+      frames            <- axes.periodFrames
+      periods           <- axes.periods
+      latency           <- axes.completionLatencyNs
+      (jitterName, jit) <- axes.hostJitter
+    } yield base.copy(
+      name = f"$rate%d-${frames}x$periods%d-$latency%.0fns-$jitterName%s",
+      sampleRate = rate,
+      periodFrames = frames,
+      periods = periods,
+      completionLatencyNs = latency,
+      hostJitter = jit
+    )
+
+  case class Point(
+    scenario: Scenario,
+    tlm: TransactionModel.Result,
+    rtl: Option[DmaEngineRun.Result]
+  )
+
+  type Outcome = SimScheduler.Outcome[Scenario, Point]
+
+  // RTL cost grows with simulated PCIe cycles; TLM cost with frames and events
+  def run(scenarios: Seq[Scenario], rtl: Boolean, parallelism: Int): Seq[Outcome] = {
+    val cost = (s: Scenario) => s.pcieCycles.toDouble
+    SimScheduler.run(scenarios, parallelism, cost)(_.name) { scenario =>
+      val rtlResult = if(rtl) Some(DmaEngineRun(scenario)) else None
+      Point(scenario, TransactionModel.run(scenario), rtlResult)
+    }
+  }
+
+  private def rtlBus(point: Point, channel: String)(field: BusMonitor.Summary => Any): Any =
+    point.rtl.flatMap(_.busSummary(channel)).map(field).getOrElse("")
+
+  def writeCsv(path: String, outcomes: Seq[Outcome]): Unit = {
+    val out = new PrintWriter(path)
+    try {
+      out.println(
+        "scenario,sample_rate,period_frames,periods,completion_ns,host_jitter_us," +
+          "frames_played,pb_underruns,cap_overruns,host_xruns,pb_level_min,first_output_us," +
+          "rtl_frames,rtl_first_output_us,rtl_read_util,rtl_read_stall,rtl_reads_outstanding," +
+          "wall_s,status"
+      )
+      for(outcome <- outcomes) {
+        val s = outcome.job
+        val fields = outcome.result.toOption match {
+          case Some(p) =>
+            Seq(
+              p.tlm.framesPlayed,
+              p.tlm.pbUnderruns,
+              p.tlm.capOverruns,
+              p.tlm.hostXruns,
+              p.tlm.pbLevelMin,
+              p.tlm.firstOutputPs / 1e6,
+              p.rtl.map(_.framesPopped).getOrElse(""),
+              p.rtl.map(_.firstPopPs / 1e6).getOrElse(""),
+              rtlBus(p, "axi.r")(s => f"${s.utilization}%.4f"),
+              rtlBus(p, "axi.r")(s => f"${s.backPressureRatio}%.4f"),
+              rtlBus(p, "axi.ar")(_.outstandingMax)
+            )
+          case None => Seq.fill(11)("")
+        }
+        val status =
+          outcome.result.fold(e => s"error: ${e.getMessage}".replace(',', ';'), _ => "ok")
+        val point = Seq(
+          s.name,
+          s.sampleRate,
+          s.periodFrames,
+          s.periods,
+          s.completionLatencyNs,
+          s.hostJitter.meanUs
+        )
+        val wall = f"${outcome.wallTimeNs / 1e9}%.2f"
+        out.println((point ++ fields ++ Seq(wall, status)).mkString(","))
+      }
+    } finally {
+      out.close()
+    }
+  }
+
+  def main(args: Array[String]): Unit = {
+    def arg(name: String): Option[String] =
+      args.sliding(2).collectFirst { case Array(`name`, value) => value }
+
+    val axes = if(args.contains("--quick")) quick else full
+    val durationFrames = arg("--frames").map(_.toLong).getOrElse(48000L)
+    val parallelism = arg("--jobs").map(_.toInt).getOrElse(SimScheduler.defaultJobs)
+    val out = arg("--out").getOrElse("benchmark-matrix.csv")
+    val base =
+      Scenario("matrix", Scenarios.defaultConfig, capture = true, durationFrames = durationFrames)
+
+    val points = scenarios(axes, base)
+    println(s"Benchmark matrix: ${points.size} scenarios on $parallelism threads")
+    val start = System.nanoTime()
+    val outcomes = run(points, args.contains("--rtl"), parallelism)
+    writeCsv(out, outcomes)
+
+    val failed = outcomes.count(_.result.isFailure)
+    println(f"Wrote $out in ${(System.nanoTime() - start) / 1e9}%.0f s, $failed%d failed")
+    if(failed > 0) sys.exit(1)
+  }
+}
@@ -0,0 +1,291 @@
+package audio
+
+import spinal.core._
+import spinal.core.sim._
+import spinal.lib.bus.amba4.axi.Axi4
+import scala.collection.mutable
+import scala.collection.mutable.ArrayBuffer
+
+// Passive utilization monitors for the valid/ready channels of the DMA path:
+// the five DMAEngine AXI channels, the PCIe-side audioOut/audioIn streams
+// (which are also the push and pop ports of the AudioCDC FIFOs) and the
+// audio-side FIFO ports. Every cycle of a channel is a transfer, a
+// back-pressure cycle (valid without ready) or an idle cycle (no valid);
+// the counts are kept per window of `windowCycles` clocks, along with the
+// burst-size distribution and the number of outstanding AXI transactions,
+// and written as a long-format CSV for plotting.
+object BusMonitor {
+  case class Window(
+    timePs: Long,
+    channel: String,
+    cycles: Int,
+    transfers: Int,
+    backPressure: Int,
+    idle: Int,
+    bursts: Int,
+    outstandingMean: Double,
+    outstandingMax: Int
+  ) {
+    def utilization: Double = transfers.toDouble / cycles
+  }
+
+  case class Summary(
+    channel: String,
+    cycles: Long,
+    transfers: Long,
+    backPressure: Long,
+    idle: Long,
+    burstSizes: Map[Int, Long], // Beats per burst -> bursts
+    outstandingMax: Int
+  ) {
+    def utilization: Double = if(cycles == 0) 0 else transfers.toDouble / cycles
+    def backPressureRatio: Double = if(cycles == 0) 0 else backPressure.toDouble / cycles
+    def meanBurst: Double = {
+      val bursts = burstSizes.values.sum
+      if(bursts == 0) 0 else burstSizes.map { case (size, n) => size * n }.sum.toDouble / bursts
+    }
+  }
+
+  // One valid/ready channel. `beats` gives the length of the burst a
+  // transfer announces (AXI address channels); without it a burst is a run
+  // of back-to-back transfers. `retired` says a transaction finished this
+  // cycle, which makes the channel track outstanding transactions.
+  class Channel(
+    val name: String,
+    valid: Bool,
+    ready: Bool,
+    beats: Option[() => Int] = None,
+    retired: Option[() => Boolean] = None
+  ) {
+    // Current window
+    private var cycles, transfers, backPressure, idle, bursts = 0
+    private var outstandingSum = 0L
+    private var outstandingMax = 0
+
+    // Whole run
+    private var totalCycles, totalTransfers, totalBackPressure, totalIdle = 0L
+    private val sizes = mutable.TreeMap[Int, Long]()
+    private var peakOutstanding = 0
+
+    private var outstanding = 0
+    private var run = 0
+
+    private def burst(size: Int): Unit = {
+      bursts += 1
+      sizes(size) = sizes.getOrElse(size, 0L) + 1
+    }
+
+    def sample(): Unit = {
+      val fire = valid.toBoolean && ready.toBoolean
+      cycles += 1
+      if(fire) transfers += 1
+      else if(valid.toBoolean) backPressure += 1
+      else idle += 1
+
+      beats match {
+        case Some(length) => if(fire) burst(length())
+        case None =>
+          if(fire) run += 1
+          else if(run > 0) { burst(run); run = 0 }
+      }
+
+      retired.foreach { done =>
+        if(fire) outstanding += 1
+        if(done() && outstanding > 0) outstanding -= 1
+        outstandingSum += outstanding
+        outstandingMax = Math.max(outstandingMax, outstanding)
+        peakOutstanding = Math.max(peakOutstanding, outstanding)
+      }
+    }
+
+    def close(timePs: Long): Window = {
+      val window = Window(
+        timePs,
+        name,
+        cycles,
+        transfers,
+        backPressure,
+        idle,
+        bursts,
+        if(cycles == 0) 0.0 else outstandingSum.toDouble / cycles,
+        outstandingMax
+      )
+      totalCycles += cycles
+      totalTransfers += transfers
+      totalBackPressure += backPressure
+      totalIdle += idle
+      cycles = 0
+      transfers = 0
+      backPressure = 0
+      idle = 0
+      bursts = 0
+      outstandingSum = 0
+      outstandingMax = outstanding
+      window
+    }
+
+    def summary: Summary = Summary(
+      name,
+      totalCycles + cycles,
+      totalTransfers + transfers,
+      totalBackPressure + backPressure,
+      totalIdle + idle,
+      sizes.toMap,
+      peakOutstanding
+    )
+  }
+
+  // Reads are outstanding from the AR handshake to the last R beat, writes
+  // from the AW handshake to the B response
+  def axiChannels(axi: Axi4): Seq[Channel] =
+    Seq(
+      new Channel(
+        "axi.ar",
+        axi.ar.valid,
+        axi.ar.ready,
+        beats = Some(() => axi.ar.len.toInt + 1),
+        retired = Some(() => axi.r.valid.toBoolean && axi.r.ready.toBoolean && axi.r.last.toBoolean)
+      ),
+      new Channel("axi.r", axi.r.valid, axi.r.ready),
+      new Channel(
+        "axi.aw",
+        axi.aw.valid,
+        axi.aw.ready,
+        beats = Some(() => axi.aw.len.toInt + 1),
+        retired = Some(() => axi.b.valid.toBoolean && axi.b.ready.toBoolean)
+      ),
+      new Channel("axi.w", axi.w.valid, axi.w.ready),
+      new Channel("axi.b", axi.b.valid, axi.b.ready)
+    )
+
+  // Internal signals of AudioPCIeTop the monitor observes; call inside the
+  // compile closure
+  def instrument(dut: AudioPCIeTop): Unit = {
+    val axi = dut.dmaEngine.io.axi
+    Seq(
+      axi.ar.valid, axi.ar.ready, axi.ar.len, axi.r.valid, axi.r.ready, axi.r.last,
+      axi.aw.valid, axi.aw.ready, axi.aw.len, axi.w.valid, axi.w.ready, axi.b.valid, axi.b.ready
+    ).foreach(_.simPublic())
+    val streams = Seq(
+      dut.dmaEngine.io.audioOut, dut.dmaEngine.io.audioIn,
+      dut.clockCrossing.txFifo.io.pop, dut.clockCrossing.rxFifo.io.push
+    )
+    streams.foreach { stream =>
+      stream.valid.simPublic()
+      stream.ready.simPublic()
+    }
+  }
+
+  // Whole card: PCIe side on the user clock, audio-side FIFO ports on the
+  // scenario's MCLK
+  def apply(dut: AudioPCIeTop, scenario: Scenario): BusMonitor = {
+    val dma = dut.dmaEngine.io
+    val cdc = dut.clockCrossing
+    val mclk =
+      if(scenario.sampleRateFamily == 0) dut.io.audio.mclk44k1 else dut.io.audio.mclk48k
+    new BusMonitor(
+      dut.clockDomain,
+      axiChannels(dma.axi) ++ Seq(
+        new Channel("audioOut", dma.audioOut.valid, dma.audioOut.ready),
+        new Channel("audioIn", dma.audioIn.valid, dma.audioIn.ready)
+      ),
+      Some(mclk),
+      Seq(
+        new Channel("txFifo.pop", cdc.txFifo.io.pop.valid, cdc.txFifo.io.pop.ready),
+        new Channel("rxFifo.push", cdc.rxFifo.io.push.valid, cdc.rxFifo.io.push.ready)
+      )
+    )
+  }
+
+  // DMAEngine on its own, as in DmaEngineRun
+  def apply(dut: DMAEngine): BusMonitor = {
+    val io = dut.io
+    new BusMonitor(
+      dut.clockDomain,
+      axiChannels(io.axi) ++ Seq(
+        new Channel("audioOut", io.audioOut.valid, io.audioOut.ready),
+        new Channel("audioIn", io.audioIn.valid, io.audioIn.ready)
+      ),
+      None,
+      Nil
+    )
+  }
+}
+
+class BusMonitor(
+  clockDomain: ClockDomain,
+  channels: Seq[BusMonitor.Channel],
+  audioClock: Option[Bool],
+  audioChannels: Seq[BusMonitor.Channel],
+  windowCycles: Int = 1024
+) {
+  import BusMonitor._
+
+  val windows = ArrayBuffer[Window]()
+
+  def start(): Unit = {
+    forkSide(channels, () => clockDomain.waitSampling())
+    audioClock.foreach { mclk =>
+      forkSide(audioChannels, () => { waitUntil(!mclk.toBoolean); waitUntil(mclk.toBoolean) })
+    }
+  }
+
+  private def forkSide(side: Seq[Channel], edge: () => Unit): Unit = fork {
+    var cycle = 0L
+    while(true) {
+      edge()
+      side.foreach(_.sample())
+      cycle += 1
+      if(cycle % windowCycles == 0) {
+        val now = simTime()
+        windows ++= side.map(_.close(now))
+      }
+    }
+  }
+
+  def summaries: Seq[Summary] = (channels ++ audioChannels).map(_.summary)
+
+  def summary(channel: String): Summary = summaries.find(_.channel == channel).get
+
+  def report(): String = {
+    val rows = summaries.map { s =>
+      val outstanding = if(s.outstandingMax > 0) s.outstandingMax.toString else "-"
+      f"  ${s.channel}%-12s ${s.utilization * 100}%7.2f%% ${s.backPressureRatio * 100}%7.2f%% " +
+        f"${s.idle}%10d ${s.meanBurst}%8.1f $outstanding%6s"
+    }
+    (f"Bus utilization:\n  ${"channel"}%-12s ${"util"}%8s ${"stall"}%8s ${"idle cyc"}%10s " +
+      f"${"burst"}%8s ${"outst"}%6s" +: rows).mkString("\n")
+  }
+
+  // Long format, one row per channel and window
+  def writeCsv(path: String): Unit = {
+    val out = new java.io.PrintWriter(path)
+    try {
+      out.println(
+        "time_ps,channel,cycles,transfers,back_pressure,idle,utilization,bursts," +
+          "outstanding_mean,outstanding_max"
+      )
+      for(w <- windows) {
+        out.println(
+          f"${w.timePs},${w.channel},${w.cycles},${w.transfers},${w.backPressure},${w.idle}," +
+            f"${w.utilization}%.4f,${w.bursts},${w.outstandingMean}%.3f,${w.outstandingMax}"
+        )
+      }
+    } finally {
+      out.close()
+    }
+  }
+
+  // Burst-size distribution over the whole run
+  def writeBurstCsv(path: String): Unit = {
+    val out = new java.io.PrintWriter(path)
+    try {
+      out.println("channel,beats,bursts")
+      for(s <- summaries; (beats, n) <- s.burstSizes.toSeq.sortBy(_._1)) {
+        out.println(s"${s.channel},$beats,$n")
+      }
+    } finally {
+      out.close()
+    }
+  }
+}
@@ -0,0 +1,175 @@
+package audio
+
+import scala.collection.mutable.ArrayBuffer
+
+// Faults injected into a Scenario at a chosen time, frame or condition, for
+// the transaction-level model and the DMAEngine RTL bench. Every injection
+// gets a FaultRecord with the time the stream took to recover and the frames
+// lost on the way, so each error path can be measured and the recovery
+// policies compared:
+//
+//   val faulty = Scenarios.fullDuplex
+//     .atFrame(9600)(Fault.PoisonedTlp())
+//     .when("playback FIFO low")(_.pbLevel < 256)(Fault.BackPressure(200))
+//   TransactionModel.run(faulty).faults.foreach(println)
+sealed trait Fault { def name: String }
+
+object Fault {
+  // The next `count` playback read completions arrive `extraNs` late
+  case class CompletionDelay(extraNs: Double, count: Int = 1) extends Fault {
+    def name = "completion-delay"
+  }
+
+  // The next `count` playback read requests are never answered; the engine
+  // gives up after the scenario's completion timeout
+  case class CompletionDrop(count: Int = 1) extends Fault {
+    def name = "completion-drop"
+  }
+
+  // The next `count` playback completions carry poisoned data (EP set, or
+  // SLVERR on the AXI side)
+  case class PoisonedTlp(count: Int = 1) extends Fault {
+    def name = "poisoned-tlp"
+  }
+
+  // The next descriptor the direction fetches points at unmapped memory
+  case class DescriptorCorruption(capture: Boolean = false) extends Fault {
+    def name = if(capture) "cap-descriptor-corruption" else "pb-descriptor-corruption"
+  }
+
+  // MCLK stops for `durationUs`; the PLL relocks once it is back
+  case class MclkLoss(durationUs: Double) extends Fault {
+    def name = "mclk-loss"
+  }
+
+  // The PLL loses lock for `durationUs` with MCLK running, then relocks
+  case class Unlock(durationUs: Double) extends Fault {
+    def name = "unlock"
+  }
+
+  // The link stops accepting requests from both DMA directions
+  case class BackPressure(durationUs: Double) extends Fault {
+    def name = "back-pressure"
+  }
+}
+
+// What a condition trigger can see, sampled at every frame boundary
+case class FaultProbe(timePs: Long, frame: Long, pbLevel: Int, capLevel: Int)
+
+sealed trait FaultTrigger
+
+object FaultTrigger {
+  case class AtTime(timePs: Long) extends FaultTrigger {
+    override def toString = s"at ${timePs / 1e6} us"
+  }
+
+  case class AtFrame(frame: Long) extends FaultTrigger {
+    override def toString = s"at frame $frame"
+  }
+
+  case class When(description: String, condition: FaultProbe => Boolean) extends FaultTrigger {
+    override def toString = s"when $description"
+  }
+}
+
+case class Injection(trigger: FaultTrigger, fault: Fault)
+
+// What happens after a DMA error is raised
+sealed trait RecoveryPolicy
+
+object RecoveryPolicy {
+  // The interrupt handler stops both directions, as the driver did before
+  // DMA errors were reported per direction
+  case object ResetBoth extends RecoveryPolicy
+
+  // Only the direction that failed is stopped and restarted
+  case object RestartDirection extends RecoveryPolicy
+
+  // The engine re-issues a failed burst up to `retries` times before it
+  // raises the error; a what-if the RTL does not implement yet
+  case class RetryInHardware(retries: Int) extends RecoveryPolicy
+}
+
+// recoveryPs is None when the run ended before the stream recovered
+case class FaultRecord(
+  fault: Fault,
+  trigger: String,
+  onsetPs: Long,
+  recoveryPs: Option[Long],
+  pbFramesLost: Long,
+  capFramesLost: Long
+) {
+  override def toString: String = {
+    val recovery = recoveryPs.map(ps => f"${ps / 1e6}%.1f us").getOrElse("never")
+    f"${fault.name}%-26s ${trigger}%-24s recovery $recovery%-12s " +
+      s"lost $pbFramesLost playback / $capFramesLost capture frames"
+  }
+}
+
+// Fires the injections of a run and follows each one until the stream has
+// recovered. The backend applies the faults, counts lost frames and says
+// whether it is healthy (no direction stopped or failing, clock locked, no
+// fault still pending); a fault has been recovered from at the first healthy
+// frame where the playback pipeline is back within `slackFrames` of its
+// level at the onset.
+class FaultTracker(injections: Seq[Injection], playback: Boolean, slackFrames: Int) {
+  private case class Open(
+    injection: Injection,
+    onsetPs: Long,
+    pbLost: Long,
+    capLost: Long,
+    pbLevel: Int
+  )
+
+  private val pending = ArrayBuffer(injections: _*)
+  private val open = ArrayBuffer[Open]()
+  private val records = ArrayBuffer[FaultRecord]()
+
+  private def due(trigger: FaultTrigger, probe: FaultProbe): Boolean = trigger match {
+    case FaultTrigger.AtTime(timePs)     => probe.timePs >= timePs
+    case FaultTrigger.AtFrame(frame)     => probe.frame >= frame
+    case FaultTrigger.When(_, condition) => condition(probe)
+  }
+
+  // Faults whose trigger holds at this frame boundary; each fires once.
+  // pbLost and capLost are the backend's running totals.
+  def fire(probe: FaultProbe, pbLost: Long, capLost: Long): Seq[Fault] = {
+    val fired = pending.filter(injection => due(injection.trigger, probe))
+    pending --= fired
+    open ++= fired.map(Open(_, probe.timePs, pbLost, capLost, probe.pbLevel))
+    fired.map(_.fault)
+  }
+
+  def frame(probe: FaultProbe, pbLost: Long, capLost: Long, healthy: Boolean): Unit = {
+    val recovered = open.filter { o =>
+      healthy && probe.timePs > o.onsetPs &&
+      (!playback || probe.pbLevel >= o.pbLevel - slackFrames)
+    }
+    open --= recovered
+    records ++= recovered.map { o =>
+      FaultRecord(
+        o.injection.fault,
+        o.injection.trigger.toString,
+        o.onsetPs,
+        Some(probe.timePs - o.onsetPs),
+        pbLost - o.pbLost,
+        capLost - o.capLost
+      )
+    }
+  }
+
+  // Records in onset order; faults still open at the end never recovered
+  def result(pbLost: Long, capLost: Long): Seq[FaultRecord] = {
+    val unrecovered = open.map { o =>
+      FaultRecord(
+        o.injection.fault,
+        o.injection.trigger.toString,
+        o.onsetPs,
+        None,
+        pbLost - o.pbLost,
+        capLost - o.capLost
+      )
+    }
+    (records ++ unrecovered).sortBy(_.onsetPs)
+  }
+}
@@ -0,0 +1,243 @@
+package audio
+
+import spinal.core._
+import spinal.core.sim._
+import spinal.lib._
+import scala.collection.mutable
+import scala.collection.mutable.ArrayBuffer
+
+// Follows individual frames from the host buffer to the I2S pins (and back for
+// capture). Every FIFO on the path is in-order, so a frame's tag is carried
+// by queueing it at each push and taking it off again at the matching pop.
+object LatencyTracer {
+  case class StageStats(name: String, count: Long, minPs: Long, meanPs: Double, maxPs: Long) {
+    def meanNs: Double = meanPs / 1000
+    def minFrames(framePeriodPs: Double): Double = minPs / framePeriodPs
+    def meanFrames(framePeriodPs: Double): Double = meanPs / framePeriodPs
+    def maxFrames(framePeriodPs: Double): Double = maxPs / framePeriodPs
+  }
+
+  case class FrameTrace(hostAddress: BigInt, stamps: Array[Long])
+
+  // Internal signals the tracer observes; call inside the compile closure
+  def instrument(dut: AudioPCIeTop): Unit = {
+    val axi = dut.dmaEngine.io.axi
+    Seq(axi.ar.valid, axi.ar.ready, axi.ar.addr, axi.aw.valid, axi.aw.ready, axi.aw.addr,
+        axi.w.valid, axi.w.ready).foreach(_.simPublic())
+    val fifos = Seq(
+      dut.dmaEngine.pbFifo.io.push, dut.dmaEngine.pbFifo.io.pop,
+      dut.dmaEngine.capFifo.io.pop,
+      dut.clockCrossing.txFifo.io.pop,
+      dut.clockCrossing.rxFifo.io.push, dut.clockCrossing.rxFifo.io.pop
+    )
+    fifos.foreach { stream =>
+      stream.valid.simPublic()
+      stream.ready.simPublic()
+    }
+  }
+
+  private class Accumulator(val name: String) {
+    var count = 0L
+    var min = Long.MaxValue
+    var max = 0L
+    var sum = 0.0
+
+    def add(deltaPs: Long): Unit = {
+      count += 1
+      min = Math.min(min, deltaPs)
+      max = Math.max(max, deltaPs)
+      sum += deltaPs
+    }
+
+    def stats: StageStats =
+      StageStats(name, count, if(count == 0) 0 else min, if(count == 0) 0 else sum / count, max)
+  }
+
+  val playbackStages = Seq("fetch", "pbFifo", "txFifo", "serializer")
+  val captureStages = Seq("serializer", "rxFifo", "capFifo")
+
+  // LatencyBudget stages each traced stage spans. The capFifo stamp is the
+  // AXI write beat, so it takes in the descriptor fetch and burst write.
+  val playbackBudget = Map(
+    "fetch" -> Seq("burst fill"),
+    "pbFifo" -> Seq("pbFifo"),
+    "txFifo" -> Seq("txFifo"),
+    "serializer" -> Seq("serializer")
+  )
+  val captureBudget = Map(
+    "serializer" -> Seq("serializer"),
+    "rxFifo" -> Seq("rxFifo"),
+    "capFifo" -> Seq("capFifo", "descriptor", "burst write")
+  )
+}
+
+class LatencyTracer(dut: AudioPCIeTop, scenario: Scenario, keepTraces: Int = 4096) {
+  import LatencyTracer._
+
+  private val axi = dut.dmaEngine.io.axi
+  private val mclk =
+    if(scenario.sampleRateFamily == 0) dut.io.audio.mclk44k1 else dut.io.audio.mclk48k
+
+  // Playback: stamps = (read request, pbFifo push, pbFifo pop, txFifo pop, pin)
+  private val pbInFifo = mutable.Queue[FrameTrace]()
+  private val pbInCdc = mutable.Queue[FrameTrace]()
+  private val pbInSerializer = mutable.Queue[FrameTrace]()
+  private val pbStages = playbackStages.map(new Accumulator(_))
+  private val pbTotal = new Accumulator("total")
+  val playbackTraces = ArrayBuffer[FrameTrace]()
+
+  // Capture: stamps = (pin, rxFifo push, rxFifo pop, capFifo pop = AXI write beat)
+  private val capInSerializer = mutable.Queue[FrameTrace]()
+  private val capInCdc = mutable.Queue[FrameTrace]()
+  private val capInFifo = mutable.Queue[FrameTrace]()
+  private val capStages = captureStages.map(new Accumulator(_))
+  private val capTotal = new Accumulator("total")
+  val captureTraces = ArrayBuffer[FrameTrace]()
+
+  private def fire(stream: Stream[_ <: Data]): Boolean =
+    stream.valid.toBoolean && stream.ready.toBoolean
+
+  private def finish(
+    trace: FrameTrace,
+    stages: Seq[Accumulator],
+    total: Accumulator,
+    kept: ArrayBuffer[FrameTrace]
+  ): Unit = {
+    for(i <- stages.indices) stages(i).add(trace.stamps(i + 1) - trace.stamps(i))
+    total.add(trace.stamps.last - trace.stamps.head)
+    if(kept.size < keepTraces) kept += trace
+  }
+
+  def start(): Unit = {
+    forkPcieSide()
+    forkAudioSide()
+  }
+
+  private def forkPcieSide(): Unit = fork {
+    var readAddr = BigInt(0)
+    var readTime = 0L
+    var readBeat = 0
+    var writeAddr = BigInt(0)
+    var writeBeat = 0
+
+    while(true) {
+      dut.clockDomain.waitSampling()
+      val now = simTime()
+
+      if(axi.ar.valid.toBoolean && axi.ar.ready.toBoolean) {
+        readAddr = axi.ar.addr.toBigInt
+        readTime = now
+        readBeat = 0
+      }
+      if(fire(dut.dmaEngine.pbFifo.io.push)) {
+        pbInFifo.enqueue(FrameTrace(readAddr + readBeat * 16, Array(readTime, now, 0L, 0L, 0L)))
+        readBeat += 1
+      }
+      if(fire(dut.dmaEngine.pbFifo.io.pop) && pbInFifo.nonEmpty) {
+        val trace = pbInFifo.dequeue()
+        trace.stamps(2) = now
+        pbInCdc.enqueue(trace)
+      }
+
+      if(fire(dut.clockCrossing.rxFifo.io.pop) && capInCdc.nonEmpty) {
+        val trace = capInCdc.dequeue()
+        trace.stamps(2) = now
+        capInFifo.enqueue(trace)
+      }
+      if(axi.aw.valid.toBoolean && axi.aw.ready.toBoolean) {
+        writeAddr = axi.aw.addr.toBigInt
+        writeBeat = 0
+      }
+      if(fire(dut.dmaEngine.capFifo.io.pop) && capInFifo.nonEmpty) {
+        val trace = capInFifo.dequeue()
+        trace.stamps(3) = now
+        val written = trace.copy(hostAddress = writeAddr + writeBeat * 16)
+        finish(written, capStages, capTotal, captureTraces)
+        writeBeat += 1
+      }
+    }
+  }
+
+  // Audio-domain FIFO ports are sampled on MCLK rising edges; frame boundaries
+  // are the falling edge of the word clock
+  private def forkAudioSide(): Unit = fork {
+    var lastWs = dut.io.audio.i2s.ws.toBoolean
+
+    while(true) {
+      waitUntil(!mclk.toBoolean)
+      waitUntil(mclk.toBoolean)
+      val now = simTime()
+
+      if(fire(dut.clockCrossing.txFifo.io.pop) && pbInCdc.nonEmpty) {
+        val trace = pbInCdc.dequeue()
+        trace.stamps(3) = now
+        pbInSerializer.enqueue(trace)
+      }
+      if(fire(dut.clockCrossing.rxFifo.io.push) && capInSerializer.nonEmpty) {
+        val trace = capInSerializer.dequeue()
+        trace.stamps(1) = now
+        capInCdc.enqueue(trace)
+      }
+
+      val ws = dut.io.audio.i2s.ws.toBoolean
+      if(lastWs && !ws) {
+        if(pbInSerializer.nonEmpty) {
+          val trace = pbInSerializer.dequeue()
+          trace.stamps(4) = now
+          finish(trace, pbStages, pbTotal, playbackTraces)
+        }
+        if(scenario.capture) {
+          capInSerializer.enqueue(FrameTrace(0, Array(now, 0L, 0L, 0L)))
+        }
+      }
+      lastWs = ws
+    }
+  }
+
+  def playbackReport: Seq[StageStats] = pbStages.map(_.stats) :+ pbTotal.stats
+  def captureReport: Seq[StageStats] = capStages.map(_.stats) :+ capTotal.stats
+
+  // Frames between the DMA read pointer and the DAC, i.e. runtime->delay
+  def playbackDelayFrames: Double = pbTotal.stats.meanFrames(scenario.framePeriodPs)
+  def captureDelayFrames: Double = capTotal.stats.meanFrames(scenario.framePeriodPs)
+
+  // Traced stages that took longer than the static budget allows, give or
+  // take the clock edge each stamp is sampled on
+  def budgetViolations(budget: LatencyBudget.Budget): Seq[String] = {
+    val slackPs = scenario.pciePeriodPs + 1e12 / scenario.mclkHz
+    def check(capture: Boolean, stats: Seq[StageStats], spans: Map[String, Seq[String]]) =
+      stats.filter(_.count > 0).flatMap { s =>
+        val worstPs = spans(s.name).map(budget.stage(capture, _).worstPs).sum
+        if(s.maxPs > worstPs + slackPs) {
+          val direction = if(capture) "capture" else "playback"
+          Some(f"$direction ${s.name}: ${s.maxPs / 1e6}%.3f us > budget ${worstPs / 1e6}%.3f us")
+        } else None
+      }
+    check(capture = false, pbStages.map(_.stats), playbackBudget) ++
+      check(capture = true, capStages.map(_.stats), captureBudget)
+  }
+
+  def report(): String = {
+    def table(title: String, stages: Seq[StageStats]): String = {
+      val rows = stages.map { s =>
+        f"  ${s.name}%-12s ${s.count}%8d ${s.minPs / 1000.0}%12.1f ${s.meanNs}%12.1f " +
+        f"${s.maxPs / 1000.0}%12.1f ${s.meanFrames(scenario.framePeriodPs)}%10.2f"
+      }
+      (f"$title\n  ${"stage"}%-12s ${"frames"}%8s ${"min ns"}%12s ${"mean ns"}%12s " +
+       f"${"max ns"}%12s ${"mean fr"}%10s" +: rows).mkString("\n")
+    }
+    table("Playback latency (host buffer -> I2S pin):", playbackReport) + "\n" +
+    table("Capture latency (I2S pin -> host buffer):", captureReport)
+  }
+
+  def writeCsv(path: String): Unit = {
+    val out = new java.io.PrintWriter(path)
+    try {
+      out.println("direction,host_address,stamps_ps")
+      for(t <- playbackTraces) out.println(s"playback,${t.hostAddress},${t.stamps.mkString(";")}")
+      for(t <- captureTraces) out.println(s"capture,${t.hostAddress},${t.stamps.mkString(";")}")
+    } finally {
+      out.close()
+    }
+  }
+}
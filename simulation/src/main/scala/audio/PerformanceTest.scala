@@ -6,6 +6,7 @@ import spinal.lib._
 import scala.collection.mutable.ArrayBuffer
 import org.scalatest.funsuite.AnyFunSuite
 import SimulationHelpers._
+import AudioRegisters._
 
 class PerformanceTest extends AnyFunSuite {
   val testConfig = AudioConfig(
@@ -22,10 +23,11 @@ class PerformanceTest extends AnyFunSuite {
   )
 
   test("DMA Performance Test") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
       val perfMonitor = new PerformanceMonitor()
       val dmaHelper = new DMAHelper(dut)
       val pcieHelper = new PCIeTransactionHelper(dut)
+      val regs = new RegisterPort(dut)
       
       // Initialize
       dut.clockDomain.forkStimulus(10)
@@ -52,27 +54,29 @@ class PerformanceTest extends AnyFunSuite {
       dmaHelper.setupDescriptorRing(0x10000, descriptors)
       
       // Configure device
-      pcieHelper.writeConfig(0x100, 0x10000)      // Descriptor base
-      pcieHelper.writeConfig(0x108, descriptorCount) // Descriptor count
-      pcieHelper.writeConfig(0x110, bufferSize)   // Buffer size
-      pcieHelper.writeConfig(0x114, 1)            // Enable interrupts
+      regs.write(DmaPbDescBase, 0x10000)
+      regs.write(DmaPbDescCount, descriptorCount)
+      regs.write(DmaPbSize, bufferSize)
+      regs.write(DmaPbIrqEn, 1)
       
       // Enable DMA
-      pcieHelper.writeConfig(0x018, 1)
+      regs.write(CtrlPbEnable, 1)
       
       // Run test
       var completedTransfers = 0
+      var lastInterrupt = simTime()
       while(completedTransfers < descriptorCount) {
         if(pcieHelper.waitForInterrupt(1000)) {
-          val latency = pcieHelper.readConfig(0x500) // Read latency counter
-          perfMonitor.recordTransfer(latency.toDouble)
+          // The card has no latency counter: time since the previous interrupt, us
+          perfMonitor.recordTransfer((simTime() - lastInterrupt) / 1e6)
+          lastInterrupt = simTime()
           completedTransfers += 1
           
           // Check for errors
-          val status = pcieHelper.readConfig(0x30C)
-          if((status & 1) != 0) {
+          if(regs.read(StatusPbUnderrun.xrun) != 0) {
             perfMonitor.recordError(isUnderrun = true)
           }
+          regs.clear(StatusPbUnderrun)
         }
       }
       
@@ -93,7 +97,7 @@ class PerformanceTest extends AnyFunSuite {
   }
   
   test("Audio Quality Test") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
       val audioGen = new AudioDataGenerator(testConfig.channelCount, testConfig.i2sDataWidth)
       val analyzer = new AudioAnalyzer(testConfig.channelCount, testConfig.i2sDataWidth)
       val dmaHelper = new DMAHelper(dut)
@@ -106,40 +110,37 @@ class PerformanceTest extends AnyFunSuite {
       
       // Setup DMA with test data
       val baseAddr = 0x1000000
-      dmaHelper.writeMem(baseAddr, sineWave.map(_.value))
+      dmaHelper.writeFrames(baseAddr, sineWave, testConfig.i2sDataWidth)
       
       // Configure for I2S playback
-      val pcieHelper = new PCIeTransactionHelper(dut)
-      pcieHelper.writeConfig(0x000, 0) // I2S mode
-      pcieHelper.writeConfig(0x004, 1) // 48kHz
-      pcieHelper.writeConfig(0x014, 1) // Master mode
+      val regs = new RegisterPort(dut)
+      regs.write(CtrlFormat, AudioFormat.I2S_STANDARD.position)
+      regs.write(CtrlSampleFamily, 1) // 48kHz
+      regs.write(CtrlMasterMode, 1)
       
-      // Capture output samples
-      val capturedSamples = ArrayBuffer[AudioSample]()
+      // Capture output frames straight into the analyzer
       var sampleCount = 0
       
       fork {
-        while(sampleCount < sineWave.length) {
+        val frame = new Array[Int](testConfig.channelCount)
+        while(sampleCount < sineWave.frames) {
           dut.clockDomain.waitSampling()
           if(dut.io.audio.i2s.ws.toBoolean) {
             for(ch <- 0 until testConfig.channelCount) {
-              capturedSamples += AudioSample(
-                dut.io.audio.i2s.sd(ch).toBigInt,
-                ch,
-                sampleCount
-              )
+              frame(ch) = dut.io.audio.i2s.sd(ch).toBigInt.toInt
             }
+            analyzer.pushFrame(frame, 0, sampleCount)
             sampleCount += 1
           }
         }
       }
       
       // Run simulation
-      dut.clockDomain.waitSampling(sineWave.length * 100)
+      dut.clockDomain.waitSampling(sineWave.frames * 100)
       
       // Analyze results
-      val stats = analyzer.analyzeSamples(capturedSamples)
-      val dropouts = analyzer.detectDropouts(capturedSamples)
+      val stats = analyzer.stats
+      val dropouts = analyzer.dropouts
       
       println("Audio Quality Analysis:")
       stats.foreach { case (channel, stats) =>
@@ -151,9 +152,9 @@ class PerformanceTest extends AnyFunSuite {
       }
       
       if(dropouts.nonEmpty) {
-        println("Dropouts detected:")
-        dropouts.foreach { case (channel, timestamp) =>
-          println(s"Channel $channel at sample $timestamp")
+        println(s"Dropouts detected: ${analyzer.dropoutCount}")
+        dropouts.foreach { timestamp =>
+          println(s"Gap after frame $timestamp")
         }
       }
       
@@ -167,7 +168,7 @@ class PerformanceTest extends AnyFunSuite {
   }
   
   test("Clock Stability Test") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
       val clockGen = new ClockGenerator()
       
       // Initialize
@@ -195,7 +196,7 @@ class PerformanceTest extends AnyFunSuite {
       }
       
       // Test clock switching
-      val pcieHelper = new PCIeTransactionHelper(dut)
+      val regs = new RegisterPort(dut)
       val clockUnlocks = ArrayBuffer[Int]()
       var switchCount = 0
       
@@ -204,7 +205,7 @@ class PerformanceTest extends AnyFunSuite {
         var lastLocked = true
         while(switchCount < 10) {
           dut.clockDomain.waitSampling()
-          val locked = (pcieHelper.readConfig(0x300) & 1) == 1
+          val locked = regs.read(StatusLocked) == 1
           if(lastLocked && !locked) {
             clockUnlocks += switchCount
           }
@@ -215,7 +216,7 @@ class PerformanceTest extends AnyFunSuite {
       // Perform clock switching
       for(i <- 0 until 10) {
         // Switch between 44.1kHz and 48kHz
-        pcieHelper.writeConfig(0x004, i % 2)
+        regs.write(CtrlSampleFamily, i % 2)
         dut.clockDomain.waitSampling(1000)
         switchCount += 1
       }
@@ -231,10 +232,11 @@ class PerformanceTest extends AnyFunSuite {
   }
   
   test("Load Test") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
       val perfMonitor = new PerformanceMonitor()
       val dmaHelper = new DMAHelper(dut)
       val pcieHelper = new PCIeTransactionHelper(dut)
+      val regs = new RegisterPort(dut)
       
       // Initialize
       dut.clockDomain.forkStimulus(10)
@@ -260,15 +262,15 @@ class PerformanceTest extends AnyFunSuite {
       dmaHelper.setupDescriptorRing(0x20000, descriptors) // Capture
       
       // Configure for maximum throughput
-      pcieHelper.writeConfig(0x000, 0)     // I2S mode
-      pcieHelper.writeConfig(0x004, 1)     // 48kHz
-      pcieHelper.writeConfig(0x008, 2)     // 4x rate (192kHz)
-      pcieHelper.writeConfig(0x038, 4096)  // Large buffer threshold
-      pcieHelper.writeConfig(0x03C, 4096)  // Large buffer threshold
+      regs.write(CtrlFormat, AudioFormat.I2S_STANDARD.position)
+      regs.write(CtrlSampleFamily, 1)     // 48kHz
+      regs.write(CtrlSampleMulti, 3)      // 4x rate (192kHz)
+      regs.write(CtrlPbThreshold, 4096)   // Large buffer threshold
+      regs.write(CtrlCapThreshold, 4096)
       
       // Enable both directions
-      pcieHelper.writeConfig(0x018, 1)     // Enable playback
-      pcieHelper.writeConfig(0x01C, 1)     // Enable capture
+      regs.write(CtrlPbEnable, 1)
+      regs.write(CtrlCapEnable, 1)
       
       // Run test
       var completedTransfers = 0
@@ -276,11 +278,14 @@ class PerformanceTest extends AnyFunSuite {
       
       while(completedTransfers < 1000) {  // Run for 1000 transfers
         if(pcieHelper.waitForInterrupt(100)) {
-          val pbStatus = pcieHelper.readConfig(0x30C)
-          val capStatus = pcieHelper.readConfig(0x310)
-          
-          if((pbStatus & 1) != 0) perfMonitor.recordError(true)
-          if((capStatus & 1) != 0) perfMonitor.recordError(false)
+          // Both event registers in one read, as the driver's handler does
+          val status = regs.snapshot(StatusPbUnderrun, StatusCapOverrun)
+          val underrun = StatusPbUnderrun.xrun.get(status(StatusPbUnderrun)) != 0
+          val overrun = StatusCapOverrun.xrun.get(status(StatusCapOverrun)) != 0
+          if(underrun) perfMonitor.recordError(true)
+          if(overrun) perfMonitor.recordError(false)
+          regs.clear(StatusPbUnderrun)
+          regs.clear(StatusCapOverrun)
           
           completedTransfers += 1
           perfMonitor.recordTransfer(System.nanoTime() - startTime)
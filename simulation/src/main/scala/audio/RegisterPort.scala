@@ -0,0 +1,144 @@
+package audio
+
+import spinal.core.sim._
+import AudioRegisters._
+
+// Typed access to the AudioRegisters map of AudioPCIeTop, in place of raw
+// offsets. Accesses are memory request TLPs to BAR0 on pcie.rx, and reads
+// wait for the completion on pcie.tx, as the host's would:
+//
+//   regs.write(CtrlPbEnable, 1)
+//   if(regs.read(StatusPbUnderrun.xrun) != 0) ...
+//   regs.clear(StatusPbUnderrun.xrun)
+//   val status = regs.snapshot(StatusPbUnderrun, StatusCapOverrun)  // One MRd
+//
+// Requests are serialized, so forked monitors can share a port.
+class RegisterPort(dut: AudioPCIeTop) {
+  private val requesterId = 0x0000 // The root port
+  private var tag = 0
+  private var busy = false
+
+  // Cycles from the last read's header beat to its first completion beat,
+  // BarDecoder.readLatency of its length
+  var lastReadCycles = 0
+
+  private val wordMask = (BigInt(1) << 32) - 1
+
+  private def exclusive[T](body: => T): T = {
+    waitUntil(!busy)
+    busy = true
+    try body finally busy = false
+  }
+
+  // Words of consecutive offsets as one value, the first in the low bits
+  private def join(words: Seq[BigInt]): BigInt =
+    words.zipWithIndex.map { case (word, i) => word << (32 * i) }.sum
+
+  // DWORDs packed four to a 128-bit beat, DW0 in the low bits
+  private def send(dwords: Seq[BigInt]): Unit = {
+    val beats = dwords.grouped(4).toSeq
+    for((beat, i) <- beats.zipWithIndex) {
+      dut.io.pcie.rx.valid #= true
+      dut.io.pcie.rx.data #= join(beat.map(_ & wordMask))
+      dut.io.pcie.rx.keepBits #= (1 << (4 * beat.size)) - 1
+      dut.io.pcie.rx.last #= i == beats.size - 1
+      dut.clockDomain.waitSamplingWhere(dut.io.pcie.rx.ready.toBoolean)
+    }
+    dut.io.pcie.rx.valid #= false
+  }
+
+  // tx.ready is only raised for the completion, a bench may be stalling it
+  private def receive(): Seq[BigInt] = {
+    val ready = dut.io.pcie.tx.ready.toBoolean
+    dut.io.pcie.tx.ready #= true
+    val dwords = Seq.newBuilder[BigInt]
+    var cycles = 0
+    var started = false
+    var last = false
+    while(!last) {
+      dut.clockDomain.waitSampling()
+      cycles += 1
+      if(dut.io.pcie.tx.valid.toBoolean) {
+        if(!started) lastReadCycles = cycles
+        started = true
+        val data = dut.io.pcie.tx.data.toBigInt
+        val keep = dut.io.pcie.tx.keepBits.toInt
+        for(j <- 0 until 4 if ((keep >> (4 * j)) & 0xF) != 0) {
+          dwords += (data >> (32 * j)) & wordMask
+        }
+        last = dut.io.pcie.tx.last.toBoolean
+      }
+    }
+    dut.io.pcie.tx.ready #= ready
+    dwords.result()
+  }
+
+  // 3DW header: fmt/type/length, requester/tag/byte enables, address
+  private def header(fmt: Int, offset: Int, count: Int): Seq[BigInt] = {
+    tag = (tag + 1) & 0xFF
+    val lastBe = if(count > 1) 0xF else 0
+    Seq(
+      BigInt(fmt << 29 | count),
+      BigInt(requesterId << 16 | tag << 8 | lastBe << 4 | 0xF),
+      BigInt(offset & ~3)
+    )
+  }
+
+  // One MWr of consecutive words
+  def writeWords(offset: Int, data: Seq[BigInt]): Unit = exclusive {
+    send(header(0x2, offset, data.size) ++ data)
+  }
+
+  // One MRd of consecutive words, answered by one completion
+  def readWords(offset: Int, count: Int): Seq[BigInt] = exclusive {
+    require(count <= BarDecoder.maxReadDwords, s"$count DWORDs in one read")
+    send(header(0x0, offset, count))
+    val completion = receive()
+    val status = (completion(1) >> 13) & 0x7
+    require(status == 0, f"Read of 0x$offset%03X completed with status $status")
+    completion.drop(3)
+  }
+
+  def writeWord(offset: Int, data: BigInt): Unit = writeWords(offset, Seq(data))
+
+  def readWord(offset: Int): BigInt = readWords(offset, 1).head
+
+  // Whole register, low word first for the 64-bit ones
+  def write(register: Register, value: BigInt): Unit = {
+    require(register.access != RO, s"${register.name} is read-only")
+    writeWords(register.offset, (0 until register.words).map(word => value >> (32 * word)))
+  }
+
+  def read(register: Register): BigInt = join(readWords(register.offset, register.words))
+
+  def read(field: Field): BigInt = field.get(read(field.register))
+
+  // Registers of one contiguous block read by a single request, the way the
+  // driver's interrupt handler snapshots the status registers
+  def snapshot(registers: Register*): Map[Register, BigInt] = {
+    val first = registers.map(_.offset).min
+    val end = registers.map(r => r.offset + 4 * r.words).max
+    val words = readWords(first, (end - first) / 4)
+    registers.map { register =>
+      val at = (register.offset - first) / 4
+      register -> join(words.slice(at, at + register.words))
+    }.toMap
+  }
+
+  // Read-modify-write of one field of an RW register
+  def write(field: Field, value: BigInt): Unit = {
+    require(field.register.access == RW, s"${field.register.name} is not RW")
+    val current = read(field.register)
+    write(field.register, (current & ~field.mask) | field.prep(value))
+  }
+
+  // Writes 1 to the given bits of a W1C register, all of them by default
+  def clear(register: Register): Unit = clear(register.fields: _*)
+
+  def clear(fields: Field*): Unit = {
+    val register = fields.head.register
+    require(register.access == W1C, s"${register.name} is not W1C")
+    require(fields.forall(_.register == register), "Fields of different registers")
+    write(register, fields.map(_.mask).reduce(_ | _))
+  }
+}
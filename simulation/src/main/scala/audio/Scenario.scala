@@ -0,0 +1,326 @@
+package audio
+
+import spinal.core._
+import spinal.core.sim._
+import SimulationHelpers._
+
+// Host scheduling model: delay between a period interrupt and the application
+// servicing the ring (writing the next playback period / reading a capture period)
+case class HostJitter(
+  meanUs: Double = 0.0,
+  sigmaUs: Double = 0.0,
+  tailProbability: Double = 0.0, // Probability of a long scheduling stall
+  tailUs: Double = 0.0           // Extra delay added on a stall
+)
+
+object HostJitter {
+  val none = HostJitter()
+  val desktop = HostJitter(meanUs = 50, sigmaUs = 30, tailProbability = 1e-3, tailUs = 2000)
+  val rtKernel = HostJitter(meanUs = 10, sigmaUs = 5, tailProbability = 1e-5, tailUs = 300)
+}
+
+// One streaming scenario, shared by the RTL tests and the transaction-level model
+case class Scenario(
+  name: String,
+  config: AudioConfig,
+  sampleRate: Int = 48000,
+  mclkMultiple: Int = 256,
+  periodFrames: Int = 1024,
+  periods: Int = 4,
+  playback: Boolean = true,
+  capture: Boolean = false,
+  durationFrames: Long = 48000,
+  pciePeriodPs: Long = 8000,       // 125 MHz user clock
+  completionLatencyNs: Double = 800, // Read request to first completion beat
+  completionJitterNs: Double = 0,
+  prefetchGuardFrames: Option[Int] = None, // PrefetchScheduler on with this guard
+  hostJitter: HostJitter = HostJitter.none,
+  seed: Long = 0,
+  faults: Seq[Injection] = Nil,
+  recovery: RecoveryPolicy = RecoveryPolicy.RestartDirection,
+  completionTimeoutUs: Double = 1e6, // PCIeConfig completionTimeout 0xA: 1 s to 3.5 s
+  restartUs: Double = 200,           // DMA error interrupt to the stream running again
+  relockUs: Double = 2000            // PLL lock time once MCLK is back
+) {
+  def sampleRateFamily: Int = if(sampleRate % 44100 == 0) 0 else 1
+  def sampleRateMulti: Int = sampleRate / (if(sampleRateFamily == 0) 44100 else 48000)
+  def mclkHz: Double = sampleRate.toDouble * mclkMultiple
+  def framePeriodPs: Double = 1e12 / sampleRate
+  def bufferFrames: Int = periodFrames * periods
+  def durationPs: Long = (durationFrames * framePeriodPs).toLong
+  def pcieCycles: Long = durationPs / pciePeriodPs
+
+  // Static per-stage latency of this scenario's rate and geometry on I2S
+  def latencyBudget: LatencyBudget.Budget = LatencyBudget(
+    config,
+    sampleRate,
+    AudioFormat.I2S_STANDARD,
+    periodFrames,
+    periods,
+    LatencyBudget.Platform(
+      pciePeriodPs = pciePeriodPs,
+      completionLatencyNs = completionLatencyNs,
+      completionWorstNs = Math.max(completionLatencyNs + 4 * completionJitterNs, 4000),
+      mclkMultiple = mclkMultiple
+    )
+  )
+
+  // Fault injection, see FaultInjection.scala
+  def at(timeUs: Double)(fault: Fault): Scenario =
+    copy(faults = faults :+ Injection(FaultTrigger.AtTime((timeUs * 1e6).toLong), fault))
+
+  def atFrame(frame: Long)(fault: Fault): Scenario =
+    copy(faults = faults :+ Injection(FaultTrigger.AtFrame(frame), fault))
+
+  def when(description: String)(condition: FaultProbe => Boolean)(fault: Fault): Scenario =
+    copy(faults = faults :+ Injection(FaultTrigger.When(description, condition), fault))
+}
+
+object Scenarios {
+  def defaultConfig = AudioConfig(
+    channelCount = 8,
+    i2sDataWidth = 24,
+    dsdBitWidth = 1,
+    useMultipleClocks = true,
+    supportDsd = true,
+    bufferSize = 8192,
+    bufferCount = 4,
+    maxBurstSize = 512,
+    fifoDepth = 1024,
+    dmaDescriptorCount = 32
+  )
+
+  def defaultPcieConfig = PCIeConfig(
+    maxReadRequestSize = 512,
+    maxPayloadSize = 256,
+    completionTimeout = 0xA,
+    relaxedOrdering = true,
+    extendedTags = true,
+    maxTags = 32
+  )
+
+  val basicPlayback = Scenario("basic-playback", defaultConfig, sampleRate = 44100)
+  val fullDuplex = Scenario("full-duplex", defaultConfig, sampleRate = 44100, capture = true)
+  val highRateDuplex = Scenario(
+    "high-rate-duplex",
+    defaultConfig,
+    sampleRate = 192000,
+    periodFrames = 256,
+    periods = 2,
+    capture = true
+  )
+  val desktopHour = Scenario(
+    "desktop-hour",
+    defaultConfig,
+    periodFrames = 128,
+    periods = 2,
+    capture = true,
+    durationFrames = 48000L * 3600,
+    completionJitterNs = 400,
+    hostJitter = HostJitter.desktop
+  )
+
+  val all = Seq(basicPlayback, fullDuplex, highRateDuplex, desktopHour)
+}
+
+// Applies a scenario to the RTL model through its BAR0 registers
+class ScenarioDriver(dut: AudioPCIeTop, scenario: Scenario) {
+  import AudioRegisters._
+
+  val regs = new RegisterPort(dut)
+
+  def startClocks(): Unit = {
+    dut.clockDomain.forkStimulus(scenario.pciePeriodPs)
+    val mclk = if(scenario.sampleRateFamily == 0) dut.io.audio.mclk44k1 else dut.io.audio.mclk48k
+    new ClockGenerator().drive(mclk, ClockProfile.ideal(scenario.mclkHz))
+  }
+
+  def configure(): Unit = {
+    regs.write(CtrlFormat, AudioFormat.I2S_STANDARD.position)
+    regs.write(CtrlSampleFamily, scenario.sampleRateFamily)
+    regs.write(CtrlSampleMulti, scenario.sampleRateMulti - 1)
+    regs.write(CtrlMasterMode, 1)
+    regs.write(CtrlTargetRate, scenario.sampleRate)
+  }
+
+  def enable(): Unit = {
+    if(scenario.playback) regs.write(CtrlPbEnable, 1)
+    if(scenario.capture) regs.write(CtrlCapEnable, 1)
+  }
+
+  def run(frames: Long = scenario.durationFrames): Unit = {
+    sleep((frames * scenario.framePeriodPs).toLong)
+  }
+}
+
+// Runs the DMAEngine RTL on a playback scenario with an AXI responder that
+// answers after the scenario's completion latency and a frame-rate drain on
+// audioOut. Used to cross-check the TLM and by the benchmark matrix. The
+// scenario's faults are applied by the responder (completion faults, link
+// back-pressure) and the drain (MCLK loss, unlock), and a DMA error is
+// handled the way the driver does: disable and re-enable the direction.
+// A BusMonitor on the engine's ports reports bus efficiency for the run.
+object DmaEngineRun {
+  case class Result(
+    bursts: Int,
+    framesPopped: Int,
+    firstPopPs: Long,
+    wallTimeNs: Long,
+    faults: Seq[FaultRecord] = Nil,
+    bus: Seq[BusMonitor.Summary] = Nil
+  ) {
+    def busSummary(channel: String): Option[BusMonitor.Summary] = bus.find(_.channel == channel)
+  }
+
+  def apply(scenario: Scenario, options: SimOptions = SimOptions(waves = false)): Result = {
+    var bursts = 0
+    var framesPopped = 0
+    var firstPopPs = -1L
+    val start = System.nanoTime()
+
+    val config = scenario.config
+    val slackFrames = config.maxBurstSize / (config.i2sDataWidth / 8) + config.maxBurstSize / 16
+    val faults = new FaultTracker(scenario.faults, playback = true, slackFrames)
+    var pbLost = 0L
+    var delayedCompletions = 0
+    var delayCycles = 0
+    var droppedCompletions = 0
+    var poisonedCompletions = 0
+    var descCorrupt = false
+    var linkStalledUntil = 0L
+    var clockStoppedUntil = 0L
+    var lockedAt = 0L
+    var bus = Seq[BusMonitor.Summary]()
+
+    def inject(fault: Fault): Unit = fault match {
+      case Fault.CompletionDelay(extraNs, count) =>
+        delayedCompletions += count
+        delayCycles = (extraNs * 1000 / scenario.pciePeriodPs).toInt
+      case Fault.CompletionDrop(count) => droppedCompletions += count
+      case Fault.PoisonedTlp(count)    => poisonedCompletions += count
+      case Fault.DescriptorCorruption(capture) =>
+        if(!capture) descCorrupt = true
+      case Fault.MclkLoss(durationUs) =>
+        clockStoppedUntil = Math.max(clockStoppedUntil, simTime() + (durationUs * 1e6).toLong)
+        lockedAt = Math.max(lockedAt, clockStoppedUntil + (scenario.relockUs * 1e6).toLong)
+      case Fault.Unlock(durationUs) =>
+        lockedAt = Math.max(lockedAt, simTime() + ((durationUs + scenario.relockUs) * 1e6).toLong)
+      case Fault.BackPressure(durationUs) =>
+        linkStalledUntil = Math.max(linkStalledUntil, simTime() + (durationUs * 1e6).toLong)
+    }
+
+    val pcieConfig = Scenarios.defaultPcieConfig
+    val compiled = SimCompileCache.compile(options, scenario.config, pcieConfig) {
+      val dut = new DMAEngine(scenario.config, pcieConfig)
+      dut.pbFifo.io.occupancy.simPublic()
+      dut
+    }
+    compiled.doSim(scenario.name) { dut =>
+      dut.clockDomain.forkStimulus(scenario.pciePeriodPs)
+      val latencyCycles = (scenario.completionLatencyNs * 1000 / scenario.pciePeriodPs).toInt
+
+      def healthy: Boolean =
+        !dut.io.control.pbError.toBoolean && simTime() >= lockedAt &&
+          simTime() >= linkStalledUntil && delayedCompletions == 0 && droppedCompletions == 0 &&
+          poisonedCompletions == 0 && !descCorrupt
+
+      dut.io.control.pbEnable #= false
+      dut.io.control.pbDescBaseAddr #= 0x10000
+      dut.io.control.pbDescCount #= scenario.config.dmaDescriptorCount
+      dut.io.control.pbPrefetchEnable #= scenario.prefetchGuardFrames.nonEmpty
+      dut.io.control.pbPrefetchGuard #= scenario.prefetchGuardFrames.getOrElse(0)
+      dut.io.control.pbQueuedDownstream #= 0 // The serializer pops pbFifo directly
+      dut.io.axi.ar.ready #= false
+      dut.io.axi.r.valid #= false
+      dut.io.axi.r.resp #= 0
+      dut.io.audioOut.ready #= false
+      val monitor = BusMonitor(dut)
+      monitor.start()
+
+      // Host memory responder; a dropped request is never answered, the
+      // engine has no completion timeout of its own
+      fork {
+        while(true) {
+          var accepted = false
+          while(!accepted) {
+            dut.io.axi.ar.ready #= simTime() >= linkStalledUntil
+            dut.clockDomain.waitSampling()
+            accepted = dut.io.axi.ar.ready.toBoolean && dut.io.axi.ar.valid.toBoolean
+          }
+          dut.io.axi.ar.ready #= false
+          bursts += 1
+          val beats = dut.io.axi.ar.len.toInt + 1
+          if(droppedCompletions > 0) {
+            droppedCompletions -= 1
+          } else {
+            // SLVERR for poisoned data, DECERR for an unmapped address
+            val resp = if(descCorrupt) 3 else if(poisonedCompletions > 0) 2 else 0
+            if(descCorrupt) descCorrupt = false
+            else if(poisonedCompletions > 0) poisonedCompletions -= 1
+            val extraCycles = if(delayedCompletions > 0) delayCycles else 0
+            delayedCompletions = Math.max(0, delayedCompletions - 1)
+
+            dut.clockDomain.waitSampling(latencyCycles + extraCycles)
+            for(beat <- 0 until beats) {
+              dut.io.axi.r.valid #= true
+              dut.io.axi.r.last #= beat == beats - 1
+              dut.io.axi.r.resp #= resp
+              dut.io.axi.r.data.randomize()
+              dut.clockDomain.waitSampling()
+            }
+            dut.io.axi.r.valid #= false
+            dut.io.axi.r.resp #= 0
+          }
+        }
+      }
+
+      // Driver: a DMA error interrupt stops the direction, the application
+      // restarts it
+      fork {
+        while(true) {
+          dut.clockDomain.waitSamplingWhere(dut.io.control.pbError.toBoolean)
+          sleep(((scenario.hostJitter.meanUs + scenario.restartUs) * 1e6).toLong)
+          dut.io.control.pbEnable #= false
+          dut.clockDomain.waitSampling(2)
+          dut.io.control.pbEnable #= true
+        }
+      }
+
+      // Serializer drain: one frame per frame period, none while MCLK is
+      // gone, muted while the PLL is unlocked
+      fork {
+        var frame = 1L
+        while(true) {
+          sleep((frame * scenario.framePeriodPs).toLong - simTime())
+          if(simTime() >= clockStoppedUntil) {
+            val locked = simTime() >= lockedAt
+            dut.io.audioOut.ready #= true
+            dut.clockDomain.waitSampling()
+            if(dut.io.audioOut.valid.toBoolean) {
+              if(locked) framesPopped += 1 else pbLost += 1
+              if(firstPopPs < 0) firstPopPs = simTime()
+            } else if(firstPopPs >= 0) {
+              pbLost += 1
+            }
+            dut.io.audioOut.ready #= false
+          } else if(firstPopPs >= 0) {
+            pbLost += 1
+          }
+
+          val probe = FaultProbe(simTime(), frame, dut.pbFifo.io.occupancy.toInt, 0)
+          faults.fire(probe, pbLost, 0).foreach(inject)
+          faults.frame(probe, pbLost, 0, healthy)
+          frame += 1
+        }
+      }
+
+      dut.clockDomain.waitSampling()
+      dut.io.control.pbEnable #= true
+      sleep(scenario.durationPs)
+      bus = monitor.summaries
+    }
+
+    val wallTimeNs = System.nanoTime() - start
+    Result(bursts, framesPopped, firstPopPs, wallTimeNs, faults.result(pbLost, 0), bus)
+  }
+}
@@ -0,0 +1,99 @@
+package audio
+
+import java.io._
+import java.util.zip.{GZIPInputStream, GZIPOutputStream}
+import spinal.core._
+import spinal.core.sim._
+import scala.collection.mutable
+
+// Snapshot of every register and memory of a design, plus whatever state the
+// testbench needs to carry on (which must be Serializable). Restoring writes
+// the values back into a fresh simulation of the same elaboration, so a long
+// run can be resumed at a checkpoint instead of re-simulated from time zero.
+//
+// Testbench threads are not captured: the bench must be able to restart
+// from its own state at a checkpoint, and must take checkpoints between
+// clock edges with no bus transaction in flight.
+object SimCheckpoint {
+  case class Snapshot(
+    timePs: Long,
+    registers: Map[String, BigInt],
+    memories: Map[String, Array[BigInt]],
+    bench: Serializable
+  )
+
+  private sealed trait Probe
+  private case class RegProbe(name: String, signal: BaseType) extends Probe
+  private case class MemProbe(name: String, mem: Mem[_]) extends Probe
+
+  private def probes(root: Component): Seq[Probe] = {
+    val found = mutable.ArrayBuffer[Probe]()
+    def walk(component: Component, path: String): Unit = {
+      component.dslBody.walkDeclarations {
+        case mem: Mem[_] =>
+          found += MemProbe(s"$path.${mem.getName()}", mem)
+        case signal: BaseType if signal.isReg =>
+          found += RegProbe(s"$path.${signal.getName()}", signal)
+        case _ =>
+      }
+      component.children.foreach(child => walk(child, s"$path.${child.getName()}"))
+    }
+    walk(root, root.getName())
+    found
+  }
+
+  // Keeps every register and memory visible to the simulation; call inside
+  // the compile closure
+  def instrument(root: Component): Unit =
+    probes(root).foreach {
+      case RegProbe(_, signal) => signal.simPublic()
+      case MemProbe(_, mem)    => mem.simPublic()
+    }
+
+  def capture(root: Component, timePs: Long, bench: Serializable): Snapshot = {
+    val registers = mutable.LinkedHashMap[String, BigInt]()
+    val memories = mutable.LinkedHashMap[String, Array[BigInt]]()
+    probes(root).foreach {
+      case RegProbe(name, signal) =>
+        registers(name) = signal match {
+          case b: Bool               => if(b.toBoolean) 1 else 0
+          case v: BitVector          => v.toBigInt
+          case e: SpinalEnumCraft[_] => enumPosition(e)
+        }
+      case MemProbe(name, mem) =>
+        memories(name) = Array.tabulate(mem.wordCount)(address => mem.getBigInt(address))
+    }
+    Snapshot(timePs, registers.toMap, memories.toMap, bench)
+  }
+
+  def restore(root: Component, snapshot: Snapshot): Unit =
+    probes(root).foreach {
+      case RegProbe(name, signal) =>
+        val value = snapshot.registers.getOrElse(
+          name,
+          throw new IllegalStateException(s"$name not in checkpoint, elaboration differs")
+        )
+        signal match {
+          case b: Bool               => b #= value != 0
+          case v: BitVector          => v #= value
+          case e: SpinalEnumCraft[_] => setEnum(e, value.toInt)
+        }
+      case MemProbe(name, mem) =>
+        for((value, address) <- snapshot.memories(name).zipWithIndex) mem.setBigInt(address, value)
+    }
+
+  private def enumPosition[T <: SpinalEnum](e: SpinalEnumCraft[T]): Int = e.toEnum.position
+
+  private def setEnum[T <: SpinalEnum](e: SpinalEnumCraft[T], position: Int): Unit =
+    e #= e.spinalEnum.elements(position)
+
+  def save(snapshot: Snapshot, path: String): Unit = {
+    val out = new ObjectOutputStream(new GZIPOutputStream(new FileOutputStream(path)))
+    try out.writeObject(snapshot) finally out.close()
+  }
+
+  def load(path: String): Snapshot = {
+    val in = new ObjectInputStream(new GZIPInputStream(new FileInputStream(path)))
+    try in.readObject().asInstanceOf[Snapshot] finally in.close()
+  }
+}
@@ -0,0 +1,57 @@
+package audio
+
+import java.util.concurrent.{Executors, TimeUnit}
+import java.util.concurrent.atomic.AtomicInteger
+import scala.concurrent.{Await, ExecutionContext, Future}
+import scala.concurrent.duration.Duration
+import scala.util.Try
+
+// Runs independent simulation jobs on a fixed pool, one job per core by
+// default (-Daudio.sim.jobs=N to override). Each doSim is single threaded,
+// so a sweep only scales by running scenarios side by side; compiled models
+// come from SimCompileCache, which builds each distinct DUT once even when
+// several jobs ask for it at the same time, and jobs name their doSim after
+// themselves so waves land in separate directories.
+object SimScheduler {
+  val defaultJobs: Int =
+    sys.props.get("audio.sim.jobs").map(_.toInt).getOrElse(Runtime.getRuntime.availableProcessors)
+
+  case class Outcome[A, R](job: A, result: Try[R], wallTimeNs: Long)
+
+  // Results come back in input order. `cost` is a relative estimate of each
+  // job's run time: the most expensive start first, so a long scenario does
+  // not end up alone on one core at the end of the sweep. A failing job is
+  // reported in its Outcome and does not stop the others.
+  def run[A, R](jobs: Seq[A], parallelism: Int = defaultJobs, cost: A => Double = (_: A) => 1.0)(
+    name: A => String
+  )(body: A => R): Seq[Outcome[A, R]] = {
+    val pool = Executors.newFixedThreadPool(Math.max(1, parallelism))
+    implicit val ec: ExecutionContext = ExecutionContext.fromExecutorService(pool)
+    val done = new AtomicInteger(0)
+    val start = System.nanoTime()
+
+    try {
+      val futures = jobs.zipWithIndex.sortBy { case (job, _) => -cost(job) }.map {
+        case (job, index) =>
+          Future {
+            val jobStart = System.nanoTime()
+            val result = Try(body(job))
+            val outcome = Outcome(job, result, System.nanoTime() - jobStart)
+            val n = done.incrementAndGet()
+            val elapsedS = (System.nanoTime() - start) / 1e9
+            val status = if(result.isSuccess) "done" else "FAILED"
+            val wallS = outcome.wallTimeNs / 1e9
+            println(
+              f"[$n%d/${jobs.size}%d] ${name(job)}%s $status%s in $wallS%.1f s, " +
+                f"eta ${elapsedS / n * (jobs.size - n)}%.0f s"
+            )
+            index -> outcome
+          }
+      }
+      Await.result(Future.sequence(futures), Duration.Inf).sortBy(_._1).map(_._2)
+    } finally {
+      pool.shutdown()
+      pool.awaitTermination(1, TimeUnit.MINUTES)
+    }
+  }
+}
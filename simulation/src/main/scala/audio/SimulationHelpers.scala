@@ -7,88 +7,133 @@ import scala.collection.mutable.ArrayBuffer
 import scala.util.Random
 
 object SimulationHelpers {
-  // Audio data generation
-  case class AudioSample(
-    value: BigInt,
-    channel: Int,
-    timestamp: Long
-  )
+  // Interleaved block of audio frames: data(frame * channelCount + channel)
+  final class FrameBuffer(val channelCount: Int, val data: Array[Int], val startFrame: Long = 0) {
+    def frames: Int = data.length / channelCount
+    def apply(frame: Int, channel: Int): Int = data(frame * channelCount + channel)
+    def update(frame: Int, channel: Int, value: Int): Unit = {
+      data(frame * channelCount + channel) = value
+    }
+  }
   
-  class AudioDataGenerator(channelCount: Int, sampleWidth: Int) {
+  object FrameBuffer {
+    def apply(channelCount: Int, frames: Int, startFrame: Long = 0): FrameBuffer =
+      new FrameBuffer(channelCount, new Array[Int](frames * channelCount), startFrame)
+    
+    // Concatenate a (short) stream of blocks into one buffer
+    def collect(channelCount: Int, blocks: Iterator[FrameBuffer]): FrameBuffer = {
+      val blockSeq = blocks.toArray
+      val start = if(blockSeq.nonEmpty) blockSeq.head.startFrame else 0L
+      val out = FrameBuffer(channelCount, blockSeq.map(_.frames).sum, start)
+      var offset = 0
+      for(block <- blockSeq) {
+        System.arraycopy(block.data, 0, out.data, offset, block.data.length)
+        offset += block.data.length
+      }
+      out
+    }
+  }
+  
+  // Audio data generation. Streaming variants yield fixed-size blocks so that
+  // arbitrarily long signals never have to be held in memory.
+  class AudioDataGenerator(channelCount: Int, sampleWidth: Int, blockFrames: Int = 4096) {
     private val random = new Random()
+    private val maxValue = ((1L << (sampleWidth - 1)) - 1).toInt
+    private val minValue = (-(1L << (sampleWidth - 1))).toInt
+    
+    private def blocks(totalFrames: Long)(value: Long => Int): Iterator[FrameBuffer] = {
+      Iterator.iterate(0L)(_ + blockFrames).takeWhile(_ < totalFrames).map { start =>
+        val frames = Math.min(blockFrames.toLong, totalFrames - start).toInt
+        val block = FrameBuffer(channelCount, frames, start)
+        var idx = 0
+        var frame = 0
+        while(frame < block.frames) {
+          val sample = value(start + frame)
+          var channel = 0
+          while(channel < channelCount) {
+            block.data(idx) = sample
+            idx += 1
+            channel += 1
+          }
+          frame += 1
+        }
+        block
+      }
+    }
     
     // Generate sine wave samples
-    def generateSineWave(frequency: Double, sampleRate: Double, duration: Double): Seq[AudioSample] = {
-      val samples = ArrayBuffer[AudioSample]()
-      val samplesCount = (duration * sampleRate).toInt
-      val maxValue = (1 << (sampleWidth - 1)) - 1
-      
-      for {
-        i <- 0 until samplesCount
-        channel <- 0 until channelCount
-      } {
-        val time = i.toDouble / sampleRate
-        val value = (Math.sin(2 * Math.PI * frequency * time) * maxValue).toInt
-        samples += AudioSample(value, channel, i)
+    def sineWave(frequency: Double, sampleRate: Double, duration: Double): Iterator[FrameBuffer] = {
+      val phaseStep = 2 * Math.PI * frequency / sampleRate
+      blocks((duration * sampleRate).toLong) { i =>
+        (Math.sin(phaseStep * i) * maxValue).toInt
       }
-      
-      samples
     }
     
-    // Generate DSD bitstream
-    def generateDSDStream(durationBits: Int): Seq[Boolean] = {
-      val stream = ArrayBuffer[Boolean]()
+    def generateSineWave(frequency: Double, sampleRate: Double, duration: Double): FrameBuffer =
+      FrameBuffer.collect(channelCount, sineWave(frequency, sampleRate, duration))
+    
+    // A different tone on every channel, for crosstalk measurements
+    def channelTones(
+      frequencies: Seq[Double],
+      sampleRate: Double,
+      duration: Double,
+      amplitude: Double = 0.5
+    ): FrameBuffer = {
+      require(frequencies.size == channelCount, "One tone per channel required")
+      val out = FrameBuffer(channelCount, (duration * sampleRate).toInt)
+      for(frame <- 0 until out.frames; channel <- 0 until channelCount) {
+        val phase = 2 * Math.PI * frequencies(channel) * frame / sampleRate
+        out(frame, channel) = (Math.sin(phase) * amplitude * maxValue).toInt
+      }
+      out
+    }
+    
+    // Exponential sine sweep on all channels, for frequency response measurements
+    def logSweep(
+      startHz: Double,
+      endHz: Double,
+      sampleRate: Double,
+      duration: Double,
+      amplitude: Double = 0.5
+    ): Iterator[FrameBuffer] = {
+      val k = duration / Math.log(endHz / startHz)
+      blocks((duration * sampleRate).toLong) { i =>
+        val t = i / sampleRate
+        val phase = 2 * Math.PI * startHz * k * (Math.exp(t / k) - 1)
+        (Math.sin(phase) * amplitude * maxValue).toInt
+      }
+    }
+    
+    // Generate DSD bitstream, packed MSB first as consumed by the DSD serializer
+    def generateDSDStream(durationBits: Int): Array[Byte] = {
+      val stream = new Array[Byte]((durationBits + 7) / 8)
       var accumulator = 0.0
       
-      for(_ <- 0 until durationBits) {
+      for(i <- 0 until durationBits) {
         // Simple noise shaping
         val input = random.nextDouble() * 2 - 1
         accumulator = accumulator + input
         val bit = accumulator >= 0
         accumulator = accumulator - (if(bit) 1.0 else -1.0)
-        stream += bit
+        if(bit) stream(i >> 3) = (stream(i >> 3) | (0x80 >> (i & 7))).toByte
       }
       
       stream
     }
     
     // Generate test patterns
-    def generateTestPattern(pattern: String, length: Int): Seq[AudioSample] = {
-      val samples = ArrayBuffer[AudioSample]()
-      
-      pattern match {
-        case "ramp" =>
-          for {
-            i <- 0 until length
-            channel <- 0 until channelCount
-          } {
-            val value = (i % (1 << sampleWidth)) - (1 << (sampleWidth - 1))
-            samples += AudioSample(value, channel, i)
-          }
-          
-        case "alternating" =>
-          for {
-            i <- 0 until length
-            channel <- 0 until channelCount
-          } {
-            val value = if(i % 2 == 0) (1 << (sampleWidth - 1)) - 1 else -(1 << (sampleWidth - 1))
-            samples += AudioSample(value, channel, i)
-          }
-          
-        case "dc" =>
-          for {
-            i <- 0 until length
-            channel <- 0 until channelCount
-          } {
-            val value = (1 << (sampleWidth - 2))  // 1/4 full scale
-            samples += AudioSample(value, channel, i)
-          }
-          
+    def testPattern(pattern: String, length: Long): Iterator[FrameBuffer] = {
+      val value: Long => Int = pattern match {
+        case "ramp"        => i => (i % (1L << sampleWidth) + minValue).toInt
+        case "alternating" => i => if(i % 2 == 0) maxValue else minValue
+        case "dc"          => _ => (1 << (sampleWidth - 2))  // 1/4 full scale
         case _ => throw new IllegalArgumentException(s"Unknown test pattern: $pattern")
       }
-      
-      samples
+      blocks(length)(value)
     }
+    
+    def generateTestPattern(pattern: String, length: Int): FrameBuffer =
+      FrameBuffer.collect(channelCount, testPattern(pattern, length))
   }
   
   // DMA helpers
@@ -114,6 +159,18 @@ object SimulationHelpers {
       }
     }
     
+    // One frame per 128-bit beat, channels packed LSB first as DMAEngine unpacks them
+    def writeFrames(address: BigInt, block: FrameBuffer, sampleWidth: Int): Unit = {
+      val mask = (BigInt(1) << sampleWidth) - 1
+      for(frame <- 0 until block.frames) {
+        var beat = BigInt(0)
+        for(channel <- 0 until block.channelCount) {
+          beat |= (BigInt(block(frame, channel)) & mask) << (channel * sampleWidth)
+        }
+        writeMem(address + frame * 16, beat)
+      }
+    }
+    
     def writeMem(address: BigInt, data: BigInt): Unit = {
       dut.clockDomain.waitSampling()
       dut.io.pcie.tx.valid #= true
@@ -144,13 +201,83 @@ object SimulationHelpers {
     }
   }
   
-  // Clock generation helpers
+  // Clock generation helpers. All times are in simulation time units, which are
+  // picoseconds with SpinalSim's default time precision.
+  case class FrequencyStep(atPs: Long, ppm: Double)
+  
+  case class ClockProfile(
+    nominalHz: Double,
+    ppmOffset: Double = 0.0,         // Static frequency error
+    wanderPpm: Double = 0.0,         // Peak of slow sinusoidal wander
+    wanderPeriodS: Double = 10.0,
+    randomJitterPsRms: Double = 0.0, // Gaussian, per edge, non-accumulating
+    periodicJitterPsPeak: Double = 0.0,
+    periodicJitterHz: Double = 0.0,
+    steps: Seq[FrequencyStep] = Nil, // Frequency steps (e.g. house clock switch-over)
+    seed: Long = 0
+  )
+  
+  object ClockProfile {
+    def ideal(hz: Double) = ClockProfile(hz)
+    
+    // Worst case we see from house clocks: +/-100 ppm, drifting, with a
+    // mid-run reference change
+    def worstCaseHouseClock(hz: Double, stepAtPs: Long) = ClockProfile(
+      nominalHz = hz,
+      ppmOffset = 100,
+      wanderPpm = 20,
+      wanderPeriodS = 0.01,
+      randomJitterPsRms = 50,
+      periodicJitterPsPeak = 200,
+      periodicJitterHz = 1000,
+      steps = Seq(FrequencyStep(stepAtPs, -200))
+    )
+  }
+  
+  // Edge scheduler for one MCLK. Ideal edges are integrated from the
+  // instantaneous frequency; jitter is added on top of each ideal edge.
+  class DriftingClock(profile: ClockProfile) {
+    private val random = new Random(profile.seed)
+    private var idealEdgePs = 0.0
+    private var lastEdgePs = 0L
+    
+    def ppmAt(timePs: Double): Double = {
+      val wander = profile.wanderPpm *
+        Math.sin(2 * Math.PI * timePs * 1e-12 / profile.wanderPeriodS)
+      val step = profile.steps.filter(_.atPs <= timePs).map(_.ppm).sum
+      profile.ppmOffset + wander + step
+    }
+    
+    def frequencyAt(timePs: Double): Double = profile.nominalHz * (1 + ppmAt(timePs) * 1e-6)
+    
+    // Absolute time of the next clock edge (either polarity)
+    def nextEdgePs(): Long = {
+      idealEdgePs += 0.5e12 / frequencyAt(idealEdgePs)
+      val periodic = profile.periodicJitterPsPeak *
+        Math.sin(2 * Math.PI * profile.periodicJitterHz * idealEdgePs * 1e-12)
+      val jittered = idealEdgePs + random.nextGaussian() * profile.randomJitterPsRms + periodic
+      lastEdgePs = Math.max(lastEdgePs + 1, jittered.round)
+      lastEdgePs
+    }
+    
+    def drive(pin: Bool): Unit = fork {
+      idealEdgePs = simTime().toDouble
+      lastEdgePs = simTime()
+      var level = false
+      while(true) {
+        sleep(Math.max(0L, nextEdgePs() - simTime()))
+        level = !level
+        pin #= level
+      }
+    }
+  }
+  
   class ClockGenerator {
     def generateMclk(frequency: Double): (Boolean => Unit) = {
-      val period = (1000000000.0 / frequency).toLong  // period in ns
+      val halfPeriodPs = Math.max(1L, (0.5e12 / frequency).round)
       
       (clock: Boolean) => {
-        sleep(period / 2)
+        sleep(halfPeriodPs)
       }
     }
     
@@ -161,6 +288,76 @@ object SimulationHelpers {
     def generate48kFamily(): (Boolean => Unit) = {
       generateMclk(12288000)  // 256 * 48000
     }
+    
+    def drive(pin: Bool, profile: ClockProfile): DriftingClock = {
+      val clock = new DriftingClock(profile)
+      clock.drive(pin)
+      clock
+    }
+  }
+  
+  // Tracks AudioCDC FIFO occupancy over time and counts slip events. Call
+  // instrument() inside the compile closure so the internal signals stay visible.
+  class FifoLevelMonitor(dut: AudioPCIeTop, samplePeriodCycles: Int = 64) {
+    case class LevelSample(timePs: Long, txLevel: Int, rxLevel: Int)
+    
+    val trajectory = ArrayBuffer[LevelSample]()
+    var txMin = Int.MaxValue
+    var txMax = 0
+    var rxMax = 0
+    var underrunSlips = 0
+    var overrunSlips = 0
+    
+    def start(): Unit = fork {
+      var cycle = 0L
+      var lastUnderrun = false
+      var lastOverrun = false
+      while(true) {
+        dut.clockDomain.waitSampling()
+        val status = dut.clockCrossing.io.pcie.status
+        val underrun = status.underrun.toBoolean
+        val overrun = status.overrun.toBoolean
+        if(underrun && !lastUnderrun) underrunSlips += 1
+        if(overrun && !lastOverrun) overrunSlips += 1
+        lastUnderrun = underrun
+        lastOverrun = overrun
+        
+        if(cycle % samplePeriodCycles == 0) {
+          val tx = dut.clockCrossing.txFifo.io.pushOccupancy.toInt
+          val rx = dut.clockCrossing.rxFifo.io.popOccupancy.toInt
+          txMin = Math.min(txMin, tx)
+          txMax = Math.max(txMax, tx)
+          rxMax = Math.max(rxMax, rx)
+          trajectory += LevelSample(simTime(), tx, rx)
+        }
+        cycle += 1
+      }
+    }
+    
+    // Smallest power-of-two depth that holds the observed excursion twice over
+    def recommendedDepth: Int = {
+      val excursion = Math.max(txMax - (if(txMin == Int.MaxValue) 0 else txMin), rxMax)
+      Integer.highestOneBit(Math.max(2 * excursion - 1, 1)) << 1
+    }
+    
+    def writeCsv(path: String): Unit = {
+      val out = new java.io.PrintWriter(path)
+      try {
+        out.println("time_ps,tx_level,rx_level")
+        trajectory.foreach(s => out.println(s"${s.timePs},${s.txLevel},${s.rxLevel}"))
+      } finally {
+        out.close()
+      }
+    }
+  }
+  
+  object FifoLevelMonitor {
+    def instrument(dut: AudioPCIeTop): Unit = {
+      dut.clockCrossing.txFifo.io.pushOccupancy.simPublic()
+      dut.clockCrossing.rxFifo.io.popOccupancy.simPublic()
+      dut.clockCrossing.io.pcie.status.underrun.simPublic()
+      dut.clockCrossing.io.pcie.status.overrun.simPublic()
+    }
   }
   
   // PCIe transaction helpers
@@ -194,44 +391,163 @@ object SimulationHelpers {
     }
   }
   
-  // Audio monitoring and analysis
-  class AudioAnalyzer(channelCount: Int, sampleWidth: Int) {
+  // Audio monitoring and analysis. Frames are folded into per-channel
+  // accumulators as they arrive, so memory use does not grow with capture length.
+  class AudioAnalyzer(channelCount: Int, sampleWidth: Int, maxRecordedDropouts: Int = 1024) {
     case class ChannelStats(
       peakLevel: Double,
       rmsLevel: Double,
       dcOffset: Double
     )
     
-    def analyzeSamples(samples: Seq[AudioSample]): Map[Int, ChannelStats] = {
-      val channelSamples = samples.groupBy(_.channel)
+    private val fullScale = (1L << (sampleWidth - 1)).toDouble
+    private val peak = new Array[Long](channelCount)
+    private val sum = new Array[Long](channelCount)
+    private val sumSquares = new Array[Double](channelCount)
+    private var frames = 0L
+    private var lastTimestamp = -1L
+    private var dropoutTotal = 0L
+    private val dropoutTimestamps = ArrayBuffer[Long]()
+    
+    def reset(): Unit = {
+      java.util.Arrays.fill(peak, 0L)
+      java.util.Arrays.fill(sum, 0L)
+      java.util.Arrays.fill(sumSquares, 0.0)
+      frames = 0
+      lastTimestamp = -1
+      dropoutTotal = 0
+      dropoutTimestamps.clear()
+    }
+    
+    // Accumulate one interleaved frame starting at data(offset)
+    def pushFrame(data: Array[Int], offset: Int, timestamp: Long): Unit = {
+      var channel = 0
+      while(channel < channelCount) {
+        val value = data(offset + channel).toLong
+        val magnitude = Math.abs(value)
+        if(magnitude > peak(channel)) peak(channel) = magnitude
+        sum(channel) += value
+        sumSquares(channel) += value.toDouble * value
+        channel += 1
+      }
       
-      channelSamples.map { case (channel, channelData) =>
-        val values = channelData.map(_.value.toDouble / (1 << (sampleWidth - 1)))
-        
-        val peak = values.map(Math.abs).max
-        val rms = Math.sqrt(values.map(x => x * x).sum / values.length)
-        val dc = values.sum / values.length
-        
-        channel -> ChannelStats(peak, rms, dc)
+      if(lastTimestamp >= 0 && timestamp - lastTimestamp > 1) {
+        dropoutTotal += 1
+        if(dropoutTimestamps.size < maxRecordedDropouts) dropoutTimestamps += lastTimestamp
       }
+      lastTimestamp = timestamp
+      frames += 1
     }
     
-    def detectDropouts(samples: Seq[AudioSample]): Seq[(Int, Long)] = {
-      val dropouts = ArrayBuffer[(Int, Long)]()
+    def push(block: FrameBuffer): Unit = {
+      var frame = 0
+      while(frame < block.frames) {
+        pushFrame(block.data, frame * channelCount, block.startFrame + frame)
+        frame += 1
+      }
+    }
+    
+    def pushAll(blocks: Iterator[FrameBuffer]): this.type = {
+      blocks.foreach(push)
+      this
+    }
+    
+    def frameCount: Long = frames
+    
+    def stats: Map[Int, ChannelStats] = {
+      (0 until channelCount).map { channel =>
+        val count = Math.max(frames, 1L).toDouble
+        channel -> ChannelStats(
+          peakLevel = peak(channel) / fullScale,
+          rmsLevel = Math.sqrt(sumSquares(channel) / count) / fullScale,
+          dcOffset = sum(channel) / count / fullScale
+        )
+      }.toMap
+    }
+    
+    // Timestamps of the last frame before each gap (first maxRecordedDropouts only)
+    def dropouts: Seq[Long] = dropoutTimestamps
+    def dropoutCount: Long = dropoutTotal
+    
+    def analyzeSamples(blocks: Iterator[FrameBuffer]): Map[Int, ChannelStats] = {
+      reset()
+      pushAll(blocks)
+      stats
+    }
+    
+    def detectDropouts(blocks: Iterator[FrameBuffer]): Seq[Long] = {
+      reset()
+      pushAll(blocks)
+      dropouts
+    }
+    
+    // Spectral analysis works on a captured buffer and runs channels in parallel
+    def channelSignal(capture: FrameBuffer, channel: Int): Array[Double] = {
+      val signal = new Array[Double](capture.frames)
+      var frame = 0
+      while(frame < capture.frames) {
+        signal(frame) = capture(frame, channel) / fullScale
+        frame += 1
+      }
+      signal
+    }
+    
+    def analyzeTone(
+      capture: FrameBuffer,
+      fundamentalHz: Double,
+      sampleRate: Double,
+      fftSize: Int = 65536,
+      window: Spectrum.Window = Spectrum.Window.BlackmanHarris
+    ): Map[Int, Spectrum.ToneStats] = {
+      (0 until channelCount).par.map { channel =>
+        val power = Spectrum.powerSpectrum(channelSignal(capture, channel), fftSize, window)
+        channel -> Spectrum.analyzeTone(power, fundamentalHz, sampleRate, window)
+      }.seq.toMap
+    }
+    
+    // crosstalk(from)(to): level of channel `from`'s tone on channel `to`, in dB
+    // relative to its level on `from`. Each channel must carry a distinct tone.
+    def crosstalkMatrix(
+      capture: FrameBuffer,
+      toneHz: Seq[Double],
+      sampleRate: Double,
+      fftSize: Int = 65536,
+      window: Spectrum.Window = Spectrum.Window.BlackmanHarris
+    ): Array[Array[Double]] = {
+      val spectra = (0 until channelCount).par.map { channel =>
+        Spectrum.powerSpectrum(channelSignal(capture, channel), fftSize, window)
+      }.seq
+      val binHz = sampleRate / (2 * spectra.head.length)
       
-      for(channel <- 0 until channelCount) {
-        val channelSamples = samples.filter(_.channel == channel).sortBy(_.timestamp)
-        var lastTimestamp = channelSamples.head.timestamp
-        
-        for(sample <- channelSamples.tail) {
-          if(sample.timestamp - lastTimestamp > 1) {
-            dropouts += ((channel, lastTimestamp))
-          }
-          lastTimestamp = sample.timestamp
+      Array.tabulate(channelCount, channelCount) { (from, to) =>
+        if(from == to) {
+          0.0
+        } else {
+          val bin = toneHz(from) / binHz
+          Spectrum.toDb(
+            Spectrum.tonePower(spectra(to), bin, window) /
+            Spectrum.tonePower(spectra(from), bin, window)
+          )
         }
       }
-      
-      dropouts
+    }
+    
+    def frequencyResponse(
+      stimulus: FrameBuffer,
+      capture: FrameBuffer,
+      sampleRate: Double,
+      fftSize: Int = 16384,
+      window: Spectrum.Window = Spectrum.Window.Hann
+    ): Map[Int, Seq[Spectrum.ResponsePoint]] = {
+      (0 until channelCount).par.map { channel =>
+        channel -> Spectrum.transferFunction(
+          channelSignal(stimulus, channel),
+          channelSignal(capture, channel),
+          fftSize,
+          sampleRate,
+          window
+        )
+      }.seq.toMap
     }
   }
   
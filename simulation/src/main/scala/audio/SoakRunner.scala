@@ -0,0 +1,282 @@
+package audio
+
+import java.io.File
+import spinal.core._
+import spinal.core.sim._
+import scala.collection.mutable.ArrayBuffer
+
+// Minutes of continuous full-duplex streaming on AudioPCIeTop with random
+// rate and period switches and injected link stalls, checkpointed so that a
+// failure after millions of frames can be replayed from the last checkpoint
+// before it with full waves instead of from time zero.
+//
+//   sbt "simulation/runMain audio.SoakRunner --minutes 10 --seed 7"
+//   sbt "simulation/runMain audio.SoakRunner --replay soak/checkpoint-028800000.ckpt"
+case class SoakConfig(
+  seed: Long = 1,
+  durationFrames: Long = 48000L * 60 * 10,
+  checkpointEveryFrames: Long = 48000L * 10,
+  keepCheckpoints: Int = 3,
+  sampleRates: Seq[Int] = Seq(44100, 48000, 88200, 96000, 176400, 192000),
+  periodFrames: Seq[Int] = Seq(64, 128, 256, 512, 1024),
+  minSegmentFrames: Int = 4800,    // Between rate/period switches
+  maxSegmentFrames: Int = 96000,
+  settleFrames: Int = 2048,        // After a switch, while the audio clock relocks
+  stallProbability: Double = 0.01, // Per period
+  maxStallUs: Double = 500,
+  pciePeriodPs: Long = 8000,
+  replayMarginFrames: Int = 2048,  // Traced past the failure on replay
+  directory: String = "soak"
+)
+
+object SoakRunner {
+  case class Failure(kind: String, frame: Long, timePs: Long)
+
+  case class Result(
+    frames: Long,
+    failure: Option[Failure],
+    checkpoints: Seq[String],
+    rateSwitches: Int,
+    stalls: Int,
+    wallTimeNs: Long,
+    replayWaves: Option[String]
+  )
+
+  // Everything the bench needs to carry on from a checkpoint. Random is
+  // Serializable, so the stimulus after a restore is the one the original
+  // run would have produced.
+  class BenchState(val config: SoakConfig) extends Serializable {
+    val random = new java.util.Random(config.seed)
+    var frame = 0L
+    var segmentStartFrame = 0L
+    var segmentStartPs = 0L
+    var segmentEndFrame = 0L
+    var sampleRate = 48000
+    var periodFrames = 256
+    var stallUntilFrame = 0L
+    var settleUntilFrame = 0L
+    var rateSwitches = 0
+    var stalls = 0
+    var errorCounts = Seq(0L, 0L, 0L) // pbUnderrun, capOverrun, clockUnlock
+
+    def frameTimePs(f: Long): Long =
+      segmentStartPs + ((f - segmentStartFrame) * 1e12 / sampleRate).toLong
+  }
+
+  // Registers and memories for checkpoints; the statusMonitor error
+  // counters the bench watches are registers too
+  def instrument(dut: AudioPCIeTop): Unit = SimCheckpoint.instrument(dut)
+
+  private def compiled(config: AudioConfig, waves: Boolean) =
+    SimCompileCache.compile(SimOptions(waves = waves), config, "soak") {
+      val dut = new AudioPCIeTop(config)
+      instrument(dut)
+      dut
+    }
+
+  def run(soak: SoakConfig, config: AudioConfig = Scenarios.defaultConfig): Result = {
+    new File(soak.directory).mkdirs()
+    val start = System.nanoTime()
+    var result: Result = null
+    compiled(config, waves = false).doSim(s"soak-${soak.seed}") { dut =>
+      val bench = new SoakBench(dut, new BenchState(soak), epochPs = 0)
+      bench.startClocks()
+      bench.reset()
+      bench.configure(firstSegment = true)
+      result = bench.stream(untilFrame = soak.durationFrames, checkpointing = true)
+    }
+    result = result.copy(wallTimeNs = System.nanoTime() - start)
+
+    // Replay the failure window from the last checkpoint before it
+    result.failure match {
+      case Some(failure) if result.checkpoints.nonEmpty =>
+        val waves = replay(result.checkpoints.last, failure.frame + soak.replayMarginFrames, config)
+        result.copy(replayWaves = Some(waves))
+      case _ => result
+    }
+  }
+
+  // Restores a checkpoint into a fresh, fully traced simulation and runs it
+  // up to `untilFrame`. Returns the doSim name the waves are filed under.
+  def replay(
+    checkpoint: String,
+    untilFrame: Long,
+    config: AudioConfig = Scenarios.defaultConfig
+  ): String = {
+    val snapshot = SimCheckpoint.load(checkpoint)
+    val state = snapshot.bench.asInstanceOf[BenchState]
+    val name = s"replay-${state.config.seed}-${state.frame}"
+    val restoreAtPs = 64 * state.config.pciePeriodPs
+    compiled(config, waves = true).doSim(name) { dut =>
+      val bench = new SoakBench(dut, state, epochPs = snapshot.timePs - restoreAtPs)
+      bench.startClocks()
+      bench.reset()
+      sleep(restoreAtPs - simTime())
+      SimCheckpoint.restore(dut, snapshot)
+      bench.applyInputs()
+      val result = bench.stream(untilFrame = untilFrame, checkpointing = false)
+      val failure = result.failure.getOrElse("no failure")
+      println(s"Replayed $checkpoint to frame ${result.frames}: $failure")
+    }
+    name
+  }
+
+  def main(args: Array[String]): Unit = {
+    def arg(name: String): Option[String] =
+      args.sliding(2).collectFirst { case Array(`name`, value) => value }
+
+    arg("--replay") match {
+      case Some(checkpoint) =>
+        val until = arg("--until-frame").map(_.toLong).getOrElse(Long.MaxValue)
+        println(s"Waves: ${replay(checkpoint, until)} in the simulation workspace")
+      case None =>
+        val soak = SoakConfig(
+          seed = arg("--seed").map(_.toLong).getOrElse(1L),
+          durationFrames = arg("--minutes").map(m => (m.toDouble * 60 * 48000).toLong)
+            .getOrElse(SoakConfig().durationFrames),
+          directory = arg("--dir").getOrElse("soak")
+        )
+        val result = run(soak)
+        println(s"""Soak seed ${soak.seed}: ${result.frames} frames in ${result.wallTimeNs / 1e9} s
+                   |  Rate/period switches: ${result.rateSwitches}
+                   |  Link stalls: ${result.stalls}
+                   |  Failure: ${result.failure.getOrElse("none")}
+                   |  Replay waves: ${result.replayWaves.getOrElse("-")}
+                   |""".stripMargin)
+        if(result.failure.nonEmpty) sys.exit(1)
+    }
+  }
+}
+
+// Drives one soak simulation. All clocks are generated here with edges at
+// fixed absolute times (epochPs + simTime()), so a run restored at a
+// checkpoint sees exactly the clock phases the original run saw.
+class SoakBench(dut: AudioPCIeTop, state: SoakRunner.BenchState, epochPs: Long) {
+  import SoakRunner._
+
+  private val soak = state.config
+  private val checkpoints = ArrayBuffer[String]()
+
+  def now: Long = epochPs + simTime()
+
+  private def driveClock(pin: Bool, halfPeriodPs: Double): Unit = fork {
+    var edge = (now / halfPeriodPs).toLong
+    pin #= edge % 2 == 1
+    while(true) {
+      edge += 1
+      sleep(Math.max(0L, (edge * halfPeriodPs).round - now))
+      pin #= edge % 2 == 1
+    }
+  }
+
+  def startClocks(): Unit = {
+    driveClock(dut.clockDomain.clockSim, soak.pciePeriodPs / 2.0)
+    driveClock(dut.io.audio.mclk44k1, 0.5e12 / 11289600)
+    driveClock(dut.io.audio.mclk48k, 0.5e12 / 12288000)
+  }
+
+  def reset(): Unit = {
+    dut.clockDomain.assertReset()
+    applyInputs()
+    dut.io.pcie.cfg.write #= false
+    dut.io.pcie.cfg.read #= false
+    dut.io.pcie.cfg.addr #= 0
+    dut.io.pcie.cfg.writeData #= 0
+    dut.clockDomain.waitRisingEdge(16)
+    dut.clockDomain.deassertReset()
+  }
+
+  // Inputs that follow from the bench state alone; the register port is
+  // idle whenever a checkpoint is taken
+  def applyInputs(): Unit = {
+    dut.io.pcie.tx.ready #= state.frame >= state.stallUntilFrame
+    dut.io.pcie.rx.valid #= false
+    dut.io.pcie.rx.last #= false
+  }
+
+  private val regs = new RegisterPort(dut)
+
+  // Picks the next rate and period size and reprograms the card
+  def configure(firstSegment: Boolean = false): Unit = {
+    val random = state.random
+    state.sampleRate = soak.sampleRates(random.nextInt(soak.sampleRates.size))
+    state.periodFrames = soak.periodFrames(random.nextInt(soak.periodFrames.size))
+    val family = if(state.sampleRate % 44100 == 0) 0 else 1
+    val multi = state.sampleRate / (if(family == 0) 44100 else 48000)
+    val periodBytes = state.periodFrames * dut.io.audio.i2s.sd.length * 4
+
+    import AudioRegisters._
+    if(!firstSegment) {
+      regs.write(CtrlPbEnable, 0)
+      regs.write(CtrlCapEnable, 0)
+      state.rateSwitches += 1
+    }
+    regs.write(CtrlSampleFamily, family)
+    regs.write(CtrlSampleMulti, multi - 1)
+    regs.write(CtrlTargetRate, state.sampleRate)
+    regs.write(DmaPbSize, periodBytes)
+    regs.write(DmaCapSize, periodBytes)
+    regs.write(CtrlPbThreshold, periodBytes / 2)
+    regs.write(CtrlCapThreshold, periodBytes / 2)
+    regs.write(CtrlPbEnable, 1)
+    regs.write(CtrlCapEnable, 1)
+
+    val spread = soak.maxSegmentFrames - soak.minSegmentFrames
+    val length = soak.minSegmentFrames + random.nextInt(spread)
+    state.segmentStartFrame = state.frame
+    state.segmentStartPs = now
+    state.segmentEndFrame = state.frame + length
+    state.settleUntilFrame = state.frame + soak.settleFrames
+  }
+
+  private def errorCounts: Seq[Long] = Seq(
+    dut.statusMonitor.pbUnderrunCount.toLong,
+    dut.statusMonitor.capOverrunCount.toLong,
+    dut.statusMonitor.clockUnlockCount.toLong
+  )
+
+  // Waits until the next pcie clock edge has passed and no other edge is
+  // due, so the checkpoint sits between edges
+  private def checkpoint(): Unit = {
+    dut.clockDomain.waitSampling()
+    sleep(soak.pciePeriodPs / 4)
+    val path = f"${soak.directory}/checkpoint-${state.frame}%09d.ckpt"
+    SimCheckpoint.save(SimCheckpoint.capture(dut, now, state), path)
+    checkpoints += path
+    if(checkpoints.size > soak.keepCheckpoints) new File(checkpoints.remove(0)).delete()
+  }
+
+  def stream(untilFrame: Long, checkpointing: Boolean): Result = {
+    var failure: Option[Failure] = None
+    if(state.frame == 0) state.errorCounts = errorCounts
+
+    while(state.frame < untilFrame && failure.isEmpty) {
+      state.frame += 1
+      sleep(Math.max(0L, state.frameTimePs(state.frame) - now))
+
+      // Any error counter moving outside the settle window after a switch
+      val counts = errorCounts
+      if(state.frame >= state.settleUntilFrame) {
+        val kinds = Seq("pbUnderrun", "capOverrun", "clockUnlock")
+        failure = kinds.zip(counts.zip(state.errorCounts)).collectFirst {
+          case (kind, (count, last)) if count != last => Failure(kind, state.frame, now)
+        }
+      }
+      state.errorCounts = counts
+
+      if(state.frame % state.periodFrames == 0 && state.frame >= state.stallUntilFrame &&
+         state.random.nextDouble() < soak.stallProbability) {
+        val stallUs = state.random.nextDouble() * soak.maxStallUs
+        val stallFrames = 1 + (stallUs * state.sampleRate / 1e6).toLong
+        state.stallUntilFrame = state.frame + stallFrames
+        state.stalls += 1
+      }
+      applyInputs()
+
+      if(state.frame >= state.segmentEndFrame) configure()
+      if(checkpointing && state.frame % soak.checkpointEveryFrames == 0) checkpoint()
+    }
+
+    Result(state.frame, failure, checkpoints.toList, state.rateSwitches, state.stalls, 0, None)
+  }
+}
@@ -0,0 +1,462 @@
+package audio
+
+import scala.collection.mutable
+import scala.collection.mutable.ArrayBuffer
+import scala.util.Random
+
+// Cycle-approximate transaction-level model of the DMAEngine -> AudioCDC ->
+// serializer pipeline. Time is kept in picoseconds; only burst, frame and host
+// events are simulated, so an hour of audio runs in seconds instead of days.
+object TransactionModel {
+  case class LevelSample(timePs: Long, playbackLevel: Int, captureLevel: Int)
+
+  case class Result(
+    scenario: String,
+    framesPlayed: Long,
+    framesCaptured: Long,
+    pbBursts: Long,
+    capBursts: Long,
+    pbInterrupts: Long,
+    capInterrupts: Long,
+    pbUnderruns: Long,
+    capOverruns: Long,
+    hostXruns: Long,
+    dmaErrors: Long,
+    firstOutputPs: Long,
+    pbLevelMin: Int,
+    pbLevelMax: Int,
+    capLevelMax: Int,
+    levelTrace: Seq[LevelSample],
+    faults: Seq[FaultRecord],
+    wallTimeNs: Long
+  ) {
+    def simulatedSeconds(framePeriodPs: Double): Double = framesPlayed * framePeriodPs / 1e12
+    def speedup(framePeriodPs: Double): Double =
+      simulatedSeconds(framePeriodPs) / (wallTimeNs / 1e9)
+  }
+
+  def run(scenario: Scenario, traceEveryFrames: Int = 0): Result =
+    new TransactionModel(scenario, traceEveryFrames).run()
+
+  private sealed trait Kind
+  private case object FrameTick extends Kind
+  private case object PbIssue extends Kind
+  private case object PbLanded extends Kind
+  private case object CapIssue extends Kind
+  private case object CapWritten extends Kind
+  private case object PbHostWake extends Kind
+  private case object CapHostWake extends Kind
+  private case object PbFailed extends Kind
+  private case object CapFailed extends Kind
+  private case class DriverWake(capture: Boolean) extends Kind
+  private case class Restarted(capture: Boolean) extends Kind
+
+  // A direction stops issuing when it raises a DMA error (Halted) and
+  // drops its FIFO contents when the driver disables it (Disabled)
+  private sealed trait DmaState
+  private case object Running extends DmaState
+  private case object Halted extends DmaState
+  private case object Disabled extends DmaState
+
+  private case class Event(timePs: Long, seq: Long, kind: Kind)
+
+  // Frames that left DMAEngine in one burst and become poppable in the audio
+  // domain once they have crossed AudioCDC
+  private case class Batch(readyPs: Long, var frames: Int)
+}
+
+class TransactionModel(scenario: Scenario, traceEveryFrames: Int = 0) {
+  import TransactionModel._
+
+  private val config = scenario.config
+  private val random = new Random(scenario.seed)
+
+  // Constants of DMAEngine and AudioCDC, shared with the static budget
+  val burstFrames = LatencyBudget.burstFrames(config)
+  val pbIssueSpace = LatencyBudget.issueFrames(config)
+  val capIssueLevel = LatencyBudget.issueFrames(config)
+  val fifoDepth = config.fifoDepth
+  val fsmOverheadCycles = LatencyBudget.fsmOverheadCycles
+  val cdcSyncCycles = LatencyBudget.cdcSyncCycles
+
+  private val pciePs = scenario.pciePeriodPs
+  private val mclkPs = 1e12 / scenario.mclkHz
+  private val cdcLatencyPs = (pciePs + cdcSyncCycles * mclkPs).toLong
+
+  private val events = mutable.PriorityQueue.empty[Event](
+    Ordering.by[Event, (Long, Long)](e => (e.timePs, e.seq)).reverse
+  )
+  private var seq = 0L
+  private var now = 0L
+
+  // Playback state: pbFifo + txFifo contents, oldest first
+  private val pbQueue = mutable.Queue[Batch]()
+  private var pbLevel = 0
+  private var pbBusy = false
+  private var pbHwPos = 0L
+  private var pbApplPos = scenario.bufferFrames.toLong // Application prefills the ring
+
+  // PrefetchScheduler inputs: the drain rate, counted at the serializer as the
+  // queue is not split here, and the completion latency estimate; -1 until
+  // measured since the direction was enabled
+  private val windowPs = cycles(1L << PrefetchScheduler.windowLog2)
+  private var pbWindowStart = 0L
+  private var pbWindowFrames = 0
+  private var pbFramesPerWindow = -1
+  private var pbLatencyCycles = -1
+  private var pbPendingLatency = 0
+
+  // Capture state: rxFifo + capFifo contents
+  private var capLevel = 0
+  private var capBusy = false
+  private var capHwPos = 0L
+  private var capApplPos = 0L
+
+  // Statistics
+  private var frameIndex = 0L
+  private var framesPlayed = 0L
+  private var framesCaptured = 0L
+  private var pbBursts = 0L
+  private var capBursts = 0L
+  private var pbInterrupts = 0L
+  private var capInterrupts = 0L
+  private var pbUnderruns = 0L
+  private var capOverruns = 0L
+  private var hostXruns = 0L
+  private var firstOutputPs = -1L
+  private var pbLevelMin = Int.MaxValue
+  private var pbLevelMax = 0
+  private var capLevelMax = 0
+  private var dmaErrors = 0L
+  private val levelTrace = ArrayBuffer[LevelSample]()
+
+  // Fault injection: frames lost to any cause, and the faults in effect
+  private val faults =
+    new FaultTracker(scenario.faults, scenario.playback, pbIssueSpace + burstFrames)
+  private var pbLost = 0L
+  private var capLost = 0L
+  private var pbState: DmaState = Running
+  private var capState: DmaState = Running
+  private var pbRetries = 0
+  private var capRetries = 0
+  private var delayedCompletions = 0
+  private var completionDelayPs = 0L
+  private var droppedCompletions = 0
+  private var poisonedCompletions = 0
+  private var pbDescCorrupt = false
+  private var capDescCorrupt = false
+  private var linkStalledUntil = 0L
+  private var clockStoppedUntil = 0L
+  private var lockedAt = 0L
+
+  private def schedule(timePs: Long, kind: Kind): Unit = {
+    events.enqueue(Event(timePs, seq, kind))
+    seq += 1
+  }
+
+  private def cycles(n: Long): Long = n * pciePs
+
+  private def completionLatencyPs: Long = {
+    val jitter = random.nextGaussian() * scenario.completionJitterNs
+    (Math.max(0.0, scenario.completionLatencyNs + jitter) * 1000).toLong
+  }
+
+  private def hostDelayPs: Long = {
+    val jitter = scenario.hostJitter
+    val base = Math.max(0.0, jitter.meanUs + random.nextGaussian() * jitter.sigmaUs)
+    val tail = if(random.nextDouble() < jitter.tailProbability) jitter.tailUs else 0.0
+    ((base + tail) * 1e6).toLong
+  }
+
+  private def pbFifoLevel: Int = Math.max(0, pbLevel - fifoDepth)
+  private def capFifoLevel: Int = Math.min(capLevel, fifoDepth)
+
+  def run(): Result = {
+    val start = System.nanoTime()
+
+    if(scenario.playback) schedule(0, PbIssue)
+    schedule(0, FrameTick)
+
+    while(events.nonEmpty) {
+      val event = events.dequeue()
+      now = event.timePs
+      event.kind match {
+        case FrameTick           => frameTick()
+        case PbIssue             => pbIssue()
+        case PbLanded            => pbLanded()
+        case CapIssue            => capIssue()
+        case CapWritten          => capWritten()
+        case PbHostWake          => pbHostWake()
+        case CapHostWake         => capHostWake()
+        case PbFailed            => dmaFailed(capture = false)
+        case CapFailed           => dmaFailed(capture = true)
+        case DriverWake(capture) => driverWake(capture)
+        case Restarted(capture)  => restart(capture)
+      }
+    }
+
+    Result(
+      scenario = scenario.name,
+      framesPlayed = framesPlayed,
+      framesCaptured = framesCaptured,
+      pbBursts = pbBursts,
+      capBursts = capBursts,
+      pbInterrupts = pbInterrupts,
+      capInterrupts = capInterrupts,
+      pbUnderruns = pbUnderruns,
+      capOverruns = capOverruns,
+      hostXruns = hostXruns,
+      dmaErrors = dmaErrors,
+      firstOutputPs = firstOutputPs,
+      pbLevelMin = if(pbLevelMin == Int.MaxValue) 0 else pbLevelMin,
+      pbLevelMax = pbLevelMax,
+      capLevelMax = capLevelMax,
+      levelTrace = levelTrace,
+      faults = faults.result(pbLost, capLost),
+      wallTimeNs = System.nanoTime() - start
+    )
+  }
+
+  // Serializer frame boundary: pop one playback frame, push one capture frame.
+  // Without MCLK nothing moves; while the PLL is unlocked frames move but
+  // are muted on the way out and invalid on the way in.
+  private def frameTick(): Unit = {
+    val clockRunning = now >= clockStoppedUntil
+    val locked = now >= lockedAt
+
+    if(scenario.playback) {
+      if(pbState == Disabled || !clockRunning) {
+        if(firstOutputPs >= 0) pbLost += 1
+      } else if(pbQueue.nonEmpty && pbQueue.head.readyPs <= now) {
+        val head = pbQueue.head
+        head.frames -= 1
+        if(head.frames == 0) pbQueue.dequeue()
+        pbLevel -= 1
+        pbWindowFrames += 1
+        if(locked) framesPlayed += 1 else pbLost += 1
+        if(firstOutputPs < 0) firstOutputPs = now
+      } else if(firstOutputPs >= 0) {
+        pbUnderruns += 1
+        pbLost += 1
+      }
+      if(firstOutputPs >= 0) pbLevelMin = Math.min(pbLevelMin, pbLevel)
+      if(now - pbWindowStart >= windowPs) {
+        pbFramesPerWindow = pbWindowFrames
+        pbWindowFrames = 0
+        pbWindowStart = now
+      }
+      pbIssue()
+    }
+
+    if(scenario.capture) {
+      if(capState == Disabled || !clockRunning || !locked) {
+        capLost += 1
+      } else if(capLevel < 2 * fifoDepth) {
+        capLevel += 1
+        framesCaptured += 1
+        capLevelMax = Math.max(capLevelMax, capLevel)
+      } else {
+        capOverruns += 1
+        capLost += 1
+      }
+      if(!capBusy) schedule(now + cdcLatencyPs, CapIssue)
+    }
+
+    if(traceEveryFrames > 0 && frameIndex % traceEveryFrames == 0) {
+      levelTrace += LevelSample(now, pbLevel, capLevel)
+    }
+
+    val probe = FaultProbe(now, frameIndex, pbLevel, capLevel)
+    faults.fire(probe, pbLost, capLost).foreach(inject)
+    faults.frame(probe, pbLost, capLost, healthy)
+
+    frameIndex += 1
+    if(frameIndex < scenario.durationFrames) {
+      schedule((frameIndex * scenario.framePeriodPs).toLong, FrameTick)
+    }
+  }
+
+  // Without the scheduler, or until it has measured, whenever a burst fits
+  private def pbRefill: Boolean = scenario.prefetchGuardFrames match {
+    case Some(guard) if pbFramesPerWindow >= 0 && pbLatencyCycles >= 0 =>
+      pbLevel < PrefetchScheduler.target(pbFramesPerWindow, pbLatencyCycles, burstFrames, guard)
+    case _ => true
+  }
+
+  private def pbIssue(): Unit = {
+    val running = frameIndex < scenario.durationFrames && pbState == Running
+    val space = fifoDepth - pbFifoLevel >= pbIssueSpace
+    if(running && !pbBusy && now >= linkStalledUntil && space && pbRefill) {
+      pbBusy = true
+      val issuedPs = now + cycles(fsmOverheadCycles + burstFrames)
+      if(droppedCompletions > 0) {
+        droppedCompletions -= 1
+        schedule(issuedPs + (scenario.completionTimeoutUs * 1e6).toLong, PbFailed)
+      } else if(poisonedCompletions > 0 || pbDescCorrupt) {
+        // Poisoned data, or an Unsupported Request for the unmapped address
+        if(pbDescCorrupt) pbDescCorrupt = false else poisonedCompletions -= 1
+        schedule(issuedPs + completionLatencyPs, PbFailed)
+      } else {
+        val extraPs = if(delayedCompletions > 0) completionDelayPs else 0L
+        delayedCompletions = Math.max(0, delayedCompletions - 1)
+        val latencyPs = completionLatencyPs + extraPs
+        pbPendingLatency = Math.min(0xFFFF, latencyPs / pciePs).toInt
+        schedule(issuedPs + latencyPs, PbLanded)
+      }
+    }
+  }
+
+  private def pbLanded(): Unit = {
+    pbBusy = false
+    if(pbState == Disabled) return // Landed after the driver stopped the stream
+    pbRetries = 0
+    pbBursts += 1
+    pbLatencyCycles = PrefetchScheduler.track(Math.max(0, pbLatencyCycles), pbPendingLatency)
+    pbQueue.enqueue(Batch(now + cdcLatencyPs, burstFrames))
+    pbLevel += burstFrames
+    pbLevelMax = Math.max(pbLevelMax, pbLevel)
+
+    val previous = pbHwPos
+    pbHwPos += burstFrames
+    if(pbHwPos > pbApplPos) {
+      // DMA fetched frames the application had not written yet
+      hostXruns += 1
+      pbApplPos = pbHwPos + scenario.bufferFrames
+    }
+    if(pbHwPos / scenario.periodFrames != previous / scenario.periodFrames) {
+      pbInterrupts += 1
+      schedule(now + hostDelayPs, PbHostWake)
+    }
+    schedule(now + cycles(1), PbIssue)
+  }
+
+  private def pbHostWake(): Unit = {
+    // Application tops the ring up to a full buffer ahead of the DMA pointer; the
+    // serviced descriptors are handed back to hardware at the same time
+    pbApplPos = Math.max(pbApplPos, pbHwPos + scenario.bufferFrames)
+  }
+
+  private def capIssue(): Unit = {
+    val running = capState == Running && now >= linkStalledUntil
+    if(running && !capBusy && capFifoLevel >= capIssueLevel) {
+      capBusy = true
+      if(capDescCorrupt) {
+        // Rejected by the descriptor checks before any data is written
+        capDescCorrupt = false
+        schedule(now + cycles(fsmOverheadCycles), CapFailed)
+      } else {
+        schedule(now + cycles(fsmOverheadCycles + burstFrames), CapWritten)
+      }
+    }
+  }
+
+  private def capWritten(): Unit = {
+    capBusy = false
+    if(capState == Disabled) return
+    capRetries = 0
+    capBursts += 1
+    capLevel -= burstFrames
+
+    val previous = capHwPos
+    capHwPos += burstFrames
+    if(capHwPos - capApplPos > scenario.bufferFrames) {
+      // DMA overwrote frames the application had not read yet
+      hostXruns += 1
+      capApplPos = capHwPos
+    }
+    if(capHwPos / scenario.periodFrames != previous / scenario.periodFrames) {
+      capInterrupts += 1
+      schedule(now + hostDelayPs, CapHostWake)
+    }
+    schedule(now + cycles(1), CapIssue)
+  }
+
+  private def capHostWake(): Unit = {
+    capApplPos = Math.max(capApplPos, capHwPos)
+  }
+
+  private def healthy: Boolean =
+    pbState == Running && capState == Running && now >= lockedAt && now >= linkStalledUntil &&
+      delayedCompletions == 0 && droppedCompletions == 0 && poisonedCompletions == 0 &&
+      !pbDescCorrupt && !capDescCorrupt
+
+  private def inject(fault: Fault): Unit = fault match {
+    case Fault.CompletionDelay(extraNs, count) =>
+      delayedCompletions += count
+      completionDelayPs = (extraNs * 1000).toLong
+    case Fault.CompletionDrop(count) => droppedCompletions += count
+    case Fault.PoisonedTlp(count)    => poisonedCompletions += count
+    case Fault.DescriptorCorruption(capture) =>
+      if(capture) capDescCorrupt = true else pbDescCorrupt = true
+    case Fault.MclkLoss(durationUs) =>
+      clockStoppedUntil = Math.max(clockStoppedUntil, now + (durationUs * 1e6).toLong)
+      lockedAt = Math.max(lockedAt, clockStoppedUntil + (scenario.relockUs * 1e6).toLong)
+    case Fault.Unlock(durationUs) =>
+      lockedAt = Math.max(lockedAt, now + ((durationUs + scenario.relockUs) * 1e6).toLong)
+    case Fault.BackPressure(durationUs) =>
+      linkStalledUntil = Math.max(linkStalledUntil, now + (durationUs * 1e6).toLong)
+  }
+
+  // A burst failed: retry it, or stop the direction and interrupt the host
+  private def dmaFailed(capture: Boolean): Unit = {
+    dmaErrors += 1
+    if(capture) capBusy = false else pbBusy = false
+    val retries = if(capture) capRetries else pbRetries
+    scenario.recovery match {
+      case RecoveryPolicy.RetryInHardware(max) if retries < max =>
+        if(capture) {
+          capRetries += 1
+          schedule(now + cycles(1), CapIssue)
+        } else {
+          pbRetries += 1
+          schedule(now + cycles(1), PbIssue)
+        }
+      case _ =>
+        if(capture) capState = Halted else pbState = Halted
+        schedule(now + hostDelayPs, DriverWake(capture))
+    }
+  }
+
+  private def driverWake(capture: Boolean): Unit = {
+    val stopped = scenario.recovery match {
+      case RecoveryPolicy.ResetBoth => Seq(false, true)
+      case _                        => Seq(capture)
+    }
+    for(direction <- stopped) {
+      disable(direction)
+      schedule(now + (scenario.restartUs * 1e6).toLong, Restarted(direction))
+    }
+  }
+
+  // Disabling a direction flushes its FIFOs
+  private def disable(capture: Boolean): Unit = {
+    if(capture && scenario.capture) {
+      capState = Disabled
+      capLost += capLevel
+      capLevel = 0
+    } else if(!capture && scenario.playback) {
+      pbState = Disabled
+      if(firstOutputPs >= 0) pbLost += pbLevel
+      pbQueue.clear()
+      pbLevel = 0
+      pbFramesPerWindow = -1
+      pbLatencyCycles = -1
+      pbWindowFrames = 0
+      pbWindowStart = now
+    }
+  }
+
+  // The application recovers from the xrun: prepare, refill, start
+  private def restart(capture: Boolean): Unit = {
+    if(capture && scenario.capture) {
+      capState = Running
+      capRetries = 0
+      capApplPos = capHwPos
+    } else if(!capture && scenario.playback) {
+      pbState = Running
+      pbRetries = 0
+      pbApplPos = pbHwPos + scenario.bufferFrames
+      pbIssue()
+    }
+  }
+}
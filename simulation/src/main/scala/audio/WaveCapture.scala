@@ -0,0 +1,178 @@
+package audio
+
+import spinal.core._
+import spinal.core.sim._
+import scala.collection.mutable.ArrayBuffer
+import scala.sys.process._
+import scala.util.Try
+
+// Triggered waveform capture of selected hierarchies. Instead of dumping
+// every signal for the whole run (SimOptions(waves = true)), the signals of
+// a few components are sampled once per clock into a ring of the last
+// `preTriggerCycles` cycles; when a trigger fires, the ring plus the next
+// `postTriggerCycles` cycles are written out as FST (through vcd2fst when it
+// is on the PATH, plain VCD otherwise). Only failure windows hit the disk,
+// so soak runs can keep capture armed.
+object WaveCapture {
+  case class Trigger(name: String, fire: () => Boolean)
+
+  // Signals of the named child components of `root` and everything below
+  // them, e.g. Seq("dmaEngine", "clockCrossing"); call inside the compile
+  // closure, like the other instrument() helpers
+  def instrument(root: Component, scopes: Seq[String]): Unit =
+    signals(root, scopes).foreach { case (_, signal) => signal.simPublic() }
+
+  def signals(root: Component, scopes: Seq[String]): Seq[(String, BaseType)] = {
+    val found = ArrayBuffer[(String, BaseType)]()
+    def walk(component: Component, path: String): Unit = {
+      component.dslBody.walkDeclarations {
+        case signal @ (_: Bool | _: BitVector) =>
+          found += s"$path.${signal.getName()}" -> signal.asInstanceOf[BaseType]
+        case _ =>
+      }
+      component.children.foreach(child => walk(child, s"$path.${child.getName()}"))
+    }
+    for(scope <- scopes) {
+      val component = root.children
+        .find(_.getName() == scope)
+        .getOrElse(throw new IllegalArgumentException(s"No component $scope in ${root.getName()}"))
+      walk(component, scope)
+    }
+    found
+  }
+
+  // Error conditions of AudioPCIeTop, see instrumentTriggers
+  def instrumentTriggers(dut: AudioPCIeTop): Unit = {
+    dut.clockCrossing.io.pcie.status.underrun.simPublic()
+    dut.clockCrossing.io.pcie.status.overrun.simPublic()
+    dut.clockCrossing.io.pcie.status.clockLocked.simPublic()
+  }
+
+  def underrun(dut: AudioPCIeTop): Trigger =
+    Trigger("underrun", () => dut.clockCrossing.io.pcie.status.underrun.toBoolean)
+
+  def overrun(dut: AudioPCIeTop): Trigger =
+    Trigger("overrun", () => dut.clockCrossing.io.pcie.status.overrun.toBoolean)
+
+  // Fires on a falling edge of clockLocked, not while the PLL first locks
+  def unlock(dut: AudioPCIeTop): Trigger = {
+    var wasLocked = false
+    Trigger("unlock", () => {
+      val locked = dut.clockCrossing.io.pcie.status.clockLocked.toBoolean
+      val fired = wasLocked && !locked
+      wasLocked = locked
+      fired
+    })
+  }
+
+  def errorTriggers(dut: AudioPCIeTop): Seq[Trigger] = Seq(underrun(dut), overrun(dut), unlock(dut))
+}
+
+class WaveCapture(
+  root: Component,
+  scopes: Seq[String],
+  clockDomain: ClockDomain,
+  triggers: Seq[WaveCapture.Trigger],
+  pathPrefix: String,
+  preTriggerCycles: Int = 1024,
+  postTriggerCycles: Int = 4096,
+  maxCaptures: Int = 1
+) {
+  import WaveCapture._
+
+  private val probes = signals(root, scopes).toArray
+  private val widths = probes.map(_._2.getBitsWidth)
+  private val ringTimes = new Array[Long](preTriggerCycles)
+  private val ring = Array.fill(preTriggerCycles)(new Array[BigInt](probes.length))
+  private var ringCount = 0L
+
+  case class Capture(trigger: String, timePs: Long, path: String)
+  val captures = ArrayBuffer[Capture]()
+
+  private def sample(into: Array[BigInt]): Unit = {
+    var i = 0
+    while(i < probes.length) {
+      into(i) = probes(i)._2 match {
+        case b: Bool      => if(b.toBoolean) 1 else 0
+        case v: BitVector => v.toBigInt
+      }
+      i += 1
+    }
+  }
+
+  fork {
+    while(captures.size < maxCaptures) {
+      clockDomain.waitSampling()
+      val slot = (ringCount % preTriggerCycles).toInt
+      ringTimes(slot) = simTime()
+      sample(ring(slot))
+      ringCount += 1
+
+      triggers.find(_.fire()).foreach { trigger =>
+        val triggerPs = simTime()
+        val pre = (0L until Math.min(ringCount, preTriggerCycles.toLong)).map { age =>
+          val s = ((ringCount - 1 - age) % preTriggerCycles).toInt
+          ringTimes(s) -> ring(s).clone()
+        }.reverse
+        val post = (0 until postTriggerCycles).map { _ =>
+          clockDomain.waitSampling()
+          val values = new Array[BigInt](probes.length)
+          sample(values)
+          simTime() -> values
+        }
+        val path = write(s"$pathPrefix-${captures.size}-${trigger.name}", pre ++ post)
+        println(s"[WaveCapture] ${trigger.name} at $triggerPs ps, window written to $path")
+        captures += Capture(trigger.name, triggerPs, path)
+        ringCount = 0
+      }
+    }
+  }
+
+  // Value-change dump of the window, converted to FST when vcd2fst exists
+  private def write(base: String, window: Seq[(Long, Array[BigInt])]): String = {
+    val vcd = s"$base.vcd"
+    val out = new java.io.PrintWriter(vcd)
+    try {
+      out.println("$timescale 1ps $end")
+      val ids = probes.indices.map(identifier)
+      for(((name, _), i) <- probes.zipWithIndex) {
+        val parts = name.split('.')
+        parts.init.foreach(scope => out.println(s"$$scope module $scope $$end"))
+        out.println(s"$$var wire ${widths(i)} ${ids(i)} ${parts.last} $$end")
+        parts.init.foreach(_ => out.println("$upscope $end"))
+      }
+      out.println("$enddefinitions $end")
+
+      var last: Array[BigInt] = null
+      for((time, values) <- window) {
+        out.println(s"#$time")
+        for(i <- values.indices if last == null || values(i) != last(i)) {
+          if(widths(i) == 1) out.println(s"${values(i)}${ids(i)}")
+          else out.println(s"b${values(i).toString(2)} ${ids(i)}")
+        }
+        last = values
+      }
+    } finally {
+      out.close()
+    }
+
+    val fst = s"$base.fst"
+    if(Try(Seq("vcd2fst", vcd, fst).! == 0).getOrElse(false)) {
+      new java.io.File(vcd).delete()
+      fst
+    } else {
+      vcd
+    }
+  }
+
+  // Printable VCD identifiers: base-94 over '!'..'~'
+  private def identifier(index: Int): String = {
+    val sb = new StringBuilder
+    var n = index
+    do {
+      sb += (33 + n % 94).toChar
+      n = n / 94 - 1
+    } while(n >= 0)
+    sb.toString
+  }
+}
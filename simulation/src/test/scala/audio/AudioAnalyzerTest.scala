@@ -0,0 +1,105 @@
+package audio
+
+import org.scalatest.funsuite.AnyFunSuite
+import SimulationHelpers._
+
+class AudioAnalyzerTest extends AnyFunSuite {
+  val channelCount = 8
+  val sampleWidth = 24
+
+  test("Streaming analysis matches block analysis") {
+    val generator = new AudioDataGenerator(channelCount, sampleWidth, blockFrames = 1000)
+    val analyzer = new AudioAnalyzer(channelCount, sampleWidth)
+
+    val whole = generator.generateSineWave(1000, 48000, 0.5)
+    val streamed = analyzer.analyzeSamples(generator.sineWave(1000, 48000, 0.5))
+    val single = analyzer.analyzeSamples(Iterator(whole))
+
+    assert(whole.frames == 24000)
+    for(channel <- 0 until channelCount) {
+      assert(streamed(channel) == single(channel))
+      assert(Math.abs(streamed(channel).rmsLevel - Math.sqrt(0.5)) < 1e-3)
+      assert(Math.abs(streamed(channel).dcOffset) < 1e-3)
+    }
+  }
+
+  test("Dropouts are detected across block boundaries") {
+    val analyzer = new AudioAnalyzer(channelCount, sampleWidth)
+    val first = FrameBuffer(channelCount, 100, startFrame = 0)
+    val second = FrameBuffer(channelCount, 100, startFrame = 105)
+
+    analyzer.pushAll(Iterator(first, second))
+
+    assert(analyzer.dropoutCount == 1)
+    assert(analyzer.dropouts == Seq(99L))
+  }
+
+  test("Long 8ch/192k capture is analyzed in constant memory") {
+    val generator = new AudioDataGenerator(channelCount, sampleWidth)
+    val analyzer = new AudioAnalyzer(channelCount, sampleWidth)
+
+    // Ten minutes of audio: 115M frames, or 920M samples if boxed one by one
+    val stats = analyzer.analyzeSamples(generator.testPattern("dc", 192000L * 600))
+
+    assert(analyzer.frameCount == 192000L * 600)
+    assert(analyzer.dropoutCount == 0)
+    stats.values.foreach { channel =>
+      assert(Math.abs(channel.dcOffset - 0.25) < 1e-6)
+      assert(Math.abs(channel.peakLevel - 0.25) < 1e-6)
+    }
+  }
+
+  test("THD+N and SNR of a clean and a distorted tone") {
+    val analyzer = new AudioAnalyzer(channelCount, sampleWidth)
+    val fullScale = (1 << (sampleWidth - 1)) - 1
+    val capture = FrameBuffer(channelCount, 131072)
+
+    // Channel 0 clean, channel 1 with a -40 dB second harmonic
+    for(frame <- 0 until capture.frames) {
+      val phase = 2 * Math.PI * 997 * frame / 48000
+      capture(frame, 0) = (0.5 * Math.sin(phase) * fullScale).round.toInt
+      val distorted = 0.5 * Math.sin(phase) + 0.005 * Math.sin(2 * phase)
+      capture(frame, 1) = (distorted * fullScale).round.toInt
+    }
+
+    val stats = analyzer.analyzeTone(capture, 997, 48000)
+
+    assert(Math.abs(stats(0).fundamentalDbfs + 6.02) < 0.1)
+    assert(stats(0).thdnDb < -130, s"24-bit THD+N too high: ${stats(0).thdnDb}")
+    assert(stats(0).snrDb > 130)
+    assert(Math.abs(stats(1).thdDb + 40) < 0.5)
+    assert(Math.abs(stats(1).thdnDb + 40) < 0.5)
+  }
+
+  test("Crosstalk matrix and frequency response") {
+    val generator = new AudioDataGenerator(channelCount, sampleWidth)
+    val analyzer = new AudioAnalyzer(channelCount, sampleWidth)
+    // Bin-centred tones: a whole number of cycles per FFT frame leaves no leakage past the
+    // window's main lobe, so the floor between channels is 24-bit quantization (~-167 dB)
+    val binHz = 48000.0 / 32768
+    val tones = (0 until channelCount).map(i => (683 + 171 * i) * binHz)
+    val stimulus = generator.channelTones(tones, 48000, 1.0)
+
+    // Leak channel 0 into channel 1 at -80 dB
+    val capture = FrameBuffer(channelCount, stimulus.frames)
+    System.arraycopy(stimulus.data, 0, capture.data, 0, stimulus.data.length)
+    for(frame <- 0 until capture.frames) {
+      capture(frame, 1) = capture(frame, 1) + (stimulus(frame, 0) * 1e-4).round.toInt
+    }
+
+    val crosstalk = analyzer.crosstalkMatrix(capture, tones, 48000, fftSize = 32768)
+    assert(Math.abs(crosstalk(0)(1) + 80) < 1.0)
+    for(from <- 0 until channelCount; to <- 0 until channelCount
+        if from != to && !(from == 0 && to == 1)) {
+      assert(crosstalk(from)(to) < -140, s"Crosstalk $from -> $to: ${crosstalk(from)(to)}")
+    }
+
+    // Half-gain path reads -6 dB across the band
+    val sweep = FrameBuffer.collect(channelCount, generator.logSweep(20, 20000, 48000, 2.0))
+    val halved = new FrameBuffer(channelCount, sweep.data.map(_ / 2))
+    val response = analyzer.frequencyResponse(sweep, halved, 48000)
+    response(0).filter(p => p.frequencyHz > 50 && p.frequencyHz < 15000).foreach { point =>
+      assert(Math.abs(point.magnitudeDb + 6.02) < 0.1, s"Response at ${point.frequencyHz} Hz")
+    }
+  }
+}
@@ -3,23 +3,15 @@ package audio
 import spinal.core._
 import spinal.core.sim._
 import spinal.lib._
+import spinal.lib.bus.simple.{PipelinedMemoryBus, PipelinedMemoryBusSlaveFactory}
 import scala.collection.mutable.ArrayBuffer
 import org.scalatest.funsuite.AnyFunSuite
+import SimulationHelpers._
+import AudioRegisters._
 
 class AudioPCIeTest extends AnyFunSuite {
   
-  def testConfig = AudioConfig(
-    channelCount = 8,
-    i2sDataWidth = 24,
-    dsdBitWidth = 1,
-    useMultipleClocks = true,
-    supportDsd = true,
-    bufferSize = 8192,
-    bufferCount = 4,
-    maxBurstSize = 512,
-    fifoDepth = 1024,
-    dmaDescriptorCount = 32
-  )
+  def testConfig = Scenarios.defaultConfig
 
   class TestEnvironment(dut: AudioPCIeTop) {
     val audioData = ArrayBuffer[BigInt]()
@@ -27,30 +19,12 @@ class AudioPCIeTest extends AnyFunSuite {
     var underruns = 0
     var overruns = 0
     
-    // Register access helpers
-    def writeReg(address: BigInt, data: BigInt): Unit = {
-      dut.clockDomain.waitSampling()
-      dut.io.pcie.cfg.write #= true
-      dut.io.pcie.cfg.addr #= address
-      dut.io.pcie.cfg.writeData #= data
-      dut.clockDomain.waitSampling()
-      dut.io.pcie.cfg.write #= false
-    }
-    
-    def readReg(address: BigInt): BigInt = {
-      dut.clockDomain.waitSampling()
-      dut.io.pcie.cfg.read #= true
-      dut.io.pcie.cfg.addr #= address
-      dut.clockDomain.waitSampling()
-      dut.io.pcie.cfg.read #= false
-      dut.io.pcie.cfg.readData.toBigInt
-    }
+    val regs = new RegisterPort(dut)
     
     // PCIe DMA helpers
     def writeDMADescriptor(baseAddr: BigInt, isPlayback: Boolean): Unit = {
-      val descBase = if(isPlayback) 0x100 else 0x200
-      writeReg(descBase, baseAddr)
-      writeReg(descBase + 0x8, 32) // descriptor count
+      regs.write(if(isPlayback) DmaPbDescBase else DmaCapDescBase, baseAddr)
+      regs.write(if(isPlayback) DmaPbDescCount else DmaCapDescCount, 32)
       
       // Initialize descriptors in memory
       for(i <- 0 until 32) {
@@ -74,27 +48,14 @@ class AudioPCIeTest extends AnyFunSuite {
       dut.io.pcie.tx.valid #= false
     }
     
-    // Audio clock generation
-    def generateClocks(): Unit = fork {
-      // 44.1kHz family clock
-      val period44k = (100000000 / 11289600) // Simulate 11.2896MHz MCLK
-      while(true) {
-        dut.io.audio.mclk44k1 #= true
-        sleep(period44k / 2)
-        dut.io.audio.mclk44k1 #= false
-        sleep(period44k / 2)
-      }
-    }
-    
-    fork {
-      // 48kHz family clock
-      val period48k = (100000000 / 12288000) // Simulate 12.288MHz MCLK
-      while(true) {
-        dut.io.audio.mclk48k #= true
-        sleep(period48k / 2)
-        dut.io.audio.mclk48k #= false
-        sleep(period48k / 2)
-      }
+    // Audio clock generation, picosecond-accurate MCLK periods
+    def generateClocks(
+      mclk44k1: ClockProfile = ClockProfile.ideal(11289600),
+      mclk48k: ClockProfile = ClockProfile.ideal(12288000)
+    ): Unit = {
+      val clockGen = new ClockGenerator()
+      clockGen.drive(dut.io.audio.mclk44k1, mclk44k1)
+      clockGen.drive(dut.io.audio.mclk48k, mclk48k)
     }
     
     // Monitoring
@@ -121,10 +82,11 @@ class AudioPCIeTest extends AnyFunSuite {
           dmaTransfers += 1
         }
         // Monitor errors
-        if(readReg(0x30C) != 0) { // pbUnderrun
+        val status = regs.snapshot(StatusPbUnderrun, StatusCapOverrun)
+        if(StatusPbUnderrun.xrun.get(status(StatusPbUnderrun)) != 0) {
           underruns += 1
         }
-        if(readReg(0x310) != 0) { // capOverrun
+        if(StatusCapOverrun.xrun.get(status(StatusCapOverrun)) != 0) {
           overruns += 1
         }
       }
@@ -132,17 +94,14 @@ class AudioPCIeTest extends AnyFunSuite {
   }
   
   test("Basic I2S Playback") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    val scenario = Scenarios.basicPlayback
+    SimCompileCache(scenario.config)(new AudioPCIeTop(scenario.config)).doSim { dut =>
       val env = new TestEnvironment(dut)
+      val driver = new ScenarioDriver(dut, scenario)
       
-      // Initialize clocks
-      dut.clockDomain.forkStimulus(10)
-      env.generateClocks()
-      
-      // Configure for I2S mode
-      env.writeReg(0x000, 0) // I2S mode
-      env.writeReg(0x004, 0) // 44.1kHz family
-      env.writeReg(0x014, 1) // Master mode
+      // Initialize clocks and configure from the shared scenario
+      driver.startClocks()
+      driver.configure()
       
       // Setup DMA
       env.writeDMADescriptor(0x10000000, true)
@@ -152,10 +111,10 @@ class AudioPCIeTest extends AnyFunSuite {
       env.monitorDMA()
       
       // Enable playback
-      env.writeReg(0x018, 1)
+      driver.enable()
       
       // Run simulation
-      dut.clockDomain.waitSampling(10000)
+      driver.run(frames = 64)
       
       // Verify results
       assert(env.dmaTransfers > 0, "No DMA transfers occurred")
@@ -165,16 +124,16 @@ class AudioPCIeTest extends AnyFunSuite {
   }
   
   test("DSD Mode Operation") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
       val env = new TestEnvironment(dut)
       
       dut.clockDomain.forkStimulus(10)
       env.generateClocks()
       
       // Configure for DSD mode
-      env.writeReg(0x000, 1) // DSD mode
-      env.writeReg(0x00C, 0) // DSD64
-      env.writeReg(0x014, 1) // Master mode
+      env.regs.write(CtrlFormat, AudioFormat.DSD_64.position)
+      env.regs.write(CtrlDsdMode, 0)
+      env.regs.write(CtrlMasterMode, 1)
       
       // Setup DMA
       env.writeDMADescriptor(0x20000000, true)
@@ -183,7 +142,7 @@ class AudioPCIeTest extends AnyFunSuite {
       env.monitorDMA()
       
       // Enable playback
-      env.writeReg(0x018, 1)
+      env.regs.write(CtrlPbEnable, 1)
       
       dut.clockDomain.waitSampling(10000)
       
@@ -193,37 +152,34 @@ class AudioPCIeTest extends AnyFunSuite {
   }
   
   test("Clock Domain Switching") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
       val env = new TestEnvironment(dut)
       
       dut.clockDomain.forkStimulus(10)
       env.generateClocks()
       
       // Start with 44.1kHz
-      env.writeReg(0x004, 0)
+      env.regs.write(CtrlSampleFamily, 0)
       dut.clockDomain.waitSampling(1000)
       
       // Switch to 48kHz
-      env.writeReg(0x004, 1)
+      env.regs.write(CtrlSampleFamily, 1)
       dut.clockDomain.waitSampling(1000)
       
       // Verify clock lock
-      val clockLocked = env.readReg(0x300)
+      val clockLocked = env.regs.read(StatusLocked)
       assert(clockLocked == 1, "Clock failed to lock after switching")
     }
   }
   
   test("Full Duplex Operation") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    val scenario = Scenarios.fullDuplex
+    SimCompileCache(scenario.config)(new AudioPCIeTop(scenario.config)).doSim { dut =>
       val env = new TestEnvironment(dut)
+      val driver = new ScenarioDriver(dut, scenario)
       
-      dut.clockDomain.forkStimulus(10)
-      env.generateClocks()
-      
-      // Configure I2S mode
-      env.writeReg(0x000, 0)
-      env.writeReg(0x004, 0)
-      env.writeReg(0x014, 1)
+      driver.startClocks()
+      driver.configure()
       
       // Setup both playback and capture DMA
       env.writeDMADescriptor(0x30000000, true)
@@ -233,10 +189,9 @@ class AudioPCIeTest extends AnyFunSuite {
       env.monitorDMA()
       
       // Enable both directions
-      env.writeReg(0x018, 1)
-      env.writeReg(0x01C, 1)
+      driver.enable()
       
-      dut.clockDomain.waitSampling(20000)
+      driver.run(frames = 128)
       
       assert(env.dmaTransfers > 0, "No full duplex transfers occurred")
       assert(env.underruns == 0, "Playback underrun in full duplex")
@@ -245,53 +200,54 @@ class AudioPCIeTest extends AnyFunSuite {
   }
   
   test("Error Recovery") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
       val env = new TestEnvironment(dut)
       
       dut.clockDomain.forkStimulus(10)
       env.generateClocks()
       
       // Start playback without DMA setup to force underrun
-      env.writeReg(0x000, 0)
-      env.writeReg(0x018, 1)
+      env.regs.write(CtrlFormat, AudioFormat.I2S_STANDARD.position)
+      env.regs.write(CtrlPbEnable, 1)
       
       dut.clockDomain.waitSampling(1000)
       
       // Verify underrun detected
-      val underrun = env.readReg(0x30C)
+      val underrun = env.regs.read(StatusPbUnderrun.xrun)
       assert(underrun == 1, "Underrun not detected")
       
-      // Reset and recover
-      env.writeReg(0x020, 1)
+      // Reset and recover; the underrun stays latched until written back
+      env.regs.write(CtrlReset, 1)
       dut.clockDomain.waitSampling(10)
-      env.writeReg(0x020, 0)
+      env.regs.write(CtrlReset, 0)
+      env.regs.clear(StatusPbUnderrun.xrun)
       
       // Setup proper DMA
       env.writeDMADescriptor(0x50000000, true)
-      env.writeReg(0x018, 1)
+      env.regs.write(CtrlPbEnable, 1)
       
       dut.clockDomain.waitSampling(1000)
       
-      val recoveryStatus = env.readReg(0x30C)
+      val recoveryStatus = env.regs.read(StatusPbUnderrun.xrun)
       assert(recoveryStatus == 0, "Failed to recover from underrun")
     }
   }
   
   test("Performance Metrics") {
-    SimConfig.withWave.compile(new AudioPCIeTop(testConfig)).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
       val env = new TestEnvironment(dut)
       
       dut.clockDomain.forkStimulus(10)
       env.generateClocks()
       
       // Setup high-throughput test
-      env.writeReg(0x000, 0)
-      env.writeReg(0x004, 0)
+      env.regs.write(CtrlFormat, AudioFormat.I2S_STANDARD.position)
+      env.regs.write(CtrlSampleFamily, 0)
       env.writeDMADescriptor(0x60000000, true)
       
       // Enable maximum performance
-      env.writeReg(0x038, 512)  // Large buffer threshold
-      env.writeReg(0x018, 1)    // Enable playback
+      env.regs.write(CtrlPbThreshold, 512)  // Large buffer threshold
+      env.regs.write(CtrlPbEnable, 1)
       
       val startTime = System.nanoTime()
       dut.clockDomain.waitSampling(50000)
@@ -307,4 +263,595 @@ class AudioPCIeTest extends AnyFunSuite {
       assert(env.underruns == 0, "Performance test caused underruns")
     }
   }
-}
\ No newline at end of file
+  
+  // A slip/no-slip stress, not a depth sizing: the drift is exaggerated far past
+  // any real house clock so that a short RTL run moves the FIFOs by several words
+  test("CDC FIFOs do not slip under exaggerated clock drift") {
+    val scenario = Scenarios.fullDuplex
+    SimConfig.withTimePrecision(1 ps).workspaceName("AudioPCIeTop_fifo_levels").compile {
+      val dut = new AudioPCIeTop(scenario.config)
+      FifoLevelMonitor.instrument(dut)
+      WaveCapture.instrument(dut, Seq("clockCrossing"))
+      WaveCapture.instrumentTriggers(dut)
+      dut
+    }.doSim { dut =>
+      val env = new TestEnvironment(dut)
+      val driver = new ScenarioDriver(dut, scenario)
+      val monitor = new FifoLevelMonitor(dut)
+      val runFrames = 4096
+      val runPs = (runFrames * scenario.framePeriodPs).toLong
+      // 100 ppm only drifts 0.4 frames in a run this short. Scale the offset so each half
+      // of the run gains (then, after the step, loses) driftWords FIFO words.
+      val driftWords = 8
+      val ppm = driftWords * 1e6 / (runFrames / 2)
+      def stressClock(hz: Double) = ClockProfile.worstCaseHouseClock(hz, runPs / 2).copy(
+        ppmOffset = ppm,
+        steps = Seq(FrequencyStep(runPs / 2, -2 * ppm))
+      )
+      
+      // A slip leaves the CDC window around it for debugging
+      val capture = new WaveCapture(dut, Seq("clockCrossing"), dut.clockDomain,
+        Seq(WaveCapture.underrun(dut), WaveCapture.overrun(dut)), "cdc_slip")
+      
+      dut.clockDomain.forkStimulus(scenario.pciePeriodPs)
+      env.generateClocks(
+        mclk44k1 = stressClock(11289600),
+        mclk48k = stressClock(12288000)
+      )
+      driver.configure()
+      env.writeDMADescriptor(0x30000000, true)
+      env.writeDMADescriptor(0x40000000, false)
+      monitor.start()
+      driver.enable()
+      
+      sleep(runPs)
+      
+      monitor.writeCsv("fifo_levels_drift_stress.csv")
+      println(s"""CDC FIFO trajectory (${monitor.trajectory.size} samples, ${ppm.round} ppm stress):
+                 |  TX level min/max: ${monitor.txMin}/${monitor.txMax}
+                 |  RX level max: ${monitor.rxMax}
+                 |  Underrun slips: ${monitor.underrunSlips}
+                 |  Overrun slips: ${monitor.overrunSlips}
+                 |""".stripMargin)
+      
+      capture.captures.foreach(c => println(s"CDC ${c.trigger} window: ${c.path}"))
+      assert(monitor.underrunSlips == 0, "Playback slipped under clock drift")
+      assert(monitor.overrunSlips == 0, "Capture slipped under clock drift")
+    }
+  }
+  
+  test("Bus utilization while streaming full duplex") {
+    val scenario = Scenarios.fullDuplex
+    SimConfig.workspaceName("AudioPCIeTop_bus").compile {
+      val dut = new AudioPCIeTop(scenario.config)
+      BusMonitor.instrument(dut)
+      dut
+    }.doSim { dut =>
+      val env = new TestEnvironment(dut)
+      val driver = new ScenarioDriver(dut, scenario)
+      val monitor = BusMonitor(dut, scenario)
+      
+      driver.startClocks()
+      driver.configure()
+      env.writeDMADescriptor(0x30000000, true)
+      env.writeDMADescriptor(0x40000000, false)
+      monitor.start()
+      driver.enable()
+      
+      driver.run(frames = 512)
+      
+      println(monitor.report())
+      monitor.writeCsv("bus_utilization.csv")
+      monitor.writeBurstCsv("bus_bursts.csv")
+      
+      assert(monitor.windows.nonEmpty, "No complete monitor window")
+      for(s <- monitor.summaries) {
+        val counted = s.transfers + s.backPressure + s.idle
+        assert(counted == s.cycles, s"${s.channel} cycles do not add up")
+      }
+      assert(monitor.summary("txFifo.pop").transfers > 0, "Serializer never popped a frame")
+    }
+  }
+  
+  test("End-to-end latency breakdown") {
+    val scenario = Scenarios.fullDuplex
+    SimConfig.workspaceName("AudioPCIeTop_latency").compile {
+      val dut = new AudioPCIeTop(scenario.config)
+      LatencyTracer.instrument(dut)
+      dut
+    }.doSim { dut =>
+      val env = new TestEnvironment(dut)
+      val driver = new ScenarioDriver(dut, scenario)
+      val tracer = new LatencyTracer(dut, scenario)
+      
+      driver.startClocks()
+      driver.configure()
+      env.writeDMADescriptor(0x30000000, true)
+      env.writeDMADescriptor(0x40000000, false)
+      tracer.start()
+      driver.enable()
+      
+      driver.run(frames = 256)
+      
+      println(tracer.report())
+      println(f"Suggested runtime->delay: playback ${tracer.playbackDelayFrames}%.1f frames, " +
+              f"capture ${tracer.captureDelayFrames}%.1f frames")
+      tracer.writeCsv("latency_trace.csv")
+      
+      val playback = tracer.playbackReport
+      assert(playback.last.count > 0, "No playback frames reached the I2S pins")
+      assert(playback.init.forall(_.minPs >= 0), "Negative stage latency")
+      // Every traced frame passes every stage, so the stage means add up to the total
+      val stageSumPs = playback.init.map(_.meanPs).sum
+      assert(Math.abs(stageSumPs - playback.last.meanPs) < 1.0,
+        s"Stage means add up to $stageSumPs ps, total is ${playback.last.meanPs} ps")
+      
+      // No traced frame is slower than the static budget's worst case
+      val budget = scenario.latencyBudget
+      println(budget.report())
+      val violations = tracer.budgetViolations(budget)
+      assert(violations.isEmpty, violations.mkString("\n"))
+    }
+  }
+  
+  test("Soak run resumes from a checkpoint") {
+    val soak = SoakConfig(
+      durationFrames = 6000,
+      checkpointEveryFrames = 2000,
+      minSegmentFrames = 1500,
+      maxSegmentFrames = 3000,
+      settleFrames = 512,
+      directory = "soak_test"
+    )
+    val result = SoakRunner.run(soak)
+    
+    println(
+      s"Soak: ${result.frames} frames, ${result.rateSwitches} switches, ${result.stalls} stalls"
+    )
+    assert(result.frames == soak.durationFrames || result.failure.nonEmpty)
+    assert(result.checkpoints.nonEmpty, "No checkpoint written")
+    
+    // Restores registers and FIFO memories into a fresh, traced simulation
+    SoakRunner.replay(result.checkpoints.head, untilFrame = result.frames)
+  }
+  
+  test("BAR0 reads return a register block in one completion") {
+    SimCompileCache(testConfig)(new AudioPCIeTop(testConfig)).doSim { dut =>
+      val env = new TestEnvironment(dut)
+      
+      dut.clockDomain.forkStimulus(10)
+      env.generateClocks()
+      dut.clockDomain.waitSampling(32)
+      
+      // Both words of a 64-bit register in one request each way
+      val base = BigInt("123456789ABC", 16)
+      env.regs.write(DmaPbDescBase, base)
+      assert(env.regs.read(DmaPbDescBase) == base)
+      assert(env.regs.lastReadCycles == BarDecoder.readLatency(2))
+      
+      // The whole control block, the largest read served
+      env.regs.write(CtrlMclkFreq, 24576000)
+      env.regs.write(CtrlTargetRate, 48000)
+      val control = env.regs.readWords(CtrlFormat.offset, BarDecoder.maxReadDwords)
+      assert(control.size == BarDecoder.maxReadDwords)
+      assert(control(CtrlMclkFreq.offset / 4) == 24576000)
+      assert(control(CtrlTargetRate.offset / 4) == 48000)
+      
+      // Latency depends on the length only, not on what the card is doing
+      env.regs.write(CtrlPbEnable, 1)
+      for(_ <- 0 until 8) {
+        env.regs.snapshot(StatusPbUnderrun, StatusCapOverrun, StatusDmaError)
+        assert(env.regs.lastReadCycles == BarDecoder.readLatency(3))
+        dut.clockDomain.waitSampling(100)
+      }
+    }
+  }
+  
+  test("FIFO watermarks fire once per episode, rate limited") {
+    SimConfig.workspaceName("FifoWatermark").compile(new FifoWatermark(11)).doSim { dut =>
+      dut.clockDomain.forkStimulus(10)
+      dut.io.enable #= true
+      dut.io.level #= 512
+      dut.io.config.low #= 256
+      dut.io.config.high #= 0
+      dut.io.config.hysteresis #= 64
+      dut.io.config.holdoff #= 2
+      
+      var lowEvents = 0
+      var highEvents = 0
+      dut.clockDomain.onSamplings {
+        if(dut.io.low.toBoolean) lowEvents += 1
+        if(dut.io.high.toBoolean) highEvents += 1
+      }
+      def hold(level: Int, cycles: Int): Unit = {
+        dut.io.level #= level
+        dut.clockDomain.waitSampling(cycles)
+      }
+      dut.clockDomain.waitSampling(4)
+      
+      // Dithering around the watermark fires once, the lowest level is kept
+      for(level <- Seq(250, 260, 240, 270, 255)) hold(level, 10)
+      assert(lowEvents == 1)
+      assert(dut.io.lowPeak.toInt == 240)
+      
+      // Back past the hysteresis re-arms, but the holdoff delays the next one
+      hold(400, 10)
+      hold(100, 10)
+      assert(lowEvents == 1)
+      hold(100, 2 * FifoWatermark.holdoffCycles)
+      assert(lowEvents == 2)
+      assert(dut.io.lowPeak.toInt == 100)
+      
+      // A threshold of 0 is off
+      hold(2047, 10)
+      assert(highEvents == 0)
+    }
+  }
+  
+  test("Capture packer writes only the routed channels, frames back to back") {
+    SimConfig.workspaceName("CapturePacker").compile(new CapturePacker(8, 32)).doSim { dut =>
+      dut.clockDomain.forkStimulus(10)
+      dut.io.enable #= false
+      dut.io.frames.valid #= false
+      dut.io.beats.ready #= true
+      
+      val beats = ArrayBuffer[BigInt]()
+      dut.clockDomain.onSamplings {
+        if(dut.io.beats.valid.toBoolean) beats += dut.io.beats.payload.toBigInt
+      }
+      // Sample c of frame f is 0xFFcf0000, so its top 16 bits name it
+      def send(frames: Int): Unit = for(f <- 0 until frames) {
+        dut.io.frames.valid #= true
+        for(c <- 0 until 8) dut.io.frames.payload(c) #= (BigInt(0xFF00 | c << 4 | f) << 16)
+        dut.clockDomain.waitSamplingWhere(dut.io.frames.ready.toBoolean)
+        dut.io.frames.valid #= false
+        dut.clockDomain.waitSampling(2)
+      }
+      // Little-endian 16-bit words of the beats, as the host sees them
+      def words(bits: Int): Seq[BigInt] = beats.toSeq.flatMap { beat =>
+        (0 until 128 / bits).map(i => (beat >> (bits * i)) & ((BigInt(1) << bits) - 1))
+      }
+      
+      // Channels 1 and 6 as S16: eight frames per beat
+      dut.io.route.mask #= 0x42
+      dut.io.route.format #= CapturePacker.S16
+      dut.io.enable #= true
+      send(8)
+      dut.clockDomain.waitSampling(4)
+      assert(words(16) == (0 until 8).flatMap(f => Seq(0xFF10 | f, 0xFF60 | f).map(BigInt(_))))
+      
+      // Three channels as S32 straddle beats; disabling drops the partial one
+      beats.clear()
+      dut.io.enable #= false
+      dut.clockDomain.waitSampling()
+      dut.io.route.mask #= 0x0D
+      dut.io.route.format #= CapturePacker.S32
+      dut.io.enable #= true
+      send(5)
+      dut.clockDomain.waitSampling(4)
+      val expected = for(f <- 0 until 5; c <- Seq(0, 2, 3)) yield BigInt(0xFF00 | c << 4 | f) << 16
+      assert(words(32) == expected.take(12))
+      
+      // A disabled packer takes frames and writes nothing
+      beats.clear()
+      dut.io.enable #= false
+      send(4)
+      assert(beats.isEmpty)
+    }
+  }
+  
+  test("Biquad bank matches its reference bit for bit, banks swap between frames") {
+    SimConfig.workspaceName("BiquadBank").compile(
+      new BiquadBank(8, 32, ClockDomain.current)
+    ).doSim { dut =>
+      dut.clockDomain.forkStimulus(10)
+      dut.io.config.enable #= false
+      dut.io.config.bank #= false
+      dut.io.coef.valid #= false
+      dut.io.input.valid #= false
+      dut.io.output.ready #= true
+      
+      val outputs = ArrayBuffer[Seq[BigInt]]()
+      dut.clockDomain.onSamplings {
+        if(dut.io.output.valid.toBoolean && dut.io.output.ready.toBoolean) {
+          outputs += dut.io.output.payload.map(s => BigInt(s.toBigInt.toInt))
+        }
+      }
+      def send(frame: Seq[BigInt]): Unit = {
+        dut.io.input.valid #= true
+        for((s, c) <- frame.zipWithIndex) dut.io.input.payload(c) #= s & 0xFFFFFFFFL
+        dut.clockDomain.waitSamplingWhere(dut.io.input.ready.toBoolean)
+        dut.io.input.valid #= false
+      }
+      def load(bank: Boolean, coefs: Seq[Seq[Seq[BigInt]]]): Unit = {
+        for(c <- 0 until 8; s <- 0 until 8; i <- 0 until 5) {
+          dut.io.coef.valid #= true
+          dut.io.coef.payload.bank #= bank
+          dut.io.coef.payload.address.channel #= c
+          dut.io.coef.payload.address.section #= s
+          dut.io.coef.payload.address.index #= i
+          dut.io.coef.payload.value #= coefs(c)(s)(i) & 0xFFFFFFFFL
+          dut.clockDomain.waitSampling()
+        }
+        dut.io.coef.valid #= false
+      }
+      
+      // Stable sections with some gain, so loud input saturates
+      val random = new scala.util.Random(98)
+      def filters(): Seq[Seq[Seq[BigInt]]] = Seq.fill(8, 8) {
+        val r = 0.5 + 0.45 * random.nextDouble()
+        val theta = Math.PI * random.nextDouble()
+        Seq(1.5, random.nextDouble() - 0.5, 0.25, -2 * r * Math.cos(theta), r * r)
+          .map(BiquadBank.quantize)
+      }
+      def frames(n: Int): Seq[Seq[BigInt]] = Seq.fill(n, 8) {
+        val loud = if(random.nextBoolean()) Int.MaxValue else Int.MinValue
+        BigInt(if(random.nextInt(4) == 0) loud else random.nextInt())
+      }
+      val sections = Seq(2, 1, 0, 8, 3, 0, 5, 1)
+      for((n, c) <- sections.zipWithIndex) dut.io.config.sections(c) #= n
+      
+      // Bank 1 loaded while the bank is off, then run on it
+      val first = filters()
+      load(bank = true, first)
+      dut.io.config.bank #= true
+      dut.io.config.enable #= true
+      val reference = new BiquadBank.Reference(first, sections)
+      val input = frames(200)
+      input.foreach(send)
+      dut.clockDomain.waitSampling(100)
+      assert(dut.io.bank.toBoolean)
+      assert(outputs == input.map(reference(_)), "Filtered output differs from the reference")
+      
+      // Bank 0 written under the running filters, switched to between frames
+      outputs.clear()
+      val second = filters()
+      load(bank = false, second)
+      dut.io.config.bank #= false
+      reference.coefs = second
+      val more = frames(50)
+      more.foreach(send)
+      dut.clockDomain.waitSampling(100)
+      assert(!dut.io.bank.toBoolean)
+      assert(outputs == more.map(reference(_)), "Bank switch not glitch-free")
+      
+      // Disabled: frames pass through untouched
+      outputs.clear()
+      dut.io.config.enable #= false
+      val bypassed = frames(4)
+      bypassed.foreach(send)
+      dut.clockDomain.waitSampling(4)
+      assert(outputs == bypassed)
+    }
+  }
+  
+  test("FIR engine matches its reference bit for bit, lanes chain into one delay line") {
+    SimConfig.workspaceName("FirEngine").compile(
+      new FirEngine(4, 24, 4, 64, ClockDomain.current)
+    ).doSim { dut =>
+      dut.clockDomain.forkStimulus(10)
+      dut.io.config.enable #= false
+      dut.io.config.channels #= 3
+      dut.io.config.taps #= 32
+      dut.io.coef.valid #= false
+      dut.io.input.valid #= false
+      dut.io.output.ready #= true
+      
+      def signed(value: BigInt): BigInt = if(value.testBit(23)) value - (BigInt(1) << 24) else value
+      val outputs = ArrayBuffer[Seq[BigInt]]()
+      dut.clockDomain.onSamplings {
+        if(dut.io.output.valid.toBoolean && dut.io.output.ready.toBoolean) {
+          outputs += dut.io.output.payload.map(s => signed(s.toBigInt))
+        }
+      }
+      def send(frame: Seq[BigInt]): Unit = {
+        dut.io.input.valid #= true
+        for((s, c) <- frame.zipWithIndex) dut.io.input.payload(c) #= s & 0xFFFFFF
+        dut.clockDomain.waitSamplingWhere(dut.io.input.ready.toBoolean)
+        dut.io.input.valid #= false
+      }
+      def load(coefs: Seq[Seq[BigInt]]): Unit = {
+        for((word, i) <- FirEngine.layout(coefs, 4).zipWithIndex) {
+          dut.io.coef.valid #= true
+          dut.io.coef.payload.index #= i
+          dut.io.coef.payload.value #= word & 0xFFFFFFFFL
+          dut.clockDomain.waitSampling()
+        }
+        dut.io.coef.valid #= false
+      }
+      
+      // A loud first tap and a long tail, so loud input saturates and every
+      // lane's segment contributes
+      val random = new scala.util.Random(99)
+      def filters(taps: Int): Seq[Seq[BigInt]] = Seq.fill(3) {
+        (0.9 +: Seq.fill(taps - 1)(0.6 * random.nextDouble() - 0.3)).map(FirEngine.quantize)
+      }
+      def frames(n: Int): Seq[Seq[BigInt]] = Seq.fill(n, 4) {
+        val loud = if(random.nextBoolean()) 0x7FFFFF else -0x800000
+        BigInt(if(random.nextInt(4) == 0) loud else random.nextInt(1 << 24) - (1 << 23))
+      }
+      
+      // 32 taps, 8 per lane; channel 3 passes through
+      val long = filters(32)
+      load(long)
+      dut.io.config.enable #= true
+      var reference = new FirEngine.Reference(long, 24)
+      val input = frames(120)
+      input.foreach(send)
+      dut.clockDomain.waitSampling(100)
+      assert(outputs == input.map(reference(_)), "Filtered output differs from the reference")
+      
+      // Reloaded with 16 taps while off: the engine restarts from silence
+      outputs.clear()
+      dut.io.config.enable #= false
+      val short = filters(16)
+      load(short)
+      dut.io.config.taps #= 16
+      dut.clockDomain.waitSampling(4)
+      dut.io.config.enable #= true
+      reference = new FirEngine.Reference(short, 24)
+      val more = frames(60)
+      more.foreach(send)
+      dut.clockDomain.waitSampling(100)
+      assert(outputs == more.map(reference(_)), "History not cleared on a new tap count")
+      
+      // Taps x channels past the BRAM: frames pass through untouched
+      outputs.clear()
+      dut.io.config.taps #= 128
+      dut.clockDomain.waitSampling(4)
+      val bypassed = frames(4)
+      bypassed.foreach(send)
+      dut.clockDomain.waitSampling(4)
+      assert(outputs == bypassed)
+    }
+  }
+  
+  test("Spectrum analyzer matches its reference bit for bit, averaging whole blocks") {
+    SimConfig.workspaceName("SpectrumAnalyzer").compile(
+      new SpectrumAnalyzer(24, 512)
+    ).doSim { dut =>
+      import SpectrumAnalyzer._
+      dut.clockDomain.forkStimulus(10)
+      dut.io.config.enable #= false
+      dut.io.config.output #= false
+      dut.io.config.channel #= 0
+      dut.io.config.size #= 8
+      dut.io.config.window #= HANN
+      dut.io.config.average #= 0
+      dut.io.sample.valid #= false
+      dut.io.bins.ready #= true
+      
+      // The output held back now and then
+      val random = new scala.util.Random(100)
+      val spectra = ArrayBuffer[Seq[Int]]()
+      val bins = ArrayBuffer[Int]()
+      dut.clockDomain.onSamplings {
+        if(dut.io.bins.valid.toBoolean && dut.io.bins.ready.toBoolean) {
+          bins += dut.io.bins.payload.fragment.toLong.toInt
+          if(dut.io.bins.payload.last.toBoolean) {
+            spectra += bins.toList
+            bins.clear()
+          }
+        }
+        dut.io.bins.ready #= random.nextInt(4) != 0
+      }
+      // One sample every 40 cycles, more than a 512-point transform needs
+      def send(samples: Seq[BigInt]): Unit = for(s <- samples) {
+        dut.io.sample.valid #= true
+        dut.io.sample.payload #= s & 0xFFFFFF
+        dut.clockDomain.waitSampling()
+        dut.io.sample.valid #= false
+        dut.clockDomain.waitSampling(39)
+      }
+      def configure(size: Int, window: Int, average: Int): Unit = {
+        spectra.clear()
+        dut.io.config.size #= size
+        dut.io.config.window #= window
+        dut.io.config.average #= average
+        dut.clockDomain.waitSampling(4)
+      }
+      // A tone, `cycles` periods per 512 samples, over noise
+      def signal(n: Int, cycles: Double, amplitude: Double, noise: Double): Seq[BigInt] =
+        (0 until n).map { i =>
+          val x = amplitude * Math.sin(2 * Math.PI * cycles * i / 512) +
+            noise * (random.nextDouble() - 0.5)
+          BigInt(Math.round(x * (1 << 23)))
+        }
+      val reference = new SpectrumAnalyzer.Reference(24, 512)
+      
+      // 256 points, one block a spectrum: consecutive blocks, none skipped
+      dut.io.config.enable #= true
+      dut.clockDomain.waitSampling(4)
+      val hann = signal(3 * 256, 20.6, 0.7, 0.2)
+      send(hann)
+      dut.clockDomain.waitSampling(256 * 40)
+      assert(
+        spectra == hann.grouped(256).map(b => reference(Seq(b), 8, HANN, 0)).toSeq,
+        "Spectra differ from the reference"
+      )
+      
+      // 512 points, four blocks a spectrum, averaged from the change on
+      configure(9, BLACKMAN_HARRIS, 2)
+      val averaged = signal(8 * 512, 40.3, 0.5, 0.4)
+      send(averaged)
+      dut.clockDomain.waitSampling(512 * 40)
+      assert(
+        spectra == averaged.grouped(2048)
+          .map(b => reference(b.grouped(512).toSeq, 9, BLACKMAN_HARRIS, 2)).toSeq,
+        "Averaged spectra differ from the reference"
+      )
+      
+      // Past maxSize clamps to it; a tone on bin 16 reads (A / 2)^2
+      configure(12, RECTANGULAR, 0)
+      val tone = signal(512, 16, 0.7, 0)
+      send(tone)
+      dut.clockDomain.waitSampling(512 * 40)
+      assert(spectra == Seq(reference(Seq(tone), 9, RECTANGULAR, 0)))
+      val peak = java.lang.Float.intBitsToFloat(spectra.head(16))
+      assert(Math.abs(peak / 0.1225 - 1) < 0.01, s"Tone reads $peak")
+      
+      // Disabled: no more spectra
+      spectra.clear()
+      dut.io.config.enable #= false
+      send(signal(600, 16, 0.7, 0))
+      dut.clockDomain.waitSampling(512 * 40)
+      assert(spectra.isEmpty)
+    }
+  }
+  
+  // StatusPbUnderrun alone on a bus, its events driven by the bench
+  class LatchBench extends Component {
+    val io = new Bundle {
+      val bus = slave(PipelinedMemoryBus(12, 32))
+      val events = in Bits(4 bits)
+      val flags = out Bits(4 bits)
+    }
+    val map = new RegisterMap(PipelinedMemoryBusSlaveFactory(io.bus))
+    io.flags := Vec(map.latch(StatusPbUnderrun, io.events.asBools: _*)).asBits
+  }
+  
+  test("W1C latches keep an event raised in the cycle that clears it") {
+    SimConfig.workspaceName("RegisterLatch").compile(new LatchBench).doSim { dut =>
+      dut.clockDomain.forkStimulus(10)
+      dut.io.bus.cmd.valid #= false
+      dut.io.events #= 0
+      dut.clockDomain.waitSampling()
+      
+      // One cycle of events, with a write of clear to the register or not
+      def cycle(events: Int, clear: Option[Int]): Int = {
+        dut.io.events #= events
+        dut.io.bus.cmd.valid #= clear.isDefined
+        dut.io.bus.cmd.write #= true
+        dut.io.bus.cmd.address #= StatusPbUnderrun.offset
+        dut.io.bus.cmd.data #= clear.getOrElse(0)
+        dut.io.bus.cmd.mask #= 0xF
+        dut.clockDomain.waitSampling()
+        dut.io.events #= 0
+        dut.io.bus.cmd.valid #= false
+        sleep(1)
+        dut.io.flags.toInt
+      }
+      
+      assert(cycle(0x3, None) == 0x3)
+      assert(cycle(0x2, Some(0x3)) == 0x2, "Period raised with its clear was dropped")
+      assert(cycle(0x0, Some(0x2)) == 0x0)
+      assert(cycle(0x4, Some(0x1)) == 0x4, "Clearing one bit touched another")
+      assert(cycle(0x0, None) == 0x4, "Latch did not hold")
+    }
+  }
+  
+  test("Register map words and fields do not overlap") {
+    val words = AudioRegisters.all.flatMap(r => (0 until r.words).map(r.offset + 4 * _))
+    assert(words.distinct.size == words.size, "Two registers share a word")
+    assert(AudioRegisters.all.forall(_.offset % 4 == 0), "Unaligned register")
+    
+    for(register <- AudioRegisters.all; Seq(a, b) <- register.fields.combinations(2)) {
+      assert((a.mask & b.mask) == 0, s"${register.name}: ${a.name} overlaps ${b.name}")
+    }
+    
+    // Field accessors round trip and leave the other fields alone
+    val period = StatusPbUnderrun.period
+    assert(period.get(period.prep(1) | StatusPbUnderrun.xrun.prep(1)) == 1)
+    assert(period.prep(3) == 2, "Value wider than its field")
+  }
+}
@@ -0,0 +1,67 @@
+package audio
+
+import org.scalatest.funsuite.AnyFunSuite
+
+class FaultInjectionTest extends AnyFunSuite {
+  // Short completion timeout so a dropped completion resolves within the run
+  val base = Scenarios.fullDuplex.copy(durationFrames = 48000, completionTimeoutUs = 100)
+
+  test("Every fault kind is recovered from in the TLM") {
+    val faults = Seq(
+      Fault.CompletionDelay(extraNs = 20000, count = 4),
+      Fault.CompletionDrop(),
+      Fault.PoisonedTlp(),
+      Fault.DescriptorCorruption(),
+      Fault.DescriptorCorruption(capture = true),
+      Fault.MclkLoss(durationUs = 500),
+      Fault.Unlock(durationUs = 100),
+      Fault.BackPressure(durationUs = 200)
+    )
+    for(fault <- faults) {
+      val result = TransactionModel.run(base.atFrame(9600)(fault))
+      val record = result.faults.head
+      println(record)
+      assert(record.recoveryPs.nonEmpty, s"${fault.name} never recovered")
+    }
+
+    // Condition trigger: a stall when the playback pipeline is at its lowest
+    val result = TransactionModel.run(
+      base.when("playback level low")(p => p.frame > 4800 && p.pbLevel < 1200)(
+        Fault.BackPressure(durationUs = 200)
+      )
+    )
+    assert(result.faults.size == 1)
+  }
+
+  test("A playback DMA error no longer stops capture") {
+    def run(recovery: RecoveryPolicy): FaultRecord = {
+      val scenario = base.copy(recovery = recovery).atFrame(9600)(Fault.PoisonedTlp())
+      TransactionModel.run(scenario).faults.head
+    }
+
+    val both = run(RecoveryPolicy.ResetBoth)
+    val direction = run(RecoveryPolicy.RestartDirection)
+    val retry = run(RecoveryPolicy.RetryInHardware(retries = 1))
+    println(s"""Poisoned completion:
+               |  Reset both:        $both
+               |  Restart direction: $direction
+               |  Retry in hardware: $retry
+               |""".stripMargin)
+
+    assert(both.capFramesLost > 0)
+    assert(direction.capFramesLost == 0, "Capture lost frames to a playback error")
+    assert(direction.pbFramesLost <= both.pbFramesLost)
+    assert(retry.pbFramesLost == 0, "A retried burst still lost frames")
+  }
+
+  test("DMAEngine RTL restarts playback after a poisoned completion") {
+    val scenario = Scenarios.basicPlayback
+      .copy(durationFrames = 4096)
+      .atFrame(1024)(Fault.PoisonedTlp())
+    val result = DmaEngineRun(scenario)
+    val record = result.faults.head
+    println(s"RTL: $record")
+
+    assert(record.recoveryPs.nonEmpty, "Playback never recovered from the DMA error")
+  }
+}
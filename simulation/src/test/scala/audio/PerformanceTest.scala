@@ -7,53 +7,35 @@ import spinal.core._
 import spinal.lib._
 
 class HardwareSpec extends AnyFlatSpec with Matchers {
+  val testConfig = AudioConfig(
+    channelCount = 8,
+    i2sDataWidth = 24,
+    dsdBitWidth = 1,
+    useMultipleClocks = true,
+    supportDsd = true,
+    bufferSize = 8192,
+    bufferCount = 4,
+    maxBurstSize = 512,
+    fifoDepth = 1024,
+    dmaDescriptorCount = 32
+  )
+
+  val pcieConfig = PCIeConfig(
+    maxReadRequestSize = 512,
+    maxPayloadSize = 256,
+    completionTimeout = 0xA,
+    relaxedOrdering = true,
+    extendedTags = true,
+    maxTags = 32
+  )
   
   "AudioPCIeTop" should "compile without errors" in {
-    val compiled = SimConfig
-      .withWave
-      .compile {
-        val dut = new AudioPCIeTop(
-          AudioConfig(
-            channelCount = 8,
-            i2sDataWidth = 24,
-            dsdBitWidth = 1,
-            useMultipleClocks = true,
-            supportDsd = true,
-            bufferSize = 8192,
-            bufferCount = 4,
-            maxBurstSize = 512,
-            fifoDepth = 1024,
-            dmaDescriptorCount = 32
-          )
-        )
-        dut
-      }
+    val compiled = SimCompileCache(testConfig)(new AudioPCIeTop(testConfig))
     compiled should not be null
   }
   
   "DMAEngine" should "handle transfers correctly" in {
-    SimConfig.withWave.compile(new DMAEngine(
-      AudioConfig(
-        channelCount = 8,
-        i2sDataWidth = 24,
-        dsdBitWidth = 1,
-        useMultipleClocks = true,
-        supportDsd = true,
-        bufferSize = 8192,
-        bufferCount = 4,
-        maxBurstSize = 512,
-        fifoDepth = 1024,
-        dmaDescriptorCount = 32
-      ),
-      PCIeConfig(
-        maxReadRequestSize = 512,
-        maxPayloadSize = 256,
-        completionTimeout = 0xA,
-        relaxedOrdering = true,
-        extendedTags = true,
-        maxTags = 32
-      )
-    )).doSim { dut =>
+    SimCompileCache(testConfig, pcieConfig)(new DMAEngine(testConfig, pcieConfig)).doSim { dut =>
       // DMA transfer test scenario
       dut.clockDomain.forkStimulus(10)
       
@@ -88,20 +70,7 @@ class HardwareSpec extends AnyFlatSpec with Matchers {
   }
   
   "AudioProcessor" should "generate correct I2S timing" in {
-    SimConfig.withWave.compile(new AudioProcessor(
-      AudioConfig(
-        channelCount = 8,
-        i2sDataWidth = 24,
-        dsdBitWidth = 1,
-        useMultipleClocks = true,
-        supportDsd = true,
-        bufferSize = 8192,
-        bufferCount = 4,
-        maxBurstSize = 512,
-        fifoDepth = 1024,
-        dmaDescriptorCount = 32
-      )
-    )).doSim { dut =>
+    SimCompileCache(testConfig)(new AudioProcessor(testConfig, ClockDomain.current)).doSim { dut =>
       dut.clockDomain.forkStimulus(10)
       
       // Configure for I2S mode
@@ -0,0 +1,124 @@
+package audio
+
+import org.scalatest.funsuite.AnyFunSuite
+
+class TransactionModelTest extends AnyFunSuite {
+  val scenario = Scenarios.basicPlayback.copy(durationFrames = 512)
+
+  test("TLM matches DMAEngine RTL on a short playback run") {
+    val rtl = DmaEngineRun(scenario)
+    val tlm = TransactionModel.run(scenario)
+
+    println(s"""Cross-check ${scenario.name}:
+               |  RTL bursts: ${rtl.bursts}  TLM bursts: ${tlm.pbBursts}
+               |  RTL frames: ${rtl.framesPopped}  TLM frames: ${tlm.framesPlayed}
+               |  RTL first frame: ${rtl.firstPopPs} ps  TLM first frame: ${tlm.firstOutputPs} ps
+               |""".stripMargin)
+
+    assert(Math.abs(rtl.bursts - tlm.pbBursts) <= 1, "Burst count diverges from RTL")
+    assert(Math.abs(rtl.framesPopped - tlm.framesPlayed) <= 1, "Played frames diverge from RTL")
+    assert(
+      Math.abs(rtl.firstPopPs - tlm.firstOutputPs) < scenario.framePeriodPs,
+      "First output frame diverges from RTL by more than one frame"
+    )
+
+    // Every read request is a full maxBurstSize burst
+    val reads = rtl.busSummary("axi.ar").get
+    println(f"RTL read bursts: ${reads.burstSizes}, mean ${reads.meanBurst}%.1f beats, " +
+      f"R channel ${rtl.busSummary("axi.r").get.utilization * 100}%.2f%% busy")
+    assert(reads.burstSizes.keySet == Set(scenario.config.maxBurstSize / 16))
+    assert(reads.transfers == rtl.bursts)
+
+    // Throughput relative to RTL, per simulated frame
+    val rtlNsPerFrame = rtl.wallTimeNs.toDouble / scenario.durationFrames
+    val hour = TransactionModel.run(Scenarios.desktopHour)
+    val tlmNsPerFrame = hour.wallTimeNs.toDouble / Scenarios.desktopHour.durationFrames
+    println(f"TLM speedup over RTL: ${rtlNsPerFrame / tlmNsPerFrame}%.0fx")
+    assert(rtlNsPerFrame / tlmNsPerFrame >= 1000, "TLM is less than 1000x faster than RTL")
+  }
+
+  test("Static latency budget matches the TLM FIFO levels") {
+    for(base <- Seq(Scenarios.fullDuplex, Scenarios.highRateDuplex)) {
+      val run = base.copy(durationFrames = 48000)
+      val result = TransactionModel.run(run, traceEveryFrames = 7)
+      val budget = run.latencyBudget
+      println(budget.report())
+
+      // Steady state: past the initial fill, both directions streaming
+      val steady = result.levelTrace.drop(result.levelTrace.size / 4)
+      def mean(level: TransactionModel.LevelSample => Int) =
+        steady.map(level).sum.toDouble / steady.size
+      def typical(capture: Boolean, stages: String*) =
+        budget.frames(stages.map(budget.stage(capture, _).typicalPs).sum)
+      def worst(capture: Boolean, stages: String*) =
+        budget.frames(stages.map(budget.stage(capture, _).worstPs).sum)
+
+      val tolerance = LatencyBudget.burstFrames(run.config) / 2.0 + 1
+      val pbTypical = typical(capture = false, "pbFifo", "txFifo")
+      val capTypical = typical(capture = true, "rxFifo", "capFifo")
+      println(f"${run.name}: playback level ${mean(_.playbackLevel)}%.1f, budget $pbTypical%.1f; " +
+        f"capture level ${mean(_.captureLevel)}%.1f, budget $capTypical%.1f")
+
+      assert(Math.abs(mean(_.playbackLevel) - pbTypical) <= tolerance)
+      assert(Math.abs(mean(_.captureLevel) - capTypical) <= tolerance)
+      assert(result.pbLevelMax <= worst(capture = false, "pbFifo", "txFifo"))
+      assert(result.capLevelMax <= worst(capture = true, "rxFifo", "capFifo"))
+    }
+  }
+
+  test("Just-in-time prefetch keeps playback just above its margin") {
+    val base = Scenarios.highRateDuplex.copy(durationFrames = 192000, completionJitterNs = 200)
+    val guard = LatencyBudget.burstFrames(base.config)
+    // Mean and lowest playback level in the steady state, past the initial
+    // fill and the drain down to the target
+    def run(scenario: Scenario) = {
+      val result = TransactionModel.run(scenario, traceEveryFrames = 7)
+      val steady = result.levelTrace.drop(result.levelTrace.size / 2).map(_.playbackLevel)
+      (result, steady.sum.toDouble / steady.size, steady.min)
+    }
+
+    val (full, fullLevel, _) = run(base)
+    val (jit, jitLevel, jitMin) = run(base.copy(prefetchGuardFrames = Some(guard)))
+    // A loaded root complex: 100 us completions drain ~19 frames per burst,
+    // the measured latency raises the target so the guard still holds
+    val (slow, slowLevel, slowMin) =
+      run(base.copy(prefetchGuardFrames = Some(guard), completionLatencyNs = 100000))
+
+    println(f"Playback level: refill when a burst fits $fullLevel%.1f, " +
+      f"just in time $jitLevel%.1f (min $jitMin), " +
+      f"with 100 us completions $slowLevel%.1f (min $slowMin) frames")
+
+    assert(jit.pbUnderruns == 0 && slow.pbUnderruns == 0)
+    assert(jitLevel < fullLevel / 8, "Prefetch did not cut the playback queue")
+    assert(jitLevel < 3 * guard)
+    assert(jitMin >= guard - 2 && slowMin >= guard - 2, "Guard not held")
+    assert(jit.framesPlayed == full.framesPlayed)
+  }
+
+  test("Hour-long session with desktop host jitter") {
+    val result = TransactionModel.run(Scenarios.desktopHour, traceEveryFrames = 48000)
+
+    println(s"""${result.scenario}:
+               |  Frames played: ${result.framesPlayed}
+               |  Host xruns: ${result.hostXruns}
+               |  FIFO underruns: ${result.pbUnderruns}
+               |  Capture overruns: ${result.capOverruns}
+               |  Playback level min/max: ${result.pbLevelMin}/${result.pbLevelMax}
+               |""".stripMargin)
+
+    assert(result.framesPlayed >= Scenarios.desktopHour.durationFrames - 2)
+    assert(result.levelTrace.size == 3600)
+  }
+
+  test("Benchmark matrix runs scenarios in parallel and keeps their order") {
+    val base = scenario.copy(durationFrames = 4800, capture = true)
+    val points = BenchmarkMatrix.scenarios(BenchmarkMatrix.quick, base)
+    val outcomes = BenchmarkMatrix.run(points, rtl = false, parallelism = 4)
+
+    assert(outcomes.map(_.job.name) == points.map(_.name))
+    assert(outcomes.forall(_.result.isSuccess), "A matrix point failed")
+    for(outcome <- outcomes) {
+      assert(outcome.result.get.tlm.framesPlayed >= base.durationFrames - 2)
+    }
+  }
+}